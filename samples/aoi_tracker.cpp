@@ -0,0 +1,235 @@
+#include "aoi_tracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+struct area_t
+{
+    float bounds[ 4 ]; // Left, top, right and bottom
+    int first_vertex; // Into aoi_tracker_t::vertices, or -1 for a rectangle
+    int vertex_count;
+};
+
+// Counters are written by the pushing thread only, and read by any thread
+struct area_counters_t
+{
+    std::atomic<int64_t> dwell_us;
+    std::atomic<int64_t> entries;
+    std::atomic<int64_t> first_entry_timestamp_us;
+};
+
+struct aoi_tracker_t
+{
+    std::vector<area_t> areas;
+    std::vector<float> vertices;
+
+    // The grid index, in compressed rows: the areas overlapping cell i are cell_areas[ cell_offsets[ i ] ] up to
+    // cell_areas[ cell_offsets[ i + 1 ] ]
+    int grid_size;
+    std::vector<int> cell_offsets;
+    std::vector<int> cell_areas;
+
+    int64_t max_gap_us;
+    std::vector<area_counters_t> counters;
+
+    // Pushing thread state. An area was hit by the previous valid sample if its hit generation is one less than the
+    // current generation.
+    std::vector<uint32_t> hit_generations;
+    uint32_t generation;
+    bool has_previous;
+    int64_t previous_us;
+    std::vector<int> previous_hits;
+    std::vector<int> hits;
+};
+
+static int grid_cell( float coordinate, int grid_size )
+{
+    int cell = (int)( coordinate * grid_size );
+    return std::min( std::max( cell, 0 ), grid_size - 1 );
+}
+
+static bool inside_polygon( float const* vertices, int count, float x, float y )
+{
+    // Count the polygon edges crossed by a ray from the point towards positive x
+    bool inside = false;
+    for( int i = 0, j = count - 1; i < count; j = i++ )
+    {
+        float xi = vertices[ i * 2 ], yi = vertices[ i * 2 + 1 ];
+        float xj = vertices[ j * 2 ], yj = vertices[ j * 2 + 1 ];
+        if( ( yi > y ) != ( yj > y ) && x < xi + ( y - yi ) * ( xj - xi ) / ( yj - yi ) ) inside = !inside;
+    }
+    return inside;
+}
+
+aoi_tracker_t* aoi_tracker_create( aoi_t const* aois, int count, int grid_size, int64_t max_gap_us )
+{
+    if( count < 0 || grid_size <= 0 ) return nullptr;
+    for( int i = 0; i < count; ++i )
+        if( aois[ i ].vertices_xy && aois[ i ].vertex_count < 3 ) return nullptr;
+
+    auto tracker = new aoi_tracker_t();
+    tracker->areas.resize( count );
+    for( int i = 0; i < count; ++i )
+    {
+        area_t& area = tracker->areas[ i ];
+        if( !aois[ i ].vertices_xy )
+        {
+            area.first_vertex = -1;
+            area.vertex_count = 0;
+            for( int j = 0; j < 4; ++j ) area.bounds[ j ] = aois[ i ].rectangle[ j ];
+            continue;
+        }
+
+        area.first_vertex = (int) tracker->vertices.size() / 2;
+        area.vertex_count = aois[ i ].vertex_count;
+        tracker->vertices.insert( tracker->vertices.end(), aois[ i ].vertices_xy,
+            aois[ i ].vertices_xy + aois[ i ].vertex_count * 2 );
+        area.bounds[ 0 ] = area.bounds[ 2 ] = aois[ i ].vertices_xy[ 0 ];
+        area.bounds[ 1 ] = area.bounds[ 3 ] = aois[ i ].vertices_xy[ 1 ];
+        for( int j = 1; j < area.vertex_count; ++j )
+        {
+            area.bounds[ 0 ] = std::min( area.bounds[ 0 ], aois[ i ].vertices_xy[ j * 2 ] );
+            area.bounds[ 1 ] = std::min( area.bounds[ 1 ], aois[ i ].vertices_xy[ j * 2 + 1 ] );
+            area.bounds[ 2 ] = std::max( area.bounds[ 2 ], aois[ i ].vertices_xy[ j * 2 ] );
+            area.bounds[ 3 ] = std::max( area.bounds[ 3 ], aois[ i ].vertices_xy[ j * 2 + 1 ] );
+        }
+    }
+
+    // Count the areas per cell first, so the index is two flat arrays rather than a vector per cell. Areas reaching
+    // past the display are listed in the edge cells, which is where points off the display are looked up.
+    tracker->grid_size = grid_size;
+    tracker->cell_offsets.assign( grid_size * grid_size + 1, 0 );
+    for( int pass = 0; pass < 2; ++pass )
+    {
+        std::vector<int> fill( tracker->cell_offsets.begin(), tracker->cell_offsets.end() - 1 );
+        for( int i = 0; i < count; ++i )
+        {
+            area_t const& area = tracker->areas[ i ];
+            if( !( area.bounds[ 0 ] <= area.bounds[ 2 ] ) || !( area.bounds[ 1 ] <= area.bounds[ 3 ] ) ) continue;
+            for( int y = grid_cell( area.bounds[ 1 ], grid_size ); y <= grid_cell( area.bounds[ 3 ], grid_size ); ++y )
+            {
+                for( int x = grid_cell( area.bounds[ 0 ], grid_size ); x <= grid_cell( area.bounds[ 2 ], grid_size );
+                    ++x )
+                {
+                    if( pass == 0 )
+                        ++tracker->cell_offsets[ y * grid_size + x + 1 ];
+                    else
+                        tracker->cell_areas[ fill[ y * grid_size + x ]++ ] = i;
+                }
+            }
+        }
+        if( pass == 0 )
+        {
+            for( int cell = 0; cell < grid_size * grid_size; ++cell )
+                tracker->cell_offsets[ cell + 1 ] += tracker->cell_offsets[ cell ];
+            tracker->cell_areas.resize( tracker->cell_offsets.back() );
+        }
+    }
+
+    tracker->max_gap_us = max_gap_us;
+    tracker->counters = std::vector<area_counters_t>( count );
+    for( auto& counters : tracker->counters )
+    {
+        counters.dwell_us = 0;
+        counters.entries = 0;
+        counters.first_entry_timestamp_us = -1;
+    }
+    tracker->hit_generations.assign( count, 0 );
+    tracker->generation = 2; // So no area starts out hit by a previous sample
+    tracker->has_previous = false;
+    tracker->previous_us = 0;
+    return tracker;
+}
+
+void aoi_tracker_destroy( aoi_tracker_t* tracker )
+{
+    delete tracker;
+}
+
+int aoi_tracker_hit_test( aoi_tracker_t const* tracker, float x, float y, int* indices, int capacity )
+{
+    if( !( x == x ) || !( y == y ) ) return 0; // NaN
+
+    int cell = grid_cell( y, tracker->grid_size ) * tracker->grid_size + grid_cell( x, tracker->grid_size );
+    int hits = 0;
+    for( int i = tracker->cell_offsets[ cell ]; i < tracker->cell_offsets[ cell + 1 ]; ++i )
+    {
+        int index = tracker->cell_areas[ i ];
+        area_t const& area = tracker->areas[ index ];
+        if( x < area.bounds[ 0 ] || x > area.bounds[ 2 ] || y < area.bounds[ 1 ] || y > area.bounds[ 3 ] ) continue;
+        if( area.first_vertex >= 0 &&
+            !inside_polygon( &tracker->vertices[ area.first_vertex * 2 ], area.vertex_count, x, y ) )
+            continue;
+        if( hits < capacity ) indices[ hits ] = index;
+        ++hits;
+    }
+    return hits;
+}
+
+static void add( std::atomic<int64_t>& counter, int64_t value )
+{
+    // Only the pushing thread writes, so this needs no read-modify-write
+    counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+}
+
+void aoi_tracker_push( aoi_tracker_t* tracker, int64_t timestamp_us, tobii_validity_t validity, float x, float y )
+{
+    // Invalid samples are skipped, so a blink shorter than the maximum gap continues the visit
+    if( validity != TOBII_VALIDITY_VALID ) return;
+
+    if( tracker->has_previous && timestamp_us - tracker->previous_us <= tracker->max_gap_us )
+    {
+        for( int index : tracker->previous_hits )
+            add( tracker->counters[ index ].dwell_us, timestamp_us - tracker->previous_us );
+    }
+    else
+    {
+        // Too long without valid data; whatever is hit now is a new visit
+        ++tracker->generation;
+    }
+
+    tracker->hits.resize( std::max<size_t>( tracker->hits.capacity(), 16 ) );
+    int count = aoi_tracker_hit_test( tracker, x, y, tracker->hits.data(), (int) tracker->hits.size() );
+    if( count > (int) tracker->hits.size() )
+    {
+        tracker->hits.resize( count );
+        aoi_tracker_hit_test( tracker, x, y, tracker->hits.data(), count );
+    }
+    tracker->hits.resize( count );
+
+    for( int index : tracker->hits )
+    {
+        if( tracker->hit_generations[ index ] != tracker->generation - 1 )
+        {
+            area_counters_t& counters = tracker->counters[ index ];
+            if( counters.entries.load( std::memory_order_relaxed ) == 0 )
+                counters.first_entry_timestamp_us.store( timestamp_us, std::memory_order_relaxed );
+            add( counters.entries, 1 );
+        }
+        tracker->hit_generations[ index ] = tracker->generation;
+    }
+    ++tracker->generation;
+
+    tracker->has_previous = true;
+    tracker->previous_us = timestamp_us;
+    std::swap( tracker->previous_hits, tracker->hits );
+}
+
+void aoi_tracker_gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    aoi_tracker_push( static_cast<aoi_tracker_t*>( user_data ), gaze_point->timestamp_us, gaze_point->validity,
+        gaze_point->position_xy[ 0 ], gaze_point->position_xy[ 1 ] );
+}
+
+tobii_error_t aoi_tracker_statistics( aoi_tracker_t const* tracker, int index, aoi_statistics_t* statistics )
+{
+    if( index < 0 || index >= (int) tracker->counters.size() ) return TOBII_ERROR_INVALID_PARAMETER;
+
+    area_counters_t const& counters = tracker->counters[ index ];
+    statistics->dwell_us = counters.dwell_us.load( std::memory_order_relaxed );
+    statistics->entries = counters.entries.load( std::memory_order_relaxed );
+    statistics->revisits = statistics->entries > 0 ? statistics->entries - 1 : 0;
+    statistics->first_entry_timestamp_us = counters.first_entry_timestamp_us.load( std::memory_order_relaxed );
+    return TOBII_ERROR_NO_ERROR;
+}
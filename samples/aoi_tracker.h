@@ -0,0 +1,56 @@
+#ifndef sample_aoi_tracker_h
+#define sample_aoi_tracker_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include <stdint.h>
+
+// Tracks how gaze visits a fixed set of areas of interest on the display. Each valid gaze point is hit tested against
+// the areas through a uniform grid, built once when the tracker is created, that lists the areas whose bounding box
+// overlaps each cell, so a lookup only looks at the few areas near the gaze point even when there are thousands.
+// Rectangles are hit by their bounds, polygons by counting edge crossings.
+//
+// Dwell time, entries and revisits are kept up to date on every sample rather than computed afterwards: the time since
+// the previous valid sample is credited to the areas that sample hit, and an area hit by a sample that was not hit by
+// the previous valid one has been entered. Short gaps in valid data, such as blinks, do not end a visit.
+
+typedef struct aoi_tracker_t aoi_tracker_t;
+
+typedef struct aoi_t
+{
+    // Polygon corners, as *vertex_count* x, y pairs in normalized display coordinates. NULL for a rectangle.
+    float const* vertices_xy;
+    int vertex_count;
+    float rectangle[ 4 ]; // Left, top, right and bottom edges, used when vertices_xy is NULL
+} aoi_t;
+
+typedef struct aoi_statistics_t
+{
+    int64_t dwell_us; // Total time gaze has been in the area
+    int64_t entries; // Number of visits
+    int64_t revisits; // Visits after the first one
+    int64_t first_entry_timestamp_us; // -1 until the area is first entered
+} aoi_statistics_t;
+
+// Copies *aois*, so the caller's arrays may be released. *grid_size* is the number of index cells along each side of
+// the display. A gap of more than *max_gap_us* between valid samples ends all visits, and is not counted as dwell.
+aoi_tracker_t* aoi_tracker_create( aoi_t const* aois, int count, int grid_size, int64_t max_gap_us );
+
+void aoi_tracker_destroy( aoi_tracker_t* tracker );
+
+// Writes the indices of up to *capacity* areas containing *x*, *y* to *indices*, and returns the number of areas hit,
+// which may be more than *capacity*.
+int aoi_tracker_hit_test( aoi_tracker_t const* tracker, float x, float y, int* indices, int capacity );
+
+// Must be called from one thread at a time, with increasing timestamps.
+void aoi_tracker_push( aoi_tracker_t* tracker, int64_t timestamp_us, tobii_validity_t validity, float x, float y );
+
+// Pushes gaze points; can be used as a tobii_gaze_point_callback_t.
+void aoi_tracker_gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data );
+
+// Safe to call from any thread while samples are pushed. The counters of an area are read one at a time, so they may
+// be from either side of a concurrent push.
+tobii_error_t aoi_tracker_statistics( aoi_tracker_t const* tracker, int index, aoi_statistics_t* statistics );
+
+#endif // sample_aoi_tracker_h
@@ -0,0 +1,465 @@
+#include "batch_processor.h"
+#include "gaze_archive.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+uint32_t const wearable_recording_magic = 0x44415754; // "TWAD"
+uint32_t const wearable_recording_version = 1;
+
+// Precedes the raw records of a wearable recording
+struct wearable_recording_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+struct recording_t
+{
+    ~recording_t() { if( archive ) gaze_archive_reader_close( archive ); }
+
+    std::vector<uint8_t> bytes;
+    gaze_archive_reader_t* archive = nullptr; // NULL for wearable recordings
+    int64_t sample_count = 0;
+};
+
+// A file to open, or a chunk of an open file to process
+struct work_t
+{
+    int file_index;
+    int chunk_index; // -1 to open the file
+    std::shared_ptr<recording_t const> recording;
+};
+
+struct work_queue_t
+{
+    std::mutex mutex;
+    std::deque<work_t> work; // The owner takes from the back, other threads steal from the front
+};
+
+struct file_slot_t
+{
+    bool opened = false;
+    std::vector<batch_task_t> tasks;
+    std::vector<void*> states;
+    std::vector<char> done;
+};
+
+struct batch_run_t
+{
+    batch_pipeline_t pipeline;
+    std::vector<std::string> paths;
+    int64_t chunk_samples;
+    int64_t warmup_samples;
+
+    std::vector<std::unique_ptr<work_queue_t>> queues;
+    std::atomic<int64_t> pending; // Work queued or in progress; pushed before the work that pushes it completes
+    std::atomic<int64_t> stolen_tasks;
+    std::atomic<int64_t> samples;
+    std::atomic<int> failed_files;
+
+    // Chunks are merged in order as soon as all chunks before them are merged
+    std::mutex merge_mutex;
+    std::vector<file_slot_t> files;
+    size_t merge_file;
+    size_t merge_chunk;
+};
+
+}
+
+
+static bool read_file( char const* path, std::vector<uint8_t>* bytes )
+{
+    FILE* file = fopen( path, "rb" );
+    if( !file ) return false;
+
+    // The size is only a hint, the file is read until a short read, which is either the end of the file or an error.
+    // One byte extra lets a file of the expected size end within the first read.
+    std::error_code error;
+    uintmax_t size_hint = std::filesystem::file_size( path, error );
+    size_t capacity = error ? 65536 : (size_t) size_hint + 1;
+    size_t length = 0;
+    for( ;; )
+    {
+        bytes->resize( capacity );
+        length += fread( bytes->data() + length, 1, capacity - length, file );
+        if( length < capacity ) break;
+        capacity *= 2;
+    }
+    bool ok = ferror( file ) == 0;
+    fclose( file );
+    bytes->resize( length );
+    return ok;
+}
+
+static std::shared_ptr<recording_t> load_recording( char const* path )
+{
+    auto recording = std::make_shared<recording_t>();
+    if( !read_file( path, &recording->bytes ) ) return nullptr;
+
+    wearable_recording_header_t header;
+    if( recording->bytes.size() >= sizeof( header ) )
+    {
+        memcpy( &header, recording->bytes.data(), sizeof( header ) );
+        if( header.magic == wearable_recording_magic )
+        {
+            size_t payload = recording->bytes.size() - sizeof( header );
+            if( header.version != wearable_recording_version ||
+                header.record_size != sizeof( tobii_wearable_advanced_data_t ) ||
+                payload % sizeof( tobii_wearable_advanced_data_t ) != 0 ) return nullptr;
+            recording->sample_count = (int64_t)( payload / sizeof( tobii_wearable_advanced_data_t ) );
+            return recording;
+        }
+    }
+
+    if( gaze_archive_reader_open( recording->bytes.data(), recording->bytes.size(), &recording->archive ) !=
+        TOBII_ERROR_NO_ERROR ) return nullptr;
+    recording->sample_count = gaze_archive_reader_sample_count( recording->archive );
+    return recording;
+}
+
+
+static void merge_completed( batch_run_t* run )
+{
+    std::lock_guard<std::mutex> lock( run->merge_mutex );
+    while( run->merge_file < run->files.size() )
+    {
+        file_slot_t& file = run->files[ run->merge_file ];
+        if( !file.opened ) break;
+        if( run->merge_chunk == file.tasks.size() )
+        {
+            ++run->merge_file;
+            run->merge_chunk = 0;
+            continue;
+        }
+        if( !file.done[ run->merge_chunk ] ) break;
+        run->pipeline.merge( &file.tasks[ run->merge_chunk ], file.states[ run->merge_chunk ],
+            run->pipeline.context );
+        file.states[ run->merge_chunk ] = nullptr;
+        ++run->merge_chunk;
+    }
+}
+
+static void push_work( batch_run_t* run, int queue, work_t work )
+{
+    ++run->pending;
+    std::lock_guard<std::mutex> lock( run->queues[ queue ]->mutex );
+    run->queues[ queue ]->work.push_back( std::move( work ) );
+}
+
+static bool take_work( batch_run_t* run, int queue, work_t* work )
+{
+    {
+        work_queue_t& own = *run->queues[ queue ];
+        std::lock_guard<std::mutex> lock( own.mutex );
+        if( !own.work.empty() )
+        {
+            *work = std::move( own.work.back() );
+            own.work.pop_back();
+            return true;
+        }
+    }
+
+    int count = (int) run->queues.size();
+    for( int i = 1; i < count; ++i )
+    {
+        work_queue_t& victim = *run->queues[ ( queue + i ) % count ];
+        std::lock_guard<std::mutex> lock( victim.mutex );
+        if( !victim.work.empty() )
+        {
+            *work = std::move( victim.work.front() );
+            victim.work.pop_front();
+            ++run->stolen_tasks;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void open_file( batch_run_t* run, int queue, int file_index )
+{
+    char const* path = run->paths[ file_index ].c_str();
+    std::shared_ptr<recording_t const> recording = load_recording( path );
+    if( !recording ) ++run->failed_files;
+
+    int64_t sample_count = recording ? recording->sample_count : 0;
+    int chunk_count = (int)( ( sample_count + run->chunk_samples - 1 ) / run->chunk_samples );
+    {
+        std::lock_guard<std::mutex> lock( run->merge_mutex );
+        file_slot_t& file = run->files[ file_index ];
+        file.tasks.resize( chunk_count );
+        file.states.assign( chunk_count, nullptr );
+        file.done.assign( chunk_count, 0 );
+        for( int chunk = 0; chunk < chunk_count; ++chunk )
+        {
+            batch_task_t& task = file.tasks[ chunk ];
+            task.path = path;
+            task.file_index = file_index;
+            task.chunk_index = chunk;
+            task.first_sample = chunk * run->chunk_samples;
+            task.sample_count = std::min( run->chunk_samples, sample_count - task.first_sample );
+            task.first_timestamp_us = 0;
+        }
+        file.opened = true;
+    }
+
+    // Pushed last chunk first, so this thread works through the file from the start while others steal from its end
+    for( int chunk = chunk_count - 1; chunk >= 0; --chunk )
+        push_work( run, queue, work_t{ file_index, chunk, recording } );
+
+    // An unreadable or empty file may have been all that held up merging
+    if( chunk_count == 0 ) merge_completed( run );
+}
+
+static void gaze_point_from_gaze_data( tobii_gaze_data_t const* gaze_data, tobii_gaze_point_t* gaze_point )
+{
+    tobii_gaze_data_eye_t const& left = gaze_data->left;
+    tobii_gaze_data_eye_t const& right = gaze_data->right;
+    bool left_valid = left.gaze_point_validity == TOBII_VALIDITY_VALID;
+    bool right_valid = right.gaze_point_validity == TOBII_VALIDITY_VALID;
+
+    gaze_point->timestamp_us = gaze_data->timestamp_system_us;
+    gaze_point->validity = left_valid || right_valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+    for( int i = 0; i < 2; ++i )
+    {
+        if( left_valid && right_valid )
+            gaze_point->position_xy[ i ] =
+                ( left.gaze_point_on_display_normalized[ i ] + right.gaze_point_on_display_normalized[ i ] ) * 0.5f;
+        else if( left_valid )
+            gaze_point->position_xy[ i ] = left.gaze_point_on_display_normalized[ i ];
+        else if( right_valid )
+            gaze_point->position_xy[ i ] = right.gaze_point_on_display_normalized[ i ];
+        else
+            gaze_point->position_xy[ i ] = 0.0f;
+    }
+}
+
+static void consumer_eye_from_advanced_eye( tobii_wearable_advanced_eye_t const* advanced,
+    tobii_wearable_consumer_eye_t* consumer )
+{
+    consumer->pupil_position_in_sensor_area_validity = advanced->pupil_position_in_sensor_area_validity;
+    memcpy( consumer->pupil_position_in_sensor_area_xy, advanced->pupil_position_in_sensor_area_xy,
+        sizeof( consumer->pupil_position_in_sensor_area_xy ) );
+    consumer->position_guide_validity = advanced->position_guide_validity;
+    memcpy( consumer->position_guide_xy, advanced->position_guide_xy, sizeof( consumer->position_guide_xy ) );
+    consumer->blink_validity = advanced->blink_validity;
+    consumer->blink = advanced->blink;
+}
+
+static void consumer_data_from_advanced_data( tobii_wearable_advanced_data_t const* advanced,
+    tobii_wearable_consumer_data_t* consumer )
+{
+    consumer->timestamp_us = advanced->timestamp_system_us;
+    consumer_eye_from_advanced_eye( &advanced->left, &consumer->left );
+    consumer_eye_from_advanced_eye( &advanced->right, &consumer->right );
+    consumer->gaze_origin_combined_validity = advanced->gaze_origin_combined_validity;
+    memcpy( consumer->gaze_origin_combined_mm_xyz, advanced->gaze_origin_combined_mm_xyz,
+        sizeof( consumer->gaze_origin_combined_mm_xyz ) );
+    consumer->gaze_direction_combined_validity = advanced->gaze_direction_combined_validity;
+    memcpy( consumer->gaze_direction_combined_normalized_xyz, advanced->gaze_direction_combined_normalized_xyz,
+        sizeof( consumer->gaze_direction_combined_normalized_xyz ) );
+    consumer->convergence_distance_validity = advanced->convergence_distance_validity;
+    consumer->convergence_distance_mm = advanced->convergence_distance_mm;
+    consumer->improve_user_position_hmd = advanced->improve_user_position_hmd;
+    consumer->increase_eye_relief = advanced->increase_eye_relief;
+}
+
+// Per thread decode buffers, reused across chunks
+struct chunk_buffers_t
+{
+    std::vector<tobii_gaze_data_t> gaze_data;
+    std::vector<tobii_wearable_advanced_data_t> wearable;
+};
+
+static void process_chunk( batch_run_t* run, work_t const& work, chunk_buffers_t* buffers )
+{
+    recording_t const& recording = *work.recording;
+    batch_pipeline_t const& pipeline = run->pipeline;
+    batch_task_t* task;
+    {
+        // The vector is not resized after the file is opened, so the task stays put without the lock
+        std::lock_guard<std::mutex> lock( run->merge_mutex );
+        task = &run->files[ work.file_index ].tasks[ work.chunk_index ];
+    }
+
+    int64_t first = std::max<int64_t>( task->first_sample - run->warmup_samples, 0 );
+    int64_t warmup = task->first_sample - first;
+    int64_t count = warmup + task->sample_count;
+    void* state;
+
+    if( recording.archive )
+    {
+        buffers->gaze_data.resize( (size_t) count );
+        count = gaze_archive_reader_decode( recording.archive, first, count, buffers->gaze_data.data(), 1 );
+        task->first_timestamp_us = buffers->gaze_data[ warmup ].timestamp_system_us;
+        state = pipeline.create ? pipeline.create( task, pipeline.context ) : nullptr;
+        for( int64_t i = 0; i < count; ++i )
+        {
+            tobii_gaze_data_t const* gaze_data = &buffers->gaze_data[ i ];
+            if( pipeline.gaze_point )
+            {
+                tobii_gaze_point_t gaze_point;
+                gaze_point_from_gaze_data( gaze_data, &gaze_point );
+                pipeline.gaze_point( &gaze_point, state );
+            }
+            if( pipeline.gaze_data ) pipeline.gaze_data( gaze_data, state );
+        }
+    }
+    else
+    {
+        // Copied out, as the records in the file need not be aligned
+        buffers->wearable.resize( (size_t) count );
+        memcpy( buffers->wearable.data(), recording.bytes.data() + sizeof( wearable_recording_header_t ) +
+            first * sizeof( tobii_wearable_advanced_data_t ), (size_t) count * sizeof( tobii_wearable_advanced_data_t ) );
+        task->first_timestamp_us = buffers->wearable[ warmup ].timestamp_system_us;
+        state = pipeline.create ? pipeline.create( task, pipeline.context ) : nullptr;
+        for( int64_t i = 0; i < count; ++i )
+        {
+            tobii_wearable_advanced_data_t const* data = &buffers->wearable[ i ];
+            if( pipeline.wearable_advanced_data ) pipeline.wearable_advanced_data( data, state );
+            if( pipeline.wearable_consumer_data )
+            {
+                tobii_wearable_consumer_data_t consumer;
+                consumer_data_from_advanced_data( data, &consumer );
+                pipeline.wearable_consumer_data( &consumer, state );
+            }
+        }
+    }
+    if( pipeline.finish ) pipeline.finish( task, state, pipeline.context );
+    run->samples += task->sample_count;
+
+    {
+        std::lock_guard<std::mutex> lock( run->merge_mutex );
+        file_slot_t& file = run->files[ work.file_index ];
+        file.states[ work.chunk_index ] = state;
+        file.done[ work.chunk_index ] = 1;
+    }
+    merge_completed( run );
+}
+
+static void worker( batch_run_t* run, int queue )
+{
+    chunk_buffers_t buffers;
+    int idle = 0;
+    while( run->pending > 0 )
+    {
+        work_t work;
+        if( !take_work( run, queue, &work ) )
+        {
+            // Others are still busy, and may yet push the chunks of the files they are opening. Back off after a
+            // while, so idle threads at the end of a run do not take cycles from the ones finishing the last chunks.
+            if( ++idle < 64 )
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+            continue;
+        }
+        idle = 0;
+        if( work.chunk_index < 0 )
+            open_file( run, queue, work.file_index );
+        else
+            process_chunk( run, work, &buffers );
+        --run->pending;
+    }
+}
+
+
+tobii_error_t batch_process_files( char const* const* paths, int count, batch_pipeline_t const* pipeline, int threads,
+    int64_t chunk_samples, int64_t warmup_samples, batch_statistics_t* statistics )
+{
+    if( ( !paths && count > 0 ) || count < 0 || !pipeline || !pipeline->merge || threads < 0 ||
+        chunk_samples <= 0 || warmup_samples < 0 ) return TOBII_ERROR_INVALID_PARAMETER;
+
+    if( threads == 0 ) threads = (int) std::max( std::thread::hardware_concurrency(), 1u );
+
+    batch_run_t run;
+    run.pipeline = *pipeline;
+    run.paths.assign( paths, paths + count );
+    std::sort( run.paths.begin(), run.paths.end() );
+    run.chunk_samples = chunk_samples;
+    run.warmup_samples = warmup_samples;
+    for( int i = 0; i < threads; ++i ) run.queues.emplace_back( new work_queue_t );
+    run.pending = 0;
+    run.stolen_tasks = 0;
+    run.samples = 0;
+    run.failed_files = 0;
+    run.files.resize( run.paths.size() );
+    run.merge_file = 0;
+    run.merge_chunk = 0;
+
+    // Files are dealt out round robin, each queue taking its lowest file first
+    for( int file = count - 1; file >= 0; --file )
+        push_work( &run, file % threads, work_t{ file, -1, nullptr } );
+
+    std::vector<std::thread> workers;
+    for( int i = 1; i < threads; ++i ) workers.emplace_back( worker, &run, i );
+    worker( &run, 0 );
+    for( auto& thread : workers ) thread.join();
+
+    if( statistics )
+    {
+        statistics->files = count;
+        statistics->failed_files = run.failed_files;
+        statistics->tasks = 0;
+        for( auto const& file : run.files ) statistics->tasks += (int64_t) file.tasks.size();
+        statistics->stolen_tasks = run.stolen_tasks;
+        statistics->samples = run.samples;
+    }
+    return TOBII_ERROR_NO_ERROR;
+}
+
+tobii_error_t batch_process_directory( char const* directory, batch_pipeline_t const* pipeline, int threads,
+    int64_t chunk_samples, int64_t warmup_samples, batch_statistics_t* statistics )
+{
+    if( !directory ) return TOBII_ERROR_INVALID_PARAMETER;
+
+    std::error_code error;
+    std::filesystem::directory_iterator entries( directory, error );
+    if( error ) return TOBII_ERROR_NOT_AVAILABLE;
+
+    std::vector<std::string> paths;
+    for( ; entries != std::filesystem::directory_iterator(); entries.increment( error ) )
+    {
+        if( error ) return TOBII_ERROR_NOT_AVAILABLE;
+        std::string extension = entries->path().extension().string();
+        if( entries->is_regular_file( error ) && ( extension == ".tgza" || extension == ".twad" ) )
+            paths.push_back( entries->path().string() );
+    }
+
+    std::vector<char const*> path_pointers;
+    for( auto const& path : paths ) path_pointers.push_back( path.c_str() );
+    return batch_process_files( path_pointers.data(), (int) path_pointers.size(), pipeline, threads, chunk_samples,
+        warmup_samples, statistics );
+}
+
+tobii_error_t batch_write_wearable_recording( char const* path, tobii_wearable_advanced_data_t const* data,
+    int64_t count )
+{
+    if( !path || ( !data && count > 0 ) || count < 0 ) return TOBII_ERROR_INVALID_PARAMETER;
+
+    FILE* file = fopen( path, "wb" );
+    if( !file ) return TOBII_ERROR_NOT_AVAILABLE;
+    wearable_recording_header_t header = { wearable_recording_magic, wearable_recording_version,
+        (uint32_t) sizeof( tobii_wearable_advanced_data_t ), 0 };
+    bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1 &&
+        fwrite( data, sizeof( tobii_wearable_advanced_data_t ), (size_t) count, file ) == (size_t) count;
+    ok = fclose( file ) == 0 && ok;
+    return ok ? TOBII_ERROR_NO_ERROR : TOBII_ERROR_INTERNAL;
+}
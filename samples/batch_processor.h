@@ -0,0 +1,78 @@
+#ifndef sample_batch_processor_h
+#define sample_batch_processor_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+// Replays recorded sessions through the same callbacks used live, as fast as the CPU allows. Two kinds of recordings
+// are read:
+//
+//   - gaze archives (*.tgza, see gaze_archive.h), replayed as tobii_gaze_data_t, and as tobii_gaze_point_t derived
+//     from the mean of the valid eyes, timestamped with the system timestamp like the live gaze point stream
+//   - wearable recordings (*.twad, see batch_write_wearable_recording), replayed as tobii_wearable_advanced_data_t, and
+//     as the tobii_wearable_consumer_data_t subset of it, timestamped with the system timestamp
+//
+// Each file is split into chunks of samples, and files and chunks are processed by a work stealing thread pool. Every
+// chunk gets its own pipeline state from the create function, so the callbacks never share state between threads. To
+// let stateful stages such as filters settle, each chunk is preceded by warm-up samples from the end of the previous
+// chunk; callbacks should ignore samples before the first_timestamp_us of their task. When a chunk is done, its state
+// is handed to the merge function. Merging happens in file and chunk order, whatever order the chunks finished in, so
+// results depend on the chunk size but are identical for any number of threads.
+
+typedef struct batch_task_t
+{
+    char const* path;
+    int file_index; // Files are processed in sorted path order
+    int chunk_index;
+    int64_t first_sample; // First sample owned by this task, warm-up samples come before it
+    int64_t sample_count; // Owned samples
+    int64_t first_timestamp_us; // System timestamp of the first owned sample
+} batch_task_t;
+
+typedef struct batch_pipeline_t
+{
+    // Creates the pipeline state for one task, which is passed as user_data to the callbacks below.
+    void* ( *create )( batch_task_t const* task, void* context );
+
+    // Any of these may be NULL.
+    tobii_gaze_point_callback_t gaze_point;
+    tobii_gaze_data_callback_t gaze_data;
+    tobii_wearable_advanced_data_callback_t wearable_advanced_data;
+    tobii_wearable_consumer_data_callback_t wearable_consumer_data;
+
+    // Called on the worker thread after the last sample of the task, so stateful stages can flush in parallel. May be
+    // NULL.
+    void ( *finish )( batch_task_t const* task, void* state, void* context );
+
+    // Folds the state of a finished task into the overall result, and destroys it. Called for one task at a time.
+    void ( *merge )( batch_task_t const* task, void* state, void* context );
+
+    void* context;
+} batch_pipeline_t;
+
+typedef struct batch_statistics_t
+{
+    int files;
+    int failed_files; // Could not be read, or are not valid recordings, and were skipped
+    int64_t tasks;
+    int64_t stolen_tasks; // Tasks taken from the queue of another thread
+    int64_t samples; // Owned samples, not counting warm-up
+} batch_statistics_t;
+
+// Processes every recording in *directory*, not descending into subdirectories. A *threads* of 0 uses one thread per
+// core. *chunk_samples* is the number of samples per task, and *warmup_samples* how many samples of the previous chunk
+// are replayed before each chunk. Returns TOBII_ERROR_NOT_AVAILABLE if the directory can not be read.
+tobii_error_t batch_process_directory( char const* directory, batch_pipeline_t const* pipeline, int threads,
+    int64_t chunk_samples, int64_t warmup_samples, batch_statistics_t* statistics );
+
+// As batch_process_directory, for a list of files.
+tobii_error_t batch_process_files( char const* const* paths, int count, batch_pipeline_t const* pipeline, int threads,
+    int64_t chunk_samples, int64_t warmup_samples, batch_statistics_t* statistics );
+
+// Writes a wearable recording, which a wearable advanced data callback can produce by collecting its samples.
+tobii_error_t batch_write_wearable_recording( char const* path, tobii_wearable_advanced_data_t const* data,
+    int64_t count );
+
+#endif // sample_batch_processor_h
@@ -0,0 +1,282 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+#include "batch_processor.h"
+#include "gaze_archive.h"
+#include "pupillometry.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Totals over all recordings; merged in a fixed order, so even the floating point sums come out the same every run
+struct analysis_totals_t
+{
+    int64_t samples;
+    int64_t fixations;
+    int64_t blinks;
+    int64_t pupil_samples;
+    int64_t interpolated_pupil_samples;
+    double pupil_diameter_sum_mm;
+};
+
+// The pipeline for one chunk: fixations from gaze points, filtered pupil diameters from gaze data or wearable data,
+// and blinks
+struct analysis_t
+{
+    int64_t first_timestamp_us;
+    pupillometry_t* pupillometry;
+    bool previous_valid;
+    float previous_xy[ 2 ];
+    int64_t previous_timestamp_us;
+    bool fixating;
+    bool blinking;
+    analysis_totals_t totals;
+};
+
+static void drain_pupillometry( analysis_t* analysis )
+{
+    pupillometry_batch_t batch;
+    pupillometry_batch( analysis->pupillometry, &batch );
+    for( int i = 0; i < batch.count; ++i )
+    {
+        // Warm-up samples only prime the filter and baseline, the previous chunk reports them
+        if( batch.timestamp_us[ i ] < analysis->first_timestamp_us ) continue;
+        if( batch.left_sample[ i ] == PUPILLOMETRY_SAMPLE_MISSING ) continue;
+        ++analysis->totals.pupil_samples;
+        if( batch.left_sample[ i ] == PUPILLOMETRY_SAMPLE_INTERPOLATED ) ++analysis->totals.interpolated_pupil_samples;
+        analysis->totals.pupil_diameter_sum_mm += batch.left_mm[ i ];
+    }
+    pupillometry_consume( analysis->pupillometry, batch.count );
+}
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    // Velocity threshold fixation detection, in display widths per second
+    auto analysis = static_cast<analysis_t*>( user_data );
+    bool valid = gaze_point->validity == TOBII_VALIDITY_VALID;
+    if( valid && analysis->previous_valid )
+    {
+        float dx = gaze_point->position_xy[ 0 ] - analysis->previous_xy[ 0 ];
+        float dy = gaze_point->position_xy[ 1 ] - analysis->previous_xy[ 1 ];
+        float dt_s = (float)( gaze_point->timestamp_us - analysis->previous_timestamp_us ) * 1e-6f;
+        bool fixating = dt_s > 0.0f && sqrtf( dx * dx + dy * dy ) < 0.5f * dt_s;
+        if( fixating && !analysis->fixating && gaze_point->timestamp_us >= analysis->first_timestamp_us )
+            ++analysis->totals.fixations;
+        analysis->fixating = fixating;
+    }
+    else if( !valid )
+        analysis->fixating = false;
+
+    analysis->previous_valid = valid;
+    analysis->previous_xy[ 0 ] = gaze_point->position_xy[ 0 ];
+    analysis->previous_xy[ 1 ] = gaze_point->position_xy[ 1 ];
+    analysis->previous_timestamp_us = gaze_point->timestamp_us;
+}
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    auto analysis = static_cast<analysis_t*>( user_data );
+    if( gaze_data->timestamp_system_us >= analysis->first_timestamp_us ) ++analysis->totals.samples;
+    pupillometry_push_gaze_data( analysis->pupillometry, gaze_data );
+    drain_pupillometry( analysis );
+}
+
+static void wearable_advanced_data_callback( tobii_wearable_advanced_data_t const* data, void* user_data )
+{
+    auto analysis = static_cast<analysis_t*>( user_data );
+    if( data->timestamp_system_us >= analysis->first_timestamp_us ) ++analysis->totals.samples;
+    pupillometry_push_wearable_advanced_data( analysis->pupillometry, data );
+    drain_pupillometry( analysis );
+}
+
+static void wearable_consumer_data_callback( tobii_wearable_consumer_data_t const* data, void* user_data )
+{
+    auto analysis = static_cast<analysis_t*>( user_data );
+    bool blinking = data->left.blink_validity == TOBII_VALIDITY_VALID && data->left.blink == TOBII_STATE_BOOL_TRUE;
+    if( blinking && !analysis->blinking && data->timestamp_us >= analysis->first_timestamp_us )
+        ++analysis->totals.blinks;
+    analysis->blinking = blinking;
+}
+
+static void* create_analysis( batch_task_t const* task, void* context )
+{
+    // Gaze archives hold screen based gaze data, wearable recordings come from a headset
+    (void) context; // Unused parameter
+    bool wearable = strstr( task->path, ".twad" ) != NULL;
+    pupillometry_config_t config;
+    pupillometry_default_config( wearable ? 120.0f : 1200.0f, &config );
+
+    analysis_t* analysis = new analysis_t();
+    analysis->first_timestamp_us = task->first_timestamp_us;
+    analysis->pupillometry = pupillometry_create( &config );
+    return analysis;
+}
+
+static void finish_analysis( batch_task_t const* task, void* state, void* context )
+{
+    (void) task; (void) context; // Unused parameters
+    auto analysis = static_cast<analysis_t*>( state );
+    pupillometry_flush( analysis->pupillometry );
+    drain_pupillometry( analysis );
+}
+
+static void merge_analysis( batch_task_t const* task, void* state, void* context )
+{
+    (void) task; // Unused parameter
+    auto analysis = static_cast<analysis_t*>( state );
+    auto totals = static_cast<analysis_totals_t*>( context );
+    totals->samples += analysis->totals.samples;
+    totals->fixations += analysis->totals.fixations;
+    totals->blinks += analysis->totals.blinks;
+    totals->pupil_samples += analysis->totals.pupil_samples;
+    totals->interpolated_pupil_samples += analysis->totals.interpolated_pupil_samples;
+    totals->pupil_diameter_sum_mm += analysis->totals.pupil_diameter_sum_mm;
+    pupillometry_destroy( analysis->pupillometry );
+    delete analysis;
+}
+
+static batch_pipeline_t analysis_pipeline( analysis_totals_t* totals )
+{
+    batch_pipeline_t pipeline = {};
+    pipeline.create = create_analysis;
+    pipeline.gaze_point = gaze_point_callback;
+    pipeline.gaze_data = gaze_data_callback;
+    pipeline.wearable_advanced_data = wearable_advanced_data_callback;
+    pipeline.wearable_consumer_data = wearable_consumer_data_callback;
+    pipeline.finish = finish_analysis;
+    pipeline.merge = merge_analysis;
+    pipeline.context = totals;
+    return pipeline;
+}
+
+static void print_totals( analysis_totals_t const* totals )
+{
+    printf( "%" PRId64 " samples, %" PRId64 " fixations, %" PRId64 " blinks, %" PRId64 " pupil samples (%" PRId64
+        " interpolated), mean filtered pupil diameter %.4f mm\n", totals->samples, totals->fixations, totals->blinks,
+        totals->pupil_samples, totals->interpolated_pupil_samples,
+        totals->pupil_samples ? totals->pupil_diameter_sum_mm / (double) totals->pupil_samples : 0.0 );
+}
+
+extern "C" int batch_processor_sample_main( void );
+extern "C" int batch_processor_sample_main( void )
+{
+    // Analyzes the recordings in the current directory, such as those written by the gaze archive sample
+    analysis_totals_t totals = {};
+    batch_pipeline_t pipeline = analysis_pipeline( &totals );
+    batch_statistics_t statistics;
+    tobii_error_t error = batch_process_directory( ".", &pipeline, 0, 12000, 1200, &statistics );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to process the recordings: %s.\n", tobii_error_message( error ) );
+        return 1;
+    }
+
+    printf( "%d recordings (%d skipped) in %" PRId64 " tasks\n", statistics.files, statistics.failed_files,
+        statistics.tasks );
+    print_totals( &totals );
+    return 0;
+}
+
+
+static bool write_recordings( std::string const& directory, int gaze_files, int wearable_files, int64_t seconds )
+{
+    // Recordings of different lengths, so some threads run out of files and have to steal chunks
+    for( int file = 0; file < gaze_files; ++file )
+    {
+        float const frequency_hz = 1200.0f;
+        int64_t count = (int64_t)( frequency_hz * seconds * ( 1 + file % 3 ) );
+        gaze_archive_writer_t* writer = gaze_archive_writer_create( 4096, 0 );
+        for( int64_t i = 0; i < count; ++i )
+        {
+            tobii_gaze_data_t gaze_data = {};
+            stream_replay_gaze_data( i + file * 100000000LL, frequency_hz, &gaze_data );
+            gaze_archive_writer_add( writer, &gaze_data );
+        }
+        void const* data;
+        size_t size;
+        gaze_archive_writer_finish( writer, &data, &size );
+        std::string path = directory + "/gaze_" + std::to_string( file ) + ".tgza";
+        FILE* out = fopen( path.c_str(), "wb" );
+        bool ok = out && fwrite( data, 1, size, out ) == size;
+        if( out ) ok = fclose( out ) == 0 && ok;
+        gaze_archive_writer_destroy( writer );
+        if( !ok ) return false;
+    }
+
+    for( int file = 0; file < wearable_files; ++file )
+    {
+        float const frequency_hz = 120.0f;
+        std::vector<tobii_wearable_advanced_data_t> recording( (size_t)( frequency_hz * seconds * ( 2 + file ) ) );
+        for( size_t i = 0; i < recording.size(); ++i )
+            stream_replay_wearable_advanced_data( (int64_t) i + file * 100000000LL, frequency_hz, &recording[ i ] );
+        std::string path = directory + "/headset_" + std::to_string( file ) + ".twad";
+        if( batch_write_wearable_recording( path.c_str(), recording.data(), (int64_t) recording.size() ) !=
+            TOBII_ERROR_NO_ERROR ) return false;
+    }
+    return true;
+}
+
+extern "C" int batch_processor_benchmark_main( void );
+extern "C" int batch_processor_benchmark_main( void )
+{
+    std::error_code ignored;
+    std::string directory = ( std::filesystem::temp_directory_path() / "batch_processor_benchmark" ).string();
+    std::filesystem::remove_all( directory, ignored );
+    std::filesystem::create_directory( directory, ignored );
+    if( !write_recordings( directory, 12, 4, 60 ) )
+    {
+        fprintf( stderr, "Failed to write the recordings to %s.\n", directory.c_str() );
+        return 1;
+    }
+
+    unsigned cores = std::thread::hardware_concurrency();
+    printf( "Processing %s on %u cores\n", directory.c_str(), cores );
+    printf( "threads  samples/s  speedup  tasks  stolen  identical\n" );
+
+    int result = 0;
+    double single_thread_rate = 0.0;
+    analysis_totals_t reference = {};
+    for( int threads = 1; threads <= 16; threads *= 2 )
+    {
+        analysis_totals_t totals = {};
+        batch_pipeline_t pipeline = analysis_pipeline( &totals );
+        batch_statistics_t statistics;
+        auto start = std::chrono::steady_clock::now();
+        tobii_error_t error = batch_process_directory( directory.c_str(), &pipeline, threads, 12000, 1200,
+            &statistics );
+        double elapsed_s = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        if( error != TOBII_ERROR_NO_ERROR || statistics.failed_files != 0 )
+        {
+            fprintf( stderr, "Failed to process the recordings.\n" );
+            result = 1;
+            break;
+        }
+
+        double rate = (double) statistics.samples / elapsed_s;
+        if( threads == 1 )
+        {
+            single_thread_rate = rate;
+            reference = totals;
+        }
+        bool identical = memcmp( &totals, &reference, sizeof( totals ) ) == 0;
+        if( !identical ) result = 1;
+        printf( "%7d  %8.2fM  %6.2fx  %5" PRId64 "  %6" PRId64 "  %s\n", threads, rate / 1e6, rate / single_thread_rate,
+            statistics.tasks, statistics.stolen_tasks, identical ? "yes" : "NO" );
+    }
+    print_totals( &reference );
+
+    std::filesystem::remove_all( directory, ignored );
+    return result;
+}
@@ -0,0 +1,236 @@
+#include "blink_detector.h"
+
+#include <algorithm>
+
+struct eye_state_t
+{
+    float closure;
+    bool closed;
+    int run; // Consecutive samples towards the other state
+    int64_t run_start_us;
+
+    // The closure of this eye within the current episode
+    bool closed_in_episode;
+    int64_t onset_us;
+    int64_t offset_us;
+};
+
+struct blink_detector_t
+{
+    blink_detector_config_t config;
+    blink_detector_callback_t callback;
+    void* user_data;
+
+    eye_state_t left;
+    eye_state_t right;
+    bool has_previous;
+    int64_t previous_us;
+
+    // An episode runs from the first eye closing until both are open again, and is classified when it ends
+    bool in_episode;
+    bool both_closed; // Both eyes were closed at the same time during the episode
+
+    // The last blink, for pairing into a double blink
+    bool has_blink;
+    int64_t blink_onset_us;
+    int64_t blink_offset_us;
+};
+
+static void reset_eye( eye_state_t* eye )
+{
+    eye->closure = 0.0f;
+    eye->closed = false;
+    eye->run = 0;
+    eye->run_start_us = 0;
+    eye->closed_in_episode = false;
+    eye->onset_us = 0;
+    eye->offset_us = 0;
+}
+
+static float closure_score( tobii_wearable_advanced_eye_t const* eye )
+{
+    // The blink flag counts double. At the default threshold a lid is closed when the flag is backed by at least two
+    // dropouts, so neither a flickering flag nor a tracking loss with all signals gone is taken for a blink on its
+    // own, unless the flag itself is unavailable
+    float score = 0.0f, weight = 3.0f;
+    score += eye->pupil_diameter_validity != TOBII_VALIDITY_VALID;
+    score += eye->pupil_position_in_sensor_area_validity != TOBII_VALIDITY_VALID;
+    score += eye->gaze_direction_validity != TOBII_VALIDITY_VALID;
+    if( eye->blink_validity == TOBII_VALIDITY_VALID )
+    {
+        score += eye->blink == TOBII_STATE_BOOL_TRUE ? 2.0f : 0.0f;
+        weight += 2.0f;
+    }
+    return score / weight;
+}
+
+static void report( blink_detector_t* detector, blink_event_type_t type, blink_eye_t eye, int64_t timestamp_us,
+    int64_t onset_us, int64_t offset_us )
+{
+    blink_event_t event;
+    event.type = type;
+    event.eye = eye;
+    event.timestamp_us = timestamp_us;
+    event.onset_us = onset_us;
+    event.offset_us = offset_us;
+    event.duration_us = offset_us - onset_us;
+    detector->callback( &event, detector->user_data );
+}
+
+static void update_eye( blink_detector_t* detector, eye_state_t* eye, blink_eye_t which, float closure,
+    int64_t timestamp_us )
+{
+    eye->closure = closure;
+    bool towards_other = eye->closed ? closure <= detector->config.open_threshold :
+        closure >= detector->config.close_threshold;
+    if( !towards_other )
+    {
+        eye->run = 0;
+        return;
+    }
+    if( eye->run++ == 0 ) eye->run_start_us = timestamp_us;
+    if( eye->run < ( eye->closed ? detector->config.open_samples : detector->config.close_samples ) ) return;
+
+    eye->run = 0;
+    eye->closed = !eye->closed;
+    if( eye->closed )
+    {
+        if( !detector->in_episode )
+        {
+            detector->in_episode = true;
+            detector->both_closed = false;
+        }
+        // An eye closing twice within one episode extends its closure
+        if( !eye->closed_in_episode ) eye->onset_us = eye->run_start_us;
+        eye->closed_in_episode = true;
+        report( detector, BLINK_EVENT_CLOSED, which, timestamp_us, eye->onset_us, timestamp_us );
+    }
+    else
+    {
+        eye->offset_us = eye->run_start_us;
+        report( detector, BLINK_EVENT_OPENED, which, timestamp_us, eye->onset_us, eye->offset_us );
+    }
+}
+
+static void end_episode( blink_detector_t* detector, int64_t timestamp_us )
+{
+    blink_detector_config_t const& config = detector->config;
+    eye_state_t* left = &detector->left;
+    eye_state_t* right = &detector->right;
+
+    if( detector->both_closed )
+    {
+        int64_t onset_us = std::min( left->onset_us, right->onset_us );
+        int64_t offset_us = std::max( left->offset_us, right->offset_us );
+        int64_t duration_us = offset_us - onset_us;
+        if( duration_us >= config.min_blink_us && duration_us <= config.max_blink_us )
+        {
+            report( detector, BLINK_EVENT_BLINK, BLINK_EYE_BOTH, timestamp_us, onset_us, offset_us );
+            if( detector->has_blink && onset_us - detector->blink_offset_us <= config.double_blink_gap_us )
+            {
+                report( detector, BLINK_EVENT_DOUBLE_BLINK, BLINK_EYE_BOTH, timestamp_us, detector->blink_onset_us,
+                    offset_us );
+                detector->has_blink = false; // A third blink starts a new pair
+            }
+            else
+            {
+                detector->has_blink = true;
+                detector->blink_onset_us = onset_us;
+                detector->blink_offset_us = offset_us;
+            }
+        }
+    }
+    else
+    {
+        // Only one eye closed, or the two closed one after the other without overlapping
+        for( int i = 0; i < 2; ++i )
+        {
+            eye_state_t* eye = i == 0 ? left : right;
+            if( !eye->closed_in_episode ) continue;
+            int64_t duration_us = eye->offset_us - eye->onset_us;
+            if( duration_us >= config.min_wink_us && duration_us <= config.max_wink_us )
+                report( detector, BLINK_EVENT_WINK, i == 0 ? BLINK_EYE_LEFT : BLINK_EYE_RIGHT, timestamp_us,
+                    eye->onset_us, eye->offset_us );
+        }
+    }
+
+    detector->in_episode = false;
+    left->closed_in_episode = false;
+    right->closed_in_episode = false;
+}
+
+void blink_detector_default_config( blink_detector_config_t* config )
+{
+    config->close_threshold = 0.7f;
+    config->open_threshold = 0.25f;
+    config->close_samples = 1;
+    config->open_samples = 1;
+    config->min_blink_us = 50000;
+    config->max_blink_us = 500000;
+    config->min_wink_us = 150000;
+    config->max_wink_us = 1500000;
+    config->double_blink_gap_us = 400000;
+    config->max_gap_us = 100000;
+}
+
+blink_detector_t* blink_detector_create( blink_detector_config_t const* config, blink_detector_callback_t callback,
+    void* user_data )
+{
+    auto detector = new blink_detector_t();
+    detector->config = *config;
+    detector->config.close_samples = std::max( detector->config.close_samples, 1 );
+    detector->config.open_samples = std::max( detector->config.open_samples, 1 );
+    detector->config.open_threshold = std::min( detector->config.open_threshold, detector->config.close_threshold );
+    detector->callback = callback;
+    detector->user_data = user_data;
+    reset_eye( &detector->left );
+    reset_eye( &detector->right );
+    detector->has_previous = false;
+    detector->previous_us = 0;
+    detector->in_episode = false;
+    detector->both_closed = false;
+    detector->has_blink = false;
+    return detector;
+}
+
+void blink_detector_destroy( blink_detector_t* detector )
+{
+    delete detector;
+}
+
+void blink_detector_push_wearable_advanced_data( blink_detector_t* detector,
+    tobii_wearable_advanced_data_t const* data )
+{
+    int64_t timestamp_us = data->timestamp_system_us;
+    if( detector->has_previous && timestamp_us <= detector->previous_us ) return; // Duplicated or out of order
+    if( detector->has_previous && timestamp_us - detector->previous_us > detector->config.max_gap_us )
+    {
+        // Whatever the eyes did during the gap is unknown, so start over. An eye reported closed is reported open as
+        // of the last sample first, so consumers waiting for it to open are not left waiting
+        if( detector->left.closed )
+            report( detector, BLINK_EVENT_OPENED, BLINK_EYE_LEFT, detector->previous_us, detector->left.onset_us,
+                detector->previous_us );
+        if( detector->right.closed )
+            report( detector, BLINK_EVENT_OPENED, BLINK_EYE_RIGHT, detector->previous_us, detector->right.onset_us,
+                detector->previous_us );
+        reset_eye( &detector->left );
+        reset_eye( &detector->right );
+        detector->in_episode = false;
+        detector->has_blink = false;
+    }
+    detector->has_previous = true;
+    detector->previous_us = timestamp_us;
+
+    update_eye( detector, &detector->left, BLINK_EYE_LEFT, closure_score( &data->left ), timestamp_us );
+    update_eye( detector, &detector->right, BLINK_EYE_RIGHT, closure_score( &data->right ), timestamp_us );
+    if( !detector->in_episode ) return;
+    if( detector->left.closed && detector->right.closed ) detector->both_closed = true;
+    if( !detector->left.closed && !detector->right.closed ) end_episode( detector, timestamp_us );
+}
+
+float blink_detector_closure( blink_detector_t const* detector, blink_eye_t eye )
+{
+    if( eye == BLINK_EYE_LEFT ) return detector->left.closure;
+    if( eye == BLINK_EYE_RIGHT ) return detector->right.closure;
+    return std::min( detector->left.closure, detector->right.closure );
+}
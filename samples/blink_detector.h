@@ -0,0 +1,87 @@
+#ifndef sample_blink_detector_h
+#define sample_blink_detector_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_wearable.h>
+
+#include <stdint.h>
+
+// Blink, double blink and wink events from the wearable advanced data stream, as each sample is pushed. Every eye gets
+// a closure score per sample, from the blink flag and from which of its pupil diameter, pupil position and gaze
+// direction signals have dropped out, so that neither a flickering flag nor a brief tracking loss passes for a closed
+// lid. An eye counts as closed once its score has reached the close threshold for a number of consecutive samples,
+// and as open again once the score has fallen to the open threshold, which is lower, for a number of samples.
+//
+// BLINK_EVENT_CLOSED and BLINK_EVENT_OPENED are reported on the sample where an eye changes state, for uses such as
+// skipping frames nobody will see. The other events are reported once both eyes are open again: a blink when both eyes
+// closed and the closure lasted between min_blink_us and max_blink_us, a wink when one eye closed for between
+// min_wink_us and max_wink_us while the other stayed open, and a double blink when a blink starts at most
+// double_blink_gap_us after the previous one ended. Longer closures and closures that are too short are reported as
+// neither.
+//
+// Pushing never allocates, and must be done from one thread at a time; events are reported from inside the push.
+
+typedef struct blink_detector_t blink_detector_t;
+
+typedef struct blink_detector_config_t
+{
+    float close_threshold; // Closure score from 0 to 1, above which a sample counts as closed
+    float open_threshold; // At most close_threshold, below which a sample counts as open
+    int close_samples; // Consecutive samples needed to change state
+    int open_samples;
+    int64_t min_blink_us;
+    int64_t max_blink_us;
+    int64_t min_wink_us;
+    int64_t max_wink_us;
+    int64_t double_blink_gap_us;
+    // Longer gaps between samples reset both eyes to open. An eye that was closed is reported as opened at the last
+    // sample before the gap, and nothing else is reported for the interrupted closure
+    int64_t max_gap_us;
+} blink_detector_config_t;
+
+typedef enum blink_event_type_t
+{
+    BLINK_EVENT_CLOSED,
+    BLINK_EVENT_OPENED,
+    BLINK_EVENT_BLINK,
+    BLINK_EVENT_DOUBLE_BLINK,
+    BLINK_EVENT_WINK,
+} blink_event_type_t;
+
+typedef enum blink_eye_t
+{
+    BLINK_EYE_LEFT = 1,
+    BLINK_EYE_RIGHT = 2,
+    BLINK_EYE_BOTH = 3,
+} blink_eye_t;
+
+typedef struct blink_event_t
+{
+    blink_event_type_t type;
+    blink_eye_t eye; // The eye that closed or opened, or was winked
+    int64_t timestamp_us; // The sample the event was detected on
+    int64_t onset_us; // First closed sample. For a double blink, of the first blink
+    int64_t offset_us; // First open sample after the closure, or the timestamp for BLINK_EVENT_CLOSED
+    int64_t duration_us; // offset_us - onset_us
+} blink_event_t;
+
+typedef void ( *blink_detector_callback_t )( blink_event_t const* event, void* user_data );
+
+// Fills *config* with values for a 120 Hz headset: close at 0.7, open at 0.25, one sample each way, blinks from 50
+// to 500 ms, winks from 150 to 1500 ms, double blinks up to 400 ms apart and gaps up to 100 ms.
+void blink_detector_default_config( blink_detector_config_t* config );
+
+blink_detector_t* blink_detector_create( blink_detector_config_t const* config, blink_detector_callback_t callback,
+    void* user_data );
+
+void blink_detector_destroy( blink_detector_t* detector );
+
+// Uses the system timestamp of *data*.
+void blink_detector_push_wearable_advanced_data( blink_detector_t* detector,
+    tobii_wearable_advanced_data_t const* data );
+
+// The closure score of the most recent sample for one eye, from 0 for fully open to 1 for closed. 1 - score can be
+// used as a coarse eye openness signal. For BLINK_EYE_BOTH, the lower of the two.
+float blink_detector_closure( blink_detector_t const* detector, blink_eye_t eye );
+
+#endif // sample_blink_detector_h
@@ -0,0 +1,402 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_wearable.h>
+
+#include "blink_detector.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+static char const* eye_name( blink_eye_t eye )
+{
+    return eye == BLINK_EYE_LEFT ? "left" : eye == BLINK_EYE_RIGHT ? "right" : "both";
+}
+
+static void print_event( blink_event_t const* event, void* user_data )
+{
+    (void) user_data; // Unused parameter
+    switch( event->type )
+    {
+        case BLINK_EVENT_CLOSED:
+            printf( "%" PRId64 ": %s eye closed\n", event->timestamp_us, eye_name( event->eye ) );
+            break;
+        case BLINK_EVENT_OPENED:
+            printf( "%" PRId64 ": %s eye opened\n", event->timestamp_us, eye_name( event->eye ) );
+            break;
+        case BLINK_EVENT_BLINK:
+            printf( "%" PRId64 ": blink, %.0f ms\n", event->timestamp_us, event->duration_us / 1000.0 );
+            break;
+        case BLINK_EVENT_DOUBLE_BLINK:
+            printf( "%" PRId64 ": double blink, %.0f ms\n", event->timestamp_us, event->duration_us / 1000.0 );
+            break;
+        case BLINK_EVENT_WINK:
+            printf( "%" PRId64 ": %s wink, %.0f ms\n", event->timestamp_us, eye_name( event->eye ),
+                event->duration_us / 1000.0 );
+            break;
+    }
+}
+
+static void wearable_advanced_data_callback( tobii_wearable_advanced_data_t const* data, void* user_data )
+{
+    blink_detector_push_wearable_advanced_data( static_cast<blink_detector_t*>( user_data ), data );
+}
+
+static void idle( void* context )
+{
+    (void) context; // Unused parameter, events are printed as they are detected
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int blink_detector_sample_main( void );
+extern "C" int blink_detector_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    blink_detector_config_t config;
+    blink_detector_default_config( &config );
+    blink_detector_t* detector = blink_detector_create( &config, print_event, NULL );
+
+    error = tobii_wearable_advanced_data_subscribe( device, wearable_advanced_data_callback, detector );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to wearable advanced data stream.\n" );
+        blink_detector_destroy( detector );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, idle, NULL );
+
+    error = tobii_wearable_advanced_data_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from wearable advanced data stream.\n" );
+    blink_detector_destroy( detector );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// What the eyes really did in the recording: closures of one or both eyes, and whether they make a blink, part of a
+// double blink, a wink, or a long closure that is none of these
+struct closure_t
+{
+    blink_eye_t eye;
+    blink_event_type_t type; // BLINK_EVENT_CLOSED for a long closure
+    int64_t onset_us; // First closed sample
+    int64_t offset_us; // First open sample after it
+    bool second_of_double;
+};
+
+struct recording_t
+{
+    std::vector<tobii_wearable_advanced_data_t> samples;
+    std::vector<closure_t> closures;
+};
+
+// Ten minutes at 120 Hz of replayed headset data, with scripted blinks, double blinks, winks and long closures, and
+// the things that make blink detection hard: signals dropping out of open eyes, short tracking losses on both eyes,
+// blink flags flickering on open eyes, and half-closed lids on the first and last sample of a closure, where the flag
+// may not be set yet
+static void generate_recording( recording_t* recording )
+{
+    float const frequency_hz = 120.0f;
+    int64_t const count = (int64_t)( frequency_hz * 600 );
+    std::mt19937 random( 7 );
+    std::uniform_real_distribution<double> uniform( 0.0, 1.0 );
+
+    recording->samples.resize( count );
+    for( int64_t i = 0; i < count; ++i )
+        stream_replay_wearable_advanced_data( i, frequency_hz, &recording->samples[ i ] );
+    auto sample_us = [ & ]( double t ) {
+        int64_t index = std::min( (int64_t)( t * frequency_hz + 0.5 ), count - 1 );
+        return recording->samples[ index ].timestamp_system_us;
+    };
+
+    // Script, in seconds
+    struct scripted_t { blink_eye_t eye; blink_event_type_t type; double start_s, end_s; bool second; };
+    std::vector<scripted_t> script;
+    for( double t = 1.0; t < 595.0; t += 1.0 + 2.0 * uniform( random ) )
+    {
+        double kind = uniform( random );
+        if( kind < 0.6 )
+        {
+            double duration = 0.08 + 0.22 * uniform( random );
+            script.push_back( { BLINK_EYE_BOTH, BLINK_EVENT_BLINK, t, t + duration, false } );
+            t += duration;
+        }
+        else if( kind < 0.75 )
+        {
+            double first = 0.08 + 0.07 * uniform( random ), gap = 0.1 + 0.2 * uniform( random );
+            double second = 0.08 + 0.07 * uniform( random );
+            script.push_back( { BLINK_EYE_BOTH, BLINK_EVENT_DOUBLE_BLINK, t, t + first, false } );
+            script.push_back( { BLINK_EYE_BOTH, BLINK_EVENT_DOUBLE_BLINK, t + first + gap, t + first + gap + second,
+                true } );
+            t += first + gap + second;
+        }
+        else if( kind < 0.9 )
+        {
+            double duration = 0.25 + 0.55 * uniform( random );
+            blink_eye_t eye = uniform( random ) < 0.5 ? BLINK_EYE_LEFT : BLINK_EYE_RIGHT;
+            script.push_back( { eye, BLINK_EVENT_WINK, t, t + duration, false } );
+            t += duration;
+        }
+        else
+        {
+            double duration = 0.8 + 0.7 * uniform( random );
+            script.push_back( { BLINK_EYE_BOTH, BLINK_EVENT_CLOSED, t, t + duration, false } );
+            t += duration;
+        }
+    }
+
+    // Per sample and eye: 0 open, 1 half closed at the edge of a closure, 2 closed
+    std::vector<uint8_t> state[ 2 ];
+    for( int e = 0; e < 2; ++e ) state[ e ].assign( count, 0 );
+    for( auto const& scripted : script )
+    {
+        int64_t first = (int64_t)( scripted.start_s * frequency_hz + 0.5 );
+        int64_t last = (int64_t)( scripted.end_s * frequency_hz + 0.5 ) - 1;
+        for( int e = 0; e < 2; ++e )
+        {
+            if( !( scripted.eye & ( 1 << e ) ) ) continue;
+            for( int64_t i = first; i <= last; ++i ) state[ e ][ i ] = ( i == first || i == last ) ? 1 : 2;
+        }
+        recording->closures.push_back( { scripted.eye, scripted.type, sample_us( scripted.start_s ),
+            recording->samples[ last + 1 ].timestamp_system_us, scripted.second } );
+    }
+
+    for( int64_t i = 0; i < count; ++i )
+    {
+        // Tracking losses of one to four samples on both eyes, too short for a blink
+        int lost = 0;
+        if( uniform( random ) < 0.002 ) lost = 1 + (int)( uniform( random ) * 4 );
+        for( int64_t j = i; j < std::min( i + lost, count ); ++j )
+            if( !state[ 0 ][ j ] && !state[ 1 ][ j ] ) state[ 0 ][ j ] = state[ 1 ][ j ] = 3;
+
+        for( int e = 0; e < 2; ++e )
+        {
+            tobii_wearable_advanced_data_t* sample = &recording->samples[ i ];
+            tobii_wearable_advanced_eye_t* eye = e == 0 ? &sample->left : &sample->right;
+            bool pupil = true, position = true, direction = true, flag = false;
+            switch( state[ e ][ i ] )
+            {
+                case 0:
+                    if( uniform( random ) < 0.02 )
+                    {
+                        int which = (int)( uniform( random ) * 3 );
+                        pupil = which != 0;
+                        position = which != 1;
+                        direction = which != 2;
+                    }
+                    if( uniform( random ) < 0.003 ) flag = true;
+                    if( uniform( random ) < 0.005 ) pupil = position = direction = false;
+                    break;
+                case 1:
+                    pupil = position = false;
+                    flag = uniform( random ) < 0.5;
+                    break;
+                case 2:
+                    pupil = position = direction = false;
+                    flag = true;
+                    break;
+                case 3:
+                    pupil = position = direction = false;
+                    break;
+            }
+            eye->pupil_diameter_validity = pupil ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+            eye->pupil_position_in_sensor_area_validity = position ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+            eye->gaze_direction_validity = direction ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+            eye->blink_validity = TOBII_VALIDITY_VALID;
+            eye->blink = flag ? TOBII_STATE_BOOL_TRUE : TOBII_STATE_BOOL_FALSE;
+        }
+    }
+}
+
+static void collect_event( blink_event_t const* event, void* user_data )
+{
+    static_cast<std::vector<blink_event_t>*>( user_data )->push_back( *event );
+}
+
+struct evaluation_t
+{
+    double median_onset_ms; // From the first closed sample to the sample the closure was detected on
+    double worst_onset_ms;
+    int missed_onsets;
+    int spurious_closures; // Closed events on eyes that were open
+    int classified; // Blinks, double blinks and winks that match the script
+    int missed;
+    int false_positives; // Blinks, double blinks and winks that do not
+    double nanoseconds_per_sample;
+};
+
+static evaluation_t evaluate( recording_t const& recording, blink_detector_config_t const& config )
+{
+    std::vector<blink_event_t> events;
+    events.reserve( recording.samples.size() );
+    blink_detector_t* detector = blink_detector_create( &config, collect_event, &events );
+    auto start = std::chrono::steady_clock::now();
+    for( auto const& sample : recording.samples ) blink_detector_push_wearable_advanced_data( detector, &sample );
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    blink_detector_destroy( detector );
+
+    evaluation_t evaluation = {};
+    evaluation.nanoseconds_per_sample = std::chrono::duration<double, std::nano>( elapsed ).count() /
+        (double) recording.samples.size();
+
+    // A closure is detected by the first closed event on one of its eyes between its onset and shortly after its end
+    int64_t const slack_us = 20000;
+    std::vector<double> onsets_ms;
+    std::vector<bool> closed_matched( events.size(), false );
+    for( auto const& closure : recording.closures )
+    {
+        bool found = false;
+        for( size_t i = 0; i < events.size(); ++i )
+        {
+            blink_event_t const& event = events[ i ];
+            if( event.type != BLINK_EVENT_CLOSED || !( event.eye & closure.eye ) ) continue;
+            if( event.timestamp_us < closure.onset_us - slack_us || event.timestamp_us > closure.offset_us + slack_us )
+                continue;
+            closed_matched[ i ] = true;
+            if( !found ) onsets_ms.push_back( std::max<int64_t>( event.timestamp_us - closure.onset_us, 0 ) / 1000.0 );
+            found = true;
+        }
+        evaluation.missed_onsets += !found;
+    }
+    for( size_t i = 0; i < events.size(); ++i )
+        evaluation.spurious_closures += events[ i ].type == BLINK_EVENT_CLOSED && !closed_matched[ i ];
+    std::sort( onsets_ms.begin(), onsets_ms.end() );
+    if( !onsets_ms.empty() )
+    {
+        evaluation.median_onset_ms = onsets_ms[ onsets_ms.size() / 2 ];
+        evaluation.worst_onset_ms = onsets_ms.back();
+    }
+
+    // Classified events must match the type, eye and onset of a scripted one. A double blink is expected as two
+    // blinks, and a double blink starting with the first of them.
+    int64_t const tolerance_us = 40000;
+    int expected = 0;
+    std::vector<bool> matched( recording.closures.size() * 2, false );
+    for( size_t c = 0; c < recording.closures.size(); ++c )
+    {
+        closure_t const& closure = recording.closures[ c ];
+        expected += closure.type == BLINK_EVENT_BLINK || closure.type == BLINK_EVENT_WINK ||
+            closure.type == BLINK_EVENT_DOUBLE_BLINK;
+        expected += closure.type == BLINK_EVENT_DOUBLE_BLINK && !closure.second_of_double;
+    }
+    for( auto const& event : events )
+    {
+        if( event.type == BLINK_EVENT_CLOSED || event.type == BLINK_EVENT_OPENED ) continue;
+        bool found = false;
+        for( size_t c = 0; c < recording.closures.size() && !found; ++c )
+        {
+            closure_t const& closure = recording.closures[ c ];
+            if( llabs( event.onset_us - closure.onset_us ) > tolerance_us ) continue;
+            bool is_blink = closure.type == BLINK_EVENT_BLINK || closure.type == BLINK_EVENT_DOUBLE_BLINK;
+            size_t slot = c * 2;
+            if( event.type == BLINK_EVENT_BLINK && is_blink )
+                found = true;
+            else if( event.type == BLINK_EVENT_WINK && closure.type == BLINK_EVENT_WINK && event.eye == closure.eye )
+                found = true;
+            else if( event.type == BLINK_EVENT_DOUBLE_BLINK && closure.type == BLINK_EVENT_DOUBLE_BLINK &&
+                !closure.second_of_double )
+            {
+                found = true;
+                ++slot;
+            }
+            if( found && !matched[ slot ] )
+            {
+                matched[ slot ] = true;
+                ++evaluation.classified;
+            }
+        }
+        evaluation.false_positives += !found;
+    }
+    evaluation.missed = expected - evaluation.classified;
+    return evaluation;
+}
+
+extern "C" int blink_detector_benchmark_main( void );
+extern "C" int blink_detector_benchmark_main( void )
+{
+    recording_t recording;
+    generate_recording( &recording );
+    printf( "%zu samples at 120 Hz, %zu scripted closures\n", recording.samples.size(), recording.closures.size() );
+    printf( "%-26s %12s %11s %9s %10s %8s %8s %8s\n", "", "onset median", "onset worst", "missed", "spurious",
+        "events", "missed", "false" );
+
+    struct variant_t { char const* name; float close_threshold; int close_samples; };
+    variant_t const variants[] = {
+        { "close 0.3, 1 sample", 0.3f, 1 },
+        { "close 0.5, 1 sample", 0.5f, 1 },
+        { "close 0.5, 2 samples", 0.5f, 2 },
+        { "close 0.7, 1 sample", 0.7f, 1 },
+        { "close 0.7, 2 samples", 0.7f, 2 },
+    };
+    evaluation_t default_evaluation = {};
+    for( auto const& variant : variants )
+    {
+        blink_detector_config_t config;
+        blink_detector_default_config( &config );
+        config.close_threshold = variant.close_threshold;
+        config.close_samples = variant.close_samples;
+        evaluation_t evaluation = evaluate( recording, config );
+        printf( "%-26s %9.1f ms %8.1f ms %9d %10d %8d %8d %8d   %.0f ns per sample\n", variant.name,
+            evaluation.median_onset_ms, evaluation.worst_onset_ms, evaluation.missed_onsets,
+            evaluation.spurious_closures, evaluation.classified, evaluation.missed, evaluation.false_positives,
+            evaluation.nanoseconds_per_sample );
+        if( variant.close_threshold == 0.7f && variant.close_samples == 1 ) default_evaluation = evaluation;
+    }
+
+    // The defaults must detect closures within 10 ms, without spurious closures or false events
+    return default_evaluation.worst_onset_ms < 10.0 && default_evaluation.spurious_closures == 0 &&
+        default_evaluation.false_positives == 0 ? 0 : 1;
+}
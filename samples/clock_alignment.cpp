@@ -0,0 +1,476 @@
+#include "clock_alignment.h"
+#include <tobii/tobii_advanced.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Lines fitted to less than this span of timestamps only estimate the offset, as their slope would be mostly noise
+static int64_t const min_drift_span_us = 10000000;
+static int const max_edges = 1024;
+
+struct timestamp_pair_t
+{
+    int64_t tracker_us;
+    int64_t system_us;
+};
+
+struct syncport_edge_t
+{
+    int64_t tracker_us;
+    int64_t system_us;
+    uint32_t signal;
+};
+
+// host = tracker + offset + slope * ( tracker - origin )
+struct clock_mapping_t
+{
+    bool mapped;
+    bool anchored;
+    int64_t origin_us;
+    double offset_us;
+    double slope;
+    int64_t residual_us;
+};
+
+struct line_t
+{
+    int64_t origin; // Mean of x
+    double offset; // Fitted y at the origin
+    double slope;
+    double residual; // Largest distance of a point from the line
+};
+
+struct aligned_device_t
+{
+    clock_alignment_t* alignment;
+    int index;
+    tobii_device_t* device;
+    bool syncport_subscribed;
+
+    std::mutex mutex; // Guards the rings, taken by the pushing thread and by clock_alignment_update
+    std::vector<timestamp_pair_t> pairs; // Ring buffer
+    size_t pair_head;
+    size_t pair_count;
+    std::vector<syncport_edge_t> edges; // Ring buffer
+    size_t edge_head;
+    size_t edge_count;
+    std::atomic<int64_t> timesyncs;
+
+    // Published by clock_alignment_update, read by anyone
+    std::atomic<uint64_t> sequence;
+    clock_mapping_t mapping;
+};
+
+struct clock_alignment_t
+{
+    clock_alignment_config_t config;
+    tobii_api_t* api;
+    std::unique_ptr<aligned_device_t[]> devices;
+    int device_count;
+
+    std::mutex update_mutex; // Serializes clock_alignment_update
+    std::vector<timestamp_pair_t> pair_scratch;
+    std::vector<syncport_edge_t> edge_scratch;
+    std::vector<syncport_edge_t> reference_scratch;
+
+    std::mutex thread_mutex;
+    std::condition_variable cv;
+    bool exit_event;
+    bool started;
+    std::thread thread;
+};
+
+static void publish( aligned_device_t* device, clock_mapping_t const& mapping )
+{
+    uint64_t sequence = device->sequence.load( std::memory_order_relaxed );
+    device->sequence.store( sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    device->mapping = mapping;
+    device->sequence.store( sequence + 2, std::memory_order_release );
+}
+
+static clock_mapping_t read_mapping( aligned_device_t const* device )
+{
+    for( ;; )
+    {
+        uint64_t sequence = device->sequence.load( std::memory_order_acquire );
+        if( sequence & 1 ) continue;
+        clock_mapping_t mapping = device->mapping;
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( device->sequence.load( std::memory_order_relaxed ) == sequence ) return mapping;
+    }
+}
+
+// Least squares line through y over x, with x relative to its mean so the sums stay precise in doubles
+template< typename Point, typename X, typename Y > static bool fit_line( std::vector<Point> const& points, X x, Y y,
+    line_t* line )
+{
+    size_t count = points.size();
+    if( count < 2 ) return false;
+
+    int64_t origin = x( points[ 0 ] );
+    double sum_x = 0.0, sum_y = 0.0;
+    for( Point const& point : points )
+    {
+        sum_x += (double)( x( point ) - origin );
+        sum_y += y( point );
+    }
+    origin += (int64_t) llround( sum_x / (double) count );
+    double mean_y = sum_y / (double) count;
+
+    double sxx = 0.0, sxy = 0.0;
+    int64_t first = x( points[ 0 ] ), last = first;
+    for( Point const& point : points )
+    {
+        double dx = (double)( x( point ) - origin );
+        sxx += dx * dx;
+        sxy += dx * ( y( point ) - mean_y );
+        first = std::min( first, x( point ) );
+        last = std::max( last, x( point ) );
+    }
+    line->origin = origin;
+    line->slope = last - first >= min_drift_span_us && sxx > 0.0 ? sxy / sxx : 0.0;
+    line->offset = mean_y - line->slope * ( sum_x / (double) count - (double)( origin - x( points[ 0 ] ) ) );
+
+    line->residual = 0.0;
+    for( Point const& point : points )
+    {
+        double fitted = line->offset + line->slope * (double)( x( point ) - origin );
+        line->residual = std::max( line->residual, fabs( y( point ) - fitted ) );
+    }
+    return true;
+}
+
+// Copies the ring entries within the window ending at the newest one
+template< typename Entry > static void copy_window( std::vector<Entry> const& ring, size_t head, size_t count,
+    int64_t window_us, std::vector<Entry>* out )
+{
+    out->clear();
+    if( count == 0 ) return;
+    size_t capacity = ring.size();
+    int64_t newest = ring[ ( head + capacity - 1 ) % capacity ].tracker_us;
+    for( size_t i = 0; i < count; ++i )
+    {
+        Entry const& entry = ring[ ( head + capacity - count + i ) % capacity ];
+        if( newest - entry.tracker_us <= window_us ) out->push_back( entry );
+    }
+}
+
+static bool fit_timestamps( clock_alignment_t* alignment, aligned_device_t* device, clock_mapping_t* mapping )
+{
+    {
+        std::lock_guard<std::mutex> lock( device->mutex );
+        copy_window( device->pairs, device->pair_head, device->pair_count, alignment->config.window_us,
+            &alignment->pair_scratch );
+    }
+
+    // The system clock minus the tracker clock, as a line over the tracker clock: its slope is the drift
+    line_t line;
+    if( !fit_line( alignment->pair_scratch, []( timestamp_pair_t const& pair ) { return pair.tracker_us; },
+        []( timestamp_pair_t const& pair ) { return (double)( pair.system_us - pair.tracker_us ); }, &line ) )
+        return false;
+
+    mapping->mapped = true;
+    mapping->anchored = false;
+    mapping->origin_us = line.origin;
+    mapping->offset_us = line.offset;
+    mapping->slope = line.slope;
+    mapping->residual_us = (int64_t) ceil( line.residual );
+    return true;
+}
+
+struct edge_match_t
+{
+    int64_t tracker_us;
+    int64_t reference_tracker_us;
+};
+
+static bool fit_edges( clock_alignment_t* alignment, std::vector<syncport_edge_t> const& reference,
+    std::vector<syncport_edge_t> const& edges, clock_mapping_t const& reference_mapping, clock_mapping_t* mapping )
+{
+    // Both lists are in capture order, so the candidates for each edge only move forward
+    std::vector<edge_match_t> matches;
+    size_t start = 0;
+    for( syncport_edge_t const& edge : edges )
+    {
+        while( start < reference.size() &&
+            reference[ start ].system_us < edge.system_us - alignment->config.max_edge_match_us )
+            ++start;
+        int64_t best_distance = alignment->config.max_edge_match_us + 1;
+        size_t best = reference.size();
+        for( size_t i = start; i < reference.size(); ++i )
+        {
+            int64_t distance = reference[ i ].system_us - edge.system_us;
+            if( distance > alignment->config.max_edge_match_us ) break;
+            if( reference[ i ].signal == edge.signal && llabs( distance ) < best_distance )
+            {
+                best_distance = llabs( distance );
+                best = i;
+            }
+        }
+        if( best < reference.size() ) matches.push_back( { edge.tracker_us, reference[ best ].tracker_us } );
+    }
+
+    // The reference tracker clock minus this one, as a line over this one
+    line_t line;
+    if( !fit_line( matches, []( edge_match_t const& match ) { return match.tracker_us; },
+        []( edge_match_t const& match ) { return (double)( match.reference_tracker_us - match.tracker_us ); },
+        &line ) )
+        return false;
+
+    // Compose with the mapping of the reference device, which is linear too
+    double reference_at_origin = (double)( line.origin - reference_mapping.origin_us ) + line.offset;
+    mapping->mapped = true;
+    mapping->anchored = true;
+    mapping->origin_us = line.origin;
+    mapping->offset_us = line.offset + reference_mapping.offset_us + reference_mapping.slope * reference_at_origin;
+    mapping->slope = ( 1.0 + line.slope ) * ( 1.0 + reference_mapping.slope ) - 1.0;
+    mapping->residual_us = (int64_t) ceil( line.residual );
+    return true;
+}
+
+static void syncport_callback( uint32_t signal, int64_t timestamp_tracker_us, int64_t timestamp_system_us,
+    void* user_data )
+{
+    auto device = static_cast<aligned_device_t*>( user_data );
+    clock_alignment_push_syncport( device->alignment, device->index, signal, timestamp_tracker_us,
+        timestamp_system_us );
+}
+
+static void alignment_thread( clock_alignment_t* alignment )
+{
+    auto next_round = std::chrono::steady_clock::now();
+    for( ;; )
+    {
+        {
+            std::unique_lock<std::mutex> lock( alignment->thread_mutex );
+            alignment->cv.wait_until( lock, std::min( next_round, std::chrono::steady_clock::now() +
+                std::chrono::seconds( 1 ) ), [&] { return alignment->exit_event; } );
+            if( alignment->exit_event ) return;
+        }
+
+        if( std::chrono::steady_clock::now() >= next_round )
+        {
+            clock_alignment_timesync_round( alignment );
+            next_round = std::chrono::steady_clock::now() +
+                std::chrono::microseconds( alignment->config.timesync_interval_us );
+        }
+        clock_alignment_update( alignment );
+    }
+}
+
+void clock_alignment_default_config( clock_alignment_config_t* config )
+{
+    config->timesync_interval_us = 5000000;
+    config->max_timesync_round_trip_us = 2000;
+    config->max_timesync_retries = 3;
+    config->window_us = 120000000;
+    config->pair_interval_us = 50000;
+    config->max_edge_match_us = 20000;
+}
+
+clock_alignment_t* clock_alignment_create( clock_alignment_config_t const* config, tobii_api_t* api,
+    tobii_device_t* const* devices, int device_count )
+{
+    auto alignment = new clock_alignment_t();
+    alignment->config = *config;
+    alignment->config.pair_interval_us = std::max( alignment->config.pair_interval_us, (int64_t) 1 );
+    alignment->api = api;
+    alignment->device_count = device_count;
+    alignment->devices.reset( new aligned_device_t[ device_count ] );
+
+    // Room for a full window of pairs, plus some slack for timestamp jitter
+    size_t pair_capacity = (size_t)( alignment->config.window_us / alignment->config.pair_interval_us ) + 16;
+    for( int i = 0; i < device_count; ++i )
+    {
+        aligned_device_t* device = &alignment->devices[ i ];
+        device->alignment = alignment;
+        device->index = i;
+        device->device = devices ? devices[ i ] : NULL;
+        device->syncport_subscribed = false;
+        device->pairs.resize( pair_capacity );
+        device->pair_head = 0;
+        device->pair_count = 0;
+        device->edges.resize( max_edges );
+        device->edge_head = 0;
+        device->edge_count = 0;
+        device->timesyncs = 0;
+        device->sequence = 0;
+        device->mapping = clock_mapping_t();
+    }
+    alignment->exit_event = false;
+    alignment->started = false;
+    return alignment;
+}
+
+void clock_alignment_destroy( clock_alignment_t* alignment )
+{
+    if( alignment->started )
+    {
+        {
+            std::lock_guard<std::mutex> lock( alignment->thread_mutex );
+            alignment->exit_event = true;
+        }
+        alignment->cv.notify_all();
+        alignment->thread.join();
+    }
+
+    for( int i = 0; i < alignment->device_count; ++i )
+    {
+        aligned_device_t* device = &alignment->devices[ i ];
+        if( device->syncport_subscribed ) tobii_digital_syncport_unsubscribe( device->device );
+    }
+    delete alignment;
+}
+
+tobii_error_t clock_alignment_start( clock_alignment_t* alignment )
+{
+    if( alignment->started ) return TOBII_ERROR_NO_ERROR;
+
+    for( int i = 0; i < alignment->device_count; ++i )
+    {
+        aligned_device_t* device = &alignment->devices[ i ];
+        if( !device->device ) continue;
+
+        tobii_supported_t supported;
+        tobii_error_t error = tobii_stream_supported( device->device, TOBII_STREAM_DIGITAL_SYNCPORT, &supported );
+        if( error != TOBII_ERROR_NO_ERROR ) return error;
+        if( supported != TOBII_SUPPORTED ) continue;
+
+        // The syncport needs a license, without which the device is aligned by its timesyncs like any other
+        error = tobii_digital_syncport_subscribe( device->device, syncport_callback, device );
+        if( error == TOBII_ERROR_NO_ERROR ) device->syncport_subscribed = true;
+        else if( error != TOBII_ERROR_INSUFFICIENT_LICENSE ) return error;
+    }
+
+    alignment->started = true;
+    alignment->thread = std::thread( alignment_thread, alignment );
+    return TOBII_ERROR_NO_ERROR;
+}
+
+tobii_error_t clock_alignment_timesync_round( clock_alignment_t* alignment )
+{
+    tobii_error_t result = TOBII_ERROR_NO_ERROR;
+    for( int i = 0; i < alignment->device_count; ++i )
+    {
+        aligned_device_t* device = &alignment->devices[ i ];
+        if( !device->device ) continue;
+
+        for( int attempt = 0; attempt <= alignment->config.max_timesync_retries; ++attempt )
+        {
+            int64_t before_us = 0, after_us = 0;
+            if( alignment->api ) tobii_system_clock( alignment->api, &before_us );
+            tobii_error_t error = tobii_update_timesync( device->device );
+            if( alignment->api ) tobii_system_clock( alignment->api, &after_us );
+            ++device->timesyncs;
+            if( error != TOBII_ERROR_NO_ERROR )
+            {
+                if( result == TOBII_ERROR_NO_ERROR ) result = error;
+                break;
+            }
+            // The offset is measured somewhere within the round trip, so a quick one is an accurate one
+            if( after_us - before_us <= alignment->config.max_timesync_round_trip_us ) break;
+        }
+    }
+    return result;
+}
+
+void clock_alignment_push_timestamps( clock_alignment_t* alignment, int device_index, int64_t timestamp_tracker_us,
+    int64_t timestamp_system_us )
+{
+    if( device_index < 0 || device_index >= alignment->device_count ) return;
+    aligned_device_t* device = &alignment->devices[ device_index ];
+
+    std::lock_guard<std::mutex> lock( device->mutex );
+    size_t capacity = device->pairs.size();
+    if( device->pair_count > 0 )
+    {
+        int64_t newest_us = device->pairs[ ( device->pair_head + capacity - 1 ) % capacity ].tracker_us;
+        if( timestamp_tracker_us - newest_us < alignment->config.pair_interval_us ) return;
+    }
+    device->pairs[ device->pair_head ] = { timestamp_tracker_us, timestamp_system_us };
+    device->pair_head = ( device->pair_head + 1 ) % capacity;
+    device->pair_count = std::min( device->pair_count + 1, capacity );
+}
+
+void clock_alignment_push_syncport( clock_alignment_t* alignment, int device_index, uint32_t signal,
+    int64_t timestamp_tracker_us, int64_t timestamp_system_us )
+{
+    if( device_index < 0 || device_index >= alignment->device_count ) return;
+    aligned_device_t* device = &alignment->devices[ device_index ];
+
+    std::lock_guard<std::mutex> lock( device->mutex );
+    device->edges[ device->edge_head ] = { timestamp_tracker_us, timestamp_system_us, signal };
+    device->edge_head = ( device->edge_head + 1 ) % device->edges.size();
+    device->edge_count = std::min( device->edge_count + 1, device->edges.size() );
+}
+
+void clock_alignment_update( clock_alignment_t* alignment )
+{
+    std::lock_guard<std::mutex> lock( alignment->update_mutex );
+
+    // Map every device through its timestamps first, as the reference device is needed to anchor the others
+    std::vector<clock_mapping_t> mappings( alignment->device_count );
+    int reference = -1;
+    for( int i = 0; i < alignment->device_count; ++i )
+    {
+        aligned_device_t* device = &alignment->devices[ i ];
+        if( !fit_timestamps( alignment, device, &mappings[ i ] ) ) continue;
+        if( reference >= 0 ) continue;
+
+        std::lock_guard<std::mutex> device_lock( device->mutex );
+        copy_window( device->edges, device->edge_head, device->edge_count, alignment->config.window_us,
+            &alignment->reference_scratch );
+        if( alignment->reference_scratch.size() >= 2 ) reference = i;
+    }
+
+    for( int i = 0; i < alignment->device_count; ++i )
+    {
+        aligned_device_t* device = &alignment->devices[ i ];
+        if( !mappings[ i ].mapped ) continue;
+        if( reference >= 0 && i != reference )
+        {
+            {
+                std::lock_guard<std::mutex> device_lock( device->mutex );
+                copy_window( device->edges, device->edge_head, device->edge_count, alignment->config.window_us,
+                    &alignment->edge_scratch );
+            }
+            clock_mapping_t anchored;
+            if( fit_edges( alignment, alignment->reference_scratch, alignment->edge_scratch, mappings[ reference ],
+                &anchored ) )
+                mappings[ i ] = anchored;
+        }
+        publish( device, mappings[ i ] );
+    }
+}
+
+int64_t clock_alignment_to_host_us( clock_alignment_t const* alignment, int device, int64_t timestamp_tracker_us,
+    int64_t fallback_system_us )
+{
+    if( device < 0 || device >= alignment->device_count ) return fallback_system_us;
+    clock_mapping_t mapping = read_mapping( &alignment->devices[ device ] );
+    if( !mapping.mapped ) return fallback_system_us;
+    return timestamp_tracker_us + (int64_t) llround( mapping.offset_us + mapping.slope *
+        (double)( timestamp_tracker_us - mapping.origin_us ) );
+}
+
+void clock_alignment_status( clock_alignment_t const* alignment, int device, clock_alignment_status_t* status )
+{
+    *status = clock_alignment_status_t();
+    if( device < 0 || device >= alignment->device_count ) return;
+    clock_mapping_t mapping = read_mapping( &alignment->devices[ device ] );
+    status->mapped = mapping.mapped;
+    status->anchored = mapping.anchored;
+    status->drift_ppm = mapping.slope * 1000000.0;
+    status->residual_us = mapping.residual_us;
+    status->timesyncs = alignment->devices[ device ].timesyncs;
+}
@@ -0,0 +1,85 @@
+#ifndef sample_clock_alignment_h
+#define sample_clock_alignment_h
+
+#include <tobii/tobii.h>
+
+#include <stdint.h>
+
+// One timeline for several trackers on the same host. Every device stamps its samples with its own tracker clock, and
+// with a system timestamp derived from it by the offset measured at the last tobii_update_timesync on that device.
+// That offset carries the error of a single round trip, and goes stale as the tracker clock drifts, so the system
+// timestamps of different devices disagree by up to milliseconds.
+//
+// The alignment runs the timesyncs of all devices together, in rounds on one thread, and retries any timesync whose
+// round trip was slow, as its offset is the least accurate. Each device then gets a line through the pairs of tracker
+// and system timestamps of its recent samples, which averages the error of many timesyncs and follows the drift, and
+// maps tracker timestamps onto the host system clock.
+//
+// Where the devices share a hardware sync signal on their digital syncports, each edge is captured by every device at
+// the same instant. The edges of each device are matched with those of the first device that has any, and a line
+// through the matched tracker timestamps maps the device onto that reference device, to within the capture jitter of
+// the edges. The reference device is mapped onto the host clock as above.
+//
+// Timestamps are pushed from the stream callbacks of each device, and can be pushed from a different thread for each
+// device. The mappings are refitted by clock_alignment_update, and read without locking.
+
+typedef struct clock_alignment_t clock_alignment_t;
+
+typedef struct clock_alignment_config_t
+{
+    int64_t timesync_interval_us; // Between rounds of timesyncs
+    int64_t max_timesync_round_trip_us; // Slower timesyncs are retried
+    int max_timesync_retries;
+    int64_t window_us; // Span of recent timestamps each line is fitted to
+    int64_t pair_interval_us; // Timestamp pairs closer together than this are skipped
+    int64_t max_edge_match_us; // How far apart in system time two devices may report the same syncport edge
+} clock_alignment_config_t;
+
+typedef struct clock_alignment_status_t
+{
+    int mapped; // Nonzero once the device has enough timestamps to be mapped
+    int anchored; // Nonzero if the device is mapped through syncport edges
+    double drift_ppm; // Of the tracker clock relative to the host clock
+    int64_t residual_us; // Largest distance of a timestamp pair, or matched edge when anchored, from the line
+    int64_t timesyncs; // Timesyncs done by clock_alignment_timesync_round, including retries
+} clock_alignment_status_t;
+
+// Fills *config* with timesyncs every 5 seconds, retried if they took more than 2 ms, up to 3 times, and lines fitted
+// to the last 2 minutes with a pair every 50 ms, matching edges up to 20 ms apart.
+void clock_alignment_default_config( clock_alignment_config_t* config );
+
+// *devices* may be NULL, for an alignment that is only fed by the push functions, such as when replaying.
+clock_alignment_t* clock_alignment_create( clock_alignment_config_t const* config, tobii_api_t* api,
+    tobii_device_t* const* devices, int device_count );
+
+// Stops the timesync thread, and unsubscribes from the syncports.
+void clock_alignment_destroy( clock_alignment_t* alignment );
+
+// Subscribes to the digital syncport of every device that supports it, and starts a thread that runs a round of
+// timesyncs every timesync_interval_us, and refits the mappings every second. Must not be called from inside a
+// callback. Devices without a syncport are mapped through their timesyncs alone.
+tobii_error_t clock_alignment_start( clock_alignment_t* alignment );
+
+// Runs tobii_update_timesync on every device, one after the other. This is what the thread does, for applications
+// that schedule their own timesyncs. Must not be called from inside a callback.
+tobii_error_t clock_alignment_timesync_round( clock_alignment_t* alignment );
+
+// Records the tracker and system timestamps of a sample of *device*, an index into the devices passed at creation.
+void clock_alignment_push_timestamps( clock_alignment_t* alignment, int device, int64_t timestamp_tracker_us,
+    int64_t timestamp_system_us );
+
+// Records a syncport edge. This is what the syncport subscriptions call.
+void clock_alignment_push_syncport( clock_alignment_t* alignment, int device, uint32_t signal,
+    int64_t timestamp_tracker_us, int64_t timestamp_system_us );
+
+// Refits the mappings of all devices to the timestamps pushed so far.
+void clock_alignment_update( clock_alignment_t* alignment );
+
+// Maps a tracker timestamp of *device* onto the host system clock. Before the device is mapped, this returns
+// *fallback_system_us*, which should be the system timestamp of the same sample. Safe to call from any thread.
+int64_t clock_alignment_to_host_us( clock_alignment_t const* alignment, int device, int64_t timestamp_tracker_us,
+    int64_t fallback_system_us );
+
+void clock_alignment_status( clock_alignment_t const* alignment, int device, clock_alignment_status_t* status );
+
+#endif // sample_clock_alignment_h
@@ -0,0 +1,313 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+
+#include "clock_alignment.h"
+#include "main_loop_linux.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static int const max_devices = 8;
+
+struct aligned_stream_t
+{
+    clock_alignment_t* alignment;
+    int device;
+    std::atomic<int64_t> correction_us; // Host timestamp minus system timestamp of the latest sample
+};
+
+struct alignment_context_t
+{
+    tobii_api_t* api;
+    clock_alignment_t* alignment;
+    aligned_stream_t streams[ max_devices ];
+    int device_count;
+    int64_t next_print_us;
+};
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    auto stream = static_cast<aligned_stream_t*>( user_data );
+    clock_alignment_push_timestamps( stream->alignment, stream->device, gaze_data->timestamp_tracker_us,
+        gaze_data->timestamp_system_us );
+
+    // The timestamp to merge the streams of all devices by
+    int64_t host_us = clock_alignment_to_host_us( stream->alignment, stream->device, gaze_data->timestamp_tracker_us,
+        gaze_data->timestamp_system_us );
+    stream->correction_us = host_us - gaze_data->timestamp_system_us;
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    static_cast<std::vector<std::string>*>( user_data )->push_back( url );
+}
+
+static void print_status( void* user_data )
+{
+    auto context = static_cast<alignment_context_t*>( user_data );
+    int64_t now_us;
+    if( tobii_system_clock( context->api, &now_us ) != TOBII_ERROR_NO_ERROR || now_us < context->next_print_us ) return;
+    context->next_print_us = now_us + 5000000;
+
+    for( int i = 0; i < context->device_count; ++i )
+    {
+        clock_alignment_status_t status;
+        clock_alignment_status( context->alignment, i, &status );
+        printf( "Device %d: %s, drift %+.1f ppm, residual %" PRId64 " us, %" PRId64 " timesyncs, system timestamps "
+            "corrected by %+" PRId64 " us\n", i, !status.mapped ? "not mapped yet" : status.anchored ? "syncport" :
+            "timesync", status.drift_ppm, status.residual_us, status.timesyncs, context->streams[ i ].correction_us
+            .load() );
+    }
+}
+
+static void pump_thread( tobii_device_t** devices, int count, std::atomic<bool>* running )
+{
+    while( *running )
+    {
+        tobii_error_t error = tobii_wait_for_callbacks( count, devices );
+        if( error != TOBII_ERROR_NO_ERROR && error != TOBII_ERROR_TIMED_OUT ) continue;
+        for( int i = 0; i < count; ++i ) tobii_device_process_callbacks( devices[ i ] );
+    }
+}
+
+extern "C" int clock_alignment_sample_main( void );
+extern "C" int clock_alignment_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    std::vector<std::string> urls;
+    error = tobii_enumerate_local_device_urls( api, url_receiver, &urls );
+    if( error != TOBII_ERROR_NO_ERROR || urls.empty() )
+    {
+        fprintf( stderr, "No devices found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* devices[ max_devices ];
+    int device_count = 0;
+    for( size_t i = 0; i < urls.size() && device_count < max_devices; ++i )
+    {
+        error = tobii_device_create( api, urls[ i ].c_str(), TOBII_FIELD_OF_USE_INTERACTIVE, &devices[ device_count ] );
+        if( error == TOBII_ERROR_NO_ERROR ) ++device_count;
+        else fprintf( stderr, "Failed to connect to %s.\n", urls[ i ].c_str() );
+    }
+
+    alignment_context_t context;
+    context.api = api;
+    clock_alignment_config_t config;
+    clock_alignment_default_config( &config );
+    context.alignment = clock_alignment_create( &config, api, devices, device_count );
+    context.device_count = device_count;
+    context.next_print_us = 0;
+    for( int i = 0; i < device_count; ++i )
+    {
+        context.streams[ i ].alignment = context.alignment;
+        context.streams[ i ].device = i;
+        context.streams[ i ].correction_us = 0;
+        error = tobii_gaze_data_subscribe( devices[ i ], gaze_data_callback, &context.streams[ i ] );
+        if( error != TOBII_ERROR_NO_ERROR )
+            fprintf( stderr, "Failed to subscribe to gaze data of device %d: %s.\n", i, tobii_error_message( error ) );
+    }
+
+    // The alignment runs the timesyncs of all devices, so no device has a timesync thread of its own
+    error = clock_alignment_start( context.alignment );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to start the clock alignment: %s.\n", tobii_error_message( error ) );
+
+    // The first device is pumped by the main loop, and any others by a thread of their own
+    std::atomic<bool> running( true );
+    std::thread others;
+    if( device_count > 1 ) others = std::thread( pump_thread, devices + 1, device_count - 1, &running );
+    if( device_count > 0 ) main_loop( devices[ 0 ], print_status, &context );
+    running = false;
+    if( others.joinable() ) others.join();
+
+    // Destroyed before the devices, as it unsubscribes from their syncports
+    clock_alignment_destroy( context.alignment );
+    for( int i = 0; i < device_count; ++i )
+    {
+        tobii_gaze_data_unsubscribe( devices[ i ] );
+        error = tobii_device_destroy( devices[ i ] );
+        if( error != TOBII_ERROR_NO_ERROR )
+            fprintf( stderr, "Failed to destroy device.\n" );
+    }
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// A device of the replayed recording. The tracker clock runs at its own rate from its own epoch, and the system
+// timestamps are derived from it with the offset measured by the last timesync, the way Stream Engine does.
+struct replay_device_t
+{
+    int64_t epoch_us;
+    double drift;
+    double system_offset_us;
+    int64_t next_timesync_us;
+};
+
+static int64_t tracker_clock( replay_device_t const& device, int64_t host_us )
+{
+    return device.epoch_us + (int64_t) llround( (double) host_us * ( 1.0 + device.drift ) );
+}
+
+static int64_t system_timestamp( replay_device_t const& device, int64_t tracker_us )
+{
+    return tracker_us + (int64_t) llround( device.system_offset_us );
+}
+
+static void replay_timesync( replay_device_t* device, int64_t host_us, std::mt19937* random, bool retry_slow,
+    clock_alignment_config_t const& config )
+{
+    // Usually a quick round trip, but one in twenty is delayed by other USB traffic. The offset is taken at the
+    // middle of the round trip, so the error is anywhere within half of it.
+    std::uniform_real_distribution<double> unit( 0.0, 1.0 );
+    for( int attempt = 0; attempt <= config.max_timesync_retries; ++attempt )
+    {
+        double round_trip_us = unit( *random ) < 0.05 ? 3000.0 + 5000.0 * unit( *random ) :
+            200.0 + 400.0 * unit( *random );
+        double error_us = ( unit( *random ) - 0.5 ) * round_trip_us;
+        device->system_offset_us = (double)( host_us - tracker_clock( *device, host_us ) ) + error_us;
+        if( !retry_slow || round_trip_us <= (double) config.max_timesync_round_trip_us ) break;
+    }
+}
+
+struct skew_t
+{
+    std::vector<double> samples_us;
+
+    void add( double skew_us ) { samples_us.push_back( skew_us ); }
+
+    double percentile( double p )
+    {
+        std::sort( samples_us.begin(), samples_us.end() );
+        return samples_us[ std::min( samples_us.size() - 1, (size_t)( p * (double) samples_us.size() ) ) ];
+    }
+};
+
+static void replay_recording( bool scheduled, int device_count, int64_t duration_us )
+{
+    clock_alignment_config_t config;
+    clock_alignment_default_config( &config );
+    std::mt19937 random( 42 );
+    std::uniform_real_distribution<double> unit( 0.0, 1.0 );
+
+    // Up to 60 ppm of drift, and timesyncs every 30 seconds at unrelated moments, as with a timesync thread per device
+    std::vector<replay_device_t> devices( device_count );
+    for( auto& device : devices )
+    {
+        device.epoch_us = (int64_t)( unit( random ) * 1e12 );
+        device.drift = ( unit( random ) - 0.5 ) * 120e-6;
+        device.next_timesync_us = scheduled ? 0 : (int64_t)( unit( random ) * 30e6 );
+        replay_timesync( &device, 0, &random, scheduled, config );
+    }
+    int64_t const timesync_interval_us = scheduled ? config.timesync_interval_us : 30000000;
+
+    // Lines fitted to the timestamps alone, and with the edges of a 1 Hz sync signal shared by all devices
+    clock_alignment_t* fitted = clock_alignment_create( &config, NULL, NULL, device_count );
+    clock_alignment_t* anchored = clock_alignment_create( &config, NULL, NULL, device_count );
+
+    skew_t raw_skew, fitted_skew, anchored_skew;
+    int64_t const sample_interval_us = 1000000 / 120;
+    int64_t const warm_up_us = 30000000;
+    int64_t next_update_us = 1000000;
+    uint32_t signal = 0;
+    std::normal_distribution<double> capture_jitter_us( 0.0, 2.0 );
+    for( int64_t host_us = 0; host_us < duration_us; host_us += 1000 )
+    {
+        for( int i = 0; i < device_count; ++i )
+        {
+            replay_device_t& device = devices[ i ];
+            if( host_us >= device.next_timesync_us )
+            {
+                replay_timesync( &device, host_us, &random, scheduled, config );
+                device.next_timesync_us = host_us + timesync_interval_us;
+            }
+            if( host_us % sample_interval_us < 1000 )
+            {
+                int64_t tracker_us = tracker_clock( device, host_us );
+                clock_alignment_push_timestamps( fitted, i, tracker_us, system_timestamp( device, tracker_us ) );
+                clock_alignment_push_timestamps( anchored, i, tracker_us, system_timestamp( device, tracker_us ) );
+            }
+        }
+        if( host_us % 500000 == 0 )
+        {
+            signal ^= 1;
+            for( int i = 0; i < device_count; ++i )
+            {
+                int64_t tracker_us = tracker_clock( devices[ i ], host_us ) +
+                    (int64_t) llround( capture_jitter_us( random ) );
+                clock_alignment_push_syncport( anchored, i, signal, tracker_us,
+                    system_timestamp( devices[ i ], tracker_us ) );
+            }
+        }
+        if( host_us >= next_update_us )
+        {
+            clock_alignment_update( fitted );
+            clock_alignment_update( anchored );
+            next_update_us += 1000000;
+        }
+
+        // The spread of the timestamps the devices give an event at this instant
+        if( host_us < warm_up_us || host_us % 10000 != 0 ) continue;
+        int64_t raw[ 2 ] = { INT64_MAX, INT64_MIN }, fit[ 2 ] = { INT64_MAX, INT64_MIN };
+        int64_t anchor[ 2 ] = { INT64_MAX, INT64_MIN };
+        for( int i = 0; i < device_count; ++i )
+        {
+            int64_t tracker_us = tracker_clock( devices[ i ], host_us );
+            int64_t system_us = system_timestamp( devices[ i ], tracker_us );
+            int64_t values[ 3 ] = { system_us, clock_alignment_to_host_us( fitted, i, tracker_us, system_us ),
+                clock_alignment_to_host_us( anchored, i, tracker_us, system_us ) };
+            int64_t* ranges[ 3 ] = { raw, fit, anchor };
+            for( int k = 0; k < 3; ++k )
+            {
+                ranges[ k ][ 0 ] = std::min( ranges[ k ][ 0 ], values[ k ] );
+                ranges[ k ][ 1 ] = std::max( ranges[ k ][ 1 ], values[ k ] );
+            }
+        }
+        raw_skew.add( (double)( raw[ 1 ] - raw[ 0 ] ) );
+        fitted_skew.add( (double)( fit[ 1 ] - fit[ 0 ] ) );
+        anchored_skew.add( (double)( anchor[ 1 ] - anchor[ 0 ] ) );
+    }
+
+    printf( "%s, %d devices, cross-device skew median / p99 / max in us:\n", scheduled ?
+        "Timesyncs in rounds every 5 s, slow ones retried" : "Timesyncs every 30 s per device", device_count );
+    printf( "  system timestamps   %7.0f %7.0f %7.0f\n", raw_skew.percentile( 0.5 ), raw_skew.percentile( 0.99 ),
+        raw_skew.percentile( 1.0 ) );
+    printf( "  fitted to timesyncs %7.0f %7.0f %7.0f\n", fitted_skew.percentile( 0.5 ),
+        fitted_skew.percentile( 0.99 ), fitted_skew.percentile( 1.0 ) );
+    printf( "  anchored by edges   %7.0f %7.0f %7.0f\n", anchored_skew.percentile( 0.5 ),
+        anchored_skew.percentile( 0.99 ), anchored_skew.percentile( 1.0 ) );
+
+    clock_alignment_destroy( fitted );
+    clock_alignment_destroy( anchored );
+}
+
+extern "C" int clock_alignment_benchmark_main( void );
+extern "C" int clock_alignment_benchmark_main( void )
+{
+    // Ten minutes of four trackers recording side by side
+    replay_recording( false, 4, 600000000 );
+    replay_recording( true, 4, 600000000 );
+    return 0;
+}
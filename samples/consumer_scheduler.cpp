@@ -0,0 +1,303 @@
+#include "consumer_scheduler.h"
+#include "pump_trace.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static int const max_consumers = 32;
+
+static char const* const worker_names[ CONSUMER_QOS_COUNT ] = { "realtime", "soft realtime consumer", "bulk consumer" };
+
+struct consumer_worker_t;
+
+struct consumer_entry_t
+{
+    consumer_qos_t qos;
+    consumer_handler_t handler;
+    void* user_data;
+    consumer_worker_t* worker; // NULL for realtime consumers
+
+    // Ring of queued records, guarded by the worker mutex
+    int capacity;
+    std::vector<uint8_t> records;
+    std::vector<int64_t> published_ns;
+    uint64_t read;
+    uint64_t write;
+
+    // Records taken out of the ring, owned by the worker so the consumer runs without the lock
+    std::vector<uint8_t> batch;
+    std::vector<int64_t> batch_published_ns;
+};
+
+// A soft realtime consumer has a worker of its own, while all bulk consumers share one.
+struct consumer_worker_t
+{
+    consumer_scheduler_t* scheduler;
+    consumer_qos_t qos;
+
+    std::mutex mutex; // Guards the rings of the consumers and the fields below, never held while consumers run
+    std::condition_variable cv;
+    consumer_entry_t* consumers[ max_consumers ];
+    int consumer_count;
+    int pending; // Records published since the worker last took them
+    bool sleeping;
+    bool exit_event;
+    std::thread thread;
+};
+
+struct consumer_class_t
+{
+    int64_t deadline_ns;
+    std::atomic<uint64_t> delivered;
+    std::atomic<uint64_t> deadline_misses;
+    std::atomic<uint64_t> dropped;
+    std::atomic<int64_t> worst_latency_ns;
+};
+
+struct consumer_scheduler_t
+{
+    size_t record_size;
+    int bulk_batch_size;
+    std::chrono::microseconds bulk_interval;
+
+    consumer_entry_t* consumers[ max_consumers ];
+    int consumer_count;
+    consumer_entry_t* realtime[ max_consumers ];
+    int realtime_count;
+    consumer_worker_t* workers[ max_consumers ];
+    int worker_count;
+    consumer_worker_t* bulk_worker;
+
+    consumer_class_t classes[ CONSUMER_QOS_COUNT ];
+};
+
+static int64_t now_ns( void )
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void account( consumer_class_t& qos_class, int64_t const* published_ns, int count, int64_t returned_ns )
+{
+    uint64_t misses = 0;
+    int64_t worst = 0;
+    for( int i = 0; i < count; ++i )
+    {
+        int64_t latency = returned_ns - published_ns[ i ];
+        if( latency > qos_class.deadline_ns ) ++misses;
+        if( latency > worst ) worst = latency;
+    }
+
+    qos_class.delivered.fetch_add( (uint64_t) count, std::memory_order_relaxed );
+    if( misses ) qos_class.deadline_misses.fetch_add( misses, std::memory_order_relaxed );
+    int64_t previous = qos_class.worst_latency_ns.load( std::memory_order_relaxed );
+    while( worst > previous &&
+        !qos_class.worst_latency_ns.compare_exchange_weak( previous, worst, std::memory_order_relaxed ) ) {}
+}
+
+// Moves the queued records of *consumer* into its batch, oldest first, and returns how many there were.
+static int take_records( consumer_entry_t* consumer, size_t record_size )
+{
+    int count = (int) ( consumer->write - consumer->read );
+    for( int i = 0; i < count; ++i )
+    {
+        int slot = (int) ( ( consumer->read + i ) % consumer->capacity );
+        memcpy( consumer->batch.data() + i * record_size, consumer->records.data() + slot * record_size,
+            record_size );
+        consumer->batch_published_ns[ i ] = consumer->published_ns[ slot ];
+    }
+    consumer->read = consumer->write;
+    return count;
+}
+
+static void consumer_worker( consumer_worker_t* worker )
+{
+    consumer_scheduler_t* scheduler = worker->scheduler;
+    consumer_class_t& qos_class = scheduler->classes[ worker->qos ];
+    bool bulk = worker->qos == CONSUMER_QOS_BULK;
+    PUMP_TRACE_THREAD_NAME( worker_names[ worker->qos ] );
+
+    int counts[ max_consumers ];
+    for( ;; )
+    {
+        int consumer_count;
+        {
+            std::unique_lock<std::mutex> lock( worker->mutex );
+            worker->sleeping = true;
+            if( bulk )
+            {
+                // Woken by the pump once a batch is full, or by the interval running out on a slow stream
+                worker->cv.wait_for( lock, scheduler->bulk_interval,
+                    [&] { return worker->pending >= scheduler->bulk_batch_size || worker->exit_event; } );
+            }
+            else
+            {
+                worker->cv.wait( lock, [&] { return worker->pending > 0 || worker->exit_event; } );
+            }
+            worker->sleeping = false;
+            if( worker->exit_event && worker->pending == 0 ) return;
+            if( worker->pending == 0 ) continue;
+
+            consumer_count = worker->consumer_count;
+            for( int i = 0; i < consumer_count; ++i )
+                counts[ i ] = take_records( worker->consumers[ i ], scheduler->record_size );
+            worker->pending = 0;
+        }
+
+        for( int i = 0; i < consumer_count; ++i )
+        {
+            if( counts[ i ] == 0 ) continue;
+            consumer_entry_t* consumer = worker->consumers[ i ];
+            {
+                PUMP_TRACE_SPAN( worker_names[ worker->qos ] );
+                consumer->handler( consumer->batch.data(), counts[ i ], consumer->user_data );
+            }
+            account( qos_class, consumer->batch_published_ns.data(), counts[ i ], now_ns() );
+        }
+    }
+}
+
+static consumer_worker_t* start_worker( consumer_scheduler_t* scheduler, consumer_qos_t qos )
+{
+    auto worker = new consumer_worker_t();
+    worker->scheduler = scheduler;
+    worker->qos = qos;
+    worker->thread = std::thread( consumer_worker, worker );
+    scheduler->workers[ scheduler->worker_count++ ] = worker;
+    return worker;
+}
+
+consumer_scheduler_t* consumer_scheduler_create( size_t record_size, int64_t const deadlines_us[ CONSUMER_QOS_COUNT ],
+    int bulk_batch_size, int64_t bulk_interval_us )
+{
+    auto scheduler = new consumer_scheduler_t();
+    scheduler->record_size = record_size;
+    scheduler->bulk_batch_size = bulk_batch_size > 0 ? bulk_batch_size : 1;
+    scheduler->bulk_interval = std::chrono::microseconds( bulk_interval_us );
+    for( int qos = 0; qos < CONSUMER_QOS_COUNT; ++qos )
+        scheduler->classes[ qos ].deadline_ns = deadlines_us[ qos ] * 1000;
+    return scheduler;
+}
+
+void consumer_scheduler_destroy( consumer_scheduler_t* scheduler )
+{
+    for( int i = 0; i < scheduler->worker_count; ++i )
+    {
+        consumer_worker_t* worker = scheduler->workers[ i ];
+        {
+            std::lock_guard<std::mutex> lock( worker->mutex );
+            worker->exit_event = true;
+        }
+        worker->cv.notify_all();
+        worker->thread.join();
+        delete worker;
+    }
+    for( int i = 0; i < scheduler->consumer_count; ++i ) delete scheduler->consumers[ i ];
+    delete scheduler;
+}
+
+int consumer_scheduler_add_consumer( consumer_scheduler_t* scheduler, consumer_qos_t qos, consumer_handler_t handler,
+    void* user_data, int queue_capacity )
+{
+    if( scheduler->consumer_count >= max_consumers || (int) qos < 0 || qos >= CONSUMER_QOS_COUNT ) return 0;
+    if( qos != CONSUMER_QOS_REALTIME && queue_capacity <= 0 ) return 0;
+
+    auto consumer = new consumer_entry_t();
+    consumer->qos = qos;
+    consumer->handler = handler;
+    consumer->user_data = user_data;
+    scheduler->consumers[ scheduler->consumer_count++ ] = consumer;
+    if( qos == CONSUMER_QOS_REALTIME )
+    {
+        scheduler->realtime[ scheduler->realtime_count++ ] = consumer;
+        return 1;
+    }
+
+    consumer->capacity = queue_capacity;
+    consumer->records.resize( queue_capacity * scheduler->record_size );
+    consumer->published_ns.resize( queue_capacity );
+    consumer->batch.resize( queue_capacity * scheduler->record_size );
+    consumer->batch_published_ns.resize( queue_capacity );
+
+    if( qos == CONSUMER_QOS_BULK )
+    {
+        if( !scheduler->bulk_worker ) scheduler->bulk_worker = start_worker( scheduler, qos );
+        consumer->worker = scheduler->bulk_worker;
+    }
+    else
+    {
+        consumer->worker = start_worker( scheduler, qos );
+    }
+
+    // The worker is already running, and reads its consumers under the lock
+    std::lock_guard<std::mutex> lock( consumer->worker->mutex );
+    consumer->worker->consumers[ consumer->worker->consumer_count++ ] = consumer;
+    return 1;
+}
+
+void consumer_scheduler_publish( consumer_scheduler_t* scheduler, void const* record )
+{
+    int64_t published = now_ns();
+
+    // Realtime consumers first, so nothing else done with the record adds to their latency
+    consumer_class_t& realtime_class = scheduler->classes[ CONSUMER_QOS_REALTIME ];
+    for( int i = 0; i < scheduler->realtime_count; ++i )
+    {
+        consumer_entry_t* consumer = scheduler->realtime[ i ];
+        consumer->handler( record, 1, consumer->user_data );
+        account( realtime_class, &published, 1, now_ns() );
+    }
+
+    size_t record_size = scheduler->record_size;
+    for( int i = 0; i < scheduler->worker_count; ++i )
+    {
+        consumer_worker_t* worker = scheduler->workers[ i ];
+        uint64_t dropped = 0;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock( worker->mutex );
+            for( int j = 0; j < worker->consumer_count; ++j )
+            {
+                // A full queue drops its oldest record rather than making the pump thread wait
+                consumer_entry_t* consumer = worker->consumers[ j ];
+                if( consumer->write - consumer->read == (uint64_t) consumer->capacity )
+                {
+                    ++consumer->read;
+                    ++dropped;
+                }
+                int slot = (int) ( consumer->write++ % consumer->capacity );
+                memcpy( consumer->records.data() + slot * record_size, record, record_size );
+                consumer->published_ns[ slot ] = published;
+            }
+            ++worker->pending;
+            int wake_at = worker->qos == CONSUMER_QOS_BULK ? scheduler->bulk_batch_size : 1;
+            wake = worker->sleeping && worker->pending == wake_at;
+        }
+        if( wake ) worker->cv.notify_one();
+        if( dropped ) scheduler->classes[ worker->qos ].dropped.fetch_add( dropped, std::memory_order_relaxed );
+    }
+}
+
+void consumer_scheduler_gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    consumer_scheduler_publish( static_cast<consumer_scheduler_t*>( user_data ), gaze_point );
+}
+
+void consumer_scheduler_statistics( consumer_scheduler_t const* scheduler,
+    consumer_scheduler_class_statistics_t statistics[ CONSUMER_QOS_COUNT ] )
+{
+    for( int qos = 0; qos < CONSUMER_QOS_COUNT; ++qos )
+    {
+        consumer_class_t const& qos_class = scheduler->classes[ qos ];
+        statistics[ qos ].delivered = qos_class.delivered.load( std::memory_order_relaxed );
+        statistics[ qos ].deadline_misses = qos_class.deadline_misses.load( std::memory_order_relaxed );
+        statistics[ qos ].dropped = qos_class.dropped.load( std::memory_order_relaxed );
+        statistics[ qos ].worst_latency_us = qos_class.worst_latency_ns.load( std::memory_order_relaxed ) / 1000;
+    }
+}
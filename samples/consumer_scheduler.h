@@ -0,0 +1,73 @@
+#ifndef sample_consumer_scheduler_h
+#define sample_consumer_scheduler_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fans one stream out to several consumers, without letting a slow consumer delay the others. A plain callback calls
+// every consumer in turn on the pump thread, so a cursor subscribed after an analytics consumer only moves once the
+// analytics are done with the sample. Here each consumer is registered with a quality of service class instead:
+//
+//  - Realtime consumers are called inline on the pump thread, before anything else is done with the sample. They
+//    must be as cheap as any other callback.
+//  - Soft realtime consumers each get a thread of their own, which is woken for every sample.
+//  - Bulk consumers share a single worker thread, which hands them the samples in batches, so waking it is paid once
+//    per batch rather than once per sample.
+//
+// Deferred consumers are fed through a bounded queue each. The pump thread never waits for a consumer: when a queue is
+// full, the oldest sample in it is dropped and counted. Every sample has a deadline per class, counted from the moment
+// it is published to the moment its consumer returns, and samples delivered late are counted as deadline misses.
+
+typedef enum consumer_qos_t
+{
+    CONSUMER_QOS_REALTIME,
+    CONSUMER_QOS_SOFT_REALTIME,
+    CONSUMER_QOS_BULK,
+    CONSUMER_QOS_COUNT,
+} consumer_qos_t;
+
+typedef struct consumer_scheduler_t consumer_scheduler_t;
+
+// Called with *count* records in the order they were published. Realtime consumers get one record at a time, deferred
+// consumers everything queued for them since they last ran. Deferred consumers run on a worker thread, outside of any
+// callback, and may call API functions.
+typedef void ( *consumer_handler_t )( void const* records, int count, void* user_data );
+
+typedef struct consumer_scheduler_class_statistics_t
+{
+    uint64_t delivered; // Records handed to consumers of the class
+    uint64_t deadline_misses; // Records delivered after their deadline
+    uint64_t dropped; // Records dropped from full queues
+    int64_t worst_latency_us; // From publishing to the consumer returning
+} consumer_scheduler_class_statistics_t;
+
+// Records are copied, *record_size* bytes at a time. *deadlines_us* holds the deadline of each class, and
+// *bulk_batch_size* is how many records the bulk worker waits for before it is woken; it also runs once
+// *bulk_interval_us* has passed since its last batch, so a slow stream is not held back indefinitely.
+consumer_scheduler_t* consumer_scheduler_create( size_t record_size, int64_t const deadlines_us[ CONSUMER_QOS_COUNT ],
+    int bulk_batch_size, int64_t bulk_interval_us );
+
+// Stops the worker threads after they have delivered what is queued.
+void consumer_scheduler_destroy( consumer_scheduler_t* scheduler );
+
+// Consumers must be added before records are published. *queue_capacity* is the number of records the queue of a
+// deferred consumer holds, and is ignored for realtime consumers. Returns 0 if there are too many consumers, or the
+// capacity is not positive.
+int consumer_scheduler_add_consumer( consumer_scheduler_t* scheduler, consumer_qos_t qos, consumer_handler_t handler,
+    void* user_data, int queue_capacity );
+
+// Calls the realtime consumers, then queues the record for the others. Must be called from one thread at a time,
+// normally the pump thread.
+void consumer_scheduler_publish( consumer_scheduler_t* scheduler, void const* record );
+
+// Publishes a gaze point; can be used as a tobii_gaze_point_callback_t for a scheduler of tobii_gaze_point_t records.
+void consumer_scheduler_gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data );
+
+// Safe to call from any thread.
+void consumer_scheduler_statistics( consumer_scheduler_t const* scheduler,
+    consumer_scheduler_class_statistics_t statistics[ CONSUMER_QOS_COUNT ] );
+
+#endif // sample_consumer_scheduler_h
@@ -0,0 +1,288 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "consumer_scheduler.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+// Realtime: the cursor only keeps the latest point, and is read back by the pump thread it runs on
+struct cursor_t
+{
+    tobii_gaze_point_t latest;
+    int64_t last_print_us;
+};
+
+static void move_cursor( void const* records, int count, void* user_data )
+{
+    cursor_t* cursor = (cursor_t*) user_data;
+    tobii_gaze_point_t const* gaze_point = (tobii_gaze_point_t const*) records;
+    if( gaze_point[ count - 1 ].validity == TOBII_VALIDITY_VALID ) cursor->latest = gaze_point[ count - 1 ];
+}
+
+// Soft realtime: reports when the gaze has stayed within a small radius for a while
+struct dwell_t
+{
+    float anchor_xy[ 2 ];
+    int64_t anchor_us;
+    bool reported;
+};
+
+static void detect_dwell( void const* records, int count, void* user_data )
+{
+    dwell_t* dwell = (dwell_t*) user_data;
+    tobii_gaze_point_t const* gaze_points = (tobii_gaze_point_t const*) records;
+    for( int i = 0; i < count; ++i )
+    {
+        tobii_gaze_point_t const& gaze_point = gaze_points[ i ];
+        if( gaze_point.validity != TOBII_VALIDITY_VALID ) continue;
+        float dx = gaze_point.position_xy[ 0 ] - dwell->anchor_xy[ 0 ];
+        float dy = gaze_point.position_xy[ 1 ] - dwell->anchor_xy[ 1 ];
+        if( dx * dx + dy * dy > 0.03f * 0.03f )
+        {
+            dwell->anchor_xy[ 0 ] = gaze_point.position_xy[ 0 ];
+            dwell->anchor_xy[ 1 ] = gaze_point.position_xy[ 1 ];
+            dwell->anchor_us = gaze_point.timestamp_us;
+            dwell->reported = false;
+        }
+        else if( !dwell->reported && gaze_point.timestamp_us - dwell->anchor_us >= 800000 )
+        {
+            printf( "Dwell at (%.2f, %.2f)\n", dwell->anchor_xy[ 0 ], dwell->anchor_xy[ 1 ] );
+            dwell->reported = true;
+        }
+    }
+}
+
+// Bulk: logs every sample, which may block on the disk without holding up the cursor
+static void log_gaze( void const* records, int count, void* user_data )
+{
+    FILE* log = (FILE*) user_data;
+    tobii_gaze_point_t const* gaze_points = (tobii_gaze_point_t const*) records;
+    for( int i = 0; i < count; ++i )
+        fprintf( log, "%" PRId64 ",%d,%f,%f\n", gaze_points[ i ].timestamp_us, (int) gaze_points[ i ].validity,
+            gaze_points[ i ].position_xy[ 0 ], gaze_points[ i ].position_xy[ 1 ] );
+}
+
+static void print_cursor( void* user_data )
+{
+    cursor_t* cursor = (cursor_t*) user_data;
+    if( cursor->latest.timestamp_us - cursor->last_print_us < 500000 ) return;
+    printf( "Cursor at (%.2f, %.2f)\n", cursor->latest.position_xy[ 0 ], cursor->latest.position_xy[ 1 ] );
+    cursor->last_print_us = cursor->latest.timestamp_us;
+}
+
+static void print_statistics( consumer_scheduler_t const* scheduler )
+{
+    static char const* const names[ CONSUMER_QOS_COUNT ] = { "Realtime", "Soft realtime", "Bulk" };
+    consumer_scheduler_class_statistics_t statistics[ CONSUMER_QOS_COUNT ];
+    consumer_scheduler_statistics( scheduler, statistics );
+    for( int qos = 0; qos < CONSUMER_QOS_COUNT; ++qos )
+        printf( "%-13s %8" PRIu64 " delivered, %6" PRIu64 " deadline misses, %6" PRIu64 " dropped, worst %" PRId64
+            " us\n", names[ qos ], statistics[ qos ].delivered, statistics[ qos ].deadline_misses,
+            statistics[ qos ].dropped, statistics[ qos ].worst_latency_us );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int consumer_scheduler_sample_main( void );
+extern "C" int consumer_scheduler_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    FILE* log = fopen( "gaze_log.csv", "w" );
+    if( !log )
+    {
+        fprintf( stderr, "Failed to open gaze_log.csv.\n" );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // The cursor has to move within a frame, the dwell detector within a few, and the log only has to keep up
+    int64_t const deadlines_us[ CONSUMER_QOS_COUNT ] = { 200, 10000, 1000000 };
+    consumer_scheduler_t* scheduler = consumer_scheduler_create( sizeof( tobii_gaze_point_t ), deadlines_us, 64,
+        100000 );
+    cursor_t cursor = {};
+    dwell_t dwell = {};
+    consumer_scheduler_add_consumer( scheduler, CONSUMER_QOS_REALTIME, move_cursor, &cursor, 0 );
+    consumer_scheduler_add_consumer( scheduler, CONSUMER_QOS_SOFT_REALTIME, detect_dwell, &dwell, 64 );
+    consumer_scheduler_add_consumer( scheduler, CONSUMER_QOS_BULK, log_gaze, log, 4096 );
+
+    error = tobii_gaze_point_subscribe( device, consumer_scheduler_gaze_point_callback, scheduler );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze stream.\n" );
+        consumer_scheduler_destroy( scheduler );
+        fclose( log );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, print_cursor, &cursor );
+
+    error = tobii_gaze_point_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze stream.\n" );
+
+    // Destroying the scheduler lets the log catch up before the file is closed
+    print_statistics( scheduler );
+    consumer_scheduler_destroy( scheduler );
+    fclose( log );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// Stand-in for work that takes *duration*, such as feature extraction for analytics
+static void spin( std::chrono::microseconds duration )
+{
+    auto end = std::chrono::steady_clock::now() + duration;
+    while( std::chrono::steady_clock::now() < end ) {}
+}
+
+struct benchmark_cursor_t
+{
+    std::chrono::steady_clock::time_point arrival; // When the sample was due from the device
+    std::vector<int64_t> latencies_ns;
+};
+
+static void benchmark_cursor( void const* records, int count, void* user_data )
+{
+    (void) records; (void) count; // Unused parameters
+    benchmark_cursor_t* cursor = (benchmark_cursor_t*) user_data;
+    cursor->latencies_ns.push_back( std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - cursor->arrival ).count() );
+}
+
+static void benchmark_soft( void const* records, int count, void* user_data )
+{
+    (void) records; (void) user_data; // Unused parameters
+    spin( std::chrono::microseconds( 20 ) * count );
+}
+
+static std::chrono::microseconds bulk_cost_per_sample;
+
+static void benchmark_bulk( void const* records, int count, void* user_data )
+{
+    (void) records; (void) user_data; // Unused parameters
+    spin( bulk_cost_per_sample * count );
+}
+
+static void print_latencies( char const* name, std::vector<int64_t>& latencies_ns )
+{
+    std::sort( latencies_ns.begin(), latencies_ns.end() );
+    size_t count = latencies_ns.size();
+    printf( "  %-10s cursor latency p50 %8.1f us, p99 %8.1f us, max %8.1f us\n", name,
+        latencies_ns[ count / 2 ] / 1000.0, latencies_ns[ count * 99 / 100 ] / 1000.0, latencies_ns.back() / 1000.0 );
+}
+
+// Feeds *sample_count* gaze points at 1200 Hz, paced like a device, either through the scheduler or by calling every
+// consumer in turn, with the analytics subscribed before the cursor as the pump would call them.
+static void run_stream( consumer_scheduler_t* scheduler, benchmark_cursor_t* cursor, int sample_count )
+{
+    float const frequency_hz = 1200.0f;
+    auto period = std::chrono::nanoseconds( (int64_t) ( 1e9 / frequency_hz ) );
+    auto start = std::chrono::steady_clock::now();
+    for( int i = 0; i < sample_count; ++i )
+    {
+        tobii_gaze_point_t gaze_point;
+        stream_replay_gaze_point( i, frequency_hz, &gaze_point );
+        cursor->arrival = start + period * i;
+        std::this_thread::sleep_until( cursor->arrival );
+        if( scheduler )
+        {
+            consumer_scheduler_gaze_point_callback( &gaze_point, scheduler );
+        }
+        else
+        {
+            benchmark_bulk( &gaze_point, 1, NULL );
+            benchmark_soft( &gaze_point, 1, NULL );
+            benchmark_cursor( &gaze_point, 1, cursor );
+        }
+    }
+}
+
+extern "C" int consumer_scheduler_benchmark_main( void );
+extern "C" int consumer_scheduler_benchmark_main( void )
+{
+    int const sample_count = 2400;
+    int64_t const deadlines_us[ CONSUMER_QOS_COUNT ] = { 100, 2000, 200000 };
+    int const bulk_costs_us[] = { 250, 1000 };
+
+    printf( "%d gaze points at 1200 Hz; realtime cursor, soft realtime consumer at 20 us per sample\n",
+        sample_count );
+    for( int bulk_cost_us : bulk_costs_us )
+    {
+        bulk_cost_per_sample = std::chrono::microseconds( bulk_cost_us );
+        printf( "Bulk consumer at %d us per sample (%.0f%% of the stream period)\n", bulk_cost_us,
+            bulk_cost_us * 1200 / 1e4 );
+
+        // Synchronous: the cursor waits for the analytics on every sample, and falls behind with them
+        benchmark_cursor_t cursor;
+        cursor.latencies_ns.reserve( sample_count );
+        run_stream( NULL, &cursor, sample_count );
+        print_latencies( "inline", cursor.latencies_ns );
+
+        cursor.latencies_ns.clear();
+        consumer_scheduler_t* scheduler = consumer_scheduler_create( sizeof( tobii_gaze_point_t ), deadlines_us, 64,
+            50000 );
+        consumer_scheduler_add_consumer( scheduler, CONSUMER_QOS_BULK, benchmark_bulk, NULL, 256 );
+        consumer_scheduler_add_consumer( scheduler, CONSUMER_QOS_SOFT_REALTIME, benchmark_soft, NULL, 64 );
+        consumer_scheduler_add_consumer( scheduler, CONSUMER_QOS_REALTIME, benchmark_cursor, &cursor, 0 );
+        run_stream( scheduler, &cursor, sample_count );
+        print_latencies( "scheduled", cursor.latencies_ns );
+        print_statistics( scheduler );
+        consumer_scheduler_destroy( scheduler );
+    }
+
+    return 0;
+}
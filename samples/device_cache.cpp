@@ -0,0 +1,374 @@
+#include "device_cache.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+static tobii_capability_t const capabilities[] = {
+    TOBII_CAPABILITY_DISPLAY_AREA_WRITABLE,
+    TOBII_CAPABILITY_CALIBRATION_2D,
+    TOBII_CAPABILITY_CALIBRATION_3D,
+    TOBII_CAPABILITY_PERSISTENT_STORAGE,
+    TOBII_CAPABILITY_CALIBRATION_PER_EYE,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_3D_GAZE_COMBINED,
+    TOBII_CAPABILITY_FACE_TYPE,
+    TOBII_CAPABILITY_COMPOUND_STREAM_USER_POSITION_GUIDE_XY,
+    TOBII_CAPABILITY_COMPOUND_STREAM_USER_POSITION_GUIDE_Z,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_LIMITED_IMAGE,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_PUPIL_DIAMETER,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_PUPIL_POSITION,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_EYE_OPENNESS,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_3D_GAZE_PER_EYE,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_USER_POSITION_GUIDE_XY,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_TRACKING_IMPROVEMENTS,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_CONVERGENCE_DISTANCE,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_IMPROVE_USER_POSITION_HMD,
+    TOBII_CAPABILITY_COMPOUND_STREAM_WEARABLE_INCREASE_EYE_RELIEF,
+};
+
+static tobii_stream_t const streams[] = {
+    TOBII_STREAM_GAZE_POINT,
+    TOBII_STREAM_GAZE_ORIGIN,
+    TOBII_STREAM_EYE_POSITION_NORMALIZED,
+    TOBII_STREAM_USER_PRESENCE,
+    TOBII_STREAM_HEAD_POSE,
+    TOBII_STREAM_WEARABLE,
+    TOBII_STREAM_GAZE_DATA,
+    TOBII_STREAM_DIGITAL_SYNCPORT,
+    TOBII_STREAM_DIAGNOSTICS_IMAGE,
+    TOBII_STREAM_USER_POSITION_GUIDE,
+    TOBII_STREAM_WEARABLE_CONSUMER,
+    TOBII_STREAM_WEARABLE_ADVANCED,
+    TOBII_STREAM_WEARABLE_FOVEATED_GAZE,
+};
+
+static tobii_state_t const bool_states[] = {
+    TOBII_STATE_POWER_SAVE_ACTIVE,
+    TOBII_STATE_REMOTE_WAKE_ACTIVE,
+    TOBII_STATE_DEVICE_PAUSED,
+    TOBII_STATE_EXCLUSIVE_MODE,
+    TOBII_STATE_CALIBRATION_ACTIVE,
+};
+
+static tobii_notification_type_t const handled_notifications[] = {
+    TOBII_NOTIFICATION_TYPE_CALIBRATION_STATE_CHANGED,
+    TOBII_NOTIFICATION_TYPE_EXCLUSIVE_MODE_STATE_CHANGED,
+    TOBII_NOTIFICATION_TYPE_TRACK_BOX_CHANGED,
+    TOBII_NOTIFICATION_TYPE_POWER_SAVE_STATE_CHANGED,
+    TOBII_NOTIFICATION_TYPE_DEVICE_PAUSED_STATE_CHANGED,
+    TOBII_NOTIFICATION_TYPE_CALIBRATION_ID_CHANGED,
+    TOBII_NOTIFICATION_TYPE_FAULTS_CHANGED,
+    TOBII_NOTIFICATION_TYPE_WARNINGS_CHANGED,
+};
+
+struct device_cache_t
+{
+    tobii_device_t* device;
+
+    std::atomic<device_cache_snapshot_t*> current;
+    std::atomic<uint32_t> epoch; // Its lowest bit selects the counter new readers use
+
+    // On separate cache lines, as every reader writes to one of them
+    alignas( 64 ) std::atomic<int64_t> readers_even;
+    alignas( 64 ) std::atomic<int64_t> readers_odd;
+
+    std::mutex write_mutex; // Serializes replacing the snapshot, never taken by readers
+};
+
+static bool is_bool_state( tobii_state_t state )
+{
+    for( tobii_state_t bool_state : bool_states )
+    {
+        if( bool_state == state ) return true;
+    }
+    return false;
+}
+
+static std::atomic<int64_t>& readers( device_cache_t* cache, int parity )
+{
+    return parity ? cache->readers_odd : cache->readers_even;
+}
+
+static void wait_for_readers( device_cache_t* cache )
+{
+    // Every reader that can still hold the old snapshot started its read section before the swap. Flip the counter
+    // new readers use and wait for the old one to drain, twice, so both counters have been seen empty since the swap.
+    // Readers never wait for this, and new readers cannot keep a counter from draining.
+    for( int flip = 0; flip < 2; ++flip )
+    {
+        uint32_t old_parity = cache->epoch.fetch_add( 1 ) & 1;
+        while( readers( cache, (int) old_parity ).load() != 0 ) std::this_thread::yield();
+    }
+}
+
+// Publishes *snapshot*, which must have been allocated with new, and frees the one it replaces. Called with the write
+// mutex held.
+static void publish( device_cache_t* cache, device_cache_snapshot_t* snapshot )
+{
+    device_cache_snapshot_t* old = cache->current.exchange( snapshot );
+    wait_for_readers( cache );
+    delete old;
+}
+
+static void read_state_bool( tobii_device_t* device, tobii_state_t state, device_cache_snapshot_t* snapshot )
+{
+    tobii_state_bool_t value;
+    if( tobii_get_state_bool( device, state, &value ) == TOBII_ERROR_NO_ERROR )
+    {
+        snapshot->state_bool[ state ] = value;
+        snapshot->states_known |= 1u << state;
+    }
+    else
+    {
+        snapshot->states_known &= ~( 1u << state );
+    }
+}
+
+static void read_state_string( tobii_device_t* device, tobii_state_t state, tobii_state_string_t value,
+    device_cache_snapshot_t* snapshot )
+{
+    if( tobii_get_state_string( device, state, value ) == TOBII_ERROR_NO_ERROR )
+        snapshot->states_known |= 1u << state;
+    else
+        snapshot->states_known &= ~( 1u << state );
+}
+
+static void read_track_box( tobii_device_t* device, device_cache_snapshot_t* snapshot )
+{
+    snapshot->has_track_box = tobii_get_track_box( device, &snapshot->track_box ) == TOBII_ERROR_NO_ERROR;
+}
+
+static void notification_handler( tobii_device_t* device, tobii_notification_t const* notification,
+    uint32_t coalesced_count, void* user_data )
+{
+    (void) device; // Unused parameter, the cache has its own
+    (void) coalesced_count; // Unused parameter, only the latest state matters
+    device_cache_push_notification( static_cast<device_cache_t*>( user_data ), notification );
+}
+
+device_cache_t* device_cache_create( tobii_device_t* device )
+{
+    auto cache = new device_cache_t();
+    cache->device = device;
+    cache->current = new device_cache_snapshot_t();
+    return cache;
+}
+
+void device_cache_destroy( device_cache_t* cache )
+{
+    delete cache->current.load();
+    delete cache;
+}
+
+tobii_error_t device_cache_refresh( device_cache_t* cache )
+{
+    if( !cache->device ) return TOBII_ERROR_NO_ERROR;
+
+    std::lock_guard<std::mutex> lock( cache->write_mutex );
+    auto snapshot = new device_cache_snapshot_t();
+    snapshot->version = cache->current.load()->version + 1;
+    snapshot->refreshed = 1;
+
+    // The device info is the one thing every device has, so failing to read it means the device is not usable
+    tobii_error_t error = tobii_get_device_info( cache->device, &snapshot->device_info );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        delete snapshot;
+        return error;
+    }
+
+    // The rest is left unsupported or unknown where the device does not report it
+    if( tobii_get_feature_group( cache->device, &snapshot->feature_group ) != TOBII_ERROR_NO_ERROR )
+        snapshot->feature_group = TOBII_FEATURE_GROUP_BLOCKED;
+    for( tobii_capability_t capability : capabilities )
+    {
+        tobii_supported_t supported;
+        if( tobii_capability_supported( cache->device, capability, &supported ) == TOBII_ERROR_NO_ERROR &&
+            supported == TOBII_SUPPORTED )
+            snapshot->capabilities |= 1ull << capability;
+    }
+    for( tobii_stream_t stream : streams )
+    {
+        tobii_supported_t supported;
+        if( tobii_stream_supported( cache->device, stream, &supported ) == TOBII_ERROR_NO_ERROR &&
+            supported == TOBII_SUPPORTED )
+            snapshot->streams |= 1ull << stream;
+    }
+    read_track_box( cache->device, snapshot );
+    for( tobii_state_t state : bool_states ) read_state_bool( cache->device, state, snapshot );
+    if( tobii_get_state_uint32( cache->device, TOBII_STATE_CALIBRATION_ID, &snapshot->calibration_id ) ==
+        TOBII_ERROR_NO_ERROR )
+        snapshot->states_known |= 1u << TOBII_STATE_CALIBRATION_ID;
+    read_state_string( cache->device, TOBII_STATE_FAULT, snapshot->faults, snapshot );
+    read_state_string( cache->device, TOBII_STATE_WARNING, snapshot->warnings, snapshot );
+
+    publish( cache, snapshot );
+    return TOBII_ERROR_NO_ERROR;
+}
+
+int device_cache_add_handlers( device_cache_t* cache, notification_dispatcher_t* dispatcher )
+{
+    for( tobii_notification_type_t type : handled_notifications )
+    {
+        if( !notification_dispatcher_add_handler( dispatcher, type, notification_handler, cache ) ) return 0;
+    }
+    return 1;
+}
+
+static void apply_state_bool( device_cache_t* cache, tobii_notification_t const* notification, tobii_state_t state,
+    device_cache_snapshot_t* snapshot )
+{
+    if( notification->value_type == TOBII_NOTIFICATION_VALUE_TYPE_STATE )
+    {
+        snapshot->state_bool[ state ] = notification->value.state;
+        snapshot->states_known |= 1u << state;
+    }
+    else if( cache->device )
+    {
+        read_state_bool( cache->device, state, snapshot );
+    }
+}
+
+static void apply_state_string( device_cache_t* cache, tobii_notification_t const* notification, tobii_state_t state,
+    tobii_state_string_t value, device_cache_snapshot_t* snapshot )
+{
+    if( notification->value_type == TOBII_NOTIFICATION_VALUE_TYPE_STRING )
+    {
+        memcpy( value, notification->value.string_, sizeof( tobii_state_string_t ) );
+        snapshot->states_known |= 1u << state;
+    }
+    else if( cache->device )
+    {
+        read_state_string( cache->device, state, value, snapshot );
+    }
+}
+
+void device_cache_push_notification( device_cache_t* cache, tobii_notification_t const* notification )
+{
+    std::lock_guard<std::mutex> lock( cache->write_mutex );
+    auto snapshot = new device_cache_snapshot_t( *cache->current.load() );
+    ++snapshot->version;
+
+    switch( notification->type )
+    {
+        case TOBII_NOTIFICATION_TYPE_CALIBRATION_STATE_CHANGED:
+            apply_state_bool( cache, notification, TOBII_STATE_CALIBRATION_ACTIVE, snapshot );
+            break;
+        case TOBII_NOTIFICATION_TYPE_EXCLUSIVE_MODE_STATE_CHANGED:
+            apply_state_bool( cache, notification, TOBII_STATE_EXCLUSIVE_MODE, snapshot );
+            break;
+        case TOBII_NOTIFICATION_TYPE_POWER_SAVE_STATE_CHANGED:
+            apply_state_bool( cache, notification, TOBII_STATE_POWER_SAVE_ACTIVE, snapshot );
+            break;
+        case TOBII_NOTIFICATION_TYPE_DEVICE_PAUSED_STATE_CHANGED:
+            apply_state_bool( cache, notification, TOBII_STATE_DEVICE_PAUSED, snapshot );
+            break;
+        case TOBII_NOTIFICATION_TYPE_TRACK_BOX_CHANGED:
+            if( cache->device ) read_track_box( cache->device, snapshot );
+            break;
+        case TOBII_NOTIFICATION_TYPE_CALIBRATION_ID_CHANGED:
+            if( notification->value_type == TOBII_NOTIFICATION_VALUE_TYPE_UINT )
+            {
+                snapshot->calibration_id = notification->value.uint_;
+                snapshot->states_known |= 1u << TOBII_STATE_CALIBRATION_ID;
+            }
+            break;
+        case TOBII_NOTIFICATION_TYPE_FAULTS_CHANGED:
+            apply_state_string( cache, notification, TOBII_STATE_FAULT, snapshot->faults, snapshot );
+            break;
+        case TOBII_NOTIFICATION_TYPE_WARNINGS_CHANGED:
+            apply_state_string( cache, notification, TOBII_STATE_WARNING, snapshot->warnings, snapshot );
+            break;
+        default:
+            // Nothing cached depends on it, so keep the current snapshot
+            delete snapshot;
+            return;
+    }
+
+    publish( cache, snapshot );
+}
+
+device_cache_snapshot_t const* device_cache_read_begin( device_cache_t* cache, device_cache_reader_t* reader )
+{
+    // Counted before the pointer is loaded, so a writer that swapped the pointer before this load waits for us
+    reader->parity = (int)( cache->epoch.load() & 1 );
+    readers( cache, reader->parity ).fetch_add( 1 );
+    return cache->current.load();
+}
+
+void device_cache_read_end( device_cache_t* cache, device_cache_reader_t const* reader )
+{
+    readers( cache, reader->parity ).fetch_sub( 1, std::memory_order_release );
+}
+
+int device_cache_capability_supported( device_cache_t* cache, tobii_capability_t capability )
+{
+    device_cache_reader_t reader;
+    int supported = (int)( ( device_cache_read_begin( cache, &reader )->capabilities >> capability ) & 1 );
+    device_cache_read_end( cache, &reader );
+    return supported;
+}
+
+int device_cache_stream_supported( device_cache_t* cache, tobii_stream_t stream )
+{
+    device_cache_reader_t reader;
+    int supported = (int)( ( device_cache_read_begin( cache, &reader )->streams >> stream ) & 1 );
+    device_cache_read_end( cache, &reader );
+    return supported;
+}
+
+tobii_error_t device_cache_get_state_bool( device_cache_t* cache, tobii_state_t state, tobii_state_bool_t* value )
+{
+    if( !is_bool_state( state ) ) return TOBII_ERROR_INVALID_PARAMETER;
+
+    device_cache_reader_t reader;
+    device_cache_snapshot_t const* snapshot = device_cache_read_begin( cache, &reader );
+    tobii_error_t error = TOBII_ERROR_NOT_SUPPORTED;
+    if( snapshot->states_known & ( 1u << state ) )
+    {
+        *value = snapshot->state_bool[ state ];
+        error = TOBII_ERROR_NO_ERROR;
+    }
+    device_cache_read_end( cache, &reader );
+    return error;
+}
+
+tobii_error_t device_cache_get_device_info( device_cache_t* cache, tobii_device_info_t* device_info )
+{
+    device_cache_reader_t reader;
+    device_cache_snapshot_t const* snapshot = device_cache_read_begin( cache, &reader );
+    tobii_error_t error = snapshot->refreshed ? TOBII_ERROR_NO_ERROR : TOBII_ERROR_NOT_SUPPORTED;
+    if( error == TOBII_ERROR_NO_ERROR ) *device_info = snapshot->device_info;
+    device_cache_read_end( cache, &reader );
+    return error;
+}
+
+tobii_error_t device_cache_get_track_box( device_cache_t* cache, tobii_track_box_t* track_box )
+{
+    device_cache_reader_t reader;
+    device_cache_snapshot_t const* snapshot = device_cache_read_begin( cache, &reader );
+    tobii_error_t error = snapshot->has_track_box ? TOBII_ERROR_NO_ERROR : TOBII_ERROR_NOT_SUPPORTED;
+    if( error == TOBII_ERROR_NO_ERROR ) *track_box = snapshot->track_box;
+    device_cache_read_end( cache, &reader );
+    return error;
+}
+
+tobii_error_t device_cache_get_feature_group( device_cache_t* cache, tobii_feature_group_t* feature_group )
+{
+    device_cache_reader_t reader;
+    device_cache_snapshot_t const* snapshot = device_cache_read_begin( cache, &reader );
+    tobii_error_t error = snapshot->refreshed ? TOBII_ERROR_NO_ERROR : TOBII_ERROR_NOT_SUPPORTED;
+    if( error == TOBII_ERROR_NO_ERROR ) *feature_group = snapshot->feature_group;
+    device_cache_read_end( cache, &reader );
+    return error;
+}
+
+uint64_t device_cache_version( device_cache_t* cache )
+{
+    device_cache_reader_t reader;
+    uint64_t version = device_cache_read_begin( cache, &reader )->version;
+    device_cache_read_end( cache, &reader );
+    return version;
+}
@@ -0,0 +1,88 @@
+#ifndef sample_device_cache_h
+#define sample_device_cache_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "notification_dispatcher.h"
+
+#include <stdint.h>
+
+// The capabilities, supported streams and state of a device, read once at connect and kept up to date from
+// notifications, so any thread can query them without a round trip to the device, and from inside callbacks, where
+// the API functions fail with TOBII_ERROR_CALLBACK_IN_PROGRESS.
+//
+// The cache holds an immutable snapshot, which is replaced as a whole whenever anything changes: the new snapshot is
+// a modified copy of the old one, published by swapping a pointer, read-copy-update style. Readers mark a read section
+// on one of two counters, and a replaced snapshot is freed only once both counters have drained, so reading never
+// blocks or copies, and a snapshot stays valid until the read section ends. Replacing waits for the readers, so keep
+// read sections short.
+//
+// State changes carried by a notification are applied from its value, and others, such as a changed track box, are
+// read from the device. Notifications are applied by the handlers added to a notification dispatcher, which run on its
+// worker thread, outside of any callback.
+
+typedef struct device_cache_t device_cache_t;
+
+typedef struct device_cache_snapshot_t
+{
+    uint64_t version; // Incremented by every change
+    int refreshed; // Nonzero once everything has been read from the device
+    tobii_device_info_t device_info;
+    tobii_feature_group_t feature_group;
+    uint64_t capabilities; // Bit n set if capability n is supported
+    uint64_t streams; // Bit n set if stream n is supported
+    int has_track_box;
+    tobii_track_box_t track_box;
+    uint32_t states_known; // Bit n set if state n is known
+    tobii_state_bool_t state_bool[ 8 ]; // Indexed by tobii_state_t, for the boolean states
+    uint32_t calibration_id;
+    tobii_state_string_t faults;
+    tobii_state_string_t warnings;
+} device_cache_snapshot_t;
+
+typedef struct device_cache_reader_t
+{
+    int parity;
+} device_cache_reader_t;
+
+// A NULL *device* creates a cache that is only changed by device_cache_push_notification, such as when replaying.
+device_cache_t* device_cache_create( tobii_device_t* device );
+
+// The handlers of the dispatcher must not run any more, so destroy the dispatcher first.
+void device_cache_destroy( device_cache_t* cache );
+
+// Reads everything from the device into a new snapshot. Call it after connecting, and after reconnecting, as the
+// notifications in between are lost. Must not be called from inside a callback.
+tobii_error_t device_cache_refresh( device_cache_t* cache );
+
+// Adds the handlers that keep the cache up to date. Returns 0 if the dispatcher has too many handlers.
+int device_cache_add_handlers( device_cache_t* cache, notification_dispatcher_t* dispatcher );
+
+// Applies a notification. This is what the handlers call. Must not be called from inside a callback.
+void device_cache_push_notification( device_cache_t* cache, tobii_notification_t const* notification );
+
+// Starts a read section, returning the current snapshot, which stays valid until device_cache_read_end. Safe to call
+// from any thread, including from inside callbacks.
+device_cache_snapshot_t const* device_cache_read_begin( device_cache_t* cache, device_cache_reader_t* reader );
+
+void device_cache_read_end( device_cache_t* cache, device_cache_reader_t const* reader );
+
+// Single queries, each in its own read section, mirroring the API functions of the same names. Capabilities and
+// streams the device did not report are not supported, and the others return TOBII_ERROR_NOT_SUPPORTED for anything
+// the device did not report.
+int device_cache_capability_supported( device_cache_t* cache, tobii_capability_t capability );
+
+int device_cache_stream_supported( device_cache_t* cache, tobii_stream_t stream );
+
+tobii_error_t device_cache_get_state_bool( device_cache_t* cache, tobii_state_t state, tobii_state_bool_t* value );
+
+tobii_error_t device_cache_get_device_info( device_cache_t* cache, tobii_device_info_t* device_info );
+
+tobii_error_t device_cache_get_track_box( device_cache_t* cache, tobii_track_box_t* track_box );
+
+tobii_error_t device_cache_get_feature_group( device_cache_t* cache, tobii_feature_group_t* feature_group );
+
+uint64_t device_cache_version( device_cache_t* cache );
+
+#endif // sample_device_cache_h
@@ -0,0 +1,254 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "device_cache.h"
+#include "main_loop_linux.h"
+#include "notification_dispatcher.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+struct cache_context_t
+{
+    device_cache_t* cache;
+    uint64_t printed_version;
+    int64_t paused_samples;
+};
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    (void) gaze_point; // Unused parameter
+    // tobii_get_state_bool would fail here with TOBII_ERROR_CALLBACK_IN_PROGRESS, the cache can be read anywhere
+    auto context = static_cast<cache_context_t*>( user_data );
+    tobii_state_bool_t paused;
+    if( device_cache_get_state_bool( context->cache, TOBII_STATE_DEVICE_PAUSED, &paused ) == TOBII_ERROR_NO_ERROR &&
+        paused == TOBII_STATE_BOOL_TRUE )
+        ++context->paused_samples;
+}
+
+static void print_changes( void* user_data )
+{
+    auto context = static_cast<cache_context_t*>( user_data );
+    device_cache_reader_t reader;
+    device_cache_snapshot_t const* snapshot = device_cache_read_begin( context->cache, &reader );
+    if( snapshot->version != context->printed_version )
+    {
+        context->printed_version = snapshot->version;
+        printf( "Version %" PRIu64 ": calibration %s, exclusive mode %s, paused %s, faults '%s', warnings '%s'\n",
+            snapshot->version, snapshot->state_bool[ TOBII_STATE_CALIBRATION_ACTIVE ] ? "active" : "inactive",
+            snapshot->state_bool[ TOBII_STATE_EXCLUSIVE_MODE ] ? "on" : "off",
+            snapshot->state_bool[ TOBII_STATE_DEVICE_PAUSED ] ? "yes" : "no", snapshot->faults, snapshot->warnings );
+    }
+    device_cache_read_end( context->cache, &reader );
+}
+
+static double query_ns( int count, tobii_device_t* device, device_cache_t* cache, bool cached )
+{
+    int supported = 0;
+    auto start = std::chrono::steady_clock::now();
+    for( int i = 0; i < count; ++i )
+    {
+        if( cached )
+        {
+            supported += device_cache_capability_supported( cache, TOBII_CAPABILITY_CALIBRATION_3D );
+        }
+        else
+        {
+            tobii_supported_t value;
+            if( tobii_capability_supported( device, TOBII_CAPABILITY_CALIBRATION_3D, &value ) == TOBII_ERROR_NO_ERROR )
+                supported += value == TOBII_SUPPORTED;
+        }
+    }
+    double elapsed_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+    if( supported != 0 && supported != count ) fprintf( stderr, "Capability changed while querying.\n" );
+    return elapsed_ns / count;
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int device_cache_sample_main( void );
+extern "C" int device_cache_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // Subscribe to notifications before reading everything, so no change can fall between the two
+    cache_context_t context = { device_cache_create( device ), 0, 0 };
+    notification_dispatcher_t* dispatcher = notification_dispatcher_create( device, 20000 );
+    device_cache_add_handlers( context.cache, dispatcher );
+    error = notification_dispatcher_subscribe( dispatcher );
+    auto start = std::chrono::steady_clock::now();
+    if( error == TOBII_ERROR_NO_ERROR ) error = device_cache_refresh( context.cache );
+    double refresh_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    if( error == TOBII_ERROR_NO_ERROR )
+        error = tobii_gaze_point_subscribe( device, gaze_point_callback, &context );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to set up the device cache: %s.\n", tobii_error_message( error ) );
+        notification_dispatcher_destroy( dispatcher );
+        device_cache_destroy( context.cache );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // What the cache costs at connect, and what a query costs with and without it
+    printf( "Reading everything at connect took %.2f ms\n", refresh_ms );
+    printf( "tobii_capability_supported: %.0f ns, cached: %.1f ns\n", query_ns( 1000, device, context.cache, false ),
+        query_ns( 1000000, device, context.cache, true ) );
+
+    main_loop( device, print_changes, &context );
+    printf( "%" PRId64 " gaze points while the device was paused\n", context.paused_samples );
+
+    error = tobii_gaze_point_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze stream.\n" );
+
+    // The dispatcher goes first, so none of the cache handlers can run once the cache is gone
+    notification_dispatcher_destroy( dispatcher );
+    device_cache_destroy( context.cache );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+struct reader_result_t
+{
+    int64_t reads;
+    int64_t torn; // Snapshots that changed during a read section, which would mean one was freed too early
+};
+
+static void reader_thread( device_cache_t* cache, std::atomic<bool>* running, reader_result_t* result )
+{
+    while( *running )
+    {
+        // Every published snapshot carries its version in the faults string, and must not change while it is read
+        device_cache_reader_t reader;
+        device_cache_snapshot_t const* snapshot = device_cache_read_begin( cache, &reader );
+        uint64_t version = snapshot->version;
+        uint64_t faults = strtoull( snapshot->faults, NULL, 10 );
+        if( snapshot->version != version || faults != version ) ++result->torn;
+        device_cache_read_end( cache, &reader );
+        ++result->reads;
+    }
+}
+
+static void push_faults( device_cache_t* cache, uint64_t version )
+{
+    tobii_notification_t notification = {};
+    notification.type = TOBII_NOTIFICATION_TYPE_FAULTS_CHANGED;
+    notification.value_type = TOBII_NOTIFICATION_VALUE_TYPE_STRING;
+    snprintf( notification.value.string_, sizeof( notification.value.string_ ), "%" PRIu64, version );
+    device_cache_push_notification( cache, &notification );
+}
+
+extern "C" int device_cache_benchmark_main( void );
+extern "C" int device_cache_benchmark_main( void )
+{
+    device_cache_t* cache = device_cache_create( NULL );
+    tobii_notification_t paused = {};
+    paused.type = TOBII_NOTIFICATION_TYPE_DEVICE_PAUSED_STATE_CHANGED;
+    paused.value_type = TOBII_NOTIFICATION_VALUE_TYPE_STATE;
+    paused.value.state = TOBII_STATE_BOOL_FALSE;
+    device_cache_push_notification( cache, &paused );
+    push_faults( cache, device_cache_version( cache ) + 1 );
+
+    // Single queries from one thread, with nothing being published
+    int const count = 10000000;
+    int64_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for( int i = 0; i < count; ++i ) found += device_cache_capability_supported( cache, TOBII_CAPABILITY_CALIBRATION_3D );
+    double capability_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start )
+        .count() / count;
+    start = std::chrono::steady_clock::now();
+    for( int i = 0; i < count; ++i )
+    {
+        tobii_state_bool_t value = TOBII_STATE_BOOL_FALSE;
+        found += device_cache_get_state_bool( cache, TOBII_STATE_DEVICE_PAUSED, &value ) == TOBII_ERROR_NO_ERROR;
+    }
+    double state_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        count;
+    printf( "Capability query %.1f ns, state query %.1f ns, %" PRId64 " found\n", capability_ns, state_ns, found );
+
+    // Readers hammering the cache while notifications are applied as fast as a millisecond apart, far more often than
+    // a device sends them
+    std::atomic<bool> running( true );
+    int const reader_count = 3;
+    reader_result_t results[ reader_count ] = {};
+    std::vector<std::thread> readers;
+    for( int i = 0; i < reader_count; ++i ) readers.emplace_back( reader_thread, cache, &running, &results[ i ] );
+
+    std::vector<double> publish_us;
+    uint64_t version = device_cache_version( cache );
+    for( int i = 0; i < 200; ++i )
+    {
+        auto publish_start = std::chrono::steady_clock::now();
+        push_faults( cache, ++version );
+        publish_us.push_back( std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() -
+            publish_start ).count() );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    running = false;
+    for( auto& reader : readers ) reader.join();
+
+    int64_t reads = 0, torn = 0;
+    for( auto const& result : results )
+    {
+        reads += result.reads;
+        torn += result.torn;
+    }
+    std::sort( publish_us.begin(), publish_us.end() );
+    printf( "%d readers: %" PRId64 " reads, %" PRId64 " torn, while publishing %zu snapshots, median %.1f us, max "
+        "%.1f us each, ending at version %" PRIu64 "\n", reader_count, reads, torn, publish_us.size(),
+        publish_us[ publish_us.size() / 2 ], publish_us.back(), device_cache_version( cache ) );
+
+    device_cache_destroy( cache );
+    return torn == 0 ? 0 : 1;
+}
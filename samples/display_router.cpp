@@ -0,0 +1,367 @@
+#include "display_router.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+struct display_t
+{
+    float corner[ 3 ]; // Top left
+    float right[ 3 ]; // From the top left to the top right corner
+    float down[ 3 ]; // From the top left to the bottom left corner
+    float normal[ 3 ]; // Not normalized
+    float inverse_right_squared;
+    float inverse_down_squared;
+    float size_px[ 2 ];
+    float bounds[ 6 ]; // Minimum x, y, z, then maximum x, y, z
+};
+
+// A node of the bounding volume hierarchy. The children of an inner node are nodes[ first ] and nodes[ first + 1 ]; a
+// leaf holds the displays order[ first ] up to order[ first + count ].
+struct node_t
+{
+    float bounds[ 6 ];
+    int first;
+    int count; // 0 for inner nodes
+};
+
+struct display_router_t
+{
+    std::vector<display_t> displays;
+    std::vector<display_router_consumer_t> consumers;
+    std::vector<void*> user_data;
+
+    std::vector<node_t> nodes;
+    std::vector<int> order;
+
+    std::vector<std::vector<display_router_hit_t>> queues;
+    display_router_statistics_t statistics;
+};
+
+struct ray_t
+{
+    float origin[ 3 ];
+    float direction[ 3 ]; // Normalized, so distances along the ray are in mm
+    float inverse[ 3 ];
+};
+
+struct test_counters_t
+{
+    uint64_t boxes;
+    uint64_t displays;
+};
+
+static float dot( float const* a, float const* b )
+{
+    return a[ 0 ] * b[ 0 ] + a[ 1 ] * b[ 1 ] + a[ 2 ] * b[ 2 ];
+}
+
+static void bounds_union( float* bounds, float const* other )
+{
+    for( int i = 0; i < 3; ++i )
+    {
+        bounds[ i ] = std::min( bounds[ i ], other[ i ] );
+        bounds[ i + 3 ] = std::max( bounds[ i + 3 ], other[ i + 3 ] );
+    }
+}
+
+static float centroid( display_t const& display, int axis )
+{
+    return 0.5f * ( display.bounds[ axis ] + display.bounds[ axis + 3 ] );
+}
+
+static void build( display_router_t* router, int node, int first, int count, int max_leaf_displays )
+{
+    float bounds[ 6 ] = { INFINITY, INFINITY, INFINITY, -INFINITY, -INFINITY, -INFINITY };
+    float centroids[ 6 ] = { INFINITY, INFINITY, INFINITY, -INFINITY, -INFINITY, -INFINITY };
+    for( int i = first; i < first + count; ++i )
+    {
+        display_t const& display = router->displays[ router->order[ i ] ];
+        bounds_union( bounds, display.bounds );
+        float const point[ 6 ] = { centroid( display, 0 ), centroid( display, 1 ), centroid( display, 2 ),
+            centroid( display, 0 ), centroid( display, 1 ), centroid( display, 2 ) };
+        bounds_union( centroids, point );
+    }
+    std::copy( bounds, bounds + 6, router->nodes[ node ].bounds );
+
+    if( count <= max_leaf_displays )
+    {
+        router->nodes[ node ].first = first;
+        router->nodes[ node ].count = count;
+        return;
+    }
+
+    // Split at the median along the axis the display centers are spread out the most
+    int axis = 0;
+    for( int i = 1; i < 3; ++i )
+        if( centroids[ i + 3 ] - centroids[ i ] > centroids[ axis + 3 ] - centroids[ axis ] ) axis = i;
+    int half = count / 2;
+    std::vector<display_t> const& displays = router->displays;
+    std::nth_element( router->order.begin() + first, router->order.begin() + first + half,
+        router->order.begin() + first + count,
+        [ &displays, axis ]( int a, int b )
+        {
+            return centroid( displays[ a ], axis ) < centroid( displays[ b ], axis );
+        } );
+
+    int children = (int) router->nodes.size();
+    router->nodes.resize( router->nodes.size() + 2 );
+    router->nodes[ node ].first = children;
+    router->nodes[ node ].count = 0;
+    build( router, children, first, half, max_leaf_displays );
+    build( router, children + 1, first + half, count - half, max_leaf_displays );
+}
+
+display_router_t* display_router_create( display_router_display_t const* displays, int count,
+    int max_leaf_displays )
+{
+    if( count < 0 || max_leaf_displays < 1 ) return nullptr;
+
+    auto router = new display_router_t();
+    router->displays.resize( count );
+    for( int i = 0; i < count; ++i )
+    {
+        tobii_display_area_t const& area = displays[ i ].area;
+        display_t& display = router->displays[ i ];
+        for( int j = 0; j < 3; ++j )
+        {
+            display.corner[ j ] = area.top_left_mm_xyz[ j ];
+            display.right[ j ] = area.top_right_mm_xyz[ j ] - area.top_left_mm_xyz[ j ];
+            display.down[ j ] = area.bottom_left_mm_xyz[ j ] - area.top_left_mm_xyz[ j ];
+        }
+        for( int j = 0; j < 3; ++j )
+            display.normal[ j ] = display.right[ ( j + 1 ) % 3 ] * display.down[ ( j + 2 ) % 3 ]
+                - display.right[ ( j + 2 ) % 3 ] * display.down[ ( j + 1 ) % 3 ];
+
+        // The corners must make a right angle, between sides of some length
+        float right_squared = dot( display.right, display.right );
+        float down_squared = dot( display.down, display.down );
+        float cosine = dot( display.right, display.down ) / sqrtf( right_squared * down_squared );
+        if( !( right_squared > 1e-6f ) || !( down_squared > 1e-6f ) || !( fabsf( cosine ) < 1e-3f ) ||
+            displays[ i ].width_px <= 0 || displays[ i ].height_px <= 0 )
+        {
+            delete router;
+            return nullptr;
+        }
+        display.inverse_right_squared = 1.0f / right_squared;
+        display.inverse_down_squared = 1.0f / down_squared;
+        display.size_px[ 0 ] = (float) displays[ i ].width_px;
+        display.size_px[ 1 ] = (float) displays[ i ].height_px;
+
+        // Padded by a millimeter, so that the box of a display lying in an axis plane is not flat
+        for( int j = 0; j < 3; ++j )
+        {
+            float const corners[ 4 ] = { display.corner[ j ], display.corner[ j ] + display.right[ j ],
+                display.corner[ j ] + display.down[ j ], display.corner[ j ] + display.right[ j ] + display.down[ j ] };
+            display.bounds[ j ] = *std::min_element( corners, corners + 4 ) - 1.0f;
+            display.bounds[ j + 3 ] = *std::max_element( corners, corners + 4 ) + 1.0f;
+        }
+
+        router->consumers.push_back( displays[ i ].consumer );
+        router->user_data.push_back( displays[ i ].user_data );
+    }
+
+    router->order.resize( count );
+    for( int i = 0; i < count; ++i ) router->order[ i ] = i;
+    router->nodes.resize( 1 );
+    build( router, 0, 0, count, max_leaf_displays );
+
+    router->queues.resize( count );
+    router->statistics = display_router_statistics_t();
+    return router;
+}
+
+void display_router_destroy( display_router_t* router )
+{
+    delete router;
+}
+
+static bool make_ray( float const* origin_xyz, float const* direction_xyz, ray_t* ray )
+{
+    float length_squared = dot( direction_xyz, direction_xyz );
+    if( !( length_squared > 1e-12f ) ) return false; // Also NaN
+    float inverse_length = 1.0f / sqrtf( length_squared );
+    for( int i = 0; i < 3; ++i )
+    {
+        ray->origin[ i ] = origin_xyz[ i ];
+        ray->direction[ i ] = direction_xyz[ i ] * inverse_length;
+        ray->inverse[ i ] = 1.0f / ray->direction[ i ];
+    }
+    return true;
+}
+
+// Returns the distance along the ray at which it enters the box, or INFINITY if it misses the box before *far*
+static float box_entry( float const* bounds, ray_t const& ray, float far )
+{
+    float entry = 0.0f;
+    for( int i = 0; i < 3; ++i )
+    {
+        float t0 = ( bounds[ i ] - ray.origin[ i ] ) * ray.inverse[ i ];
+        float t1 = ( bounds[ i + 3 ] - ray.origin[ i ] ) * ray.inverse[ i ];
+        entry = std::max( entry, std::min( t0, t1 ) );
+        far = std::min( far, std::max( t0, t1 ) );
+    }
+    return entry <= far ? entry : INFINITY;
+}
+
+// Hits the display if the ray crosses it nearer than *distance*, and updates *distance* and *position_xy*
+static bool hit_display( display_t const& display, ray_t const& ray, float* distance, float* position_xy )
+{
+    float denominator = dot( ray.direction, display.normal );
+    if( denominator == 0.0f ) return false;
+    float to_corner[ 3 ] = { display.corner[ 0 ] - ray.origin[ 0 ], display.corner[ 1 ] - ray.origin[ 1 ],
+        display.corner[ 2 ] - ray.origin[ 2 ] };
+    float t = dot( to_corner, display.normal ) / denominator;
+    if( !( t > 0.0f ) || !( t < *distance ) ) return false;
+
+    float on_display[ 3 ];
+    for( int i = 0; i < 3; ++i ) on_display[ i ] = ray.direction[ i ] * t - to_corner[ i ];
+    float x = dot( on_display, display.right ) * display.inverse_right_squared;
+    float y = dot( on_display, display.down ) * display.inverse_down_squared;
+    if( !( x >= 0.0f && x < 1.0f && y >= 0.0f && y < 1.0f ) ) return false;
+
+    *distance = t;
+    position_xy[ 0 ] = x;
+    position_xy[ 1 ] = y;
+    return true;
+}
+
+static int intersect( display_router_t const* router, ray_t const& ray, float* pixel_xy, float* distance_mm,
+    test_counters_t* counters )
+{
+    if( router->displays.empty() ) return -1;
+
+    // Depth first, nearer child first. A node is only pushed once its box is known to be hit, and is skipped when
+    // popped if a display nearer than its box has been hit since. The tree is balanced, so the stack holds at most one
+    // node per level.
+    struct entry_t { int node; float distance; };
+    entry_t stack[ 64 ];
+    int depth = 0;
+    float best = INFINITY;
+    float best_xy[ 2 ] = {};
+    int best_display = -1;
+
+    ++counters->boxes;
+    float root = box_entry( router->nodes[ 0 ].bounds, ray, best );
+    if( root < INFINITY ) stack[ depth++ ] = { 0, root };
+    while( depth > 0 )
+    {
+        entry_t entry = stack[ --depth ];
+        if( entry.distance >= best ) continue;
+        node_t const& node = router->nodes[ entry.node ];
+        if( node.count > 0 )
+        {
+            for( int i = node.first; i < node.first + node.count; ++i )
+            {
+                ++counters->displays;
+                if( hit_display( router->displays[ router->order[ i ] ], ray, &best, best_xy ) )
+                    best_display = router->order[ i ];
+            }
+            continue;
+        }
+
+        counters->boxes += 2;
+        entry_t children[ 2 ] = { { node.first, box_entry( router->nodes[ node.first ].bounds, ray, best ) },
+            { node.first + 1, box_entry( router->nodes[ node.first + 1 ].bounds, ray, best ) } };
+        if( children[ 1 ].distance > children[ 0 ].distance ) std::swap( children[ 0 ], children[ 1 ] );
+        for( entry_t const& child : children )
+            if( child.distance < INFINITY ) stack[ depth++ ] = child;
+    }
+
+    if( best_display >= 0 )
+    {
+        display_t const& display = router->displays[ best_display ];
+        if( pixel_xy )
+        {
+            pixel_xy[ 0 ] = best_xy[ 0 ] * display.size_px[ 0 ];
+            pixel_xy[ 1 ] = best_xy[ 1 ] * display.size_px[ 1 ];
+        }
+        if( distance_mm ) *distance_mm = best;
+    }
+    return best_display;
+}
+
+int display_router_intersect( display_router_t const* router, float const* origin_xyz, float const* direction_xyz,
+    float* pixel_xy, float* distance_mm )
+{
+    ray_t ray;
+    if( !make_ray( origin_xyz, direction_xyz, &ray ) ) return -1;
+    test_counters_t counters = {};
+    return intersect( router, ray, pixel_xy, distance_mm, &counters );
+}
+
+// The ray from the mean origin of the valid eyes through the mean of their gaze points
+static bool gaze_ray( tobii_gaze_data_t const* gaze_data, ray_t* ray )
+{
+    float origin[ 3 ] = {};
+    float point[ 3 ] = {};
+    int valid = 0;
+    tobii_gaze_data_eye_t const* eyes[ 2 ] = { &gaze_data->left, &gaze_data->right };
+    for( tobii_gaze_data_eye_t const* eye : eyes )
+    {
+        if( eye->gaze_origin_validity != TOBII_VALIDITY_VALID || eye->gaze_point_validity != TOBII_VALIDITY_VALID )
+            continue;
+        for( int i = 0; i < 3; ++i )
+        {
+            origin[ i ] += eye->gaze_origin_from_eye_tracker_mm[ i ];
+            point[ i ] += eye->gaze_point_from_eye_tracker_mm[ i ];
+        }
+        ++valid;
+    }
+    if( valid == 0 ) return false;
+
+    float direction[ 3 ];
+    for( int i = 0; i < 3; ++i ) direction[ i ] = point[ i ] - origin[ i ];
+    float const scale = 1.0f / (float) valid;
+    for( int i = 0; i < 3; ++i ) origin[ i ] *= scale;
+    return make_ray( origin, direction, ray );
+}
+
+void display_router_route( display_router_t* router, tobii_gaze_data_t const* gaze_data, int count,
+    display_router_hit_t* hits )
+{
+    test_counters_t counters = {};
+    for( int i = 0; i < count; ++i )
+    {
+        display_router_hit_t hit;
+        hit.timestamp_us = gaze_data[ i ].timestamp_system_us;
+        hit.display = -1;
+        hit.pixel_xy[ 0 ] = hit.pixel_xy[ 1 ] = NAN;
+        hit.distance_mm = NAN;
+
+        ray_t ray;
+        if( !gaze_ray( &gaze_data[ i ], &ray ) )
+            ++router->statistics.invalid;
+        else if( ( hit.display = intersect( router, ray, hit.pixel_xy, &hit.distance_mm, &counters ) ) < 0 )
+            ++router->statistics.off_display;
+        else
+            router->queues[ hit.display ].push_back( hit );
+        if( hits ) hits[ i ] = hit;
+    }
+    router->statistics.routed += (uint64_t) count;
+    router->statistics.box_tests += counters.boxes;
+    router->statistics.display_tests += counters.displays;
+}
+
+void display_router_gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    display_router_route( static_cast<display_router_t*>( user_data ), gaze_data, 1, NULL );
+}
+
+void display_router_dispatch( display_router_t* router )
+{
+    for( size_t i = 0; i < router->queues.size(); ++i )
+    {
+        std::vector<display_router_hit_t>& queue = router->queues[ i ];
+        if( queue.empty() ) continue;
+        if( router->consumers[ i ] )
+            router->consumers[ i ]( (int) i, queue.data(), (int) queue.size(), router->user_data[ i ] );
+        queue.clear();
+    }
+}
+
+void display_router_statistics( display_router_t const* router, display_router_statistics_t* statistics )
+{
+    *statistics = router->statistics;
+}
@@ -0,0 +1,81 @@
+#ifndef sample_display_router_h
+#define sample_display_router_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+
+#include <stdint.h>
+
+// Routes gaze to one of several displays sharing a single tracker. The tracker maps gaze onto the one display area it
+// is configured with, but the gaze ray, from the gaze origin through gaze_point_from_eye_tracker_mm, stays valid
+// wherever the user looks. The router follows each ray past the configured display area and intersects it with a set
+// of display rectangles, given in the tracker coordinate system like tobii_display_area_t, and reports the nearest
+// display hit with pixel coordinates on that display.
+//
+// The displays are found through a bounding volume hierarchy: a binary tree of boxes, built once when the router is
+// created, where each box holds the displays below it. A ray is only tested against the displays whose boxes it
+// passes through, nearest box first, and boxes further away than a display already hit are skipped.
+//
+// Routed samples are queued per display. Dispatching hands each display consumer its queued hits as one array, in the
+// order the samples were routed, so consumers are called once per batch rather than once per sample. All functions
+// except display_router_intersect must be called from one thread at a time, normally the pump thread.
+
+typedef struct display_router_t display_router_t;
+
+typedef struct display_router_hit_t
+{
+    int64_t timestamp_us; // System timestamp of the sample
+    int display; // Index into the displays, -1 if the gaze is on no display or the sample has no valid eye
+    float pixel_xy[ 2 ]; // From the top left corner of the display
+    float distance_mm; // From the gaze origin to the display
+} display_router_hit_t;
+
+// Called with the hits queued for one display since the last dispatch.
+typedef void ( *display_router_consumer_t )( int display, display_router_hit_t const* hits, int count,
+    void* user_data );
+
+typedef struct display_router_display_t
+{
+    tobii_display_area_t area; // Corners in the tracker coordinate system, in mm
+    int width_px;
+    int height_px;
+    display_router_consumer_t consumer; // NULL to only count the hits
+    void* user_data;
+} display_router_display_t;
+
+typedef struct display_router_statistics_t
+{
+    uint64_t routed;
+    uint64_t invalid; // Samples without a valid eye
+    uint64_t off_display; // Valid samples that hit no display
+    uint64_t box_tests; // Bounding boxes the rays were tested against
+    uint64_t display_tests; // Display rectangles the rays were tested against
+} display_router_statistics_t;
+
+// Copies *displays*. Each leaf of the tree holds up to *max_leaf_displays* displays; a value of *count* or more tests
+// every ray against every display. Returns NULL if a display area is not a rectangle of some size, or a size in
+// pixels is not positive.
+display_router_t* display_router_create( display_router_display_t const* displays, int count,
+    int max_leaf_displays );
+
+void display_router_destroy( display_router_t* router );
+
+// Returns the index of the nearest display the ray hits, or -1. *direction_xyz* need not be normalized. *pixel_xy* and
+// *distance_mm* may be NULL. Thread safe.
+int display_router_intersect( display_router_t const* router, float const* origin_xyz, float const* direction_xyz,
+    float* pixel_xy, float* distance_mm );
+
+// Routes *count* samples and queues the hits. The ray is taken from the mean of the valid eyes. Writes the hits to
+// *hits* as well, unless it is NULL.
+void display_router_route( display_router_t* router, tobii_gaze_data_t const* gaze_data, int count,
+    display_router_hit_t* hits );
+
+// Routes and queues one sample; can be used as a tobii_gaze_data_callback_t.
+void display_router_gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data );
+
+// Calls the consumer of every display with queued hits, and empties the queues.
+void display_router_dispatch( display_router_t* router );
+
+void display_router_statistics( display_router_t const* router, display_router_statistics_t* statistics );
+
+#endif // sample_display_router_h
@@ -0,0 +1,323 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_config.h>
+
+#include "display_router.h"
+#include "main_loop_linux.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+struct monitor_t
+{
+    char const* name;
+    int64_t hits;
+    int64_t last_print_us;
+};
+
+static void monitor_consumer( int display, display_router_hit_t const* hits, int count, void* user_data )
+{
+    monitor_t* monitor = (monitor_t*) user_data;
+    monitor->hits += count;
+    display_router_hit_t const& last = hits[ count - 1 ];
+    if( last.timestamp_us - monitor->last_print_us < 1000000 ) return;
+    printf( "Display %d (%s): gaze at pixel %.0f, %.0f, %.0f mm away, %" PRId64 " samples so far\n", display,
+        monitor->name, last.pixel_xy[ 0 ], last.pixel_xy[ 1 ], last.distance_mm, monitor->hits );
+    monitor->last_print_us = last.timestamp_us;
+}
+
+static void dispatch( void* user_data )
+{
+    display_router_dispatch( (display_router_t*) user_data );
+}
+
+// A display the same size as *area*, hinged on its left or right edge and turned *angle_deg* towards the user
+static tobii_display_area_t side_display( tobii_display_area_t const& area, float side, float angle_deg )
+{
+    float right[ 3 ], down[ 3 ], towards_user[ 3 ];
+    for( int i = 0; i < 3; ++i )
+    {
+        right[ i ] = area.top_right_mm_xyz[ i ] - area.top_left_mm_xyz[ i ];
+        down[ i ] = area.bottom_left_mm_xyz[ i ] - area.top_left_mm_xyz[ i ];
+    }
+    for( int i = 0; i < 3; ++i )
+        towards_user[ i ] = right[ ( i + 2 ) % 3 ] * down[ ( i + 1 ) % 3 ]
+            - right[ ( i + 1 ) % 3 ] * down[ ( i + 2 ) % 3 ];
+    float down_length = sqrtf( down[ 0 ] * down[ 0 ] + down[ 1 ] * down[ 1 ] + down[ 2 ] * down[ 2 ] );
+    float angle = angle_deg * 3.14159265f / 180.0f;
+
+    // The normal is |right| * |down| long, so dividing by |down| makes it as long as the top edge
+    tobii_display_area_t result;
+    for( int i = 0; i < 3; ++i )
+    {
+        float turned = cosf( angle ) * right[ i ] + side * sinf( angle ) * towards_user[ i ] / down_length;
+        result.top_left_mm_xyz[ i ] = side > 0.0f ? area.top_right_mm_xyz[ i ] : area.top_left_mm_xyz[ i ] - turned;
+        result.top_right_mm_xyz[ i ] = result.top_left_mm_xyz[ i ] + turned;
+        result.bottom_left_mm_xyz[ i ] = result.top_left_mm_xyz[ i ] + down[ i ];
+    }
+    return result;
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int display_router_sample_main( void );
+extern "C" int display_router_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // Three 2560x1440 monitors: the one the tracker is configured for, with one on each side turned 30 degrees in
+    tobii_display_area_t center;
+    error = tobii_get_display_area( device, &center );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to get the display area.\n" );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+    monitor_t monitors[ 3 ] = { { "left", 0, 0 }, { "center", 0, 0 }, { "right", 0, 0 } };
+    display_router_display_t const displays[ 3 ] = {
+        { side_display( center, -1.0f, 30.0f ), 2560, 1440, monitor_consumer, &monitors[ 0 ] },
+        { center, 2560, 1440, monitor_consumer, &monitors[ 1 ] },
+        { side_display( center, 1.0f, 30.0f ), 2560, 1440, monitor_consumer, &monitors[ 2 ] },
+    };
+    display_router_t* router = display_router_create( displays, 3, 1 );
+
+    error = tobii_gaze_data_subscribe( device, display_router_gaze_data_callback, router );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze data stream.\n" );
+        display_router_destroy( router );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // The callbacks route each sample, and the hits of all samples from one round of callbacks are dispatched together
+    main_loop( device, dispatch, router );
+
+    error = tobii_gaze_data_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze data stream.\n" );
+
+    display_router_statistics_t statistics;
+    display_router_statistics( router, &statistics );
+    printf( "%" PRIu64 " samples, %" PRIu64 " invalid, %" PRIu64 " off every display\n", statistics.routed,
+        statistics.invalid, statistics.off_display );
+    display_router_destroy( router );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// Deterministic noise for the benchmark, uniform in [0, 1)
+static float uniform( uint32_t* state )
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (float)( *state >> 8 ) / 16777216.0f;
+}
+
+// A 24 inch monitor at *angle_deg* around a user sitting at *head_xyz*, facing them from *distance_mm* away
+static tobii_display_area_t wall_display( float const* head_xyz, float angle_deg, float center_y_mm,
+    float distance_mm )
+{
+    float angle = angle_deg * 3.14159265f / 180.0f;
+    float center[ 3 ] = { head_xyz[ 0 ] + distance_mm * sinf( angle ), center_y_mm,
+        head_xyz[ 2 ] - distance_mm * cosf( angle ) };
+    float right[ 3 ] = { 531.0f * cosf( angle ), 0.0f, 531.0f * sinf( angle ) };
+    float down[ 3 ] = { 0.0f, -299.0f, 0.0f };
+    tobii_display_area_t area;
+    for( int i = 0; i < 3; ++i )
+    {
+        area.top_left_mm_xyz[ i ] = center[ i ] - 0.5f * right[ i ] - 0.5f * down[ i ];
+        area.top_right_mm_xyz[ i ] = area.top_left_mm_xyz[ i ] + right[ i ];
+        area.bottom_left_mm_xyz[ i ] = area.top_left_mm_xyz[ i ] + down[ i ];
+    }
+    return area;
+}
+
+static void count_consumer( int display, display_router_hit_t const* hits, int count, void* user_data )
+{
+    (void) display; // Unused parameter
+    (void) hits; // Unused parameter
+    *(int64_t*) user_data += count;
+}
+
+// Routes a million gaze data samples at 120 Hz for a user facing *rows* of *columns* 1920x1080 monitors, on an arc
+// *distance_mm* from their head. The tracker sits below the middle of the wall, configured for a display area in its
+// own x-y plane. The user fixates a new point every 300 ms: on one of the displays nine times out of ten, and above or
+// below the wall otherwise. Both eyes have 0.3 degrees of noise, one sample in 30 has no valid eye and one in 20 only
+// one.
+static void benchmark_wall( char const* name, int columns, int rows, float distance_mm )
+{
+    float const head[ 3 ] = { 0.0f, 330.0f, 700.0f };
+    float const column_deg = 2.0f * atanf( 265.5f / distance_mm ) * 180.0f / 3.14159265f;
+    int const display_count = columns * rows;
+    std::vector<int64_t> counts( (size_t) display_count );
+    std::vector<display_router_display_t> displays( (size_t) display_count );
+    for( int i = 0; i < display_count; ++i )
+    {
+        float angle_deg = ( (float)( i % columns ) - 0.5f * (float)( columns - 1 ) ) * column_deg;
+        float center_y_mm = head[ 1 ] + ( 0.5f * (float)( rows - 1 ) - (float)( i / columns ) ) * 310.0f;
+        displays[ (size_t) i ] = { wall_display( head, angle_deg, center_y_mm, distance_mm ), 1920, 1080,
+            count_consumer, &counts[ (size_t) i ] };
+    }
+
+    int const count = 1 << 20;
+    std::vector<tobii_gaze_data_t> samples( (size_t) count );
+    std::vector<int> truth( (size_t) count );
+    uint32_t state = 1;
+    float target[ 3 ] = {};
+    int target_display = -1;
+    for( int i = 0; i < count; ++i )
+    {
+        if( i % 36 == 0 )
+        {
+            target_display = uniform( &state ) < 0.9f ? (int)( uniform( &state ) * (float) display_count ) : -1;
+            if( target_display >= 0 )
+            {
+                tobii_display_area_t const& area = displays[ (size_t) target_display ].area;
+                float x = 0.02f + 0.96f * uniform( &state ), y = 0.02f + 0.96f * uniform( &state );
+                for( int j = 0; j < 3; ++j )
+                    target[ j ] = area.top_left_mm_xyz[ j ] + x * ( area.top_right_mm_xyz[ j ] -
+                        area.top_left_mm_xyz[ j ] ) + y * ( area.bottom_left_mm_xyz[ j ] - area.top_left_mm_xyz[ j ] );
+            }
+            else
+            {
+                float angle = ( uniform( &state ) - 0.5f ) * (float) columns * column_deg * 3.14159265f / 180.0f;
+                target[ 0 ] = head[ 0 ] + distance_mm * sinf( angle );
+                float above = uniform( &state ) < 0.5f ? 1.0f : -1.0f;
+                target[ 1 ] = head[ 1 ] + above * ( 155.0f * (float) rows + 300.0f );
+                target[ 2 ] = head[ 2 ] - distance_mm * cosf( angle );
+            }
+        }
+        truth[ (size_t) i ] = target_display;
+
+        tobii_gaze_data_t& sample = samples[ (size_t) i ];
+        sample.timestamp_system_us = (int64_t) i * 8333;
+        sample.timestamp_tracker_us = sample.timestamp_system_us;
+        sample.frame_count = (uint32_t) i;
+        sample.frame_skipped = 0;
+        float invalid = uniform( &state );
+        tobii_gaze_data_eye_t* eyes[ 2 ] = { &sample.left, &sample.right };
+        for( int e = 0; e < 2; ++e )
+        {
+            tobii_gaze_data_eye_t& eye = *eyes[ e ];
+            bool valid = invalid >= 1.0f / 30.0f && !( invalid < 1.0f / 30.0f + 1.0f / 20.0f && e == 0 );
+            eye.gaze_origin_validity = eye.gaze_point_validity = valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+            float direction[ 3 ];
+            for( int j = 0; j < 3; ++j )
+            {
+                eye.gaze_origin_from_eye_tracker_mm[ j ] = head[ j ] + ( j == 0 ? ( e == 0 ? -32.0f : 32.0f ) : 0.0f );
+                direction[ j ] = target[ j ] - eye.gaze_origin_from_eye_tracker_mm[ j ];
+            }
+            float length = sqrtf( direction[ 0 ] * direction[ 0 ] + direction[ 1 ] * direction[ 1 ] +
+                direction[ 2 ] * direction[ 2 ] );
+
+            // Uniform noise of 0.3 degrees standard deviation on each axis
+            for( int j = 0; j < 3; ++j )
+                direction[ j ] = direction[ j ] / length + 0.3f * 3.14159265f / 180.0f * 3.4641f *
+                    ( uniform( &state ) - 0.5f );
+
+            // Where the ray crosses the configured display area plane, z = 0
+            float t = -eye.gaze_origin_from_eye_tracker_mm[ 2 ] / direction[ 2 ];
+            for( int j = 0; j < 3; ++j )
+                eye.gaze_point_from_eye_tracker_mm[ j ] = eye.gaze_origin_from_eye_tracker_mm[ j ] + t * direction[ j ];
+        }
+    }
+
+    // Routed in batches of 1024 samples, each followed by a dispatch, through the tree with one display per leaf and
+    // then with every display tested for every sample
+    printf( "%s, %d displays\n", name, display_count );
+    int const batch = 1024;
+    std::vector<display_router_hit_t> hits( (size_t) count );
+    int const leaves[ 2 ] = { 1, display_count };
+    char const* names[ 2 ] = { "Bounding volume hierarchy", "Every display" };
+    for( int run = 0; run < 2; ++run )
+    {
+        display_router_t* router = display_router_create( displays.data(), display_count, leaves[ run ] );
+        auto start = std::chrono::steady_clock::now();
+        for( int first = 0; first < count; first += batch )
+        {
+            display_router_route( router, samples.data() + first, batch, hits.data() + first );
+            display_router_dispatch( router );
+        }
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+        int64_t correct = 0, valid = 0;
+        for( int i = 0; i < count; ++i )
+        {
+            if( !( samples[ (size_t) i ].left.gaze_point_validity == TOBII_VALIDITY_VALID ||
+                samples[ (size_t) i ].right.gaze_point_validity == TOBII_VALIDITY_VALID ) ) continue;
+            ++valid;
+            if( hits[ (size_t) i ].display == truth[ (size_t) i ] ) ++correct;
+        }
+        display_router_statistics_t statistics;
+        display_router_statistics( router, &statistics );
+        int64_t dispatched = 0;
+        for( int64_t display_hits : counts ) dispatched += display_hits;
+        printf( "  %s: %.1f M samples/s, %.0f ns per sample, %.1f box and %.1f display tests per sample\n",
+            names[ run ], count / seconds / 1e6, seconds * 1e9 / count,
+            (double) statistics.box_tests / (double) statistics.routed,
+            (double) statistics.display_tests / (double) statistics.routed );
+        printf( "    %.3f%% on the right display, %" PRIu64 " invalid, %" PRIu64 " off every display, %" PRId64
+            " dispatched\n", 100.0 * (double) correct / (double) valid, statistics.invalid, statistics.off_display,
+            dispatched );
+        std::fill( counts.begin(), counts.end(), 0 );
+        display_router_destroy( router );
+    }
+}
+
+extern "C" int display_router_benchmark_main( void );
+extern "C" int display_router_benchmark_main( void )
+{
+    benchmark_wall( "Trading desk, two rows of four at 700 mm", 4, 2, 700.0f );
+    benchmark_wall( "Control room wall, six rows of eight at 2.5 m", 8, 6, 2500.0f );
+    return 0;
+}
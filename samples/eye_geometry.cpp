@@ -0,0 +1,259 @@
+#include "eye_geometry.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+
+struct eye_geometry_t
+{
+    eye_geometry_config_t config;
+
+    // Inputs, as last seen. Only the updating thread touches these.
+    bool has_lens;
+    tobii_lens_configuration_t lens;
+    bool has_eyes[ 2 ];
+    float eyes_xyz[ 2 ][ 3 ]; // Smoothed
+
+    // What the published snapshot was computed from
+    bool published;
+    tobii_lens_configuration_t published_lens;
+    float published_eyes_xyz[ 2 ][ 3 ];
+    uint64_t version;
+
+    // Sequence number, 2n+1 while snapshot n is being written and 2n+2 once it is complete
+    std::atomic<uint64_t> sequence;
+    eye_geometry_snapshot_t snapshot;
+};
+
+static float distance( float const* a, float const* b )
+{
+    float dx = a[ 0 ] - b[ 0 ], dy = a[ 1 ] - b[ 1 ], dz = a[ 2 ] - b[ 2 ];
+    return sqrtf( dx * dx + dy * dy + dz * dz );
+}
+
+static void compute_eye( eye_geometry_config_t const* config, float const* lens_xyz, float const* eye_xyz,
+    eye_geometry_eye_t* eye )
+{
+    memcpy( eye->position_xyz, eye_xyz, sizeof( eye->position_xyz ) );
+    memcpy( eye->lens_xyz, lens_xyz, sizeof( eye->lens_xyz ) );
+    eye->image_center_xyz[ 0 ] = lens_xyz[ 0 ];
+    eye->image_center_xyz[ 1 ] = lens_xyz[ 1 ];
+    eye->image_center_xyz[ 2 ] = lens_xyz[ 2 ] + config->virtual_image_distance_mm;
+    eye->image_size_mm[ 0 ] = config->virtual_image_size_mm[ 0 ];
+    eye->image_size_mm[ 1 ] = config->virtual_image_size_mm[ 1 ];
+
+    // The image rectangle as seen from the eye. Headset x points to the user's left, so the left edge of the image is
+    // at the larger x, and distances to the right of the eye are its x minus that of the point.
+    float depth = eye->image_center_xyz[ 2 ] - eye_xyz[ 2 ];
+    float half_width = 0.5f * eye->image_size_mm[ 0 ], half_height = 0.5f * eye->image_size_mm[ 1 ];
+    float left = eye_xyz[ 0 ] - ( eye->image_center_xyz[ 0 ] + half_width );
+    float bottom = eye->image_center_xyz[ 1 ] - half_height - eye_xyz[ 1 ];
+    eye->tan_left = left / depth;
+    eye->tan_right = ( left + 2.0f * half_width ) / depth;
+    eye->tan_down = bottom / depth;
+    eye->tan_up = ( bottom + 2.0f * half_height ) / depth;
+
+    // Relative to the eye, a point at x, y, w lands on the image at -x * depth / w to the right of the eye, so u * w is
+    // linear in the point: u * w = ( -x * depth + w * ( -left ) ) / width, and likewise for v from the top edge down
+    float su = -depth / ( 2.0f * half_width ), ou = -left / ( 2.0f * half_width );
+    float sv = -depth / ( 2.0f * half_height ), ov = ( bottom + 2.0f * half_height ) / ( 2.0f * half_height );
+    float ex = eye_xyz[ 0 ], ey = eye_xyz[ 1 ], ez = eye_xyz[ 2 ];
+    float const to_display[ 16 ] = {
+        su, 0.0f, ou, -su * ex - ou * ez,
+        0.0f, sv, ov, -sv * ey - ov * ez,
+        0.0f, 0.0f, 1.0f, -ez,
+        0.0f, 0.0f, 1.0f, -ez,
+    };
+    memcpy( eye->to_display, to_display, sizeof( to_display ) );
+}
+
+void eye_geometry_compute( eye_geometry_config_t const* config, tobii_lens_configuration_t const* lens,
+    float const* left_xyz, float const* right_xyz, eye_geometry_snapshot_t* snapshot )
+{
+    snapshot->valid = 1;
+    snapshot->ipd_mm = distance( left_xyz, right_xyz );
+    compute_eye( config, lens->left_xyz, left_xyz, &snapshot->left );
+    compute_eye( config, lens->right_xyz, right_xyz, &snapshot->right );
+}
+
+static void update( eye_geometry_t* geometry )
+{
+    if( !geometry->has_lens || !geometry->has_eyes[ 0 ] || !geometry->has_eyes[ 1 ] ) return;
+
+    if( geometry->published )
+    {
+        float threshold = geometry->config.update_threshold_mm;
+        bool moved = distance( geometry->lens.left_xyz, geometry->published_lens.left_xyz ) > threshold ||
+            distance( geometry->lens.right_xyz, geometry->published_lens.right_xyz ) > threshold ||
+            distance( geometry->eyes_xyz[ 0 ], geometry->published_eyes_xyz[ 0 ] ) > threshold ||
+            distance( geometry->eyes_xyz[ 1 ], geometry->published_eyes_xyz[ 1 ] ) > threshold;
+        if( !moved ) return;
+    }
+
+    geometry->published = true;
+    geometry->published_lens = geometry->lens;
+    memcpy( geometry->published_eyes_xyz, geometry->eyes_xyz, sizeof( geometry->eyes_xyz ) );
+
+    // Compute outside the critical section, so readers retry for as short a time as possible
+    eye_geometry_snapshot_t snapshot;
+    eye_geometry_compute( &geometry->config, &geometry->lens, geometry->eyes_xyz[ 0 ], geometry->eyes_xyz[ 1 ],
+        &snapshot );
+    snapshot.version = ++geometry->version;
+
+    uint64_t sequence = geometry->sequence.load( std::memory_order_relaxed );
+    geometry->sequence.store( sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    geometry->snapshot = snapshot;
+    geometry->sequence.store( sequence + 2, std::memory_order_release );
+}
+
+void eye_geometry_default_config( eye_geometry_config_t* config )
+{
+    config->virtual_image_distance_mm = 1300.0f;
+    config->virtual_image_size_mm[ 0 ] = 1200.0f;
+    config->virtual_image_size_mm[ 1 ] = 1200.0f;
+    config->update_threshold_mm = 0.5f;
+    config->smoothing = 0.01f;
+}
+
+eye_geometry_t* eye_geometry_create( eye_geometry_config_t const* config )
+{
+    auto geometry = new eye_geometry_t();
+    geometry->config = *config;
+    geometry->has_lens = false;
+    geometry->has_eyes[ 0 ] = geometry->has_eyes[ 1 ] = false;
+    geometry->published = false;
+    geometry->version = 0;
+    geometry->sequence = 0;
+    memset( &geometry->snapshot, 0, sizeof( geometry->snapshot ) );
+    return geometry;
+}
+
+void eye_geometry_destroy( eye_geometry_t* geometry )
+{
+    delete geometry;
+}
+
+tobii_error_t eye_geometry_read_lens_configuration( eye_geometry_t* geometry, tobii_device_t* device )
+{
+    tobii_lens_configuration_t lens;
+    tobii_error_t error = tobii_get_lens_configuration( device, &lens );
+    if( error != TOBII_ERROR_NO_ERROR ) return error;
+    eye_geometry_set_lens_configuration( geometry, &lens );
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void eye_geometry_set_lens_configuration( eye_geometry_t* geometry, tobii_lens_configuration_t const* lens )
+{
+    geometry->has_lens = true;
+    geometry->lens = *lens;
+    update( geometry );
+}
+
+static void smooth_eye( eye_geometry_t* geometry, int eye, float const* origin_xyz )
+{
+    float* xyz = geometry->eyes_xyz[ eye ];
+    if( !geometry->has_eyes[ eye ] )
+    {
+        memcpy( xyz, origin_xyz, sizeof( geometry->eyes_xyz[ eye ] ) );
+        geometry->has_eyes[ eye ] = true;
+        return;
+    }
+    for( int i = 0; i < 3; ++i ) xyz[ i ] += geometry->config.smoothing * ( origin_xyz[ i ] - xyz[ i ] );
+}
+
+void eye_geometry_push_wearable_advanced_data( eye_geometry_t* geometry, tobii_wearable_advanced_data_t const* data )
+{
+    bool left = data->left.gaze_origin_validity == TOBII_VALIDITY_VALID;
+    bool right = data->right.gaze_origin_validity == TOBII_VALIDITY_VALID;
+    if( left ) smooth_eye( geometry, 0, data->left.gaze_origin_mm_xyz );
+    if( right ) smooth_eye( geometry, 1, data->right.gaze_origin_mm_xyz );
+    if( left || right ) update( geometry );
+}
+
+void eye_geometry_push_wearable_consumer_data( eye_geometry_t* geometry, tobii_wearable_consumer_data_t const* data )
+{
+    if( data->gaze_origin_combined_validity != TOBII_VALIDITY_VALID ) return;
+    float const* origin = data->gaze_origin_combined_mm_xyz;
+
+    if( !geometry->has_eyes[ 0 ] || !geometry->has_eyes[ 1 ] )
+    {
+        // Without per-eye origins, start from eyes centered behind the lenses
+        if( !geometry->has_lens ) return;
+        for( int i = 0; i < 3; ++i )
+        {
+            float half = 0.5f * ( geometry->lens.right_xyz[ i ] - geometry->lens.left_xyz[ i ] );
+            geometry->eyes_xyz[ 0 ][ i ] = origin[ i ] - half;
+            geometry->eyes_xyz[ 1 ][ i ] = origin[ i ] + half;
+        }
+        geometry->has_eyes[ 0 ] = geometry->has_eyes[ 1 ] = true;
+        update( geometry );
+        return;
+    }
+
+    // Move both eyes with the smoothed midpoint
+    for( int i = 0; i < 3; ++i )
+    {
+        float middle = 0.5f * ( geometry->eyes_xyz[ 0 ][ i ] + geometry->eyes_xyz[ 1 ][ i ] );
+        float shift = geometry->config.smoothing * ( origin[ i ] - middle );
+        geometry->eyes_xyz[ 0 ][ i ] += shift;
+        geometry->eyes_xyz[ 1 ][ i ] += shift;
+    }
+    update( geometry );
+}
+
+void eye_geometry_snapshot( eye_geometry_t const* geometry, eye_geometry_snapshot_t* snapshot )
+{
+    for( ;; )
+    {
+        uint64_t sequence = geometry->sequence.load( std::memory_order_acquire );
+        if( sequence & 1 ) continue;
+        *snapshot = geometry->snapshot;
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( geometry->sequence.load( std::memory_order_relaxed ) == sequence ) return;
+    }
+}
+
+void eye_geometry_project_gaze( eye_geometry_snapshot_t const* snapshot, eye_geometry_eye_index_t eye,
+    float const* origins_xyz, float const* directions_xyz, int count, float* display_xy )
+{
+    eye_geometry_eye_t const* geometry = eye == EYE_GEOMETRY_LEFT ? &snapshot->left : &snapshot->right;
+    if( !snapshot->valid )
+    {
+        for( int i = 0; i < count * 2; ++i ) display_xy[ i ] = NAN;
+        return;
+    }
+
+    if( !origins_xyz )
+    {
+        // The point one direction away from the eye has the direction's z as its depth, and the eye position cancels
+        // out of the transform, leaving u = su * x / z + ou and likewise for v
+        float su = geometry->to_display[ 0 ], ou = geometry->to_display[ 2 ];
+        float sv = geometry->to_display[ 5 ], ov = geometry->to_display[ 6 ];
+        for( int i = 0; i < count; ++i )
+        {
+            float const* d = directions_xyz + i * 3;
+            float inverse_depth = 1.0f / d[ 2 ];
+            bool hit = d[ 2 ] > 0.0f;
+            display_xy[ i * 2 ] = hit ? su * d[ 0 ] * inverse_depth + ou : NAN;
+            display_xy[ i * 2 + 1 ] = hit ? sv * d[ 1 ] * inverse_depth + ov : NAN;
+        }
+        return;
+    }
+
+    // Explicit origins: intersect each ray with the image plane
+    float plane_z = geometry->image_center_xyz[ 2 ];
+    float left = geometry->image_center_xyz[ 0 ] + 0.5f * geometry->image_size_mm[ 0 ];
+    float top = geometry->image_center_xyz[ 1 ] + 0.5f * geometry->image_size_mm[ 1 ];
+    float inverse_width = 1.0f / geometry->image_size_mm[ 0 ], inverse_height = 1.0f / geometry->image_size_mm[ 1 ];
+    for( int i = 0; i < count; ++i )
+    {
+        float const* o = origins_xyz + i * 3;
+        float const* d = directions_xyz + i * 3;
+        float t = ( plane_z - o[ 2 ] ) / d[ 2 ];
+        bool hit = d[ 2 ] > 0.0f && t >= 0.0f;
+        display_xy[ i * 2 ] = hit ? ( left - ( o[ 0 ] + t * d[ 0 ] ) ) * inverse_width : NAN;
+        display_xy[ i * 2 + 1 ] = hit ? ( top - ( o[ 1 ] + t * d[ 1 ] ) ) * inverse_height : NAN;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef sample_eye_geometry_h
+#define sample_eye_geometry_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_wearable.h>
+
+#include <stdint.h>
+
+// Cached per-eye geometry for headset rendering: the interpupillary distance, the eye positions, and for each eye the
+// off-axis frustum to the virtual image of its display and a transform from headset coordinates to normalized display
+// coordinates. Everything is recomputed only when the lens configuration or a smoothed eye position has moved by more
+// than a threshold, rather than every frame, and published as a snapshot that render threads copy without locking.
+//
+// Eye positions come from the per-eye gaze origins of the wearable advanced data. The consumer data only carries the
+// combined origin, so it moves both eyes together and keeps the current distance between them.
+//
+// Headset coordinates are those of the lens configuration and the gaze origins: right handed, in millimeters, with z
+// pointing away from the user and y up, so x points to the user's left and the left lens has the larger x. Each
+// virtual image is a rectangle facing the user, centered in front of its lens.
+
+typedef struct eye_geometry_t eye_geometry_t;
+
+typedef struct eye_geometry_config_t
+{
+    float virtual_image_distance_mm; // From the lens to the virtual image of the display
+    float virtual_image_size_mm[ 2 ]; // Width and height of the virtual image
+    float update_threshold_mm; // Movement that triggers a recompute
+    float smoothing; // Weight of each new gaze origin in the running eye position, from 0 to 1
+} eye_geometry_config_t;
+
+typedef struct eye_geometry_eye_t
+{
+    float position_xyz[ 3 ];
+    float lens_xyz[ 3 ];
+    float image_center_xyz[ 3 ]; // Center of the virtual image
+    float image_size_mm[ 2 ];
+
+    // Tangents of the frustum half angles, signed, as used for off-axis projection matrices
+    float tan_left;
+    float tan_right;
+    float tan_down;
+    float tan_up;
+
+    // Row major. Maps a headset point, as a column vector with w = 1, to ( u * w, v * w, w, w ), where u and v are
+    // where the point appears on the display in normalized coordinates, 0, 0 at the top left, and w is its depth in
+    // front of the eye.
+    float to_display[ 16 ];
+} eye_geometry_eye_t;
+
+typedef struct eye_geometry_snapshot_t
+{
+    uint64_t version; // Incremented by every recompute, 0 before the first one
+    int valid; // Zero until a lens configuration and eye positions are known
+    float ipd_mm;
+    eye_geometry_eye_t left;
+    eye_geometry_eye_t right;
+} eye_geometry_snapshot_t;
+
+typedef enum eye_geometry_eye_index_t
+{
+    EYE_GEOMETRY_LEFT,
+    EYE_GEOMETRY_RIGHT,
+} eye_geometry_eye_index_t;
+
+// Fills *config* with a 1.3 m virtual image 1.2 m wide and 1.2 m tall, recomputing on 0.5 mm of movement, and eye
+// positions averaged over about a hundred samples.
+void eye_geometry_default_config( eye_geometry_config_t* config );
+
+eye_geometry_t* eye_geometry_create( eye_geometry_config_t const* config );
+
+void eye_geometry_destroy( eye_geometry_t* geometry );
+
+// Reads the lens configuration from *device*. Must not be called from inside a callback; call it at startup and after
+// changing the lens configuration. The functions that update the geometry must be called from one thread at a time.
+tobii_error_t eye_geometry_read_lens_configuration( eye_geometry_t* geometry, tobii_device_t* device );
+
+void eye_geometry_set_lens_configuration( eye_geometry_t* geometry, tobii_lens_configuration_t const* lens );
+
+void eye_geometry_push_wearable_advanced_data( eye_geometry_t* geometry, tobii_wearable_advanced_data_t const* data );
+
+void eye_geometry_push_wearable_consumer_data( eye_geometry_t* geometry, tobii_wearable_consumer_data_t const* data );
+
+// Computes a snapshot directly, without caching. For eye positions from elsewhere, or one-off use.
+void eye_geometry_compute( eye_geometry_config_t const* config, tobii_lens_configuration_t const* lens,
+    float const* left_xyz, float const* right_xyz, eye_geometry_snapshot_t* snapshot );
+
+// Safe to call from any thread while the geometry is being updated.
+void eye_geometry_snapshot( eye_geometry_t const* geometry, eye_geometry_snapshot_t* snapshot );
+
+// Projects *count* gaze directions from the eye position onto the display of *eye*, writing normalized display
+// coordinates to *display_xy*. With *origins_xyz*, rays start at those origins instead. Rays that do not reach the
+// virtual image plane give NaN.
+void eye_geometry_project_gaze( eye_geometry_snapshot_t const* snapshot, eye_geometry_eye_index_t eye,
+    float const* origins_xyz, float const* directions_xyz, int count, float* display_xy );
+
+#endif // sample_eye_geometry_h
@@ -0,0 +1,249 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_wearable.h>
+
+#include "eye_geometry.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+struct render_context_t
+{
+    eye_geometry_t* geometry;
+    std::atomic<bool> running;
+};
+
+static void render_thread( render_context_t* context )
+{
+    // A 90 Hz render loop, setting up both eye cameras from the cached geometry every frame
+    auto next_frame = std::chrono::steady_clock::now();
+    for( int frame = 0; context->running; ++frame )
+    {
+        next_frame += std::chrono::microseconds( 11111 );
+        std::this_thread::sleep_until( next_frame );
+
+        eye_geometry_snapshot_t snapshot;
+        eye_geometry_snapshot( context->geometry, &snapshot );
+        if( frame % 90 != 0 ) continue;
+        if( !snapshot.valid )
+        {
+            printf( "Frame %d: no eye geometry yet\n", frame );
+            continue;
+        }
+        printf( "Frame %d: IPD %.1f mm, left frustum %.3f %.3f %.3f %.3f, version %" PRIu64 "\n", frame,
+            snapshot.ipd_mm, snapshot.left.tan_left, snapshot.left.tan_right, snapshot.left.tan_down,
+            snapshot.left.tan_up, snapshot.version );
+    }
+}
+
+static void wearable_advanced_data_callback( tobii_wearable_advanced_data_t const* data, void* user_data )
+{
+    eye_geometry_push_wearable_advanced_data( static_cast<eye_geometry_t*>( user_data ), data );
+}
+
+static void idle( void* context )
+{
+    (void) context; // Unused parameter, the render thread does all the work
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int eye_geometry_sample_main( void );
+extern "C" int eye_geometry_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    eye_geometry_config_t config;
+    eye_geometry_default_config( &config );
+    eye_geometry_t* geometry = eye_geometry_create( &config );
+
+    // Read once here rather than every frame; it is a round trip to the tracker
+    error = eye_geometry_read_lens_configuration( geometry, device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to read the lens configuration.\n" );
+        eye_geometry_destroy( geometry );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    error = tobii_wearable_advanced_data_subscribe( device, wearable_advanced_data_callback, geometry );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to wearable advanced data stream.\n" );
+        eye_geometry_destroy( geometry );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    render_context_t render_context;
+    render_context.geometry = geometry;
+    render_context.running = true;
+    std::thread renderer( render_thread, &render_context );
+
+    main_loop( device, idle, NULL );
+
+    render_context.running = false;
+    renderer.join();
+
+    error = tobii_wearable_advanced_data_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from wearable advanced data stream.\n" );
+    eye_geometry_destroy( geometry );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+extern "C" int eye_geometry_benchmark_main( void );
+extern "C" int eye_geometry_benchmark_main( void )
+{
+    // Ten minutes of replayed headset data at 120 Hz, with lenses 15 mm in front of the replayed eyes
+    float const frequency_hz = 120.0f;
+    std::vector<tobii_wearable_advanced_data_t> samples( (size_t)( frequency_hz * 600 ) );
+    for( size_t i = 0; i < samples.size(); ++i )
+        stream_replay_wearable_advanced_data( (int64_t) i, frequency_hz, &samples[ i ] );
+    tobii_lens_configuration_t lens = { { 32.0f, 0.0f, 15.0f }, { -32.0f, 0.0f, 15.0f } };
+
+    eye_geometry_config_t config;
+    eye_geometry_default_config( &config );
+    eye_geometry_t* geometry = eye_geometry_create( &config );
+    eye_geometry_set_lens_configuration( geometry, &lens );
+    auto start = std::chrono::steady_clock::now();
+    for( auto const& sample : samples ) eye_geometry_push_wearable_advanced_data( geometry, &sample );
+    double push_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        (double) samples.size();
+    eye_geometry_snapshot_t snapshot;
+    eye_geometry_snapshot( geometry, &snapshot );
+    printf( "%zu samples: %.0f ns per push, %" PRIu64 " recomputes, IPD %.2f mm\n", samples.size(), push_ns,
+        snapshot.version, snapshot.ipd_mm );
+
+    // One frame at 90 Hz for every 1.33 samples. Before: rebuild the geometry from the newest sample every frame,
+    // which is what the renderer did, not counting the tobii_get_lens_configuration round trip it also made. After:
+    // copy the cached snapshot.
+    int const frames = 1000000;
+    volatile float sink = 0.0f;
+    start = std::chrono::steady_clock::now();
+    for( int frame = 0; frame < frames; ++frame )
+    {
+        tobii_wearable_advanced_data_t const& sample = samples[ (size_t)( frame * 4 / 3 ) % samples.size() ];
+        eye_geometry_snapshot_t frame_geometry;
+        eye_geometry_compute( &config, &lens, sample.left.gaze_origin_mm_xyz, sample.right.gaze_origin_mm_xyz,
+            &frame_geometry );
+        sink = sink + frame_geometry.left.tan_left;
+    }
+    double before_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        frames;
+    start = std::chrono::steady_clock::now();
+    for( int frame = 0; frame < frames; ++frame )
+    {
+        eye_geometry_snapshot_t frame_geometry;
+        eye_geometry_snapshot( geometry, &frame_geometry );
+        sink = sink + frame_geometry.left.tan_left;
+    }
+    double after_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        frames;
+    printf( "Per frame: %.1f ns recomputing, %.1f ns from the cache\n", before_ns, after_ns );
+
+    // Batch projection of the combined gaze direction, from the eye and from the combined origin
+    std::vector<float> origins, directions;
+    for( auto const& sample : samples )
+    {
+        origins.insert( origins.end(), sample.gaze_origin_combined_mm_xyz, sample.gaze_origin_combined_mm_xyz + 3 );
+        directions.insert( directions.end(), sample.gaze_direction_combined_normalized_xyz,
+            sample.gaze_direction_combined_normalized_xyz + 3 );
+    }
+    std::vector<float> from_eye( samples.size() * 2 ), from_origin( samples.size() * 2 );
+    int const count = (int) samples.size();
+    start = std::chrono::steady_clock::now();
+    for( int round = 0; round < 20; ++round )
+        eye_geometry_project_gaze( &snapshot, EYE_GEOMETRY_LEFT, NULL, directions.data(), count, from_eye.data() );
+    double eye_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        ( 20.0 * count );
+    start = std::chrono::steady_clock::now();
+    for( int round = 0; round < 20; ++round )
+        eye_geometry_project_gaze( &snapshot, EYE_GEOMETRY_LEFT, origins.data(), directions.data(), count,
+            from_origin.data() );
+    double origin_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        ( 20.0 * count );
+    printf( "Projecting gaze: %.2f ns per vector from the eye, %.2f ns from given origins\n", eye_ns, origin_ns );
+
+    // Both ways must agree when the origins are the eye itself
+    std::vector<float> eye_origins;
+    for( int i = 0; i < count; ++i )
+        eye_origins.insert( eye_origins.end(), snapshot.left.position_xyz, snapshot.left.position_xyz + 3 );
+    eye_geometry_project_gaze( &snapshot, EYE_GEOMETRY_LEFT, eye_origins.data(), directions.data(), count,
+        from_origin.data() );
+    float worst = 0.0f;
+    for( int i = 0; i < count * 2; ++i ) worst = std::max( worst, fabsf( from_eye[ i ] - from_origin[ i ] ) );
+    printf( "Largest difference between the two projections: %g\n", worst );
+
+    // A target on the user's left, at larger headset x than the left eye, must land on the left half of the display,
+    // both through the projection and through the transform
+    float const* eye = snapshot.left.position_xyz;
+    float target[ 3 ] = { eye[ 0 ] + 200.0f, eye[ 1 ], eye[ 2 ] + 1000.0f };
+    float direction[ 3 ] = { target[ 0 ] - eye[ 0 ], target[ 1 ] - eye[ 1 ], target[ 2 ] - eye[ 2 ] };
+    float projected[ 2 ];
+    eye_geometry_project_gaze( &snapshot, EYE_GEOMETRY_LEFT, NULL, direction, 1, projected );
+    float const* m = snapshot.left.to_display;
+    float transformed_u = ( m[ 0 ] * target[ 0 ] + m[ 1 ] * target[ 1 ] + m[ 2 ] * target[ 2 ] + m[ 3 ] ) /
+        ( m[ 12 ] * target[ 0 ] + m[ 13 ] * target[ 1 ] + m[ 14 ] * target[ 2 ] + m[ 15 ] );
+    bool sides_correct = projected[ 0 ] < 0.5f && transformed_u < 0.5f && snapshot.left.tan_left < 0.0f &&
+        snapshot.left.tan_right > 0.0f;
+    printf( "Target on the user's left: u %.3f projected, %.3f transformed, %s\n", projected[ 0 ], transformed_u,
+        sides_correct ? "left half" : "MIRRORED" );
+
+    eye_geometry_destroy( geometry );
+    return worst < 1e-4f && sides_correct ? 0 : 1;
+}
@@ -0,0 +1,531 @@
+#include "flight_recorder_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+static size_t const huge_page_size = 2u << 20;
+static uint64_t const event_capacity = 1024;
+static std::chrono::seconds const automatic_dump_interval( 30 ); // Between dumps the recorder requests itself
+
+struct flight_ring_t
+{
+    char* records; // NULL until the stream is added
+    uint32_t record_size;
+    uint64_t capacity;
+    size_t mapped_size;
+    bool huge_pages;
+    uint64_t next_slot; // Only touched by the publishing thread
+    alignas( 64 ) std::atomic<uint64_t> written; // Records published so far
+};
+
+struct flight_recorder_t
+{
+    std::string directory;
+    tobii_api_t* api;
+    tobii_device_t* device;
+    float seconds;
+    float frequency_hz;
+    bool subscribed[ FLIGHT_RECORDER_STREAM_COUNT ];
+    flight_ring_t rings[ FLIGHT_RECORDER_STREAM_COUNT ];
+    std::atomic<bool> added[ FLIGHT_RECORDER_STREAM_COUNT ];
+    std::mutex error_mutex; // Errors are published from any thread
+    std::atomic<bool> connection_lost; // Set by the first connection failure, cleared by the next success
+
+    // Dump requests, guarded by the mutex
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable done_cv;
+    bool exit_event;
+    uint64_t requested;
+    uint64_t completed;
+    uint32_t pending; // Requests not yet taken by the dump thread
+    char pending_reason[ sizeof( flight_recorder_file_header_t::reason ) ];
+    int64_t pending_requested_us;
+    bool automatic_dumped; // Whether last_automatic_dump is set
+    std::chrono::steady_clock::time_point last_automatic_dump;
+    std::string last_dump_path;
+    flight_recorder_statistics_t statistics;
+    std::thread thread;
+};
+
+static uint32_t record_size( flight_recorder_stream_t stream )
+{
+    switch( stream )
+    {
+        case FLIGHT_RECORDER_GAZE_POINT: return sizeof( tobii_gaze_point_t );
+        case FLIGHT_RECORDER_GAZE_ORIGIN: return sizeof( tobii_gaze_origin_t );
+        case FLIGHT_RECORDER_EYE_POSITION_NORMALIZED: return sizeof( tobii_eye_position_normalized_t );
+        case FLIGHT_RECORDER_USER_PRESENCE: return sizeof( flight_recorder_user_presence_t );
+        case FLIGHT_RECORDER_HEAD_POSE: return sizeof( tobii_head_pose_t );
+        case FLIGHT_RECORDER_NOTIFICATIONS: return sizeof( tobii_notification_t );
+        case FLIGHT_RECORDER_USER_POSITION_GUIDE: return sizeof( tobii_user_position_guide_t );
+        case FLIGHT_RECORDER_GAZE_DATA: return sizeof( tobii_gaze_data_t );
+        case FLIGHT_RECORDER_WEARABLE_CONSUMER_DATA: return sizeof( tobii_wearable_consumer_data_t );
+        case FLIGHT_RECORDER_WEARABLE_ADVANCED_DATA: return sizeof( tobii_wearable_advanced_data_t );
+        case FLIGHT_RECORDER_ERRORS: return sizeof( flight_recorder_error_t );
+        default: return 0;
+    }
+}
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_GAZE_POINT, gaze_point );
+}
+
+static void gaze_origin_callback( tobii_gaze_origin_t const* gaze_origin, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_GAZE_ORIGIN, gaze_origin );
+}
+
+static void eye_position_callback( tobii_eye_position_normalized_t const* eye_position, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_EYE_POSITION_NORMALIZED,
+        eye_position );
+}
+
+static void user_presence_callback( tobii_user_presence_status_t status, int64_t timestamp_us, void* user_data )
+{
+    flight_recorder_user_presence_t presence = { status, timestamp_us };
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_USER_PRESENCE, &presence );
+}
+
+static void head_pose_callback( tobii_head_pose_t const* head_pose, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_HEAD_POSE, head_pose );
+}
+
+static void notifications_callback( tobii_notification_t const* notification, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_NOTIFICATIONS,
+        notification );
+}
+
+static void user_position_guide_callback( tobii_user_position_guide_t const* data, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_USER_POSITION_GUIDE, data );
+}
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_GAZE_DATA, gaze_data );
+}
+
+static void wearable_consumer_callback( tobii_wearable_consumer_data_t const* data, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_WEARABLE_CONSUMER_DATA,
+        data );
+}
+
+static void wearable_advanced_callback( tobii_wearable_advanced_data_t const* data, void* user_data )
+{
+    flight_recorder_publish( static_cast<flight_recorder_t*>( user_data ), FLIGHT_RECORDER_WEARABLE_ADVANCED_DATA,
+        data );
+}
+
+static tobii_error_t subscribe( flight_recorder_t* recorder, flight_recorder_stream_t stream )
+{
+    tobii_device_t* device = recorder->device;
+    switch( stream )
+    {
+        case FLIGHT_RECORDER_GAZE_POINT: return tobii_gaze_point_subscribe( device, gaze_point_callback, recorder );
+        case FLIGHT_RECORDER_GAZE_ORIGIN: return tobii_gaze_origin_subscribe( device, gaze_origin_callback, recorder );
+        case FLIGHT_RECORDER_EYE_POSITION_NORMALIZED:
+            return tobii_eye_position_normalized_subscribe( device, eye_position_callback, recorder );
+        case FLIGHT_RECORDER_USER_PRESENCE:
+            return tobii_user_presence_subscribe( device, user_presence_callback, recorder );
+        case FLIGHT_RECORDER_HEAD_POSE: return tobii_head_pose_subscribe( device, head_pose_callback, recorder );
+        case FLIGHT_RECORDER_NOTIFICATIONS:
+            return tobii_notifications_subscribe( device, notifications_callback, recorder );
+        case FLIGHT_RECORDER_USER_POSITION_GUIDE:
+            return tobii_user_position_guide_subscribe( device, user_position_guide_callback, recorder );
+        case FLIGHT_RECORDER_GAZE_DATA: return tobii_gaze_data_subscribe( device, gaze_data_callback, recorder );
+        case FLIGHT_RECORDER_WEARABLE_CONSUMER_DATA:
+            return tobii_wearable_consumer_data_subscribe( device, wearable_consumer_callback, recorder );
+        case FLIGHT_RECORDER_WEARABLE_ADVANCED_DATA:
+            return tobii_wearable_advanced_data_subscribe( device, wearable_advanced_callback, recorder );
+        default: return TOBII_ERROR_INVALID_PARAMETER;
+    }
+}
+
+static tobii_error_t unsubscribe( flight_recorder_t* recorder, flight_recorder_stream_t stream )
+{
+    tobii_device_t* device = recorder->device;
+    switch( stream )
+    {
+        case FLIGHT_RECORDER_GAZE_POINT: return tobii_gaze_point_unsubscribe( device );
+        case FLIGHT_RECORDER_GAZE_ORIGIN: return tobii_gaze_origin_unsubscribe( device );
+        case FLIGHT_RECORDER_EYE_POSITION_NORMALIZED: return tobii_eye_position_normalized_unsubscribe( device );
+        case FLIGHT_RECORDER_USER_PRESENCE: return tobii_user_presence_unsubscribe( device );
+        case FLIGHT_RECORDER_HEAD_POSE: return tobii_head_pose_unsubscribe( device );
+        case FLIGHT_RECORDER_NOTIFICATIONS: return tobii_notifications_unsubscribe( device );
+        case FLIGHT_RECORDER_USER_POSITION_GUIDE: return tobii_user_position_guide_unsubscribe( device );
+        case FLIGHT_RECORDER_GAZE_DATA: return tobii_gaze_data_unsubscribe( device );
+        case FLIGHT_RECORDER_WEARABLE_CONSUMER_DATA: return tobii_wearable_consumer_data_unsubscribe( device );
+        case FLIGHT_RECORDER_WEARABLE_ADVANCED_DATA: return tobii_wearable_advanced_data_unsubscribe( device );
+        default: return TOBII_ERROR_INVALID_PARAMETER;
+    }
+}
+
+// Maps the records of a ring and touches every page, so publishing never faults. Rings of a huge page or more try
+// the reserved huge pages first, and otherwise ask for transparent ones before the pages are touched.
+static bool allocate_ring( flight_ring_t* ring )
+{
+    size_t size = (size_t) ring->record_size * ring->capacity;
+    void* memory = MAP_FAILED;
+    if( size >= huge_page_size )
+    {
+        size = ( size + huge_page_size - 1 ) & ~( huge_page_size - 1 );
+        memory = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+            -1, 0 );
+        ring->huge_pages = memory != MAP_FAILED;
+    }
+    if( memory == MAP_FAILED )
+    {
+        memory = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if( memory == MAP_FAILED ) return false;
+        if( size >= huge_page_size ) madvise( memory, size, MADV_HUGEPAGE );
+        memset( memory, 0, size );
+    }
+    ring->records = static_cast<char*>( memory );
+    ring->mapped_size = size;
+    return true;
+}
+
+static int64_t system_clock_us( flight_recorder_t const* recorder )
+{
+    int64_t timestamp_us = 0;
+    if( recorder->api && tobii_system_clock( recorder->api, &timestamp_us ) == TOBII_ERROR_NO_ERROR )
+        return timestamp_us;
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+static bool write_all( int fd, void const* data, size_t size )
+{
+    auto bytes = static_cast<char const*>( data );
+    while( size > 0 )
+    {
+        ssize_t written = write( fd, bytes, size );
+        if( written < 0 && errno == EINTR ) continue;
+        if( written <= 0 ) return false;
+        bytes += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+// Writes the records of a ring, oldest first, straight from the ring while it is being published to. Slots that were
+// overwritten while the kernel copied them are found afterwards from the write counter, and marked as skipped.
+static bool write_section( int fd, flight_recorder_stream_t stream, flight_ring_t* ring, uint64_t* bytes,
+    uint64_t* skipped )
+{
+    off_t section_offset = lseek( fd, 0, SEEK_CUR );
+    flight_recorder_section_t section = { (uint32_t) stream, ring->record_size, 0, 0 };
+    if( section_offset < 0 || !write_all( fd, &section, sizeof( section ) ) ) return false;
+
+    uint64_t written = ring->written.load( std::memory_order_acquire );
+    uint64_t count = std::min( written, ring->capacity );
+    uint64_t oldest = written - count;
+    uint64_t first_slot = oldest % ring->capacity;
+    uint64_t first_part = std::min( count, ring->capacity - first_slot );
+    if( !write_all( fd, ring->records + first_slot * ring->record_size, first_part * ring->record_size ) ||
+        !write_all( fd, ring->records, ( count - first_part ) * ring->record_size ) )
+        return false;
+
+    // The record being published when the counter was read may be half written too
+    std::atomic_thread_fence( std::memory_order_acquire );
+    uint64_t written_after = ring->written.load( std::memory_order_acquire );
+    uint64_t overwritten_end = written_after + 1 > ring->capacity ? written_after + 1 - ring->capacity : 0;
+    section.record_count = count;
+    section.skipped = overwritten_end > oldest ? std::min( overwritten_end - oldest, count ) : 0;
+    if( pwrite( fd, &section, sizeof( section ), section_offset ) != (ssize_t) sizeof( section ) ) return false;
+
+    *bytes += sizeof( section ) + count * ring->record_size;
+    *skipped += section.skipped;
+    return true;
+}
+
+static std::string dump_path( flight_recorder_t const* recorder, int64_t requested_us, uint64_t sequence,
+    char const* reason )
+{
+    std::string name = "flight_" + std::to_string( requested_us ) + "_" + std::to_string( sequence ) + "_";
+    for( char const* c = reason; *c; ++c )
+        name += ( *c >= 'a' && *c <= 'z' ) || ( *c >= 'A' && *c <= 'Z' ) || ( *c >= '0' && *c <= '9' ) || *c == '-' ?
+            *c : '_';
+    return recorder->directory + "/" + name + ".tfr";
+}
+
+static void write_dump( flight_recorder_t* recorder, flight_recorder_file_header_t const* header, uint64_t sequence )
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string path = dump_path( recorder, header->requested_us, sequence, header->reason );
+    std::string temporary = path + ".tmp";
+
+    // Written under a temporary name, and only renamed once it is complete and on disk
+    bool ok = false;
+    uint64_t bytes = sizeof( *header ), skipped = 0;
+    int fd = open( temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if( fd >= 0 )
+    {
+        ok = write_all( fd, header, sizeof( *header ) );
+        for( int stream = 0; ok && stream < FLIGHT_RECORDER_STREAM_COUNT; ++stream )
+            if( recorder->added[ stream ].load( std::memory_order_acquire ) )
+                ok = write_section( fd, (flight_recorder_stream_t) stream, &recorder->rings[ stream ], &bytes,
+                    &skipped );
+        ok = ok && fsync( fd ) == 0;
+        ok = close( fd ) == 0 && ok;
+        ok = ok && rename( temporary.c_str(), path.c_str() ) == 0;
+        if( !ok ) unlink( temporary.c_str() );
+    }
+    int64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() -
+        start ).count();
+
+    std::lock_guard<std::mutex> lock( recorder->mutex );
+    if( ok )
+    {
+        ++recorder->statistics.dumps;
+        recorder->statistics.skipped += skipped;
+        recorder->statistics.last_dump_us = elapsed_us;
+        recorder->statistics.last_dump_bytes = bytes;
+        recorder->last_dump_path = path;
+    }
+    else
+        ++recorder->statistics.failed_dumps;
+}
+
+static void dump_thread( flight_recorder_t* recorder )
+{
+    uint64_t sequence = 0;
+    std::unique_lock<std::mutex> lock( recorder->mutex );
+    for( ;; )
+    {
+        recorder->cv.wait( lock, [&] { return recorder->pending > 0 || recorder->exit_event; } );
+        if( recorder->pending == 0 ) return;
+
+        // Take every request so far, so those arriving during the write make up the next dump
+        flight_recorder_file_header_t header = {};
+        header.magic = FLIGHT_RECORDER_MAGIC;
+        header.version = FLIGHT_RECORDER_VERSION;
+        for( int stream = 0; stream < FLIGHT_RECORDER_STREAM_COUNT; ++stream )
+            header.section_count += recorder->added[ stream ].load( std::memory_order_acquire ) ? 1 : 0;
+        header.requested_us = recorder->pending_requested_us;
+        header.merged_requests = recorder->pending - 1;
+        memcpy( header.reason, recorder->pending_reason, sizeof( header.reason ) );
+        recorder->statistics.merged_requests += recorder->pending - 1;
+        recorder->pending = 0;
+        uint64_t taken = recorder->requested;
+
+        lock.unlock();
+        write_dump( recorder, &header, sequence++ );
+        lock.lock();
+        recorder->completed = taken;
+        recorder->done_cv.notify_all();
+    }
+}
+
+tobii_error_t flight_recorder_create( char const* directory, tobii_api_t* api, tobii_device_t* device, float seconds,
+    float frequency_hz, flight_recorder_t** recorder )
+{
+    if( !directory || !recorder || seconds <= 0.0f || frequency_hz <= 0.0f ) return TOBII_ERROR_INVALID_PARAMETER;
+
+    auto result = new flight_recorder_t();
+    result->directory = directory;
+    result->api = api;
+    result->device = device;
+    result->seconds = seconds;
+    result->frequency_hz = frequency_hz;
+    result->exit_event = false;
+    result->requested = 0;
+    result->completed = 0;
+    result->pending = 0;
+    result->automatic_dumped = false;
+    result->connection_lost = false;
+
+    // Errors are always recorded, as they are what explains most incidents
+    tobii_error_t error = flight_recorder_add_stream( result, FLIGHT_RECORDER_ERRORS );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        delete result;
+        return error;
+    }
+    result->thread = std::thread( dump_thread, result );
+    *recorder = result;
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void flight_recorder_destroy( flight_recorder_t* recorder )
+{
+    for( int stream = 0; stream < FLIGHT_RECORDER_STREAM_COUNT; ++stream )
+        if( recorder->subscribed[ stream ] ) unsubscribe( recorder, (flight_recorder_stream_t) stream );
+
+    // Requests still pending are written before the thread exits
+    {
+        std::lock_guard<std::mutex> lock( recorder->mutex );
+        recorder->exit_event = true;
+    }
+    recorder->cv.notify_all();
+    recorder->thread.join();
+
+    for( auto& ring : recorder->rings )
+        if( ring.records ) munmap( ring.records, ring.mapped_size );
+    delete recorder;
+}
+
+// Automatic requests, those the recorder makes itself, are dropped within automatic_dump_interval of the last one
+// that was taken, so a device that keeps failing does not fill the disk with dumps.
+static void request_dump( flight_recorder_t* recorder, char const* reason, bool automatic )
+{
+    int64_t requested_us = system_clock_us( recorder );
+    {
+        std::lock_guard<std::mutex> lock( recorder->mutex );
+        if( automatic )
+        {
+            auto now = std::chrono::steady_clock::now();
+            if( recorder->automatic_dumped && now - recorder->last_automatic_dump < automatic_dump_interval )
+            {
+                ++recorder->statistics.suppressed_requests;
+                return;
+            }
+            recorder->automatic_dumped = true;
+            recorder->last_automatic_dump = now;
+        }
+        if( recorder->pending++ == 0 )
+        {
+            recorder->pending_requested_us = requested_us;
+            snprintf( recorder->pending_reason, sizeof( recorder->pending_reason ), "%s", reason ? reason : "" );
+        }
+        ++recorder->requested;
+    }
+    recorder->cv.notify_one();
+}
+
+tobii_error_t flight_recorder_add_stream( flight_recorder_t* recorder, flight_recorder_stream_t stream )
+{
+    if( (int) stream < 0 || stream >= FLIGHT_RECORDER_STREAM_COUNT ) return TOBII_ERROR_INVALID_PARAMETER;
+    if( recorder->added[ stream ] ) return TOBII_ERROR_ALREADY_SUBSCRIBED;
+
+    // Streams that only change now and then get a fixed number of records instead
+    flight_ring_t* ring = &recorder->rings[ stream ];
+    bool events = stream == FLIGHT_RECORDER_NOTIFICATIONS || stream == FLIGHT_RECORDER_USER_PRESENCE ||
+        stream == FLIGHT_RECORDER_ERRORS;
+    if( !ring->records )
+    {
+        ring->record_size = record_size( stream );
+        ring->capacity = events ? event_capacity : std::max( (uint64_t) 1,
+            (uint64_t) ceil( (double) recorder->seconds * (double) recorder->frequency_hz ) );
+        if( !allocate_ring( ring ) ) return TOBII_ERROR_ALLOCATION_FAILED;
+    }
+    recorder->added[ stream ].store( true, std::memory_order_release );
+
+    // A ring whose subscription failed is left out of dumps, but kept until the recorder is destroyed, as a dump
+    // could be reading it
+    if( recorder->device && stream != FLIGHT_RECORDER_ERRORS )
+    {
+        tobii_error_t error = subscribe( recorder, stream );
+        if( error != TOBII_ERROR_NO_ERROR )
+        {
+            recorder->added[ stream ].store( false, std::memory_order_release );
+            return error;
+        }
+        recorder->subscribed[ stream ] = true;
+    }
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void flight_recorder_publish( flight_recorder_t* recorder, flight_recorder_stream_t stream, void const* record )
+{
+    flight_ring_t* ring = &recorder->rings[ stream ];
+    if( !ring->records ) return;
+
+    uint64_t written = ring->written.load( std::memory_order_relaxed );
+    memcpy( ring->records + ring->next_slot * ring->record_size, record, ring->record_size );
+    if( ++ring->next_slot == ring->capacity ) ring->next_slot = 0;
+    ring->written.store( written + 1, std::memory_order_release );
+
+    if( stream == FLIGHT_RECORDER_NOTIFICATIONS )
+    {
+        // Any fault or warning that is raised, rather than cleared, is worth a dump
+        auto notification = static_cast<tobii_notification_t const*>( record );
+        bool raised = notification->value_type == TOBII_NOTIFICATION_VALUE_TYPE_STRING &&
+            notification->value.string_[ 0 ] != '\0';
+        if( raised && notification->type == TOBII_NOTIFICATION_TYPE_FAULTS_CHANGED )
+            request_dump( recorder, "faults", true );
+        else if( raised && notification->type == TOBII_NOTIFICATION_TYPE_WARNINGS_CHANGED )
+            request_dump( recorder, "warnings", true );
+    }
+}
+
+void flight_recorder_publish_error( flight_recorder_t* recorder, tobii_error_t error, char const* function )
+{
+    if( error == TOBII_ERROR_NO_ERROR )
+    {
+        // The connection works again, so the next failure starts a new outage
+        if( recorder->connection_lost.load( std::memory_order_relaxed ) )
+            recorder->connection_lost.store( false, std::memory_order_relaxed );
+        return;
+    }
+
+    flight_recorder_error_t record = {};
+    record.timestamp_us = recorder->api ? system_clock_us( recorder ) : 0;
+    record.error = error;
+    if( function ) snprintf( record.function, sizeof( record.function ), "%s", function );
+    {
+        std::lock_guard<std::mutex> lock( recorder->error_mutex );
+        flight_recorder_publish( recorder, FLIGHT_RECORDER_ERRORS, &record );
+    }
+
+    // Every retry during an outage fails the same way, and only the first failure has the data leading up to it
+    if( error == TOBII_ERROR_CONNECTION_FAILED && !recorder->connection_lost.exchange( true ) )
+        request_dump( recorder, "connection_failed", true );
+}
+
+void flight_recorder_dump( flight_recorder_t* recorder, char const* reason )
+{
+    request_dump( recorder, reason, false );
+}
+
+void flight_recorder_wait_for_dumps( flight_recorder_t* recorder )
+{
+    std::unique_lock<std::mutex> lock( recorder->mutex );
+    uint64_t requested = recorder->requested;
+    recorder->done_cv.wait( lock, [&] { return recorder->completed >= requested; } );
+}
+
+void flight_recorder_last_dump_path( flight_recorder_t* recorder, char* path, size_t size )
+{
+    if( size == 0 ) return;
+    std::lock_guard<std::mutex> lock( recorder->mutex );
+    snprintf( path, size, "%s", recorder->last_dump_path.c_str() );
+}
+
+void flight_recorder_statistics( flight_recorder_t const* recorder, flight_recorder_statistics_t* statistics )
+{
+    {
+        std::lock_guard<std::mutex> lock( recorder->mutex );
+        *statistics = recorder->statistics;
+    }
+    statistics->records = 0;
+    statistics->memory_bytes = 0;
+    statistics->huge_page_rings = 0;
+    for( int stream = 0; stream < FLIGHT_RECORDER_STREAM_COUNT; ++stream )
+    {
+        if( !recorder->added[ stream ].load( std::memory_order_acquire ) ) continue;
+        flight_ring_t const& ring = recorder->rings[ stream ];
+        statistics->records += ring.written.load( std::memory_order_relaxed );
+        statistics->memory_bytes += ring.mapped_size;
+        statistics->huge_page_rings += ring.huge_pages ? 1 : 0;
+    }
+}
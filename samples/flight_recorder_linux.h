@@ -0,0 +1,131 @@
+#ifndef sample_flight_recorder_linux_h
+#define sample_flight_recorder_linux_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Keeps the last seconds of every recorded stream in memory, along with the errors returned by the API, so there is
+// data from just before an incident when one happens. Each stream gets a ring sized for the configured duration at the
+// configured rate, allocated and touched up front, on explicit huge pages when the system has them reserved and on
+// transparent huge pages otherwise, so recording never allocates or page faults.
+//
+// Recording a sample is a copy into the ring of its stream and a counter update. Dumps are written by a thread of the
+// recorder, straight from the rings, while recording goes on: whatever was overwritten during the write is marked as
+// skipped in the file rather than held back. A dump is written to a temporary file, synced, and renamed into place, so
+// a dump file is either complete or not there. Dumps are requested on demand, when a notification reports faults or
+// warnings, and when the first TOBII_ERROR_CONNECTION_FAILED of an outage is recorded; the retries that follow do not
+// dump again until a call has succeeded. The recorder's own requests are limited to one every 30 seconds, and the
+// others are dropped and counted. Requests that arrive while a dump is being written are merged into a single dump
+// after it.
+//
+// Dump files start with a flight_recorder_file_header_t, followed by a flight_recorder_section_t and its records for
+// each stream, oldest first. Records are the tobii record type of the stream, or the types below for user presence and
+// errors.
+
+typedef enum flight_recorder_stream_t
+{
+    FLIGHT_RECORDER_GAZE_POINT,
+    FLIGHT_RECORDER_GAZE_ORIGIN,
+    FLIGHT_RECORDER_EYE_POSITION_NORMALIZED,
+    FLIGHT_RECORDER_USER_PRESENCE,
+    FLIGHT_RECORDER_HEAD_POSE,
+    FLIGHT_RECORDER_NOTIFICATIONS,
+    FLIGHT_RECORDER_USER_POSITION_GUIDE,
+    FLIGHT_RECORDER_GAZE_DATA,
+    FLIGHT_RECORDER_WEARABLE_CONSUMER_DATA,
+    FLIGHT_RECORDER_WEARABLE_ADVANCED_DATA,
+    FLIGHT_RECORDER_ERRORS,
+    FLIGHT_RECORDER_STREAM_COUNT,
+} flight_recorder_stream_t;
+
+typedef struct flight_recorder_t flight_recorder_t;
+
+typedef struct flight_recorder_user_presence_t
+{
+    tobii_user_presence_status_t status;
+    int64_t timestamp_us;
+} flight_recorder_user_presence_t;
+
+typedef struct flight_recorder_error_t
+{
+    int64_t timestamp_us; // From tobii_system_clock, or 0 without an api
+    tobii_error_t error;
+    char function[ 52 ]; // The API function that returned the error
+} flight_recorder_error_t;
+
+#define FLIGHT_RECORDER_MAGIC 0x524c4654 // "TFLR"
+#define FLIGHT_RECORDER_VERSION 1
+
+typedef struct flight_recorder_file_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t section_count;
+    uint32_t reserved;
+    int64_t requested_us; // When the dump was requested, from tobii_system_clock
+    uint32_t merged_requests; // Requests that arrived while the previous dump was written
+    char reason[ 44 ]; // Of the first request
+} flight_recorder_file_header_t;
+
+typedef struct flight_recorder_section_t
+{
+    uint32_t stream; // flight_recorder_stream_t
+    uint32_t record_size;
+    uint64_t record_count;
+    uint64_t skipped; // Leading records that were overwritten while the dump was written, and must be ignored
+} flight_recorder_section_t;
+
+typedef struct flight_recorder_statistics_t
+{
+    uint64_t records;
+    uint64_t dumps;
+    uint64_t failed_dumps;
+    uint64_t merged_requests;
+    uint64_t suppressed_requests; // Requests of the recorder's own dropped by the 30 second limit
+    uint64_t skipped; // Records overwritten while being dumped, over all dumps
+    int64_t last_dump_us; // How long the last dump took to write, sync and rename
+    uint64_t last_dump_bytes;
+    uint64_t memory_bytes; // Held by the rings
+    int huge_page_rings; // Rings on explicit huge pages, the others use transparent huge pages if enabled
+} flight_recorder_statistics_t;
+
+// Dumps are written to *directory*, which must exist. Each stream added later gets a ring for *seconds* at
+// *frequency_hz*; the notification, user presence and error rings hold 1024 records. *api* timestamps the
+// errors and dump requests, and may be NULL. A NULL *device* creates a recorder which is only fed through the publish
+// functions.
+tobii_error_t flight_recorder_create( char const* directory, tobii_api_t* api, tobii_device_t* device, float seconds,
+    float frequency_hz, flight_recorder_t** recorder );
+
+// Unsubscribes all streams, and waits for a dump being written to finish.
+void flight_recorder_destroy( flight_recorder_t* recorder );
+
+// Allocates the ring of *stream* and subscribes to it on the device. Must not be called from inside a callback.
+// Returns TOBII_ERROR_ALLOCATION_FAILED if the ring can not be allocated.
+tobii_error_t flight_recorder_add_stream( flight_recorder_t* recorder, flight_recorder_stream_t stream );
+
+// Records a sample of *stream*, which must point to its record type. This is what the subscription callbacks call,
+// and may be used for streams subscribed to elsewhere, once added. Calls for one stream must be made from one thread
+// at a time.
+void flight_recorder_publish( flight_recorder_t* recorder, flight_recorder_stream_t stream, void const* record );
+
+// Records an error returned by *function*, from any thread. TOBII_ERROR_NO_ERROR is not recorded, but ends an outage,
+// so pass the result of every call that can fail with TOBII_ERROR_CONNECTION_FAILED, including tobii_device_reconnect.
+void flight_recorder_publish_error( flight_recorder_t* recorder, tobii_error_t error, char const* function );
+
+// Requests a dump, and returns without waiting for it. Safe to call from any thread, including from callbacks.
+void flight_recorder_dump( flight_recorder_t* recorder, char const* reason );
+
+// Waits until every dump requested so far has been written.
+void flight_recorder_wait_for_dumps( flight_recorder_t* recorder );
+
+// Copies the path of the last dump written to *path*, which is empty before the first dump.
+void flight_recorder_last_dump_path( flight_recorder_t* recorder, char* path, size_t size );
+
+void flight_recorder_statistics( flight_recorder_t const* recorder, flight_recorder_statistics_t* statistics );
+
+#endif // sample_flight_recorder_linux_h
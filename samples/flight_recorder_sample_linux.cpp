@@ -0,0 +1,312 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_config.h>
+
+#include "flight_recorder_linux.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+
+// Reads a line from stdin if one has been typed, without blocking
+static bool read_command( char* command )
+{
+    fd_set fds;
+    FD_ZERO( &fds );
+    FD_SET( 0, &fds );
+    timeval timeout = { 0, 0 };
+    if( select( 1, &fds, NULL, NULL, &timeout ) <= 0 ) return false;
+    char line[ 64 ];
+    if( !fgets( line, sizeof( line ), stdin ) ) return false;
+    *command = line[ 0 ];
+    return true;
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int flight_recorder_sample_main( void );
+extern "C" int flight_recorder_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    float frequency_hz;
+    error = tobii_get_output_frequency( device, &frequency_hz );
+    if( error != TOBII_ERROR_NO_ERROR ) frequency_hz = 120.0f;
+
+    // The last minute of everything the device offers, dumped to the current directory
+    flight_recorder_t* recorder;
+    error = flight_recorder_create( ".", api, device, 60.0f, frequency_hz, &recorder );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to create the flight recorder: %s.\n", tobii_error_message( error ) );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+    struct { flight_recorder_stream_t stream; tobii_stream_t tobii_stream; } const streams[] = {
+        { FLIGHT_RECORDER_GAZE_POINT, TOBII_STREAM_GAZE_POINT },
+        { FLIGHT_RECORDER_GAZE_ORIGIN, TOBII_STREAM_GAZE_ORIGIN },
+        { FLIGHT_RECORDER_EYE_POSITION_NORMALIZED, TOBII_STREAM_EYE_POSITION_NORMALIZED },
+        { FLIGHT_RECORDER_USER_PRESENCE, TOBII_STREAM_USER_PRESENCE },
+        { FLIGHT_RECORDER_HEAD_POSE, TOBII_STREAM_HEAD_POSE },
+        { FLIGHT_RECORDER_USER_POSITION_GUIDE, TOBII_STREAM_USER_POSITION_GUIDE },
+        { FLIGHT_RECORDER_GAZE_DATA, TOBII_STREAM_GAZE_DATA },
+        { FLIGHT_RECORDER_WEARABLE_CONSUMER_DATA, TOBII_STREAM_WEARABLE_CONSUMER },
+        { FLIGHT_RECORDER_WEARABLE_ADVANCED_DATA, TOBII_STREAM_WEARABLE_ADVANCED },
+    };
+    for( auto const& entry : streams )
+    {
+        tobii_supported_t supported;
+        error = tobii_stream_supported( device, entry.tobii_stream, &supported );
+        if( error != TOBII_ERROR_NO_ERROR || supported != TOBII_SUPPORTED ) continue;
+        error = flight_recorder_add_stream( recorder, entry.stream );
+        if( error != TOBII_ERROR_NO_ERROR )
+            fprintf( stderr, "Not recording stream %d: %s.\n", (int) entry.stream, tobii_error_message( error ) );
+    }
+    error = flight_recorder_add_stream( recorder, FLIGHT_RECORDER_NOTIFICATIONS );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Not recording notifications: %s.\n", tobii_error_message( error ) );
+
+    flight_recorder_statistics_t statistics;
+    flight_recorder_statistics( recorder, &statistics );
+    printf( "Recording into %.1f MB, %d rings on huge pages. Enter d to dump, q to quit.\n",
+        (double) statistics.memory_bytes / 1048576.0, statistics.huge_page_rings );
+
+    // The usual pump loop, except that every result is recorded. The first connection failure dumps what led up to
+    // it, and the reconnect retries after it do not.
+    bool running = true;
+    bool try_reconnect = false;
+    while( running )
+    {
+        char command;
+        if( read_command( &command ) )
+        {
+            if( command == 'd' ) flight_recorder_dump( recorder, "on_demand" );
+            else running = false;
+        }
+        if( try_reconnect )
+        {
+            error = tobii_device_reconnect( device );
+            flight_recorder_publish_error( recorder, error, "tobii_device_reconnect" );
+            if( error != TOBII_ERROR_NO_ERROR )
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1000 ) );
+                continue;
+            }
+            try_reconnect = false;
+        }
+        error = tobii_wait_for_callbacks( 1, &device );
+        if( error != TOBII_ERROR_TIMED_OUT )
+            flight_recorder_publish_error( recorder, error, "tobii_wait_for_callbacks" );
+        if( error == TOBII_ERROR_CONNECTION_FAILED )
+        {
+            try_reconnect = true;
+            continue;
+        }
+        error = tobii_device_process_callbacks( device );
+        flight_recorder_publish_error( recorder, error, "tobii_device_process_callbacks" );
+        if( error == TOBII_ERROR_CONNECTION_FAILED ) try_reconnect = true;
+    }
+
+    // Destroying the recorder unsubscribes, and finishes any dump still being written
+    flight_recorder_wait_for_dumps( recorder );
+    flight_recorder_statistics( recorder, &statistics );
+    char path[ 512 ];
+    flight_recorder_last_dump_path( recorder, path, sizeof( path ) );
+    printf( "%" PRIu64 " dumps, the last one %s\n", statistics.dumps, path );
+    flight_recorder_destroy( recorder );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+struct pump_result_t
+{
+    int64_t samples;
+    double max_publish_us; // Longest a pair of samples took to record
+};
+
+// Records gaze data and gaze points at 1200 Hz in real time, as the pump thread would
+static void pump_thread( flight_recorder_t* recorder, std::vector<tobii_gaze_data_t> const* gaze_data,
+    std::vector<tobii_gaze_point_t> const* gaze_points, std::atomic<bool>* running, pump_result_t* result )
+{
+    auto next = std::chrono::steady_clock::now();
+    size_t i = 0;
+    while( *running )
+    {
+        auto start = std::chrono::steady_clock::now();
+        flight_recorder_publish( recorder, FLIGHT_RECORDER_GAZE_DATA, &( *gaze_data )[ i ] );
+        flight_recorder_publish( recorder, FLIGHT_RECORDER_GAZE_POINT, &( *gaze_points )[ i ] );
+        result->max_publish_us = std::max( result->max_publish_us, std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start ).count() );
+        ++result->samples;
+        i = ( i + 1 ) % gaze_data->size();
+        next += std::chrono::microseconds( 833 );
+        std::this_thread::sleep_until( next );
+    }
+}
+
+extern "C" int flight_recorder_benchmark_main( void );
+extern "C" int flight_recorder_benchmark_main( void )
+{
+    std::error_code ignored;
+    std::string directory = ( std::filesystem::temp_directory_path() / "flight_recorder_benchmark" ).string();
+    std::filesystem::remove_all( directory, ignored );
+    std::filesystem::create_directory( directory, ignored );
+
+    // A minute at 1200 Hz of the gaze data and gaze point streams
+    float const frequency_hz = 1200.0f;
+    size_t const count = 72000;
+    std::vector<tobii_gaze_data_t> gaze_data( count );
+    std::vector<tobii_gaze_point_t> gaze_points( count );
+    for( size_t i = 0; i < count; ++i )
+    {
+        stream_replay_gaze_data( (int64_t) i, frequency_hz, &gaze_data[ i ] );
+        stream_replay_gaze_point( (int64_t) i, frequency_hz, &gaze_points[ i ] );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    flight_recorder_t* recorder;
+    if( flight_recorder_create( directory.c_str(), NULL, NULL, 60.0f, frequency_hz, &recorder ) !=
+        TOBII_ERROR_NO_ERROR ) return 1;
+    flight_recorder_add_stream( recorder, FLIGHT_RECORDER_GAZE_DATA );
+    flight_recorder_add_stream( recorder, FLIGHT_RECORDER_GAZE_POINT );
+    double create_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    flight_recorder_statistics_t statistics;
+    flight_recorder_statistics( recorder, &statistics );
+    printf( "Rings of %.1f MB allocated and touched in %.1f ms, %d on explicit huge pages\n",
+        (double) statistics.memory_bytes / 1048576.0, create_ms, statistics.huge_page_rings );
+
+    // Steady state: the rings have wrapped many times over, and every record lands on a page already touched
+    int const laps = 10;
+    start = std::chrono::steady_clock::now();
+    for( int lap = 0; lap < laps; ++lap )
+        for( size_t i = 0; i < count; ++i )
+            flight_recorder_publish( recorder, FLIGHT_RECORDER_GAZE_DATA, &gaze_data[ i ] );
+    double gaze_data_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        ( (double) laps * count );
+    start = std::chrono::steady_clock::now();
+    for( int lap = 0; lap < laps; ++lap )
+        for( size_t i = 0; i < count; ++i )
+            flight_recorder_publish( recorder, FLIGHT_RECORDER_GAZE_POINT, &gaze_points[ i ] );
+    double gaze_point_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start )
+        .count() / ( (double) laps * count );
+    printf( "Recording a sample: gaze data (%zu bytes) %.1f ns, gaze point (%zu bytes) %.1f ns\n",
+        sizeof( tobii_gaze_data_t ), gaze_data_ns, sizeof( tobii_gaze_point_t ), gaze_point_ns );
+
+    // Dumps of the full minute while a pump thread keeps recording at 1200 Hz
+    std::atomic<bool> running( true );
+    pump_result_t pump = {};
+    std::thread pump_worker( pump_thread, recorder, &gaze_data, &gaze_points, &running, &pump );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+    pump.max_publish_us = 0.0;
+    std::vector<double> dump_ms;
+    uint64_t skipped = 0;
+    for( int i = 0; i < 5; ++i )
+    {
+        flight_recorder_dump( recorder, "benchmark" );
+        flight_recorder_wait_for_dumps( recorder );
+        flight_recorder_statistics( recorder, &statistics );
+        dump_ms.push_back( (double) statistics.last_dump_us / 1000.0 );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+    }
+    skipped = statistics.skipped;
+    running = false;
+    pump_worker.join();
+
+    // Read back the last dump, to check it holds a full minute of both streams
+    char path[ 512 ];
+    flight_recorder_last_dump_path( recorder, path, sizeof( path ) );
+    uint64_t records[ 2 ] = {};
+    FILE* file = fopen( path, "rb" );
+    flight_recorder_file_header_t header;
+    if( file && fread( &header, sizeof( header ), 1, file ) == 1 && header.magic == FLIGHT_RECORDER_MAGIC )
+    {
+        for( uint32_t i = 0; i < header.section_count; ++i )
+        {
+            flight_recorder_section_t section;
+            if( fread( &section, sizeof( section ), 1, file ) != 1 ) break;
+            if( section.stream == FLIGHT_RECORDER_GAZE_DATA ) records[ 0 ] = section.record_count - section.skipped;
+            if( section.stream == FLIGHT_RECORDER_GAZE_POINT ) records[ 1 ] = section.record_count - section.skipped;
+            fseek( file, (long)( section.record_count * section.record_size ), SEEK_CUR );
+        }
+    }
+    if( file ) fclose( file );
+
+    std::sort( dump_ms.begin(), dump_ms.end() );
+    printf( "Dumping 60 s at 1200 Hz, %.1f MB: median %.1f ms, max %.1f ms including fsync, %" PRIu64 " records "
+        "skipped over %zu dumps\n", (double) statistics.last_dump_bytes / 1048576.0, dump_ms[ dump_ms.size() / 2 ],
+        dump_ms.back(), skipped, dump_ms.size() );
+    printf( "Pump thread meanwhile: %" PRId64 " samples, longest record %.1f us\n", pump.samples, pump.max_publish_us );
+    printf( "Last dump holds %" PRIu64 " gaze data and %" PRIu64 " gaze points\n", records[ 0 ], records[ 1 ] );
+
+    // An unplugged tracker: the pump loop and a minute of reconnect retries all fail, which must dump once. A
+    // reconnect that works ends the outage, and the next one is within the 30 seconds, so it is counted but not dumped.
+    uint64_t dumps_before = statistics.dumps;
+    flight_recorder_publish_error( recorder, TOBII_ERROR_CONNECTION_FAILED, "tobii_device_process_callbacks" );
+    for( int retry = 0; retry < 60; ++retry )
+        flight_recorder_publish_error( recorder, TOBII_ERROR_CONNECTION_FAILED, "tobii_device_reconnect" );
+    flight_recorder_publish_error( recorder, TOBII_ERROR_NO_ERROR, "tobii_device_reconnect" );
+    flight_recorder_publish_error( recorder, TOBII_ERROR_CONNECTION_FAILED, "tobii_device_process_callbacks" );
+    flight_recorder_wait_for_dumps( recorder );
+    flight_recorder_statistics( recorder, &statistics );
+    uint64_t outage_dumps = statistics.dumps - dumps_before;
+    bool outage_ok = outage_dumps == 1 && statistics.suppressed_requests == 1;
+    printf( "Two outages, 62 connection failures: %" PRIu64 " dumps, %" PRIu64 " suppressed, %s\n", outage_dumps,
+        statistics.suppressed_requests, outage_ok ? "as expected" : "WRONG" );
+
+    flight_recorder_destroy( recorder );
+    std::filesystem::remove_all( directory, ignored );
+    return statistics.failed_dumps == 0 && outage_ok ? 0 : 1;
+}
@@ -0,0 +1,445 @@
+#include "frame_sampler.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+
+// A sample reduced to what the sampler blends: a bit of validity and a rate of change per value, and the stream's
+// flags as bits. The rates are worked out when the sample is pushed, from the newest sample at least the velocity
+// window older, so extrapolating at query time needs only the newest sample.
+template< int N >
+struct blend_sample_t
+{
+    int64_t timestamp_us;
+    uint32_t valid; // Bit per value
+    uint32_t flags;
+    float values[ N ];
+    float velocity_per_us[ N ];
+};
+
+// Per-stream history, pushed to by one thread and read by any number of threads. Each slot is guarded by its own
+// sequence number, 2n+1 while sample n is being written and 2n+2 once it is complete, so a reader can tell a torn or
+// overwritten slot from the sample it expected and try again. The capacity only has to cover the velocity window and
+// the latency between a sample being captured and a frame asking for it.
+template< int N >
+struct history_t
+{
+    static uint64_t const capacity = 32; // Must be a power of two
+
+    struct slot_t
+    {
+        std::atomic<uint64_t> sequence;
+        std::atomic<int64_t> timestamp_us; // Separate from the sample, so searching does not copy whole samples
+        blend_sample_t<N> sample;
+    };
+
+    slot_t slots[ capacity ];
+    std::atomic<uint64_t> count; // Total number of samples pushed
+};
+
+// Value layout of each stream
+int const gaze_point_values = 2;
+int const head_pose_values = 6; // Position xyz, then rotation xyz
+int const wearable_values = 15;
+int const wearable_left_pupil = 0; // Then left position guide, right pupil and right position guide, two values each
+int const wearable_origin = 8;
+int const wearable_direction = 11;
+int const wearable_convergence = 14;
+
+enum wearable_flag_t
+{
+    WEARABLE_LEFT_BLINK_VALID = 1 << 0,
+    WEARABLE_LEFT_BLINK = 1 << 1,
+    WEARABLE_RIGHT_BLINK_VALID = 1 << 2,
+    WEARABLE_RIGHT_BLINK = 1 << 3,
+    WEARABLE_IMPROVE_USER_POSITION = 1 << 4,
+    WEARABLE_INCREASE_EYE_RELIEF = 1 << 5,
+};
+
+struct frame_sampler_t
+{
+    int64_t max_prediction_us;
+    int64_t velocity_window_us;
+    bool gaze_point_subscribed;
+    bool head_pose_subscribed;
+    bool wearable_subscribed;
+    history_t<gaze_point_values> gaze_points;
+    history_t<head_pose_values> head_poses;
+    history_t<wearable_values> wearable;
+};
+
+template< int N >
+static void history_push( history_t<N>* history, int64_t velocity_window_us, blend_sample_t<N>* sample )
+{
+    // Duplicated and out of order samples would break the search, so they are dropped. Only this thread writes the
+    // slots, so it can read them without checking sequence numbers.
+    uint64_t const mask = history_t<N>::capacity - 1;
+    uint64_t count = history->count.load( std::memory_order_relaxed );
+    if( count > 0 && sample->timestamp_us <= history->slots[ ( count - 1 ) & mask ].sample.timestamp_us ) return;
+
+    if( count > 0 )
+    {
+        uint64_t oldest = count >= history_t<N>::capacity ? count - ( history_t<N>::capacity - 1 ) : 0;
+        uint64_t index = count - 1;
+        while( index > oldest &&
+            sample->timestamp_us - history->slots[ index & mask ].sample.timestamp_us < velocity_window_us ) --index;
+        blend_sample_t<N> const& reference = history->slots[ index & mask ].sample;
+        float inverse_us = 1.0f / (float)( sample->timestamp_us - reference.timestamp_us );
+        uint32_t velocity_valid = sample->valid & reference.valid;
+        for( int i = 0; i < N; ++i )
+            sample->velocity_per_us[ i ] = ( velocity_valid >> i ) & 1 ?
+                ( sample->values[ i ] - reference.values[ i ] ) * inverse_us : 0.0f;
+    }
+    else
+        memset( sample->velocity_per_us, 0, sizeof( sample->velocity_per_us ) );
+
+    auto& slot = history->slots[ count & mask ];
+    slot.sequence.store( 2 * count + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    slot.timestamp_us.store( sample->timestamp_us, std::memory_order_relaxed );
+    memcpy( &slot.sample, sample, sizeof( *sample ) );
+    slot.sequence.store( 2 * count + 2, std::memory_order_release );
+    history->count.store( count + 1, std::memory_order_release );
+}
+
+template< int N >
+static bool history_timestamp( history_t<N> const& history, uint64_t index, int64_t* timestamp_us )
+{
+    auto const& slot = history.slots[ index & ( history_t<N>::capacity - 1 ) ];
+    uint64_t expected = 2 * index + 2;
+    if( slot.sequence.load( std::memory_order_acquire ) != expected ) return false;
+    *timestamp_us = slot.timestamp_us.load( std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_acquire );
+    return slot.sequence.load( std::memory_order_relaxed ) == expected;
+}
+
+// Copies the first *size* bytes of the sample, interpolating does not need the velocities
+template< int N >
+static bool history_read( history_t<N> const& history, uint64_t index, blend_sample_t<N>* sample,
+    size_t size = sizeof( blend_sample_t<N> ) )
+{
+    auto const& slot = history.slots[ index & ( history_t<N>::capacity - 1 ) ];
+    uint64_t expected = 2 * index + 2;
+    if( slot.sequence.load( std::memory_order_acquire ) != expected ) return false;
+    memcpy( sample, &slot.sample, size );
+    std::atomic_thread_fence( std::memory_order_acquire );
+    return slot.sequence.load( std::memory_order_relaxed ) == expected;
+}
+
+// Copies the newest sample at or before *timestamp_us* to *base*, and the sample after it, if any, to *next*.
+// Returns 0 if there is no such sample, 1 to extrapolate from *base* and 2 to interpolate towards *next*.
+template< int N >
+static int history_select( history_t<N> const& history, int64_t timestamp_us, blend_sample_t<N>* base,
+    blend_sample_t<N>* next )
+{
+    for( ;; )
+    {
+        uint64_t count = history.count.load( std::memory_order_acquire );
+        if( count == 0 ) return 0;
+
+        // Frames usually ask for a time past the newest sample
+        int64_t newest_us;
+        if( !history_timestamp( history, count - 1, &newest_us ) ) continue;
+        if( newest_us <= timestamp_us )
+        {
+            if( history_read( history, count - 1, base ) ) return 1;
+            continue;
+        }
+
+        // Otherwise search for the last sample at or before it, starting from where it would be at a steady rate.
+        // The oldest slot is left alone, the pushing thread may already be overwriting it.
+        uint64_t oldest = count >= history_t<N>::capacity ? count - ( history_t<N>::capacity - 1 ) : 0;
+        int64_t oldest_us;
+        if( !history_timestamp( history, oldest, &oldest_us ) ) continue;
+        if( oldest_us > timestamp_us ) return 0;
+        uint64_t low = oldest + (uint64_t)( (double)( count - 1 - oldest ) * (double)( timestamp_us - oldest_us ) /
+            (double)( newest_us - oldest_us ) );
+        int64_t low_us, next_us;
+        bool torn = !history_timestamp( history, low, &low_us );
+        while( !torn && low_us > timestamp_us )
+            torn = !history_timestamp( history, --low, &low_us );
+        while( !torn )
+        {
+            torn = !history_timestamp( history, low + 1, &next_us );
+            if( torn || next_us > timestamp_us ) break;
+            ++low;
+        }
+        size_t size = offsetof( blend_sample_t<N>, velocity_per_us );
+        if( !torn && history_read( history, low, base, size ) && history_read( history, low + 1, next, size ) )
+            return 2;
+    }
+}
+
+// Blends the values to *timestamp_us*, and returns the bits of those that are valid. Values valid in both samples
+// are interpolated, or extrapolated along their velocity, and values valid in one are held, but nothing further than
+// *max_prediction_us* from the sample it comes from. Invalid values and velocities are stored as zero, which keeps
+// the loops free of branches.
+template< int N >
+static uint32_t blend( blend_sample_t<N> const& base, blend_sample_t<N> const* next, int kind, int64_t timestamp_us,
+    int64_t max_prediction_us, float* result )
+{
+    int64_t since_base_us = timestamp_us - base.timestamp_us;
+    if( kind == 1 )
+    {
+        if( since_base_us > max_prediction_us )
+        {
+            memset( result, 0, sizeof( float ) * N );
+            return 0;
+        }
+        float dt_us = (float) since_base_us;
+        for( int i = 0; i < N; ++i ) result[ i ] = base.values[ i ] + base.velocity_per_us[ i ] * dt_us;
+        return base.valid;
+    }
+
+    float weight = (float) since_base_us / (float)( next->timestamp_us - base.timestamp_us );
+    if( base.valid == next->valid )
+    {
+        // The usual case, with invalid values zero in both samples
+        for( int i = 0; i < N; ++i ) result[ i ] = base.values[ i ] + ( next->values[ i ] - base.values[ i ] ) * weight;
+        return base.valid;
+    }
+
+    uint32_t both = base.valid & next->valid;
+    uint32_t hold_base = since_base_us <= max_prediction_us ? base.valid & ~both : 0;
+    uint32_t hold_next = next->timestamp_us - timestamp_us <= max_prediction_us ? next->valid & ~base.valid : 0;
+    float base_weight[ N ], next_weight[ N ];
+    for( int i = 0; i < N; ++i )
+    {
+        base_weight[ i ] = ( both >> i ) & 1 ? 1.0f - weight : (float)( ( hold_base >> i ) & 1 );
+        next_weight[ i ] = ( both >> i ) & 1 ? weight : (float)( ( hold_next >> i ) & 1 );
+    }
+    for( int i = 0; i < N; ++i ) result[ i ] = base.values[ i ] * base_weight[ i ] + next->values[ i ] * next_weight[ i ];
+    return both | hold_base | hold_next;
+}
+
+static tobii_validity_t validity( uint32_t valid, int index )
+{
+    return ( valid >> index ) & 1 ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+}
+
+template< int N >
+static void pack( blend_sample_t<N>* sample, int index, int count, tobii_validity_t validity, float const* values )
+{
+    if( validity != TOBII_VALIDITY_VALID ) return; // Left as zero
+    memcpy( &sample->values[ index ], values, sizeof( float ) * count );
+    sample->valid |= ( ( 1u << count ) - 1 ) << index;
+}
+
+static void sample_gaze_point( frame_sampler_t const* sampler, int64_t timestamp_us, frame_sample_t* sample )
+{
+    blend_sample_t<gaze_point_values> base, next;
+    int kind = history_select( sampler->gaze_points, timestamp_us, &base, &next );
+    uint32_t valid = 0;
+    tobii_gaze_point_t* result = &sample->gaze_point;
+    if( kind ) valid = blend( base, &next, kind, timestamp_us, sampler->max_prediction_us, result->position_xy );
+    else memset( result->position_xy, 0, sizeof( result->position_xy ) );
+
+    result->timestamp_us = timestamp_us;
+    result->validity = validity( valid, 0 );
+    sample->gaze_point_age_us = kind ? timestamp_us - base.timestamp_us : -1;
+}
+
+static void sample_head_pose( frame_sampler_t const* sampler, int64_t timestamp_us, frame_sample_t* sample )
+{
+    blend_sample_t<head_pose_values> base, next;
+    int kind = history_select( sampler->head_poses, timestamp_us, &base, &next );
+    uint32_t valid = 0;
+    float values[ head_pose_values ];
+    if( kind ) valid = blend( base, &next, kind, timestamp_us, sampler->max_prediction_us, values );
+    else memset( values, 0, sizeof( values ) );
+
+    tobii_head_pose_t* result = &sample->head_pose;
+    result->timestamp_us = timestamp_us;
+    result->position_validity = validity( valid, 0 );
+    memcpy( result->position_xyz, values, sizeof( result->position_xyz ) );
+    for( int i = 0; i < 3; ++i ) result->rotation_validity_xyz[ i ] = validity( valid, 3 + i );
+    memcpy( result->rotation_xyz, values + 3, sizeof( result->rotation_xyz ) );
+    sample->head_pose_age_us = kind ? timestamp_us - base.timestamp_us : -1;
+}
+
+static void unpack_wearable_eye( uint32_t valid, float const* values, int index, bool blink_valid, bool blink,
+    tobii_wearable_consumer_eye_t* eye )
+{
+    eye->pupil_position_in_sensor_area_validity = validity( valid, index );
+    memcpy( eye->pupil_position_in_sensor_area_xy, values + index, sizeof( eye->pupil_position_in_sensor_area_xy ) );
+    eye->position_guide_validity = validity( valid, index + 2 );
+    memcpy( eye->position_guide_xy, values + index + 2, sizeof( eye->position_guide_xy ) );
+    eye->blink_validity = blink_valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+    eye->blink = blink ? TOBII_STATE_BOOL_TRUE : TOBII_STATE_BOOL_FALSE;
+}
+
+static void sample_wearable( frame_sampler_t const* sampler, int64_t timestamp_us, frame_sample_t* sample )
+{
+    blend_sample_t<wearable_values> base, next;
+    int kind = history_select( sampler->wearable, timestamp_us, &base, &next );
+    uint32_t valid = 0;
+    uint32_t flags = kind ? base.flags : 0;
+    float values[ wearable_values ];
+    if( kind ) valid = blend( base, &next, kind, timestamp_us, sampler->max_prediction_us, values );
+    else memset( values, 0, sizeof( values ) );
+
+    // A blend of unit vectors is shorter than one, so the direction is normalized again
+    float* direction = values + wearable_direction;
+    float length = sqrtf( direction[ 0 ] * direction[ 0 ] + direction[ 1 ] * direction[ 1 ] +
+        direction[ 2 ] * direction[ 2 ] );
+    if( length > 1e-6f )
+    {
+        float inverse_length = 1.0f / length;
+        for( int i = 0; i < 3; ++i ) direction[ i ] *= inverse_length;
+    }
+    else
+        valid &= ~( 1u << wearable_direction );
+
+    tobii_wearable_consumer_data_t* result = &sample->wearable;
+    result->timestamp_us = timestamp_us;
+    unpack_wearable_eye( valid, values, wearable_left_pupil, flags & WEARABLE_LEFT_BLINK_VALID,
+        flags & WEARABLE_LEFT_BLINK, &result->left );
+    unpack_wearable_eye( valid, values, wearable_left_pupil + 4, flags & WEARABLE_RIGHT_BLINK_VALID,
+        flags & WEARABLE_RIGHT_BLINK, &result->right );
+    result->gaze_origin_combined_validity = validity( valid, wearable_origin );
+    memcpy( result->gaze_origin_combined_mm_xyz, values + wearable_origin,
+        sizeof( result->gaze_origin_combined_mm_xyz ) );
+    result->gaze_direction_combined_validity = validity( valid, wearable_direction );
+    memcpy( result->gaze_direction_combined_normalized_xyz, direction,
+        sizeof( result->gaze_direction_combined_normalized_xyz ) );
+    result->convergence_distance_validity = validity( valid, wearable_convergence );
+    result->convergence_distance_mm = values[ wearable_convergence ];
+    result->improve_user_position_hmd = flags & WEARABLE_IMPROVE_USER_POSITION ?
+        TOBII_STATE_BOOL_TRUE : TOBII_STATE_BOOL_FALSE;
+    result->increase_eye_relief = flags & WEARABLE_INCREASE_EYE_RELIEF ?
+        TOBII_STATE_BOOL_TRUE : TOBII_STATE_BOOL_FALSE;
+    sample->wearable_age_us = kind ? timestamp_us - base.timestamp_us : -1;
+}
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    frame_sampler_push_gaze_point( static_cast<frame_sampler_t*>( user_data ), gaze_point );
+}
+
+static void head_pose_callback( tobii_head_pose_t const* head_pose, void* user_data )
+{
+    frame_sampler_push_head_pose( static_cast<frame_sampler_t*>( user_data ), head_pose );
+}
+
+static void wearable_callback( tobii_wearable_consumer_data_t const* data, void* user_data )
+{
+    frame_sampler_push_wearable_consumer_data( static_cast<frame_sampler_t*>( user_data ), data );
+}
+
+frame_sampler_t* frame_sampler_create( int64_t max_prediction_us, int64_t velocity_window_us )
+{
+    auto sampler = new frame_sampler_t();
+    sampler->max_prediction_us = max_prediction_us;
+    sampler->velocity_window_us = velocity_window_us;
+    return sampler;
+}
+
+void frame_sampler_destroy( frame_sampler_t* sampler )
+{
+    delete sampler;
+}
+
+tobii_error_t frame_sampler_subscribe( frame_sampler_t* sampler, tobii_device_t* device )
+{
+    // Screen based trackers have gaze points and possibly head pose, headsets have the wearable stream
+    tobii_error_t error = tobii_gaze_point_subscribe( device, gaze_point_callback, sampler );
+    if( error != TOBII_ERROR_NO_ERROR && error != TOBII_ERROR_NOT_SUPPORTED ) return error;
+    sampler->gaze_point_subscribed = error == TOBII_ERROR_NO_ERROR;
+
+    error = tobii_head_pose_subscribe( device, head_pose_callback, sampler );
+    if( error == TOBII_ERROR_NO_ERROR || error == TOBII_ERROR_NOT_SUPPORTED )
+    {
+        sampler->head_pose_subscribed = error == TOBII_ERROR_NO_ERROR;
+        error = tobii_wearable_consumer_data_subscribe( device, wearable_callback, sampler );
+        if( error == TOBII_ERROR_NO_ERROR || error == TOBII_ERROR_NOT_SUPPORTED )
+        {
+            sampler->wearable_subscribed = error == TOBII_ERROR_NO_ERROR;
+            if( sampler->gaze_point_subscribed || sampler->head_pose_subscribed || sampler->wearable_subscribed )
+                return TOBII_ERROR_NO_ERROR;
+            error = TOBII_ERROR_NOT_SUPPORTED;
+        }
+    }
+
+    frame_sampler_unsubscribe( sampler, device );
+    return error;
+}
+
+tobii_error_t frame_sampler_unsubscribe( frame_sampler_t* sampler, tobii_device_t* device )
+{
+    // Reports the first failure, but still unsubscribes from the other streams
+    tobii_error_t result = TOBII_ERROR_NO_ERROR;
+    if( sampler->gaze_point_subscribed )
+    {
+        tobii_error_t error = tobii_gaze_point_unsubscribe( device );
+        if( result == TOBII_ERROR_NO_ERROR ) result = error;
+    }
+    if( sampler->head_pose_subscribed )
+    {
+        tobii_error_t error = tobii_head_pose_unsubscribe( device );
+        if( result == TOBII_ERROR_NO_ERROR ) result = error;
+    }
+    if( sampler->wearable_subscribed )
+    {
+        tobii_error_t error = tobii_wearable_consumer_data_unsubscribe( device );
+        if( result == TOBII_ERROR_NO_ERROR ) result = error;
+    }
+    sampler->gaze_point_subscribed = false;
+    sampler->head_pose_subscribed = false;
+    sampler->wearable_subscribed = false;
+    return result;
+}
+
+void frame_sampler_push_gaze_point( frame_sampler_t* sampler, tobii_gaze_point_t const* gaze_point )
+{
+    blend_sample_t<gaze_point_values> sample = {};
+    sample.timestamp_us = gaze_point->timestamp_us;
+    pack( &sample, 0, 2, gaze_point->validity, gaze_point->position_xy );
+    history_push( &sampler->gaze_points, sampler->velocity_window_us, &sample );
+}
+
+void frame_sampler_push_head_pose( frame_sampler_t* sampler, tobii_head_pose_t const* head_pose )
+{
+    // Each rotation axis carries its own validity
+    blend_sample_t<head_pose_values> sample = {};
+    sample.timestamp_us = head_pose->timestamp_us;
+    pack( &sample, 0, 3, head_pose->position_validity, head_pose->position_xyz );
+    for( int i = 0; i < 3; ++i )
+        pack( &sample, 3 + i, 1, head_pose->rotation_validity_xyz[ i ], &head_pose->rotation_xyz[ i ] );
+    history_push( &sampler->head_poses, sampler->velocity_window_us, &sample );
+}
+
+void frame_sampler_push_wearable_consumer_data( frame_sampler_t* sampler, tobii_wearable_consumer_data_t const* data )
+{
+    blend_sample_t<wearable_values> sample = {};
+    sample.timestamp_us = data->timestamp_us;
+    tobii_wearable_consumer_eye_t const* eyes[ 2 ] = { &data->left, &data->right };
+    for( int eye = 0; eye < 2; ++eye )
+    {
+        int index = wearable_left_pupil + eye * 4;
+        pack( &sample, index, 2, eyes[ eye ]->pupil_position_in_sensor_area_validity,
+            eyes[ eye ]->pupil_position_in_sensor_area_xy );
+        pack( &sample, index + 2, 2, eyes[ eye ]->position_guide_validity, eyes[ eye ]->position_guide_xy );
+    }
+    pack( &sample, wearable_origin, 3, data->gaze_origin_combined_validity, data->gaze_origin_combined_mm_xyz );
+    pack( &sample, wearable_direction, 3, data->gaze_direction_combined_validity,
+        data->gaze_direction_combined_normalized_xyz );
+    pack( &sample, wearable_convergence, 1, data->convergence_distance_validity, &data->convergence_distance_mm );
+
+    if( data->left.blink_validity == TOBII_VALIDITY_VALID ) sample.flags |= WEARABLE_LEFT_BLINK_VALID;
+    if( data->left.blink == TOBII_STATE_BOOL_TRUE ) sample.flags |= WEARABLE_LEFT_BLINK;
+    if( data->right.blink_validity == TOBII_VALIDITY_VALID ) sample.flags |= WEARABLE_RIGHT_BLINK_VALID;
+    if( data->right.blink == TOBII_STATE_BOOL_TRUE ) sample.flags |= WEARABLE_RIGHT_BLINK;
+    if( data->improve_user_position_hmd == TOBII_STATE_BOOL_TRUE ) sample.flags |= WEARABLE_IMPROVE_USER_POSITION;
+    if( data->increase_eye_relief == TOBII_STATE_BOOL_TRUE ) sample.flags |= WEARABLE_INCREASE_EYE_RELIEF;
+    history_push( &sampler->wearable, sampler->velocity_window_us, &sample );
+}
+
+void frame_sampler_sample_at( frame_sampler_t const* sampler, int64_t system_time_us, frame_sample_t* sample )
+{
+    sample->timestamp_us = system_time_us;
+    sample_gaze_point( sampler, system_time_us, sample );
+    sample_head_pose( sampler, system_time_us, sample );
+    sample_wearable( sampler, system_time_us, sample );
+}
@@ -0,0 +1,57 @@
+#ifndef sample_frame_sampler_h
+#define sample_frame_sampler_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_wearable.h>
+
+// Answers "where was the user looking at this exact time" for a render loop, by interpolating or extrapolating the
+// gaze point, head pose and wearable consumer data streams to a system clock timestamp, such as the scan-out time of
+// the frame being rendered. The pump thread pushes samples into a small history per stream, and any number of render
+// threads query it without taking locks; a query that races with a push simply reads the slots again.
+//
+// Values are interpolated between the samples around the requested time. Past the newest sample they are extrapolated
+// along the slope from a sample at least *velocity_window_us* older, so tracker noise between neighbouring samples is
+// not magnified. Each field keeps its own validity: when only one of the samples is valid its value is held, and
+// nothing is extrapolated or held further than *max_prediction_us* from the sample it is based on. Flags such as blink
+// are taken from the newest sample at or before the requested time.
+
+typedef struct frame_sampler_t frame_sampler_t;
+
+typedef struct frame_sample_t
+{
+    int64_t timestamp_us; // The requested time, which is also the timestamp of the records below
+
+    tobii_gaze_point_t gaze_point;
+    tobii_head_pose_t head_pose;
+    tobii_wearable_consumer_data_t wearable;
+
+    // How long before timestamp_us the newest sample at or before it was captured. -1 when there is no such sample,
+    // because the stream has no samples yet or they are all newer, in which case all fields of the record are invalid.
+    int64_t gaze_point_age_us;
+    int64_t head_pose_age_us;
+    int64_t wearable_age_us;
+} frame_sample_t;
+
+frame_sampler_t* frame_sampler_create( int64_t max_prediction_us, int64_t velocity_window_us );
+
+void frame_sampler_destroy( frame_sampler_t* sampler );
+
+// Subscribes to whichever of the three streams *device* supports, and returns TOBII_ERROR_NOT_SUPPORTED if none.
+tobii_error_t frame_sampler_subscribe( frame_sampler_t* sampler, tobii_device_t* device );
+
+tobii_error_t frame_sampler_unsubscribe( frame_sampler_t* sampler, tobii_device_t* device );
+
+// Feed samples directly, for example from a recording. These are what the subscription callbacks call, and each
+// stream must be pushed from one thread at a time. Samples that are not newer than the previous one are dropped.
+void frame_sampler_push_gaze_point( frame_sampler_t* sampler, tobii_gaze_point_t const* gaze_point );
+
+void frame_sampler_push_head_pose( frame_sampler_t* sampler, tobii_head_pose_t const* head_pose );
+
+void frame_sampler_push_wearable_consumer_data( frame_sampler_t* sampler, tobii_wearable_consumer_data_t const* data );
+
+// Lock-free, and safe to call from any thread while samples are being pushed. *system_time_us* is in the clock of
+// tobii_system_clock, which is what the stream timestamps are in.
+void frame_sampler_sample_at( frame_sampler_t const* sampler, int64_t system_time_us, frame_sample_t* sample );
+
+#endif // sample_frame_sampler_h
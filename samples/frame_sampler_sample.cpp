@@ -0,0 +1,277 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_wearable.h>
+
+#include "frame_sampler.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+struct render_context_t
+{
+    tobii_api_t* api;
+    frame_sampler_t* sampler;
+    std::atomic<bool> running;
+};
+
+static void render_thread( render_context_t* context )
+{
+    // A 90 Hz render loop, where a frame reaches the display about 20 ms after it starts rendering
+    int64_t const scan_out_delay_us = 20000;
+    auto next_frame = std::chrono::steady_clock::now();
+    for( int frame = 0; context->running; ++frame )
+    {
+        next_frame += std::chrono::microseconds( 11111 );
+        std::this_thread::sleep_until( next_frame );
+
+        int64_t now_us;
+        if( tobii_system_clock( context->api, &now_us ) != TOBII_ERROR_NO_ERROR ) continue;
+
+        // Render with gaze where it will be when the frame is seen, rather than wherever the last sample was
+        frame_sample_t sample;
+        frame_sampler_sample_at( context->sampler, now_us + scan_out_delay_us, &sample );
+        if( frame % 9 != 0 ) continue;
+        if( sample.gaze_point.validity == TOBII_VALIDITY_VALID )
+            printf( "Frame %d: gaze %f, %f from a sample %.1f ms before scan-out\n", frame,
+                sample.gaze_point.position_xy[ 0 ], sample.gaze_point.position_xy[ 1 ],
+                sample.gaze_point_age_us / 1000.0 );
+        else if( sample.wearable.gaze_direction_combined_validity == TOBII_VALIDITY_VALID )
+            printf( "Frame %d: gaze direction %f, %f, %f from a sample %.1f ms before scan-out\n", frame,
+                sample.wearable.gaze_direction_combined_normalized_xyz[ 0 ],
+                sample.wearable.gaze_direction_combined_normalized_xyz[ 1 ],
+                sample.wearable.gaze_direction_combined_normalized_xyz[ 2 ], sample.wearable_age_us / 1000.0 );
+        else
+            printf( "Frame %d: no gaze\n", frame );
+    }
+}
+
+static void idle( void* context )
+{
+    (void) context; // Unused parameter, the render thread does all the work
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int frame_sampler_sample_main( void );
+extern "C" int frame_sampler_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // Extrapolate up to 30 ms, along the gaze velocity over the last 8 ms
+    frame_sampler_t* sampler = frame_sampler_create( 30000, 8000 );
+    error = frame_sampler_subscribe( sampler, device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to the gaze streams.\n" );
+        frame_sampler_destroy( sampler );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    render_context_t render_context;
+    render_context.api = api;
+    render_context.sampler = sampler;
+    render_context.running = true;
+    std::thread renderer( render_thread, &render_context );
+
+    // The pump thread only pushes samples, the renderer never waits for it
+    main_loop( device, idle, NULL );
+
+    render_context.running = false;
+    renderer.join();
+
+    error = frame_sampler_unsubscribe( sampler, device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from the gaze streams.\n" );
+    frame_sampler_destroy( sampler );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+static void consumer_data_from_advanced_data( tobii_wearable_advanced_data_t const* advanced,
+    tobii_wearable_consumer_data_t* consumer )
+{
+    // Only the fields the sampler interpolates
+    memset( consumer, 0, sizeof( *consumer ) );
+    consumer->timestamp_us = advanced->timestamp_system_us;
+    consumer->gaze_origin_combined_validity = advanced->gaze_origin_combined_validity;
+    memcpy( consumer->gaze_origin_combined_mm_xyz, advanced->gaze_origin_combined_mm_xyz,
+        sizeof( consumer->gaze_origin_combined_mm_xyz ) );
+    consumer->gaze_direction_combined_validity = advanced->gaze_direction_combined_validity;
+    memcpy( consumer->gaze_direction_combined_normalized_xyz, advanced->gaze_direction_combined_normalized_xyz,
+        sizeof( consumer->gaze_direction_combined_normalized_xyz ) );
+    consumer->convergence_distance_validity = advanced->convergence_distance_validity;
+    consumer->convergence_distance_mm = advanced->convergence_distance_mm;
+    consumer->left.blink_validity = advanced->left.blink_validity;
+    consumer->left.blink = advanced->left.blink;
+    consumer->right.blink_validity = advanced->right.blink_validity;
+    consumer->right.blink = advanced->right.blink;
+}
+
+// Pushes replayed samples up to *index* of the fastest stream: gaze points at 1200 Hz and head poses at 30 Hz from a
+// screen based tracker, or wearable data at 120 Hz from a headset
+struct replay_t
+{
+    bool headset;
+    float frequency_hz;
+    int64_t head_index;
+
+    void push( frame_sampler_t* sampler, int64_t index, int64_t* timestamp_us )
+    {
+        if( headset )
+        {
+            tobii_wearable_advanced_data_t advanced;
+            tobii_wearable_consumer_data_t consumer;
+            stream_replay_wearable_advanced_data( index, frequency_hz, &advanced );
+            consumer_data_from_advanced_data( &advanced, &consumer );
+            frame_sampler_push_wearable_consumer_data( sampler, &consumer );
+            *timestamp_us = consumer.timestamp_us;
+            return;
+        }
+
+        float const head_hz = 30.0f;
+        tobii_gaze_point_t gaze_point;
+        stream_replay_gaze_point( index, frequency_hz, &gaze_point );
+        frame_sampler_push_gaze_point( sampler, &gaze_point );
+        while( head_index * frequency_hz <= index * head_hz )
+        {
+            tobii_head_pose_t head_pose;
+            stream_replay_head_pose( head_index++, head_hz, &head_pose );
+            frame_sampler_push_head_pose( sampler, &head_pose );
+        }
+        *timestamp_us = gaze_point.timestamp_us;
+    }
+};
+
+// Queries at *offsets_us* from the newest sample timestamp at the time of each query
+static double nanoseconds_per_query( frame_sampler_t const* sampler, std::atomic<int64_t> const& newest_us,
+    std::vector<int64_t> const& offsets_us, double* valid_fraction )
+{
+    frame_sample_t sample;
+    int valid = 0;
+    auto start = std::chrono::steady_clock::now();
+    for( int64_t offset_us : offsets_us )
+    {
+        frame_sampler_sample_at( sampler, newest_us.load( std::memory_order_relaxed ) + offset_us, &sample );
+        valid += sample.gaze_point.validity == TOBII_VALIDITY_VALID ||
+            sample.wearable.gaze_direction_combined_validity == TOBII_VALIDITY_VALID;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    *valid_fraction = (double) valid / (double) offsets_us.size();
+    return std::chrono::duration<double, std::nano>( elapsed ).count() / (double) offsets_us.size();
+}
+
+static double benchmark_device( char const* name, bool headset )
+{
+    frame_sampler_t* sampler = frame_sampler_create( 30000, 8000 );
+    replay_t replay = { headset, headset ? 120.0f : 1200.0f, 0 };
+    std::atomic<int64_t> newest_us( 0 );
+    int64_t const history = 1000;
+    for( int64_t i = 0; i < history; ++i )
+    {
+        int64_t timestamp_us;
+        replay.push( sampler, i, &timestamp_us );
+        newest_us = timestamp_us;
+    }
+
+    // Frames ask for their scan-out time, 5 to 25 ms past the newest sample, which extrapolates. Asking for earlier
+    // times, up to 20 ms before the newest sample, interpolates between the two samples around it.
+    std::mt19937 random( 1 );
+    std::vector<int64_t> ahead_us( 1000000 ), behind_us( 1000000 );
+    for( auto& offset_us : ahead_us ) offset_us = 5000 + (int64_t)( random() % 20000 );
+    for( auto& offset_us : behind_us ) offset_us = -(int64_t)( random() % 20000 );
+
+    printf( "%s\n", name );
+    double valid;
+    nanoseconds_per_query( sampler, newest_us, ahead_us, &valid ); // Warm up
+    double worst_ns = 0.0;
+    for( int pumping = 0; pumping < 2; ++pumping )
+    {
+        // A pump thread pushing at the stream rate, so queries race with writes as they would in a game
+        std::atomic<bool> running( pumping != 0 );
+        std::thread pump( [ & ]() {
+            auto next = std::chrono::steady_clock::now();
+            for( int64_t i = history; running; ++i )
+            {
+                next += std::chrono::nanoseconds( (int64_t)( 1e9 / replay.frequency_hz ) );
+                std::this_thread::sleep_until( next );
+                int64_t timestamp_us;
+                replay.push( sampler, i, &timestamp_us );
+                newest_us = timestamp_us;
+            }
+        } );
+        double ahead_ns = nanoseconds_per_query( sampler, newest_us, ahead_us, &valid );
+        printf( "    %-36s %6.1f ns per query (%.1f%% valid gaze)\n",
+            pumping ? "scan-out time, while pushing:" : "scan-out time:", ahead_ns, 100.0 * valid );
+        double behind_ns = nanoseconds_per_query( sampler, newest_us, behind_us, &valid );
+        printf( "    %-36s %6.1f ns per query (%.1f%% valid gaze)\n",
+            pumping ? "past time, while pushing:" : "past time:", behind_ns, 100.0 * valid );
+        running = false;
+        pump.join();
+        worst_ns = std::max( worst_ns, std::max( ahead_ns, behind_ns ) );
+    }
+
+    frame_sampler_destroy( sampler );
+    return worst_ns;
+}
+
+extern "C" int frame_sampler_benchmark_main( void );
+extern "C" int frame_sampler_benchmark_main( void )
+{
+    printf( "sample_at on %u cores\n", std::thread::hardware_concurrency() );
+    double worst_ns = benchmark_device( "Screen based, gaze point 1200 Hz and head pose 30 Hz", false );
+    worst_ns = std::max( worst_ns, benchmark_device( "Headset, wearable consumer data 120 Hz", true ) );
+    return worst_ns < 100.0 ? 0 : 1;
+}
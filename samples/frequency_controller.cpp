@@ -0,0 +1,204 @@
+#include "frequency_controller.h"
+#include <tobii/tobii_config.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct frequency_consumer_t
+{
+    int id;
+    float min_rate_hz;
+    int64_t latency_budget_us;
+};
+
+// Number of timestamps the delivered rate is estimated over
+static uint32_t const rate_window = 64;
+
+// Verification windows to try after a mismatch while the device reports the selected frequency, before giving up
+static int const max_verification_retries = 3;
+
+struct frequency_controller_t
+{
+    tobii_device_t* device;
+    std::vector<float> frequencies; // Ascending
+
+    std::mutex consumers_mutex;
+    std::vector<frequency_consumer_t> consumers;
+    int next_consumer_id;
+    bool consumers_changed;
+
+    // Owned by the pump thread, except for the atomics which may be read from anywhere
+    int64_t timestamps[ rate_window ];
+    uint32_t timestamp_count;
+    int verification_retries;
+    std::atomic<float> selected_hz;
+    std::atomic<float> delivered_hz;
+    std::atomic<int> verification;
+};
+
+static float required_frequency( frequency_consumer_t const& consumer )
+{
+    // A sample is at most one period old when it arrives, so the period must fit within the latency budget
+    float budget_hz = consumer.latency_budget_us > 0 ? 1000000.0f / (float) consumer.latency_budget_us : 0.0f;
+    return std::max( consumer.min_rate_hz, budget_hz );
+}
+
+static float select_frequency( std::vector<float> const& frequencies, float required_hz )
+{
+    // Devices report rates like 119.88 Hz for a nominal 120 Hz, so allow a small tolerance
+    for( float frequency : frequencies )
+        if( frequency >= required_hz * 0.99f ) return frequency;
+
+    // Nothing is fast enough, so the best that can be done is the highest frequency
+    return frequencies.back();
+}
+
+static void restart_verification( frequency_controller_t* controller )
+{
+    controller->timestamp_count = 0;
+    controller->delivered_hz = 0.0f;
+    controller->verification = FREQUENCY_VERIFICATION_PENDING;
+}
+
+static void frequency_receiver( float output_frequency, void* user_data )
+{
+    static_cast<std::vector<float>*>( user_data )->push_back( output_frequency );
+}
+
+frequency_controller_t* frequency_controller_create( tobii_device_t* device )
+{
+    auto controller = new frequency_controller_t();
+    controller->device = device;
+    controller->selected_hz = 0.0f;
+    restart_verification( controller );
+    return controller;
+}
+
+void frequency_controller_destroy( frequency_controller_t* controller )
+{
+    delete controller;
+}
+
+tobii_error_t frequency_controller_start( frequency_controller_t* controller )
+{
+    std::vector<float> frequencies;
+    tobii_error_t error = tobii_enumerate_output_frequencies( controller->device, frequency_receiver, &frequencies );
+    if( error != TOBII_ERROR_NO_ERROR ) return error;
+    if( frequencies.empty() ) return TOBII_ERROR_NOT_SUPPORTED;
+    std::sort( frequencies.begin(), frequencies.end() );
+    controller->frequencies = frequencies;
+
+    float current_hz;
+    error = tobii_get_output_frequency( controller->device, &current_hz );
+    if( error != TOBII_ERROR_NO_ERROR ) return error;
+    controller->selected_hz = current_hz;
+
+    // Make the first update pick a frequency, even with no consumers registered
+    std::lock_guard<std::mutex> lock( controller->consumers_mutex );
+    controller->consumers_changed = true;
+    return TOBII_ERROR_NO_ERROR;
+}
+
+int frequency_controller_add_consumer( frequency_controller_t* controller, float min_rate_hz,
+    int64_t latency_budget_us )
+{
+    std::lock_guard<std::mutex> lock( controller->consumers_mutex );
+    frequency_consumer_t consumer = { controller->next_consumer_id++, min_rate_hz, latency_budget_us };
+    controller->consumers.push_back( consumer );
+    controller->consumers_changed = true;
+    return consumer.id;
+}
+
+void frequency_controller_remove_consumer( frequency_controller_t* controller, int consumer_id )
+{
+    std::lock_guard<std::mutex> lock( controller->consumers_mutex );
+    auto& consumers = controller->consumers;
+    consumers.erase( std::remove_if( consumers.begin(), consumers.end(),
+        [consumer_id]( frequency_consumer_t const& consumer ) { return consumer.id == consumer_id; } ),
+        consumers.end() );
+    controller->consumers_changed = true;
+}
+
+tobii_error_t frequency_controller_update( frequency_controller_t* controller )
+{
+    if( controller->frequencies.empty() ) return TOBII_ERROR_NOT_AVAILABLE; // Not started
+
+    float target_hz = controller->selected_hz;
+    {
+        std::lock_guard<std::mutex> lock( controller->consumers_mutex );
+        if( controller->consumers_changed )
+        {
+            float required_hz = 0.0f;
+            for( auto const& consumer : controller->consumers )
+                required_hz = std::max( required_hz, required_frequency( consumer ) );
+            target_hz = select_frequency( controller->frequencies, required_hz );
+            controller->consumers_changed = false;
+        }
+    }
+
+    if( target_hz == controller->selected_hz && controller->verification != FREQUENCY_VERIFICATION_MISMATCH )
+        return TOBII_ERROR_NO_ERROR;
+
+    if( target_hz == controller->selected_hz )
+    {
+        // The delivered rate is off. Only reapply if another client has actually changed the frequency, as the
+        // mismatch could also be caused by lost samples.
+        float device_hz;
+        tobii_error_t error = tobii_get_output_frequency( controller->device, &device_hz );
+        if( error != TOBII_ERROR_NO_ERROR ) return error;
+        if( device_hz == target_hz )
+        {
+            // Keeps reporting the failure until the delivered rate recovers or another frequency is selected
+            if( ++controller->verification_retries < max_verification_retries ) restart_verification( controller );
+            else controller->verification = FREQUENCY_VERIFICATION_FAILED;
+            return TOBII_ERROR_NO_ERROR;
+        }
+    }
+
+    tobii_error_t error = tobii_set_output_frequency( controller->device, target_hz );
+    if( error != TOBII_ERROR_NO_ERROR ) return error;
+    controller->selected_hz = target_hz;
+    controller->verification_retries = 0;
+    restart_verification( controller );
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void frequency_controller_push_timestamp( frequency_controller_t* controller, int64_t timestamp_us )
+{
+    controller->timestamps[ controller->timestamp_count % rate_window ] = timestamp_us;
+    ++controller->timestamp_count;
+    if( controller->timestamp_count < rate_window ) return;
+
+    int64_t newest = timestamp_us;
+    int64_t oldest = controller->timestamps[ controller->timestamp_count % rate_window ];
+    if( newest <= oldest ) return;
+
+    float delivered_hz = (float)( rate_window - 1 ) * 1000000.0f / (float)( newest - oldest );
+    float selected_hz = controller->selected_hz;
+    controller->delivered_hz = delivered_hz;
+    if( fabsf( delivered_hz - selected_hz ) <= selected_hz * 0.05f )
+    {
+        controller->verification = FREQUENCY_VERIFICATION_OK;
+        controller->verification_retries = 0;
+    }
+    else if( controller->verification != FREQUENCY_VERIFICATION_FAILED )
+    {
+        controller->verification = FREQUENCY_VERIFICATION_MISMATCH;
+    }
+}
+
+float frequency_controller_selected_frequency( frequency_controller_t const* controller )
+{
+    return controller->selected_hz;
+}
+
+frequency_verification_t frequency_controller_verification( frequency_controller_t const* controller,
+    float* delivered_hz )
+{
+    if( delivered_hz ) *delivered_hz = controller->delivered_hz;
+    return (frequency_verification_t) controller->verification.load();
+}
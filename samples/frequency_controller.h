@@ -0,0 +1,50 @@
+#ifndef sample_frequency_controller_h
+#define sample_frequency_controller_h
+
+#include <tobii/tobii.h>
+
+// Runs the device at the lowest output frequency that satisfies every registered consumer. A consumer declares the
+// sample rate it needs and its latency budget; as a new sample can be up to one period old, the budget also puts a
+// lower bound on the frequency. The controller picks from the frequencies the device enumerates, switches as consumers
+// come and go, and checks that the rate actually delivered matches the selected one.
+//
+// Consumers can be added and removed from any thread. frequency_controller_update and
+// frequency_controller_push_timestamp must be called from the pump thread, outside of callbacks for the former.
+
+typedef struct frequency_controller_t frequency_controller_t;
+
+typedef enum frequency_verification_t
+{
+    FREQUENCY_VERIFICATION_PENDING, // Not enough samples since the last switch
+    FREQUENCY_VERIFICATION_OK,
+    FREQUENCY_VERIFICATION_MISMATCH, // The delivered rate is more than 5% off the selected frequency
+    // Still off after several verification windows, while the device reports the selected frequency. Not retried
+    // until the delivered rate recovers or another frequency is selected
+    FREQUENCY_VERIFICATION_FAILED,
+} frequency_verification_t;
+
+frequency_controller_t* frequency_controller_create( tobii_device_t* device );
+
+void frequency_controller_destroy( frequency_controller_t* controller );
+
+// Reads the available output frequencies from the device. Fails if the device can not enumerate them.
+tobii_error_t frequency_controller_start( frequency_controller_t* controller );
+
+// Returns an id for frequency_controller_remove_consumer.
+int frequency_controller_add_consumer( frequency_controller_t* controller, float min_rate_hz,
+    int64_t latency_budget_us );
+
+void frequency_controller_remove_consumer( frequency_controller_t* controller, int consumer_id );
+
+// Applies the best frequency for the current consumers, and reapplies it if another client has changed it.
+tobii_error_t frequency_controller_update( frequency_controller_t* controller );
+
+// Feed the timestamps of a stream running at the output frequency, such as the gaze point stream.
+void frequency_controller_push_timestamp( frequency_controller_t* controller, int64_t timestamp_us );
+
+float frequency_controller_selected_frequency( frequency_controller_t const* controller );
+
+frequency_verification_t frequency_controller_verification( frequency_controller_t const* controller,
+    float* delivered_hz );
+
+#endif // sample_frequency_controller_h
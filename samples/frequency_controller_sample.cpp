@@ -0,0 +1,137 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "frequency_controller.h"
+#include "main_loop_linux.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+
+struct controller_context_t
+{
+    frequency_controller_t* controller;
+    std::chrono::steady_clock::time_point start;
+    int analytics_consumer;
+    int last_report_s;
+};
+
+static void gaze_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    // The gaze point stream runs at the output frequency, so its timestamps show the delivered rate
+    frequency_controller_push_timestamp( static_cast<frequency_controller_t*>( user_data ), gaze_point->timestamp_us );
+}
+
+static void run_consumers( void* user_data )
+{
+    auto context = static_cast<controller_context_t*>( user_data );
+    int elapsed_s = (int) std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now() - context->start ).count();
+
+    // Simulate an analytics consumer with a tight latency budget joining after 5 seconds and leaving after 15
+    if( elapsed_s >= 5 && elapsed_s < 15 && context->analytics_consumer < 0 )
+        context->analytics_consumer = frequency_controller_add_consumer( context->controller, 0.0f, 8000 );
+    else if( elapsed_s >= 15 && context->analytics_consumer >= 0 )
+    {
+        frequency_controller_remove_consumer( context->controller, context->analytics_consumer );
+        context->analytics_consumer = -1;
+    }
+
+    tobii_error_t error = frequency_controller_update( context->controller );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to apply output frequency: %s.\n", tobii_error_message( error ) );
+
+    if( elapsed_s != context->last_report_s )
+    {
+        context->last_report_s = elapsed_s;
+        float delivered_hz;
+        frequency_verification_t verification = frequency_controller_verification( context->controller, &delivered_hz );
+        printf( "Selected %.1f Hz, delivered %.1f Hz%s\n", frequency_controller_selected_frequency( context->controller ),
+            delivered_hz, verification == FREQUENCY_VERIFICATION_MISMATCH ? " MISMATCH" :
+            verification == FREQUENCY_VERIFICATION_FAILED ? " FAILED" :
+            verification == FREQUENCY_VERIFICATION_PENDING ? " (pending)" : "" );
+    }
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int frequency_controller_sample_main( void );
+extern "C" int frequency_controller_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    frequency_controller_t* controller = frequency_controller_create( device );
+    error = frequency_controller_start( controller );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to enumerate output frequencies: %s.\n", tobii_error_message( error ) );
+        frequency_controller_destroy( controller );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // A cursor needs 30 samples per second, and tolerates up to 33 ms of sampling latency
+    frequency_controller_add_consumer( controller, 30.0f, 33000 );
+
+    error = tobii_gaze_point_subscribe( device, gaze_callback, controller );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze stream.\n" );
+        frequency_controller_destroy( controller );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    controller_context_t context = { controller, std::chrono::steady_clock::now(), -1, -1 };
+    main_loop( device, run_consumers, &context );
+
+    error = tobii_gaze_point_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze stream.\n" );
+    frequency_controller_destroy( controller );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
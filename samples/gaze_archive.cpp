@@ -0,0 +1,644 @@
+#include "gaze_archive.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef GAZE_ARCHIVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Archives are written in host byte order, and only read back on little endian hosts
+static uint32_t const archive_magic = 0x415a4754; // "TGZA"
+static uint32_t const archive_version = 1;
+
+enum chunk_compression_t
+{
+    CHUNK_COMPRESSION_NONE,
+    CHUNK_COMPRESSION_ZSTD,
+};
+
+struct archive_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t reserved;
+};
+
+// A chunk is the timestamp_tracker_us column as a bit stream of its own, which is never compressed so seeking stays
+// cheap, followed by the bit stream of all other columns
+struct chunk_index_t
+{
+    uint64_t offset; // From the start of the archive
+    uint32_t timestamps_size;
+    uint32_t stored_size; // Of the other columns
+    uint32_t raw_size; // Of the other columns, before zstd
+    uint32_t sample_count;
+    uint32_t compression;
+    uint32_t reserved;
+    int64_t first_timestamp_us;
+    int64_t last_timestamp_us;
+};
+
+struct archive_footer_t
+{
+    uint64_t index_offset;
+    uint32_t chunk_count;
+    uint32_t magic;
+};
+
+// Columns of the gaze data record, as offsets into tobii_gaze_data_t
+static int const eye_float_count = 15;
+static int const eye_validity_count = 4;
+static int const float_column_count = 2 * eye_float_count;
+static int const validity_column_count = 2 * eye_validity_count;
+
+struct column_layout_t
+{
+    size_t floats[ float_column_count ];
+    size_t validities[ validity_column_count ];
+
+    column_layout_t()
+    {
+        size_t eyes[ 2 ] = { offsetof( tobii_gaze_data_t, left ), offsetof( tobii_gaze_data_t, right ) };
+        int f = 0, v = 0;
+        for( size_t eye : eyes )
+        {
+            for( int i = 0; i < 3; ++i )
+                floats[ f++ ] = eye + offsetof( tobii_gaze_data_eye_t, gaze_origin_from_eye_tracker_mm ) + i * 4;
+            for( int i = 0; i < 3; ++i )
+                floats[ f++ ] = eye + offsetof( tobii_gaze_data_eye_t, gaze_origin_in_track_box_normalized ) + i * 4;
+            for( int i = 0; i < 3; ++i )
+                floats[ f++ ] = eye + offsetof( tobii_gaze_data_eye_t, gaze_point_from_eye_tracker_mm ) + i * 4;
+            for( int i = 0; i < 2; ++i )
+                floats[ f++ ] = eye + offsetof( tobii_gaze_data_eye_t, gaze_point_on_display_normalized ) + i * 4;
+            for( int i = 0; i < 3; ++i )
+                floats[ f++ ] = eye + offsetof( tobii_gaze_data_eye_t, eyeball_center_from_eye_tracker_mm ) + i * 4;
+            floats[ f++ ] = eye + offsetof( tobii_gaze_data_eye_t, pupil_diameter_mm );
+
+            validities[ v++ ] = eye + offsetof( tobii_gaze_data_eye_t, gaze_origin_validity );
+            validities[ v++ ] = eye + offsetof( tobii_gaze_data_eye_t, gaze_point_validity );
+            validities[ v++ ] = eye + offsetof( tobii_gaze_data_eye_t, eyeball_center_validity );
+            validities[ v++ ] = eye + offsetof( tobii_gaze_data_eye_t, pupil_validity );
+        }
+    }
+};
+
+static column_layout_t const columns;
+
+struct bit_writer_t
+{
+    std::vector<uint8_t>* out;
+    uint64_t pending; // The low *bits* bits have not been written yet
+    int bits;
+
+    // At most 32 bits at a time
+    void write( uint32_t value, int count )
+    {
+        pending = ( pending << count ) | value;
+        bits += count;
+        while( bits >= 8 )
+        {
+            bits -= 8;
+            out->push_back( (uint8_t)( pending >> bits ) );
+        }
+    }
+
+    void write64( uint64_t value )
+    {
+        write( (uint32_t)( value >> 32 ), 32 );
+        write( (uint32_t) value, 32 );
+    }
+
+    void flush()
+    {
+        if( bits > 0 ) out->push_back( (uint8_t)( pending << ( 8 - bits ) ) );
+        bits = 0;
+    }
+};
+
+struct bit_reader_t
+{
+    uint8_t const* data;
+    uint8_t const* end;
+    uint64_t pending;
+    int bits;
+
+    // At most 32 bits at a time. Reading past the end yields zeros, so damaged data can not read out of bounds.
+    uint32_t read( int count )
+    {
+        if( bits < count )
+        {
+            if( end - data >= 4 )
+            {
+                pending = ( pending << 32 ) | ( (uint64_t) data[ 0 ] << 24 ) | ( (uint64_t) data[ 1 ] << 16 ) |
+                    ( (uint64_t) data[ 2 ] << 8 ) | data[ 3 ];
+                data += 4;
+                bits += 32;
+            }
+            else
+            {
+                while( bits < count )
+                {
+                    pending = ( pending << 8 ) | ( data < end ? *data++ : 0 );
+                    bits += 8;
+                }
+            }
+        }
+        bits -= count;
+        return (uint32_t)( ( pending >> bits ) & ( ( (uint64_t) 1 << count ) - 1 ) );
+    }
+
+    uint64_t read64()
+    {
+        uint64_t high = read( 32 );
+        return ( high << 32 ) | read( 32 );
+    }
+};
+
+static void write_integer( bit_writer_t* writer, int64_t value )
+{
+    // Zigzag, so small negative values are small too, then a prefix selecting the width
+    uint64_t zigzag = ( (uint64_t) value << 1 ) ^ (uint64_t)( value >> 63 );
+    if( zigzag == 0 ) writer->write( 0, 1 );
+    else if( zigzag < ( 1u << 7 ) ) writer->write( ( 2u << 7 ) | (uint32_t) zigzag, 2 + 7 );
+    else if( zigzag < ( 1u << 12 ) ) writer->write( ( 6u << 12 ) | (uint32_t) zigzag, 3 + 12 );
+    else if( zigzag < ( 1u << 20 ) ) writer->write( ( 14u << 20 ) | (uint32_t) zigzag, 4 + 20 );
+    else
+    {
+        writer->write( 15, 4 );
+        writer->write64( zigzag );
+    }
+}
+
+static int64_t read_integer( bit_reader_t* reader )
+{
+    uint64_t zigzag;
+    if( reader->read( 1 ) == 0 ) return 0;
+    else if( reader->read( 1 ) == 0 ) zigzag = reader->read( 7 );
+    else if( reader->read( 1 ) == 0 ) zigzag = reader->read( 12 );
+    else if( reader->read( 1 ) == 0 ) zigzag = reader->read( 20 );
+    else zigzag = reader->read64();
+    return (int64_t)( zigzag >> 1 ) ^ -(int64_t)( zigzag & 1 );
+}
+
+// Per column state of the XOR float encoding
+struct xor_state_t
+{
+    uint32_t previous;
+    int leading; // Window of the previous meaningful bits, leading is -1 before the first window
+    int trailing;
+};
+
+static void write_float( bit_writer_t* writer, xor_state_t* state, uint32_t value )
+{
+    uint32_t x = value ^ state->previous;
+    state->previous = value;
+    if( x == 0 )
+    {
+        writer->write( 0, 1 );
+        return;
+    }
+
+    int leading = std::min( __builtin_clz( x ), 31 );
+    int trailing = __builtin_ctz( x );
+    if( state->leading >= 0 && leading >= state->leading && trailing >= state->trailing )
+    {
+        // Fits in the previous window, so only the bits are needed
+        int length = 32 - state->leading - state->trailing;
+        writer->write( 2, 2 );
+        writer->write( x >> state->trailing, length );
+        return;
+    }
+
+    int length = 32 - leading - trailing;
+    writer->write( ( 3u << 10 ) | ( (uint32_t) leading << 5 ) | (uint32_t)( length - 1 ), 2 + 5 + 5 );
+    writer->write( x >> trailing, length );
+    state->leading = leading;
+    state->trailing = trailing;
+}
+
+static uint32_t read_float( bit_reader_t* reader, xor_state_t* state )
+{
+    if( reader->read( 1 ) == 0 ) return state->previous;
+    if( reader->read( 1 ) == 1 )
+    {
+        state->leading = (int) reader->read( 5 );
+        int length = (int) reader->read( 5 ) + 1;
+        state->trailing = std::max( 32 - state->leading - length, 0 ); // Clamped, in case the data is damaged
+    }
+    else if( state->leading < 0 )
+    {
+        return state->previous; // Damaged, a window must be set before it is reused
+    }
+    int length = 32 - state->leading - state->trailing;
+    uint32_t x = reader->read( length ) << state->trailing;
+    state->previous ^= x;
+    return state->previous;
+}
+
+static uint32_t float_bits( tobii_gaze_data_t const& sample, size_t offset )
+{
+    uint32_t bits;
+    memcpy( &bits, reinterpret_cast<char const*>( &sample ) + offset, sizeof( bits ) );
+    return bits;
+}
+
+static void encode_timestamps( tobii_gaze_data_t const* samples, uint32_t count, std::vector<uint8_t>* out )
+{
+    bit_writer_t writer = { out, 0, 0 };
+    writer.write64( (uint64_t) samples[ 0 ].timestamp_tracker_us );
+    int64_t previous_delta = 0;
+    for( uint32_t i = 1; i < count; ++i )
+    {
+        int64_t delta = samples[ i ].timestamp_tracker_us - samples[ i - 1 ].timestamp_tracker_us;
+        write_integer( &writer, delta - previous_delta );
+        previous_delta = delta;
+    }
+    writer.flush();
+}
+
+static void encode_columns( tobii_gaze_data_t const* samples, uint32_t count, std::vector<uint8_t>* out )
+{
+    bit_writer_t writer = { out, 0, 0 };
+
+    int64_t previous_offset = samples[ 0 ].timestamp_system_us - samples[ 0 ].timestamp_tracker_us;
+    writer.write64( (uint64_t) previous_offset );
+    for( uint32_t i = 1; i < count; ++i )
+    {
+        int64_t offset = samples[ i ].timestamp_system_us - samples[ i ].timestamp_tracker_us;
+        write_integer( &writer, offset - previous_offset );
+        previous_offset = offset;
+    }
+
+    writer.write( samples[ 0 ].frame_count, 32 );
+    int64_t previous_delta = 0;
+    for( uint32_t i = 1; i < count; ++i )
+    {
+        int64_t delta = (int64_t) samples[ i ].frame_count - (int64_t) samples[ i - 1 ].frame_count;
+        write_integer( &writer, delta - previous_delta );
+        previous_delta = delta;
+    }
+
+    int64_t previous_skipped = 0;
+    for( uint32_t i = 0; i < count; ++i )
+    {
+        write_integer( &writer, (int64_t) samples[ i ].frame_skipped - previous_skipped );
+        previous_skipped = samples[ i ].frame_skipped;
+    }
+
+    for( size_t offset : columns.validities )
+    {
+        for( uint32_t i = 0; i < count; ++i )
+        {
+            tobii_validity_t validity;
+            memcpy( &validity, reinterpret_cast<char const*>( &samples[ i ] ) + offset, sizeof( validity ) );
+            writer.write( validity == TOBII_VALIDITY_VALID ? 1 : 0, 1 );
+        }
+    }
+
+    for( size_t offset : columns.floats )
+    {
+        xor_state_t state = { float_bits( samples[ 0 ], offset ), -1, 0 };
+        writer.write( state.previous, 32 );
+        for( uint32_t i = 1; i < count; ++i ) write_float( &writer, &state, float_bits( samples[ i ], offset ) );
+    }
+
+    writer.flush();
+}
+
+// Writes every *stride* bytes, so it can decode into an array of timestamps as well as into the samples
+static void decode_timestamps( uint8_t const* data, size_t size, uint32_t count, int64_t* timestamps, size_t stride )
+{
+    bit_reader_t reader = { data, data + size, 0, 0 };
+    int64_t timestamp = (int64_t) reader.read64();
+    int64_t delta = 0;
+    for( uint32_t i = 0; i < count; ++i )
+    {
+        if( i > 0 )
+        {
+            delta += read_integer( &reader );
+            timestamp += delta;
+        }
+        *reinterpret_cast<int64_t*>( reinterpret_cast<char*>( timestamps ) + i * stride ) = timestamp;
+    }
+}
+
+// Expects the timestamp_tracker_us column to be decoded already
+static void decode_columns( uint8_t const* data, size_t size, uint32_t count, tobii_gaze_data_t* samples )
+{
+    bit_reader_t reader = { data, data + size, 0, 0 };
+
+    int64_t delta = 0;
+    int64_t offset = (int64_t) reader.read64();
+    samples[ 0 ].timestamp_system_us = samples[ 0 ].timestamp_tracker_us + offset;
+    for( uint32_t i = 1; i < count; ++i )
+    {
+        offset += read_integer( &reader );
+        samples[ i ].timestamp_system_us = samples[ i ].timestamp_tracker_us + offset;
+    }
+
+    samples[ 0 ].frame_count = reader.read( 32 );
+    delta = 0;
+    for( uint32_t i = 1; i < count; ++i )
+    {
+        delta += read_integer( &reader );
+        samples[ i ].frame_count = (uint32_t)( (int64_t) samples[ i - 1 ].frame_count + delta );
+    }
+
+    int64_t skipped = 0;
+    for( uint32_t i = 0; i < count; ++i )
+    {
+        skipped += read_integer( &reader );
+        samples[ i ].frame_skipped = (uint32_t) skipped;
+    }
+
+    for( size_t column : columns.validities )
+    {
+        for( uint32_t i = 0; i < count; ++i )
+        {
+            tobii_validity_t validity = reader.read( 1 ) ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+            memcpy( reinterpret_cast<char*>( &samples[ i ] ) + column, &validity, sizeof( validity ) );
+        }
+    }
+
+    for( size_t column : columns.floats )
+    {
+        xor_state_t state = { reader.read( 32 ), -1, 0 };
+        memcpy( reinterpret_cast<char*>( &samples[ 0 ] ) + column, &state.previous, sizeof( uint32_t ) );
+        for( uint32_t i = 1; i < count; ++i )
+        {
+            uint32_t bits = read_float( &reader, &state );
+            memcpy( reinterpret_cast<char*>( &samples[ i ] ) + column, &bits, sizeof( bits ) );
+        }
+    }
+}
+
+struct gaze_archive_writer_t
+{
+    uint32_t samples_per_chunk;
+    int zstd_level;
+    std::vector<tobii_gaze_data_t> pending;
+    std::vector<uint8_t> archive;
+    std::vector<uint8_t> bits; // Bit stream of the chunk being encoded
+    std::vector<chunk_index_t> index;
+    bool finished;
+};
+
+static void write_chunk( gaze_archive_writer_t* writer )
+{
+    if( writer->pending.empty() ) return;
+    uint32_t count = (uint32_t) writer->pending.size();
+    chunk_index_t chunk = {};
+    chunk.offset = writer->archive.size();
+    encode_timestamps( writer->pending.data(), count, &writer->archive );
+    chunk.timestamps_size = (uint32_t)( writer->archive.size() - chunk.offset );
+
+    writer->bits.clear();
+    encode_columns( writer->pending.data(), count, &writer->bits );
+    chunk.raw_size = (uint32_t) writer->bits.size();
+    chunk.sample_count = count;
+    chunk.first_timestamp_us = writer->pending.front().timestamp_tracker_us;
+    chunk.last_timestamp_us = writer->pending.back().timestamp_tracker_us;
+    chunk.compression = CHUNK_COMPRESSION_NONE;
+
+#ifdef GAZE_ARCHIVE_ZSTD
+    if( writer->zstd_level > 0 )
+    {
+        size_t start = writer->archive.size();
+        size_t bound = ZSTD_compressBound( writer->bits.size() );
+        writer->archive.resize( start + bound );
+        size_t compressed = ZSTD_compress( writer->archive.data() + start, bound, writer->bits.data(),
+            writer->bits.size(), writer->zstd_level );
+        // The bit stream is already dense, so zstd does not always win
+        if( !ZSTD_isError( compressed ) && compressed < writer->bits.size() )
+        {
+            writer->archive.resize( start + compressed );
+            chunk.stored_size = (uint32_t) compressed;
+            chunk.compression = CHUNK_COMPRESSION_ZSTD;
+        }
+        else
+        {
+            writer->archive.resize( start );
+        }
+    }
+#endif
+
+    if( chunk.compression == CHUNK_COMPRESSION_NONE )
+    {
+        writer->archive.insert( writer->archive.end(), writer->bits.begin(), writer->bits.end() );
+        chunk.stored_size = chunk.raw_size;
+    }
+    writer->index.push_back( chunk );
+    writer->pending.clear();
+}
+
+template< typename T >
+static void append( std::vector<uint8_t>* out, T const& value )
+{
+    uint8_t const* bytes = reinterpret_cast<uint8_t const*>( &value );
+    out->insert( out->end(), bytes, bytes + sizeof( T ) );
+}
+
+gaze_archive_writer_t* gaze_archive_writer_create( int samples_per_chunk, int zstd_level )
+{
+    auto writer = new gaze_archive_writer_t();
+    writer->samples_per_chunk = (uint32_t) std::max( samples_per_chunk, 1 );
+    writer->zstd_level = zstd_level;
+    writer->pending.reserve( writer->samples_per_chunk );
+    archive_header_t header = { archive_magic, archive_version, 0 };
+    append( &writer->archive, header );
+    return writer;
+}
+
+void gaze_archive_writer_destroy( gaze_archive_writer_t* writer )
+{
+    delete writer;
+}
+
+void gaze_archive_writer_add( gaze_archive_writer_t* writer, tobii_gaze_data_t const* gaze_data )
+{
+    if( writer->finished ) return;
+    writer->pending.push_back( *gaze_data );
+    if( writer->pending.size() == writer->samples_per_chunk ) write_chunk( writer );
+}
+
+void gaze_archive_writer_finish( gaze_archive_writer_t* writer, void const** data, size_t* size )
+{
+    if( !writer->finished )
+    {
+        write_chunk( writer );
+        archive_footer_t footer = { writer->archive.size(), (uint32_t) writer->index.size(), archive_magic };
+        for( chunk_index_t const& chunk : writer->index ) append( &writer->archive, chunk );
+        append( &writer->archive, footer );
+        writer->finished = true;
+    }
+    *data = writer->archive.data();
+    *size = writer->archive.size();
+}
+
+struct gaze_archive_reader_t
+{
+    uint8_t const* data;
+    std::vector<chunk_index_t> chunks;
+    std::vector<int64_t> first_samples; // Cumulative sample count before each chunk, plus the total at the end
+    std::vector<int64_t> last_timestamps; // For the binary search
+};
+
+tobii_error_t gaze_archive_reader_open( void const* data, size_t size, gaze_archive_reader_t** reader )
+{
+    if( !data || !reader || size < sizeof( archive_header_t ) + sizeof( archive_footer_t ) )
+        return TOBII_ERROR_INVALID_PARAMETER;
+    auto bytes = static_cast<uint8_t const*>( data );
+
+    archive_header_t header;
+    archive_footer_t footer;
+    memcpy( &header, bytes, sizeof( header ) );
+    memcpy( &footer, bytes + size - sizeof( footer ), sizeof( footer ) );
+    if( header.magic != archive_magic || header.version != archive_version || footer.magic != archive_magic )
+        return TOBII_ERROR_INVALID_PARAMETER;
+    size_t index_end = size - sizeof( footer );
+    if( footer.index_offset > index_end ||
+        ( index_end - footer.index_offset ) != (size_t) footer.chunk_count * sizeof( chunk_index_t ) )
+        return TOBII_ERROR_INVALID_PARAMETER;
+
+    auto result = new gaze_archive_reader_t();
+    result->data = bytes;
+    result->chunks.resize( footer.chunk_count );
+    if( footer.chunk_count > 0 )
+        memcpy( result->chunks.data(), bytes + footer.index_offset, footer.chunk_count * sizeof( chunk_index_t ) );
+
+    tobii_error_t error = TOBII_ERROR_NO_ERROR;
+    int64_t first_sample = 0;
+    for( chunk_index_t const& chunk : result->chunks )
+    {
+        // Everything the decoder trusts is checked here, so decoding itself never has to fail
+        if( chunk.offset < sizeof( header ) ||
+            chunk.offset + chunk.timestamps_size + chunk.stored_size > footer.index_offset ||
+            chunk.sample_count == 0 || chunk.compression > CHUNK_COMPRESSION_ZSTD )
+            error = TOBII_ERROR_INVALID_PARAMETER;
+#ifndef GAZE_ARCHIVE_ZSTD
+        else if( chunk.compression == CHUNK_COMPRESSION_ZSTD )
+            error = TOBII_ERROR_NOT_SUPPORTED;
+#endif
+        result->first_samples.push_back( first_sample );
+        result->last_timestamps.push_back( chunk.last_timestamp_us );
+        first_sample += chunk.sample_count;
+    }
+    result->first_samples.push_back( first_sample );
+
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        delete result;
+        return error;
+    }
+    *reader = result;
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void gaze_archive_reader_close( gaze_archive_reader_t* reader )
+{
+    delete reader;
+}
+
+int64_t gaze_archive_reader_sample_count( gaze_archive_reader_t const* reader )
+{
+    return reader->first_samples.back();
+}
+
+// Returns the bit stream of the columns after the timestamps, decompressing it into *scratch* if needed
+static uint8_t const* column_bits( gaze_archive_reader_t const* reader, chunk_index_t const& chunk,
+    std::vector<uint8_t>* scratch, size_t* size )
+{
+    uint8_t const* stored = reader->data + chunk.offset + chunk.timestamps_size;
+    *size = chunk.stored_size;
+#ifdef GAZE_ARCHIVE_ZSTD
+    if( chunk.compression == CHUNK_COMPRESSION_ZSTD )
+    {
+        scratch->resize( chunk.raw_size );
+        size_t decompressed = ZSTD_decompress( scratch->data(), scratch->size(), stored, chunk.stored_size );
+        *size = ZSTD_isError( decompressed ) ? 0 : decompressed;
+        return scratch->data();
+    }
+#else
+    (void) scratch; // Unused parameter
+#endif
+    return stored;
+}
+
+static void decode_chunk( gaze_archive_reader_t const* reader, chunk_index_t const& chunk,
+    std::vector<uint8_t>* scratch, tobii_gaze_data_t* samples )
+{
+    memset( samples, 0, chunk.sample_count * sizeof( tobii_gaze_data_t ) );
+    decode_timestamps( reader->data + chunk.offset, chunk.timestamps_size, chunk.sample_count,
+        &samples[ 0 ].timestamp_tracker_us, sizeof( tobii_gaze_data_t ) );
+    size_t size;
+    uint8_t const* bits = column_bits( reader, chunk, scratch, &size );
+    decode_columns( bits, size, chunk.sample_count, samples );
+}
+
+int64_t gaze_archive_reader_seek( gaze_archive_reader_t const* reader, int64_t timestamp_us )
+{
+    auto found = std::lower_bound( reader->last_timestamps.begin(), reader->last_timestamps.end(), timestamp_us );
+    if( found == reader->last_timestamps.end() ) return gaze_archive_reader_sample_count( reader );
+    size_t chunk_number = (size_t)( found - reader->last_timestamps.begin() );
+    chunk_index_t const& chunk = reader->chunks[ chunk_number ];
+    int64_t first_sample = reader->first_samples[ chunk_number ];
+    if( timestamp_us <= chunk.first_timestamp_us ) return first_sample;
+
+    std::vector<int64_t> timestamps( chunk.sample_count );
+    decode_timestamps( reader->data + chunk.offset, chunk.timestamps_size, chunk.sample_count, timestamps.data(),
+        sizeof( int64_t ) );
+    return first_sample + ( std::lower_bound( timestamps.begin(), timestamps.end(), timestamp_us ) -
+        timestamps.begin() );
+}
+
+int64_t gaze_archive_reader_decode( gaze_archive_reader_t const* reader, int64_t first, int64_t count,
+    tobii_gaze_data_t* gaze_data, int threads )
+{
+    int64_t total = gaze_archive_reader_sample_count( reader );
+    if( first < 0 || first >= total || count <= 0 ) return 0;
+    count = std::min( count, total - first );
+    int64_t last = first + count;
+
+    // Chunks overlapping the requested range
+    size_t begin = (size_t)( std::upper_bound( reader->first_samples.begin(), reader->first_samples.end(), first ) -
+        reader->first_samples.begin() ) - 1;
+    size_t end = (size_t)( std::lower_bound( reader->first_samples.begin(), reader->first_samples.end(), last ) -
+        reader->first_samples.begin() );
+
+    std::atomic<size_t> next_chunk( begin );
+    auto worker = [&]()
+    {
+        std::vector<uint8_t> scratch;
+        std::vector<tobii_gaze_data_t> partial;
+        for( size_t i = next_chunk++; i < end; i = next_chunk++ )
+        {
+            chunk_index_t const& chunk = reader->chunks[ i ];
+            int64_t chunk_first = reader->first_samples[ i ];
+            int64_t chunk_last = chunk_first + chunk.sample_count;
+            if( chunk_first >= first && chunk_last <= last )
+            {
+                decode_chunk( reader, chunk, &scratch, gaze_data + ( chunk_first - first ) );
+                continue;
+            }
+            // Only part of the chunk was asked for
+            partial.resize( chunk.sample_count );
+            decode_chunk( reader, chunk, &scratch, partial.data() );
+            int64_t from = std::max( first, chunk_first );
+            int64_t to = std::min( last, chunk_last );
+            memcpy( gaze_data + ( from - first ), partial.data() + ( from - chunk_first ),
+                (size_t)( to - from ) * sizeof( tobii_gaze_data_t ) );
+        }
+    };
+
+    int thread_count = (int) std::min<size_t>( (size_t) std::max( threads, 1 ), end - begin );
+    std::vector<std::thread> workers;
+    for( int i = 1; i < thread_count; ++i ) workers.emplace_back( worker );
+    worker();
+    for( auto& thread : workers ) thread.join();
+    return count;
+}
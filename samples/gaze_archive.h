@@ -0,0 +1,57 @@
+#ifndef sample_gaze_archive_h
+#define sample_gaze_archive_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+
+#include <stddef.h>
+
+// Lossless archive format for long gaze data recordings. Samples are grouped into chunks, and each chunk is stored
+// column by column as bit streams:
+//
+//   - timestamp_tracker_us and frame_count as delta of delta, which is a single bit per sample at a steady rate
+//   - timestamp_system_us as the delta of its offset from the tracker timestamp
+//   - each validity as its own bit column
+//   - each float as the XOR with the previous value of the column, storing only the bits between the leading and
+//     trailing zeros, and only the bits themselves if they fit in the window of the previous value (as in Gorilla)
+//
+// When built with GAZE_ARCHIVE_ZSTD defined (and linked with libzstd), chunks may also be compressed with zstd. The
+// tracker timestamp column is always left uncompressed, so seeking never has to decompress anything.
+//
+// The archive ends with an index holding the time range of every chunk, so a reader can find the chunk for any
+// timestamp with a binary search, and decode chunks independently of each other on multiple threads.
+
+typedef struct gaze_archive_writer_t gaze_archive_writer_t;
+typedef struct gaze_archive_reader_t gaze_archive_reader_t;
+
+// *samples_per_chunk* trades seek granularity against compression, 4096 is a few seconds at 1200 Hz. A *zstd_level*
+// of 0 stores chunks without zstd, which is also what happens when built without GAZE_ARCHIVE_ZSTD.
+gaze_archive_writer_t* gaze_archive_writer_create( int samples_per_chunk, int zstd_level );
+
+void gaze_archive_writer_destroy( gaze_archive_writer_t* writer );
+
+// Samples must be added in recording order.
+void gaze_archive_writer_add( gaze_archive_writer_t* writer, tobii_gaze_data_t const* gaze_data );
+
+// Encodes the last chunk and appends the index. *data* points to the complete archive, and stays valid until the
+// writer is destroyed. No samples can be added afterwards.
+void gaze_archive_writer_finish( gaze_archive_writer_t* writer, void const** data, size_t* size );
+
+// The archive data is not copied, and must outlive the reader. Returns TOBII_ERROR_INVALID_PARAMETER if *data* is not
+// a valid archive, and TOBII_ERROR_NOT_SUPPORTED if it holds zstd chunks but zstd support was not built in.
+tobii_error_t gaze_archive_reader_open( void const* data, size_t size, gaze_archive_reader_t** reader );
+
+void gaze_archive_reader_close( gaze_archive_reader_t* reader );
+
+int64_t gaze_archive_reader_sample_count( gaze_archive_reader_t const* reader );
+
+// Index of the first sample with a timestamp_tracker_us at or after *timestamp_us*, or the sample count if there is
+// none. Only the timestamp column of a single chunk is decoded.
+int64_t gaze_archive_reader_seek( gaze_archive_reader_t const* reader, int64_t timestamp_us );
+
+// Decodes *count* samples starting at sample *first* into *gaze_data*, spreading the chunks over up to *threads*
+// threads. Returns the number of samples decoded, which is less than *count* at the end of the archive.
+int64_t gaze_archive_reader_decode( gaze_archive_reader_t const* reader, int64_t first, int64_t count,
+    tobii_gaze_data_t* gaze_data, int threads );
+
+#endif // sample_gaze_archive_h
@@ -0,0 +1,191 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+
+#include "gaze_archive.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    gaze_archive_writer_add( static_cast<gaze_archive_writer_t*>( user_data ), gaze_data );
+}
+
+static void idle( void* context )
+{
+    (void) context; // Unused parameter, the callback does all the work
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int gaze_archive_sample_main( void );
+extern "C" int gaze_archive_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    gaze_archive_writer_t* writer = gaze_archive_writer_create( 4096, 3 );
+    error = tobii_gaze_data_subscribe( device, gaze_data_callback, writer );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze data stream.\n" );
+        gaze_archive_writer_destroy( writer );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // Record until a key is pressed
+    main_loop( device, idle, NULL );
+
+    error = tobii_gaze_data_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze data stream.\n" );
+
+    void const* data;
+    size_t size;
+    gaze_archive_writer_finish( writer, &data, &size );
+    FILE* file = fopen( "gaze_recording.tgza", "wb" );
+    if( file && fwrite( data, 1, size, file ) == size )
+        printf( "Wrote %zu bytes to gaze_recording.tgza\n", size );
+    else
+        fprintf( stderr, "Failed to write gaze_recording.tgza.\n" );
+    if( file ) fclose( file );
+    gaze_archive_writer_destroy( writer );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+static double megabytes_per_second( size_t bytes, std::chrono::steady_clock::duration elapsed )
+{
+    return (double) bytes / 1e6 / std::chrono::duration<double>( elapsed ).count();
+}
+
+static int benchmark_level( std::vector<tobii_gaze_data_t> const& recording, int zstd_level )
+{
+    size_t raw_size = recording.size() * sizeof( tobii_gaze_data_t );
+
+    auto start = std::chrono::steady_clock::now();
+    gaze_archive_writer_t* writer = gaze_archive_writer_create( 4096, zstd_level );
+    for( auto const& gaze_data : recording ) gaze_archive_writer_add( writer, &gaze_data );
+    void const* data;
+    size_t size;
+    gaze_archive_writer_finish( writer, &data, &size );
+    auto encode_time = std::chrono::steady_clock::now() - start;
+
+    gaze_archive_reader_t* reader;
+    tobii_error_t error = gaze_archive_reader_open( data, size, &reader );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to open the archive: %s.\n", tobii_error_message( error ) );
+        gaze_archive_writer_destroy( writer );
+        return 1;
+    }
+
+    printf( "zstd level %d: %.1f MB -> %.1f MB, ratio %.2f (%.1f bytes per sample), encode %.0f MB/s\n", zstd_level,
+        raw_size / 1e6, size / 1e6, (double) raw_size / (double) size, (double) size / (double) recording.size(),
+        megabytes_per_second( raw_size, encode_time ) );
+
+    // Decoding must reproduce the recording exactly, padding included, as decoded records are zero initialized
+    std::vector<tobii_gaze_data_t> decoded( recording.size() );
+    int thread_counts[] = { 1, 2, 4, 8 };
+    int result = 0;
+    for( int threads : thread_counts )
+    {
+        memset( decoded.data(), 0xff, raw_size );
+        start = std::chrono::steady_clock::now();
+        gaze_archive_reader_decode( reader, 0, (int64_t) decoded.size(), decoded.data(), threads );
+        auto decode_time = std::chrono::steady_clock::now() - start;
+        bool identical = memcmp( decoded.data(), recording.data(), raw_size ) == 0;
+        if( !identical ) result = 1;
+        printf( "    decode on %d thread%s: %.0f MB/s%s\n", threads, threads > 1 ? "s" : "",
+            megabytes_per_second( raw_size, decode_time ), identical ? "" : " MISMATCH" );
+    }
+
+    // Random seeks, each decoding one timestamp column
+    std::mt19937 random( 1 );
+    int64_t first_us = recording.front().timestamp_tracker_us;
+    int64_t span_us = recording.back().timestamp_tracker_us - first_us;
+    int const seeks = 10000;
+    start = std::chrono::steady_clock::now();
+    for( int i = 0; i < seeks; ++i )
+    {
+        int64_t target_us = first_us + (int64_t)( random() % (uint64_t) span_us );
+        int64_t index = gaze_archive_reader_seek( reader, target_us );
+        if( recording[ index ].timestamp_tracker_us < target_us ||
+            ( index > 0 && recording[ index - 1 ].timestamp_tracker_us >= target_us ) ) result = 1;
+    }
+    auto seek_time = std::chrono::steady_clock::now() - start;
+    printf( "    seek: %.1f us%s\n", std::chrono::duration<double, std::micro>( seek_time ).count() / seeks,
+        result ? " (errors)" : "" );
+
+    gaze_archive_reader_close( reader );
+    gaze_archive_writer_destroy( writer );
+    return result;
+}
+
+extern "C" int gaze_archive_benchmark_main( void );
+extern "C" int gaze_archive_benchmark_main( void )
+{
+    // Ten minutes of replayed gaze data at 1200 Hz, zero initialized so the struct padding compares equal
+    float const frequency_hz = 1200.0f;
+    std::vector<tobii_gaze_data_t> recording( (size_t)( frequency_hz * 600 ) );
+    for( size_t i = 0; i < recording.size(); ++i )
+        stream_replay_gaze_data( (int64_t) i, frequency_hz, &recording[ i ] );
+
+    printf( "%zu samples of %zu bytes, on %u cores\n", recording.size(), sizeof( tobii_gaze_data_t ),
+        std::thread::hardware_concurrency() );
+    int result = benchmark_level( recording, 0 );
+#ifdef GAZE_ARCHIVE_ZSTD
+    result |= benchmark_level( recording, 3 );
+#endif
+    return result;
+}
@@ -0,0 +1,300 @@
+#include "gaze_fusion.h"
+
+#include <math.h>
+#include <string.h>
+
+// Per-stream history. The capacity only has to cover the rate difference between the streams and the gaze point
+// stream, so searching it from the newest sample is bounded by a small constant.
+template< typename T >
+struct history_t
+{
+    static uint32_t const capacity = 8; // Must be a power of two
+    T samples[ capacity ];
+    uint32_t count; // Total number of samples pushed
+};
+
+struct head_sample_t
+{
+    int64_t timestamp_us;
+    bool position_valid;
+    float position_xyz[ 3 ];
+    bool rotation_valid_xyz[ 3 ];
+    float rotation_xyz[ 3 ];
+};
+
+// The eyes are kept apart, since the midpoint of both and the origin of one eye are about 30 mm apart, and
+// interpolating between the two would produce origins neither eye was ever at.
+struct origin_sample_t
+{
+    int64_t timestamp_us;
+    bool left_valid;
+    float left_xyz[ 3 ];
+    bool right_valid;
+    float right_xyz[ 3 ];
+};
+
+struct gaze_fusion_t
+{
+    tobii_display_area_t display_area;
+    int64_t max_hold_us;
+    gaze_fusion_callback_t callback;
+    void* user_data;
+    history_t<head_sample_t> head_poses;
+    history_t<origin_sample_t> gaze_origins;
+    bool eye_offset_valid;
+    float eye_offset_xyz[ 3 ]; // Right eye origin minus left eye origin, from the latest sample with both eyes
+};
+
+template< typename T >
+static void history_push( history_t<T>* history, T const& sample )
+{
+    // Duplicated and out of order samples would break the bracketing search, so they are dropped
+    if( history->count > 0 )
+    {
+        T const& newest = history->samples[ ( history->count - 1 ) & ( history_t<T>::capacity - 1 ) ];
+        if( sample.timestamp_us <= newest.timestamp_us ) return;
+    }
+    history->samples[ history->count & ( history_t<T>::capacity - 1 ) ] = sample;
+    ++history->count;
+}
+
+template< typename T >
+static void history_bracket( history_t<T> const& history, int64_t timestamp_us, T const** before, T const** after )
+{
+    // Find the newest sample at or before the timestamp, and the sample following it
+    *before = nullptr;
+    *after = nullptr;
+    uint32_t size = history.count < history_t<T>::capacity ? history.count : history_t<T>::capacity;
+    for( uint32_t i = 0; i < size; ++i )
+    {
+        T const* sample = &history.samples[ ( history.count - 1 - i ) & ( history_t<T>::capacity - 1 ) ];
+        if( sample->timestamp_us <= timestamp_us )
+        {
+            *before = sample;
+            return;
+        }
+        *after = sample;
+    }
+}
+
+// Interpolates *count* floats between the bracketing samples when both are valid, and otherwise falls back to the
+// valid one if it is close enough in time. Returns false if no usable value exists.
+static bool resolve( int64_t timestamp_us, int64_t max_hold_us, int count,
+    int64_t before_us, bool before_valid, float const* before,
+    int64_t after_us, bool after_valid, float const* after, float* result )
+{
+    if( before_valid && after_valid )
+    {
+        float weight = (float)( timestamp_us - before_us ) / (float)( after_us - before_us );
+        for( int i = 0; i < count; ++i ) result[ i ] = before[ i ] + ( after[ i ] - before[ i ] ) * weight;
+        return true;
+    }
+    if( before_valid && timestamp_us - before_us <= max_hold_us )
+    {
+        memcpy( result, before, sizeof( float ) * count );
+        return true;
+    }
+    if( after_valid && after_us - timestamp_us <= max_hold_us )
+    {
+        memcpy( result, after, sizeof( float ) * count );
+        return true;
+    }
+    return false;
+}
+
+static tobii_validity_t validity( bool valid )
+{
+    return valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+}
+
+static void fuse_head_pose( gaze_fusion_t const* fusion, int64_t timestamp_us, gaze_fusion_record_t* record )
+{
+    head_sample_t const* before;
+    head_sample_t const* after;
+    history_bracket( fusion->head_poses, timestamp_us, &before, &after );
+
+    static head_sample_t const none = {};
+    if( !before ) before = &none;
+    if( !after ) after = &none;
+
+    bool valid = resolve( timestamp_us, fusion->max_hold_us, 3,
+        before->timestamp_us, before->position_valid, before->position_xyz,
+        after->timestamp_us, after->position_valid, after->position_xyz, record->head_position_xyz );
+    record->head_position_validity = validity( valid );
+
+    // Each rotation axis carries its own validity
+    for( int i = 0; i < 3; ++i )
+    {
+        valid = resolve( timestamp_us, fusion->max_hold_us, 1,
+            before->timestamp_us, before->rotation_valid_xyz[ i ], &before->rotation_xyz[ i ],
+            after->timestamp_us, after->rotation_valid_xyz[ i ], &after->rotation_xyz[ i ],
+            &record->head_rotation_xyz[ i ] );
+        record->head_rotation_validity_xyz[ i ] = validity( valid );
+    }
+}
+
+static void fuse_gaze_origin( gaze_fusion_t const* fusion, int64_t timestamp_us, gaze_fusion_record_t* record )
+{
+    origin_sample_t const* before;
+    origin_sample_t const* after;
+    history_bracket( fusion->gaze_origins, timestamp_us, &before, &after );
+
+    static origin_sample_t const none = {};
+    if( !before ) before = &none;
+    if( !after ) after = &none;
+
+    float left_xyz[ 3 ], right_xyz[ 3 ];
+    bool left = resolve( timestamp_us, fusion->max_hold_us, 3,
+        before->timestamp_us, before->left_valid, before->left_xyz,
+        after->timestamp_us, after->left_valid, after->left_xyz, left_xyz );
+    bool right = resolve( timestamp_us, fusion->max_hold_us, 3,
+        before->timestamp_us, before->right_valid, before->right_xyz,
+        after->timestamp_us, after->right_valid, after->right_xyz, right_xyz );
+
+    // Combine the eyes only now, and stand in for a missing eye with the last known offset between the eyes, so the
+    // combined origin stays at the midpoint when an eye is lost
+    float half_offset = fusion->eye_offset_valid ? 0.5f : 0.0f;
+    for( int i = 0; i < 3; ++i )
+    {
+        if( left && right ) record->gaze_origin_xyz[ i ] = ( left_xyz[ i ] + right_xyz[ i ] ) * 0.5f;
+        else if( left ) record->gaze_origin_xyz[ i ] = left_xyz[ i ] + fusion->eye_offset_xyz[ i ] * half_offset;
+        else if( right ) record->gaze_origin_xyz[ i ] = right_xyz[ i ] - fusion->eye_offset_xyz[ i ] * half_offset;
+        else record->gaze_origin_xyz[ i ] = 0.0f;
+    }
+    record->gaze_origin_validity = validity( left || right );
+}
+
+static bool gaze_direction( tobii_display_area_t const* area, float const* origin_xyz, float const* position_xy,
+    float* direction_xyz )
+{
+    // Map the normalized gaze point onto the display area plane, then point the ray at it from the gaze origin
+    float length_squared = 0.0f;
+    for( int i = 0; i < 3; ++i )
+    {
+        float on_display = area->top_left_mm_xyz[ i ]
+            + ( area->top_right_mm_xyz[ i ] - area->top_left_mm_xyz[ i ] ) * position_xy[ 0 ]
+            + ( area->bottom_left_mm_xyz[ i ] - area->top_left_mm_xyz[ i ] ) * position_xy[ 1 ];
+        direction_xyz[ i ] = on_display - origin_xyz[ i ];
+        length_squared += direction_xyz[ i ] * direction_xyz[ i ];
+    }
+    if( length_squared < 1e-6f ) return false;
+
+    float inverse_length = 1.0f / sqrtf( length_squared );
+    for( int i = 0; i < 3; ++i ) direction_xyz[ i ] *= inverse_length;
+    return true;
+}
+
+static void head_pose_callback( tobii_head_pose_t const* head_pose, void* user_data )
+{
+    gaze_fusion_push_head_pose( static_cast<gaze_fusion_t*>( user_data ), head_pose );
+}
+
+static void gaze_origin_callback( tobii_gaze_origin_t const* gaze_origin, void* user_data )
+{
+    gaze_fusion_push_gaze_origin( static_cast<gaze_fusion_t*>( user_data ), gaze_origin );
+}
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    gaze_fusion_push_gaze_point( static_cast<gaze_fusion_t*>( user_data ), gaze_point );
+}
+
+gaze_fusion_t* gaze_fusion_create( tobii_display_area_t const* display_area, int64_t max_hold_us,
+    gaze_fusion_callback_t callback, void* user_data )
+{
+    auto fusion = new gaze_fusion_t();
+    fusion->display_area = *display_area;
+    fusion->max_hold_us = max_hold_us;
+    fusion->callback = callback;
+    fusion->user_data = user_data;
+    return fusion;
+}
+
+void gaze_fusion_destroy( gaze_fusion_t* fusion )
+{
+    delete fusion;
+}
+
+void gaze_fusion_set_display_area( gaze_fusion_t* fusion, tobii_display_area_t const* display_area )
+{
+    fusion->display_area = *display_area;
+}
+
+tobii_error_t gaze_fusion_subscribe( gaze_fusion_t* fusion, tobii_device_t* device )
+{
+    tobii_error_t error = tobii_head_pose_subscribe( device, head_pose_callback, fusion );
+    if( error != TOBII_ERROR_NO_ERROR && error != TOBII_ERROR_NOT_SUPPORTED ) return error;
+
+    error = tobii_gaze_origin_subscribe( device, gaze_origin_callback, fusion );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        tobii_head_pose_unsubscribe( device );
+        return error;
+    }
+
+    error = tobii_gaze_point_subscribe( device, gaze_point_callback, fusion );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        tobii_gaze_origin_unsubscribe( device );
+        tobii_head_pose_unsubscribe( device );
+        return error;
+    }
+
+    return TOBII_ERROR_NO_ERROR;
+}
+
+tobii_error_t gaze_fusion_unsubscribe( gaze_fusion_t* fusion, tobii_device_t* device )
+{
+    (void) fusion; // Unused parameter, kept for symmetry with gaze_fusion_subscribe
+    tobii_error_t error = tobii_gaze_point_unsubscribe( device );
+    tobii_error_t origin_error = tobii_gaze_origin_unsubscribe( device );
+    if( error == TOBII_ERROR_NO_ERROR ) error = origin_error;
+    tobii_head_pose_unsubscribe( device ); // Fails if the device has no head pose stream, which is fine
+    return error;
+}
+
+void gaze_fusion_push_head_pose( gaze_fusion_t* fusion, tobii_head_pose_t const* head_pose )
+{
+    head_sample_t sample;
+    sample.timestamp_us = head_pose->timestamp_us;
+    sample.position_valid = head_pose->position_validity == TOBII_VALIDITY_VALID;
+    memcpy( sample.position_xyz, head_pose->position_xyz, sizeof( sample.position_xyz ) );
+    for( int i = 0; i < 3; ++i )
+        sample.rotation_valid_xyz[ i ] = head_pose->rotation_validity_xyz[ i ] == TOBII_VALIDITY_VALID;
+    memcpy( sample.rotation_xyz, head_pose->rotation_xyz, sizeof( sample.rotation_xyz ) );
+    history_push( &fusion->head_poses, sample );
+}
+
+void gaze_fusion_push_gaze_origin( gaze_fusion_t* fusion, tobii_gaze_origin_t const* gaze_origin )
+{
+    origin_sample_t sample;
+    sample.timestamp_us = gaze_origin->timestamp_us;
+    sample.left_valid = gaze_origin->left_validity == TOBII_VALIDITY_VALID;
+    sample.right_valid = gaze_origin->right_validity == TOBII_VALIDITY_VALID;
+    memcpy( sample.left_xyz, gaze_origin->left_xyz, sizeof( sample.left_xyz ) );
+    memcpy( sample.right_xyz, gaze_origin->right_xyz, sizeof( sample.right_xyz ) );
+    history_push( &fusion->gaze_origins, sample );
+
+    if( sample.left_valid && sample.right_valid )
+    {
+        for( int i = 0; i < 3; ++i ) fusion->eye_offset_xyz[ i ] = sample.right_xyz[ i ] - sample.left_xyz[ i ];
+        fusion->eye_offset_valid = true;
+    }
+}
+
+void gaze_fusion_push_gaze_point( gaze_fusion_t* fusion, tobii_gaze_point_t const* gaze_point )
+{
+    gaze_fusion_record_t record;
+    record.timestamp_us = gaze_point->timestamp_us;
+    fuse_head_pose( fusion, gaze_point->timestamp_us, &record );
+    fuse_gaze_origin( fusion, gaze_point->timestamp_us, &record );
+
+    bool valid = gaze_point->validity == TOBII_VALIDITY_VALID
+        && record.gaze_origin_validity == TOBII_VALIDITY_VALID
+        && gaze_direction( &fusion->display_area, record.gaze_origin_xyz, gaze_point->position_xy,
+            record.gaze_direction_xyz );
+    record.gaze_direction_validity = validity( valid );
+    if( !valid ) memset( record.gaze_direction_xyz, 0, sizeof( record.gaze_direction_xyz ) );
+
+    fusion->callback( &record, fusion->user_data );
+}
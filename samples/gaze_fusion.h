@@ -0,0 +1,55 @@
+#ifndef sample_gaze_fusion_h
+#define sample_gaze_fusion_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+// Fuses the head pose, gaze origin and gaze point streams into one record per gaze point. Head pose and gaze origin
+// are interpolated to the gaze point timestamp from a small history per stream, so the lookup is constant time and
+// never allocates. All coordinates are in millimeters from the center of the display, and the gaze direction is a unit
+// vector from the combined gaze origin towards the gaze point on the display area. The combined gaze origin is the
+// midpoint between the eyes; while only one eye is tracked, it is estimated from that eye and the last seen offset
+// between the eyes.
+
+typedef struct gaze_fusion_t gaze_fusion_t;
+
+typedef struct gaze_fusion_record_t
+{
+    int64_t timestamp_us; // Timestamp of the gaze point this record was fused for
+    tobii_validity_t head_position_validity;
+    float head_position_xyz[ 3 ];
+    tobii_validity_t head_rotation_validity_xyz[ 3 ];
+    float head_rotation_xyz[ 3 ];
+    tobii_validity_t gaze_origin_validity;
+    float gaze_origin_xyz[ 3 ];
+    tobii_validity_t gaze_direction_validity;
+    float gaze_direction_xyz[ 3 ];
+} gaze_fusion_record_t;
+
+typedef void ( *gaze_fusion_callback_t )( gaze_fusion_record_t const* record, void* user_data );
+
+// *max_hold_us* is how far from its nearest valid sample a head pose or gaze origin value may be used when it can not
+// be interpolated, for example when the gaze point is newer than the latest head pose.
+gaze_fusion_t* gaze_fusion_create( tobii_display_area_t const* display_area, int64_t max_hold_us,
+    gaze_fusion_callback_t callback, void* user_data );
+
+void gaze_fusion_destroy( gaze_fusion_t* fusion );
+
+// Call when TOBII_NOTIFICATION_TYPE_DISPLAY_AREA_CHANGED is received.
+void gaze_fusion_set_display_area( gaze_fusion_t* fusion, tobii_display_area_t const* display_area );
+
+// Subscribes the fusion stage to the three streams of *device*. A device without a head pose stream is accepted, and
+// will produce records with invalid head fields.
+tobii_error_t gaze_fusion_subscribe( gaze_fusion_t* fusion, tobii_device_t* device );
+
+tobii_error_t gaze_fusion_unsubscribe( gaze_fusion_t* fusion, tobii_device_t* device );
+
+// Feed samples directly, for example from a recording. These are what the subscription callbacks call, and must be
+// called from one thread at a time. Pushing a gaze point invokes the callback with the fused record.
+void gaze_fusion_push_head_pose( gaze_fusion_t* fusion, tobii_head_pose_t const* head_pose );
+
+void gaze_fusion_push_gaze_origin( gaze_fusion_t* fusion, tobii_gaze_origin_t const* gaze_origin );
+
+void gaze_fusion_push_gaze_point( gaze_fusion_t* fusion, tobii_gaze_point_t const* gaze_point );
+
+#endif // sample_gaze_fusion_h
@@ -0,0 +1,186 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_config.h>
+
+#include "gaze_fusion.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+static void store_record( gaze_fusion_record_t const* record, void* user_data )
+{
+    // Store the latest fused record in the supplied storage
+    gaze_fusion_record_t* record_storage = (gaze_fusion_record_t*) user_data;
+    *record_storage = *record;
+}
+
+static void print_record( void* context )
+{
+    auto record = static_cast<gaze_fusion_record_t*>( context );
+    if( record->gaze_direction_validity == TOBII_VALIDITY_VALID )
+        printf( "Gaze ray: %" PRId64 " from {% 6.1f, % 6.1f, % 6.1f} towards {% 2.3f, % 2.3f, % 2.3f}\n",
+            record->timestamp_us, record->gaze_origin_xyz[ 0 ], record->gaze_origin_xyz[ 1 ],
+            record->gaze_origin_xyz[ 2 ], record->gaze_direction_xyz[ 0 ], record->gaze_direction_xyz[ 1 ],
+            record->gaze_direction_xyz[ 2 ] );
+    else
+        printf( "Gaze ray: %" PRId64 " INVALID\n", record->timestamp_us );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int gaze_fusion_sample_main( void );
+extern "C" int gaze_fusion_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // The display area is needed to turn normalized gaze points into positions in the same space as the gaze origin
+    tobii_display_area_t display_area;
+    error = tobii_get_display_area( device, &display_area );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to read the display area.\n" );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    gaze_fusion_record_t latest_record = {};
+    latest_record.gaze_direction_validity = TOBII_VALIDITY_INVALID;
+    // Allow values to be held for up to 50 ms, about three periods of a 60 Hz head pose stream
+    gaze_fusion_t* fusion = gaze_fusion_create( &display_area, 50000, store_record, &latest_record );
+
+    error = gaze_fusion_subscribe( fusion, device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to the fusion streams: %s.\n", tobii_error_message( error ) );
+        gaze_fusion_destroy( fusion );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, print_record, &latest_record );
+
+    error = gaze_fusion_unsubscribe( fusion, device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from the fusion streams.\n" );
+    gaze_fusion_destroy( fusion );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+struct replay_event_t
+{
+    int64_t timestamp_us;
+    int stream;
+    size_t index;
+};
+
+static void count_valid( gaze_fusion_record_t const* record, void* user_data )
+{
+    if( record->gaze_direction_validity == TOBII_VALIDITY_VALID ) ++*(int64_t*) user_data;
+}
+
+extern "C" int gaze_fusion_benchmark_main( void );
+extern "C" int gaze_fusion_benchmark_main( void )
+{
+    // Ten minutes of replayed gaze point and gaze origin at 120 Hz, with head pose at 60 Hz
+    int64_t const duration_s = 600;
+    std::vector<tobii_gaze_point_t> gaze_points( 120 * duration_s );
+    std::vector<tobii_gaze_origin_t> gaze_origins( 120 * duration_s );
+    std::vector<tobii_head_pose_t> head_poses( 60 * duration_s );
+    std::vector<replay_event_t> events;
+    for( size_t i = 0; i < gaze_points.size(); ++i )
+    {
+        stream_replay_gaze_point( (int64_t) i, 120.0f, &gaze_points[ i ] );
+        events.push_back( { gaze_points[ i ].timestamp_us, 0, i } );
+    }
+    for( size_t i = 0; i < gaze_origins.size(); ++i )
+    {
+        stream_replay_gaze_origin( (int64_t) i, 120.0f, &gaze_origins[ i ] );
+        events.push_back( { gaze_origins[ i ].timestamp_us, 1, i } );
+    }
+    for( size_t i = 0; i < head_poses.size(); ++i )
+    {
+        stream_replay_head_pose( (int64_t) i, 60.0f, &head_poses[ i ] );
+        events.push_back( { head_poses[ i ].timestamp_us, 2, i } );
+    }
+    // Deliver in timestamp order, as the pump thread would
+    std::stable_sort( events.begin(), events.end(),
+        []( replay_event_t const& a, replay_event_t const& b ) { return a.timestamp_us < b.timestamp_us; } );
+
+    // A 520 x 290 mm display, 20 mm above the tracker
+    tobii_display_area_t display_area = { { -260.0f, 310.0f, 0.0f }, { 260.0f, 310.0f, 0.0f }, { -260.0f, 20.0f, 0.0f } };
+
+    int const passes = 20;
+    int64_t valid_records = 0;
+    std::chrono::nanoseconds elapsed( 0 );
+    for( int pass = 0; pass < passes; ++pass )
+    {
+        gaze_fusion_t* fusion = gaze_fusion_create( &display_area, 50000, count_valid, &valid_records );
+        auto start = std::chrono::steady_clock::now();
+        for( auto const& event : events )
+        {
+            if( event.stream == 0 ) gaze_fusion_push_gaze_point( fusion, &gaze_points[ event.index ] );
+            else if( event.stream == 1 ) gaze_fusion_push_gaze_origin( fusion, &gaze_origins[ event.index ] );
+            else gaze_fusion_push_head_pose( fusion, &head_poses[ event.index ] );
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+        gaze_fusion_destroy( fusion );
+    }
+
+    double records = (double) gaze_points.size() * passes;
+    double seconds = std::chrono::duration<double>( elapsed ).count();
+    printf( "Fused %.0f records in %.3f s: %.1f M records/s, %.1f ns per record (including origin and head pose "
+        "pushes)\n", records, seconds, records / seconds / 1e6, seconds * 1e9 / records );
+    printf( "Valid gaze rays: %.1f%%\n", 100.0 * (double) valid_records / records );
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include "gaze_heatmap.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 )
+    #include <xmmintrin.h>
+    #define GAZE_HEATMAP_SSE
+#endif
+
+static int const tile_size = 16;
+static int const kernel_phases = 16; // Sub-cell positions the kernel is precomputed for
+static float const max_sigma_cells = 16.0f;
+
+struct tile_t
+{
+    std::atomic<uint32_t> sequence; // Odd while the tile is being updated
+    alignas( 16 ) float cells[ tile_size * tile_size ];
+};
+
+struct gaze_heatmap_t
+{
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    int radius; // Kernel half width in cells
+    int kernel_size; // 2 * radius + 2, the kernel of each phase is shifted by up to one cell
+    std::vector<float> kernels; // kernel_phases kernels of kernel_size weights, each summing to one
+    std::vector<tile_t> tiles;
+    std::atomic<uint64_t> count;
+
+    // Scratch for the adding thread: the column and row weights over the tiles a splat touches
+    std::vector<float> column_weights;
+    std::vector<float> row_weights;
+};
+
+static void accumulate_row( float* row, float const* column_weights, float row_weight )
+{
+    // *row* is a tile row, aligned to 16 bytes
+#ifdef GAZE_HEATMAP_SSE
+    __m128 weight = _mm_set1_ps( row_weight );
+    for( int i = 0; i < tile_size; i += 4 )
+    {
+        __m128 cells = _mm_load_ps( row + i );
+        cells = _mm_add_ps( cells, _mm_mul_ps( _mm_loadu_ps( column_weights + i ), weight ) );
+        _mm_store_ps( row + i, cells );
+    }
+#else
+    for( int i = 0; i < tile_size; ++i ) row[ i ] += column_weights[ i ] * row_weight;
+#endif
+}
+
+// Lays the kernel for *center* (in cells) out over whole tiles. Returns the first tile it covers, and the number of
+// tiles in *tile_count*; zero if it lies outside the grid.
+static int lay_out_kernel( gaze_heatmap_t const* heatmap, float center, int cells, float* weights, int* tile_count )
+{
+    // Cell i covers [i, i + 1), so its center is at i + 0.5
+    float position = center - 0.5f;
+    float whole = floorf( position );
+    int phase = std::min( (int)( ( position - whole ) * kernel_phases ), kernel_phases - 1 );
+    int first_cell = (int) whole - heatmap->radius;
+    int last_cell = first_cell + heatmap->kernel_size - 1;
+    if( last_cell < 0 || first_cell >= cells )
+    {
+        *tile_count = 0;
+        return 0;
+    }
+
+    int first_tile = std::max( first_cell, 0 ) / tile_size;
+    int last_tile = std::min( last_cell, cells - 1 ) / tile_size;
+    *tile_count = last_tile - first_tile + 1;
+
+    // Zero outside the kernel, and outside the grid in the padding of the last tile
+    memset( weights, 0, sizeof( float ) * *tile_count * tile_size );
+    float const* kernel = &heatmap->kernels[ phase * heatmap->kernel_size ];
+    int offset = first_tile * tile_size;
+    for( int i = 0; i < heatmap->kernel_size; ++i )
+    {
+        int cell = first_cell + i;
+        if( cell >= 0 && cell < cells ) weights[ cell - offset ] = kernel[ i ];
+    }
+    return first_tile;
+}
+
+gaze_heatmap_t* gaze_heatmap_create( int width, int height, float sigma_cells )
+{
+    if( width <= 0 || height <= 0 || !( sigma_cells > 0.0f ) ) return nullptr;
+    sigma_cells = std::min( sigma_cells, max_sigma_cells );
+
+    auto heatmap = new gaze_heatmap_t();
+    heatmap->width = width;
+    heatmap->height = height;
+    heatmap->tiles_x = ( width + tile_size - 1 ) / tile_size;
+    heatmap->tiles_y = ( height + tile_size - 1 ) / tile_size;
+    heatmap->radius = (int) ceilf( 3.0f * sigma_cells );
+    heatmap->kernel_size = 2 * heatmap->radius + 2;
+
+    // Kernel i of a phase covers the cell radius - i cells left of the cell the splat falls in
+    heatmap->kernels.resize( kernel_phases * heatmap->kernel_size );
+    for( int phase = 0; phase < kernel_phases; ++phase )
+    {
+        float offset = ( phase + 0.5f ) / kernel_phases;
+        float* kernel = &heatmap->kernels[ phase * heatmap->kernel_size ];
+        float sum = 0.0f;
+        for( int i = 0; i < heatmap->kernel_size; ++i )
+        {
+            float distance = (float)( i - heatmap->radius ) - offset;
+            kernel[ i ] = expf( -distance * distance / ( 2.0f * sigma_cells * sigma_cells ) );
+            sum += kernel[ i ];
+        }
+        for( int i = 0; i < heatmap->kernel_size; ++i ) kernel[ i ] /= sum;
+    }
+
+    heatmap->tiles = std::vector<tile_t>( heatmap->tiles_x * heatmap->tiles_y );
+    for( auto& tile : heatmap->tiles ) memset( tile.cells, 0, sizeof( tile.cells ) );
+    heatmap->count = 0;
+
+    int max_tiles = ( heatmap->kernel_size + tile_size - 2 ) / tile_size + 1;
+    heatmap->column_weights.resize( max_tiles * tile_size );
+    heatmap->row_weights.resize( max_tiles * tile_size );
+    return heatmap;
+}
+
+void gaze_heatmap_destroy( gaze_heatmap_t* heatmap )
+{
+    delete heatmap;
+}
+
+void gaze_heatmap_add( gaze_heatmap_t* heatmap, float x, float y, float weight )
+{
+    if( !( x == x ) || !( y == y ) ) return; // NaN
+
+    // Far off-display points would only overflow the cell arithmetic, their kernels are empty anyway
+    float margin = (float)( heatmap->radius + 2 );
+    float column = std::min( std::max( x * heatmap->width, -margin ), heatmap->width + margin );
+    float row = std::min( std::max( y * heatmap->height, -margin ), heatmap->height + margin );
+
+    int column_tiles, row_tiles;
+    int first_tile_x = lay_out_kernel( heatmap, column, heatmap->width, heatmap->column_weights.data(), &column_tiles );
+    int first_tile_y = lay_out_kernel( heatmap, row, heatmap->height, heatmap->row_weights.data(), &row_tiles );
+    if( column_tiles == 0 || row_tiles == 0 ) return;
+
+    for( int ty = 0; ty < row_tiles; ++ty )
+    {
+        float const* row_weights = &heatmap->row_weights[ ty * tile_size ];
+        for( int tx = 0; tx < column_tiles; ++tx )
+        {
+            tile_t& tile = heatmap->tiles[ ( first_tile_y + ty ) * heatmap->tiles_x + first_tile_x + tx ];
+            float const* column_weights = &heatmap->column_weights[ tx * tile_size ];
+
+            uint32_t sequence = tile.sequence.load( std::memory_order_relaxed );
+            tile.sequence.store( sequence + 1, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_release );
+            for( int i = 0; i < tile_size; ++i )
+                if( row_weights[ i ] != 0.0f )
+                    accumulate_row( &tile.cells[ i * tile_size ], column_weights, row_weights[ i ] * weight );
+            tile.sequence.store( sequence + 2, std::memory_order_release );
+        }
+    }
+    heatmap->count.store( heatmap->count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+void gaze_heatmap_gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    if( gaze_point->validity != TOBII_VALIDITY_VALID ) return;
+    gaze_heatmap_add( static_cast<gaze_heatmap_t*>( user_data ), gaze_point->position_xy[ 0 ],
+        gaze_point->position_xy[ 1 ], 1.0f );
+}
+
+void gaze_heatmap_clear( gaze_heatmap_t* heatmap )
+{
+    for( auto& tile : heatmap->tiles )
+    {
+        uint32_t sequence = tile.sequence.load( std::memory_order_relaxed );
+        tile.sequence.store( sequence + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        memset( tile.cells, 0, sizeof( tile.cells ) );
+        tile.sequence.store( sequence + 2, std::memory_order_release );
+    }
+    heatmap->count.store( 0, std::memory_order_relaxed );
+}
+
+uint64_t gaze_heatmap_snapshot( gaze_heatmap_t const* heatmap, float* cells )
+{
+    uint64_t count = heatmap->count.load( std::memory_order_relaxed );
+    float copy[ tile_size * tile_size ];
+    for( int ty = 0; ty < heatmap->tiles_y; ++ty )
+    {
+        for( int tx = 0; tx < heatmap->tiles_x; ++tx )
+        {
+            tile_t const& tile = heatmap->tiles[ ty * heatmap->tiles_x + tx ];
+            for( ;; )
+            {
+                uint32_t sequence = tile.sequence.load( std::memory_order_acquire );
+                if( sequence & 1 ) continue;
+                memcpy( copy, tile.cells, sizeof( copy ) );
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if( tile.sequence.load( std::memory_order_relaxed ) == sequence ) break;
+            }
+
+            // Tiles on the right and bottom edges may extend past the grid
+            int columns = std::min( tile_size, heatmap->width - tx * tile_size );
+            int rows = std::min( tile_size, heatmap->height - ty * tile_size );
+            for( int row = 0; row < rows; ++row )
+                memcpy( &cells[ ( ty * tile_size + row ) * heatmap->width + tx * tile_size ],
+                    &copy[ row * tile_size ], sizeof( float ) * columns );
+        }
+    }
+    return count;
+}
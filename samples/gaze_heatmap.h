@@ -0,0 +1,39 @@
+#ifndef sample_gaze_heatmap_h
+#define sample_gaze_heatmap_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include <stdint.h>
+
+// Live gaze heatmap. Each valid gaze point is splatted into a float grid covering the display area, as a Gaussian
+// that sums to one. The kernel is separable, so a splat is a row weight times a precomputed column kernel, added to
+// the grid four cells at a time with SSE where available. The grid is stored as 16 by 16 cell tiles, and a splat only
+// touches the tiles under its kernel.
+//
+// One thread adds gaze points while any other thread takes snapshots. Each tile has a sequence number that is odd
+// while the tile is being updated, and the snapshot copies a tile again if it changed under it, so adding never waits.
+
+typedef struct gaze_heatmap_t gaze_heatmap_t;
+
+// *width* and *height* are the grid size in cells, and *sigma_cells* the standard deviation of the kernel in cells,
+// at most 16.
+gaze_heatmap_t* gaze_heatmap_create( int width, int height, float sigma_cells );
+
+void gaze_heatmap_destroy( gaze_heatmap_t* heatmap );
+
+// *x* and *y* are in normalized display coordinates, like tobii_gaze_point_t::position_xy. Points whose kernel lies
+// entirely off the display are ignored. Must be called from one thread at a time, as must gaze_heatmap_clear.
+void gaze_heatmap_add( gaze_heatmap_t* heatmap, float x, float y, float weight );
+
+// Adds valid gaze points with a weight of one; can be used as a tobii_gaze_point_callback_t.
+void gaze_heatmap_gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data );
+
+void gaze_heatmap_clear( gaze_heatmap_t* heatmap );
+
+// Copies the grid to *cells*, row by row, and returns the number of points added to it. Safe to call from any
+// thread while points are added; every tile in the copy is consistent, though tiles copied later may include points
+// added after earlier tiles were copied.
+uint64_t gaze_heatmap_snapshot( gaze_heatmap_t const* heatmap, float* cells );
+
+#endif // sample_gaze_heatmap_h
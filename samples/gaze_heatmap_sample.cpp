@@ -0,0 +1,356 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "aoi_tracker.h"
+#include "gaze_heatmap.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+struct gaze_statistics_t
+{
+    gaze_heatmap_t* heatmap;
+    aoi_tracker_t* tracker;
+    int aoi_count;
+    std::vector<float> cells;
+    std::chrono::steady_clock::time_point next_report;
+};
+
+static int const heatmap_width = 64;
+static int const heatmap_height = 36;
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    auto statistics = static_cast<gaze_statistics_t*>( user_data );
+    gaze_heatmap_gaze_point_callback( gaze_point, statistics->heatmap );
+    aoi_tracker_gaze_point_callback( gaze_point, statistics->tracker );
+}
+
+static void print_statistics( void* context )
+{
+    auto statistics = static_cast<gaze_statistics_t*>( context );
+    auto now = std::chrono::steady_clock::now();
+    if( now < statistics->next_report ) return;
+    statistics->next_report = now + std::chrono::seconds( 1 );
+
+    uint64_t count = gaze_heatmap_snapshot( statistics->heatmap, statistics->cells.data() );
+    int peak = (int)( std::max_element( statistics->cells.begin(), statistics->cells.end() ) -
+        statistics->cells.begin() );
+    printf( "%" PRIu64 " gaze points, hottest cell %d, %d\n", count, peak % heatmap_width, peak / heatmap_width );
+    for( int i = 0; i < statistics->aoi_count; ++i )
+    {
+        aoi_statistics_t aoi;
+        if( aoi_tracker_statistics( statistics->tracker, i, &aoi ) != TOBII_ERROR_NO_ERROR || aoi.entries == 0 )
+            continue;
+        printf( "    Area %2d: %6.2f s dwell, %" PRId64 " entries, %" PRId64 " revisits\n", i,
+            aoi.dwell_us / 1e6, aoi.entries, aoi.revisits );
+    }
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int gaze_heatmap_sample_main( void );
+extern "C" int gaze_heatmap_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // A four by three grid of tiles, as on a start screen, and a triangular play button in the middle
+    std::vector<aoi_t> aois;
+    for( int row = 0; row < 3; ++row )
+    {
+        for( int column = 0; column < 4; ++column )
+        {
+            aoi_t aoi = {};
+            aoi.rectangle[ 0 ] = 0.05f + column * 0.23f;
+            aoi.rectangle[ 1 ] = 0.05f + row * 0.31f;
+            aoi.rectangle[ 2 ] = aoi.rectangle[ 0 ] + 0.2f;
+            aoi.rectangle[ 3 ] = aoi.rectangle[ 1 ] + 0.28f;
+            aois.push_back( aoi );
+        }
+    }
+    float const play_button_xy[] = { 0.47f, 0.45f, 0.55f, 0.5f, 0.47f, 0.55f };
+    aoi_t play_button = { play_button_xy, 3, {} };
+    aois.push_back( play_button );
+
+    gaze_statistics_t statistics;
+    statistics.heatmap = gaze_heatmap_create( heatmap_width, heatmap_height, 1.5f );
+    // Gaps longer than 150 ms are more than a blink, and end all visits
+    statistics.tracker = aoi_tracker_create( aois.data(), (int) aois.size(), 8, 150000 );
+    statistics.aoi_count = (int) aois.size();
+    statistics.cells.resize( heatmap_width * heatmap_height );
+    statistics.next_report = std::chrono::steady_clock::now();
+
+    error = tobii_gaze_point_subscribe( device, gaze_point_callback, &statistics );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze stream.\n" );
+        aoi_tracker_destroy( statistics.tracker );
+        gaze_heatmap_destroy( statistics.heatmap );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, print_statistics, &statistics );
+
+    error = tobii_gaze_point_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze stream.\n" );
+    aoi_tracker_destroy( statistics.tracker );
+    gaze_heatmap_destroy( statistics.heatmap );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// A busy user interface: small rectangles, and polygons with 6 to 12 corners around a random center
+static void generate_aois( int count, std::mt19937* random, std::vector<aoi_t>* aois, std::vector<float>* vertices )
+{
+    std::uniform_real_distribution<float> position( 0.0f, 1.0f );
+    std::uniform_real_distribution<float> size( 0.01f, 0.06f );
+    std::uniform_int_distribution<int> corners( 6, 12 );
+    int polygons = count / 4;
+    vertices->clear();
+    vertices->reserve( polygons * 24 );
+    aois->assign( count, aoi_t() );
+    for( int i = polygons; i < count; ++i )
+    {
+        aoi_t& aoi = ( *aois )[ i ];
+        aoi.rectangle[ 0 ] = position( *random );
+        aoi.rectangle[ 1 ] = position( *random );
+        aoi.rectangle[ 2 ] = aoi.rectangle[ 0 ] + size( *random );
+        aoi.rectangle[ 3 ] = aoi.rectangle[ 1 ] + size( *random );
+    }
+    std::vector<int> first_vertex( polygons );
+    for( int i = 0; i < polygons; ++i )
+    {
+        float x = position( *random ), y = position( *random ), radius = size( *random );
+        first_vertex[ i ] = (int) vertices->size();
+        ( *aois )[ i ].vertex_count = corners( *random );
+        for( int j = 0; j < ( *aois )[ i ].vertex_count; ++j )
+        {
+            float angle = 6.2831853f * j / ( *aois )[ i ].vertex_count;
+            float reach = radius * ( 0.6f + 0.4f * position( *random ) );
+            vertices->push_back( x + reach * cosf( angle ) );
+            vertices->push_back( y + reach * sinf( angle ) );
+        }
+    }
+    // The vertex array is complete, so pointers into it stay valid
+    for( int i = 0; i < polygons; ++i ) ( *aois )[ i ].vertices_xy = vertices->data() + first_vertex[ i ];
+}
+
+struct device_t
+{
+    gaze_heatmap_t* heatmap;
+    aoi_tracker_t* tracker;
+    std::vector<tobii_gaze_point_t> gaze_points;
+};
+
+static double cpu_seconds()
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+extern "C" int gaze_heatmap_benchmark_main( void );
+extern "C" int gaze_heatmap_benchmark_main( void )
+{
+    int const device_count = 8;
+    float const frequency_hz = 1200.0f;
+    int const aoi_count = 4000;
+    int const heatmap_width_cells = 256, heatmap_height_cells = 144;
+    int const seconds = 10;
+
+    std::mt19937 random( 1 );
+    std::vector<aoi_t> aois;
+    std::vector<float> vertices;
+    generate_aois( aoi_count, &random, &aois, &vertices );
+
+    // The grid index must find exactly what a single cell, which tests every area, finds
+    aoi_tracker_t* indexed = aoi_tracker_create( aois.data(), aoi_count, 32, 100000 );
+    aoi_tracker_t* brute_force = aoi_tracker_create( aois.data(), aoi_count, 1, 100000 );
+    std::uniform_real_distribution<float> position( -0.05f, 1.05f );
+    std::vector<int> indexed_hits( aoi_count ), brute_force_hits( aoi_count );
+    int mismatches = 0, hits = 0;
+    for( int i = 0; i < 100000; ++i )
+    {
+        float x = position( random ), y = position( random );
+        int count = aoi_tracker_hit_test( indexed, x, y, indexed_hits.data(), aoi_count );
+        int expected = aoi_tracker_hit_test( brute_force, x, y, brute_force_hits.data(), aoi_count );
+        std::sort( indexed_hits.begin(), indexed_hits.begin() + count );
+        mismatches += count != expected ||
+            !std::equal( indexed_hits.begin(), indexed_hits.begin() + count, brute_force_hits.begin() );
+        hits += count;
+    }
+    printf( "Grid index on %d areas: %d mismatches against testing every area, %.2f hits per point\n", aoi_count,
+        mismatches, hits / 100000.0 );
+    aoi_tracker_destroy( brute_force );
+    aoi_tracker_destroy( indexed );
+
+    std::vector<device_t> devices( device_count );
+    for( int d = 0; d < device_count; ++d )
+    {
+        devices[ d ].heatmap = gaze_heatmap_create( heatmap_width_cells, heatmap_height_cells, 4.0f );
+        devices[ d ].tracker = aoi_tracker_create( aois.data(), aoi_count, 32, 100000 );
+        devices[ d ].gaze_points.resize( (size_t)( frequency_hz * seconds ) );
+        for( size_t i = 0; i < devices[ d ].gaze_points.size(); ++i )
+            stream_replay_gaze_point( (int64_t) i + d * 1000003, frequency_hz, &devices[ d ].gaze_points[ i ] );
+    }
+
+    // Flat out, one stage at a time
+    double heatmap_ns = 0.0, tracker_ns = 0.0;
+    size_t samples = 0;
+    for( auto& device : devices )
+    {
+        auto start = std::chrono::steady_clock::now();
+        for( auto const& gaze_point : device.gaze_points )
+            gaze_heatmap_gaze_point_callback( &gaze_point, device.heatmap );
+        auto middle = std::chrono::steady_clock::now();
+        for( auto const& gaze_point : device.gaze_points )
+            aoi_tracker_gaze_point_callback( &gaze_point, device.tracker );
+        auto end = std::chrono::steady_clock::now();
+        heatmap_ns += std::chrono::duration<double, std::nano>( middle - start ).count();
+        tracker_ns += std::chrono::duration<double, std::nano>( end - middle ).count();
+        samples += device.gaze_points.size();
+    }
+    printf( "%zu samples: heatmap %.0f ns, areas of interest %.0f ns per sample\n", samples, heatmap_ns / samples,
+        tracker_ns / samples );
+
+    // Live, each device pushing from its own thread at its stream rate, while a viewer snapshots every heatmap at
+    // 60 Hz. Continuing the timestamps of the flat out run keeps the counters going.
+    std::atomic<bool> running( true );
+    std::atomic<int64_t> worst_lag_us( 0 );
+    double start_cpu = cpu_seconds();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pumps;
+    for( auto& device : devices )
+    {
+        pumps.emplace_back( [ &, start ]() {
+            auto next = start;
+            int64_t period_us = device.gaze_points[ 1 ].timestamp_us - device.gaze_points[ 0 ].timestamp_us;
+            int64_t span_us = device.gaze_points.back().timestamp_us - device.gaze_points.front().timestamp_us +
+                period_us;
+            for( size_t i = 0; i < device.gaze_points.size(); ++i )
+            {
+                next += std::chrono::nanoseconds( (int64_t)( 1e9 / frequency_hz ) );
+                std::this_thread::sleep_until( next );
+                int64_t lag_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - next ).count();
+                if( lag_us > worst_lag_us ) worst_lag_us = lag_us;
+
+                tobii_gaze_point_t gaze_point = device.gaze_points[ i ];
+                gaze_point.timestamp_us += span_us;
+                gaze_heatmap_gaze_point_callback( &gaze_point, device.heatmap );
+                aoi_tracker_gaze_point_callback( &gaze_point, device.tracker );
+            }
+        } );
+    }
+
+    std::vector<float> cells( heatmap_width_cells * heatmap_height_cells );
+    double snapshot_ns = 0.0;
+    int snapshots = 0;
+    double mass_ratio = 0.0;
+    std::thread viewer( [ & ]() {
+        auto next = start;
+        while( running )
+        {
+            next += std::chrono::microseconds( 16667 );
+            std::this_thread::sleep_until( next );
+            for( auto& device : devices )
+            {
+                auto snapshot_start = std::chrono::steady_clock::now();
+                uint64_t count = gaze_heatmap_snapshot( device.heatmap, cells.data() );
+                snapshot_ns += std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() -
+                    snapshot_start ).count();
+                ++snapshots;
+                double mass = 0.0;
+                for( float cell : cells ) mass += cell;
+                if( count > 0 ) mass_ratio = mass / (double) count;
+            }
+        }
+    } );
+    for( auto& pump : pumps ) pump.join();
+    running = false;
+    viewer.join();
+    double wall_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    double cpu_share = ( cpu_seconds() - start_cpu ) / wall_seconds;
+
+    printf( "%d devices at %.0f Hz for %d s on %u cores: %.1f%% of a core, worst sample lag %.2f ms\n", device_count,
+        frequency_hz, seconds, std::thread::hardware_concurrency(), 100.0 * cpu_share, worst_lag_us / 1000.0 );
+    printf( "%d snapshots of %dx%d cells while pushing: %.1f us each, heatmap mass %.3f per point\n", snapshots,
+        heatmap_width_cells, heatmap_height_cells, snapshot_ns / snapshots / 1000.0, mass_ratio );
+
+    aoi_statistics_t busiest = {};
+    int busiest_index = -1;
+    for( int i = 0; i < aoi_count; ++i )
+    {
+        aoi_statistics_t aoi;
+        aoi_tracker_statistics( devices[ 0 ].tracker, i, &aoi );
+        if( aoi.dwell_us > busiest.dwell_us )
+        {
+            busiest = aoi;
+            busiest_index = i;
+        }
+    }
+    if( busiest_index >= 0 )
+        printf( "Device 0 dwelt longest on area %d: %.2f s, %" PRId64 " entries, %" PRId64 " revisits\n",
+            busiest_index, busiest.dwell_us / 1e6, busiest.entries, busiest.revisits );
+
+    for( auto& device : devices )
+    {
+        aoi_tracker_destroy( device.tracker );
+        gaze_heatmap_destroy( device.heatmap );
+    }
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,453 @@
+#include "gaze_resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+// Channels are interpolated as a row of lanes, padded to a multiple of the widest vector registers. With one eye
+// enabled, the channels of that eye fit in half the lanes, and every kernel is instantiated for that width too.
+static int const both_lanes = 16;
+static int const mono_lanes = 8;
+
+template< int Lanes >
+struct input_row_t
+{
+    int64_t timestamp_us;
+    alignas( Lanes * 4 ) float values[ Lanes ]; // NaN where invalid, zero in the padding
+};
+
+// The channel in each lane, for each enabled eye. With both eyes, lane n is channel n.
+static int const both_channels[] = {
+    GAZE_RESAMPLER_LEFT_POINT_X, GAZE_RESAMPLER_LEFT_POINT_Y, GAZE_RESAMPLER_RIGHT_POINT_X,
+    GAZE_RESAMPLER_RIGHT_POINT_Y, GAZE_RESAMPLER_LEFT_ORIGIN_X, GAZE_RESAMPLER_LEFT_ORIGIN_Y,
+    GAZE_RESAMPLER_LEFT_ORIGIN_Z, GAZE_RESAMPLER_RIGHT_ORIGIN_X, GAZE_RESAMPLER_RIGHT_ORIGIN_Y,
+    GAZE_RESAMPLER_RIGHT_ORIGIN_Z, GAZE_RESAMPLER_LEFT_PUPIL, GAZE_RESAMPLER_RIGHT_PUPIL };
+static int const left_channels[] = { GAZE_RESAMPLER_LEFT_POINT_X, GAZE_RESAMPLER_LEFT_POINT_Y,
+    GAZE_RESAMPLER_LEFT_ORIGIN_X, GAZE_RESAMPLER_LEFT_ORIGIN_Y, GAZE_RESAMPLER_LEFT_ORIGIN_Z,
+    GAZE_RESAMPLER_LEFT_PUPIL };
+static int const right_channels[] = { GAZE_RESAMPLER_RIGHT_POINT_X, GAZE_RESAMPLER_RIGHT_POINT_Y,
+    GAZE_RESAMPLER_RIGHT_ORIGIN_X, GAZE_RESAMPLER_RIGHT_ORIGIN_Y, GAZE_RESAMPLER_RIGHT_ORIGIN_Z,
+    GAZE_RESAMPLER_RIGHT_PUPIL };
+
+template< int Lanes >
+static int constexpr used_lanes()
+{
+    return Lanes == both_lanes ? GAZE_RESAMPLER_CHANNEL_COUNT : GAZE_RESAMPLER_CHANNEL_COUNT / 2;
+}
+
+struct gaze_resampler_t
+{
+    gaze_resampler_config_t config;
+    tobii_enabled_eye_t enabled_eye;
+    int const* lane_channels;
+    uint16_t live_channels; // Bit n set when channel n is produced
+
+    // Pushed samples, from one before the segment the next grid point falls in, in the rows of the enabled eye mode.
+    // Rows before *first* are spent, and are removed in bulk once there are enough of them.
+    std::vector<input_row_t<both_lanes>> both_rows;
+    std::vector<input_row_t<mono_lanes>> mono_rows;
+    size_t first;
+    size_t cursor; // Newest row at or before the next grid point
+    bool started;
+    int64_t next_point; // Index of the next grid point, which is at next_point / output_frequency_hz seconds
+
+    // The batch, as structure of arrays
+    int batch_count;
+    std::vector<int64_t> batch_us;
+    std::vector<float> batch_channels[ GAZE_RESAMPLER_CHANNEL_COUNT ]; // Written only while the channel is live
+    std::vector<uint16_t> batch_valid;
+    std::vector<float> batch_nan; // Stands in for the channels that are not live
+
+    gaze_resampler_statistics_t statistics;
+};
+
+template< int Lanes >
+static std::vector<input_row_t<Lanes>>& rows_of( gaze_resampler_t* resampler );
+
+template<>
+std::vector<input_row_t<both_lanes>>& rows_of<both_lanes>( gaze_resampler_t* resampler )
+{
+    return resampler->both_rows;
+}
+
+template<>
+std::vector<input_row_t<mono_lanes>>& rows_of<mono_lanes>( gaze_resampler_t* resampler )
+{
+    return resampler->mono_rows;
+}
+
+static int64_t floor_div( int64_t numerator, int64_t denominator )
+{
+    int64_t quotient = numerator / denominator;
+    return quotient * denominator > numerator ? quotient - 1 : quotient;
+}
+
+static int64_t point_time_us( gaze_resampler_t const* resampler, int64_t point )
+{
+    return floor_div( point * 1000000, resampler->config.output_frequency_hz );
+}
+
+// Time of a grid point after a row, in microseconds. Exact up to the precision of a double, however far the
+// timestamps are from zero.
+static double point_offset_us( gaze_resampler_t const* resampler, int64_t point, int64_t timestamp_us )
+{
+    int64_t frequency_hz = resampler->config.output_frequency_hz;
+    return (double)( point * 1000000 - timestamp_us * frequency_hz ) / (double) frequency_hz;
+}
+
+// result = a * p0 + b * p1 + c * p2 + d * p3, one lane per channel
+template< int Lanes >
+static void weigh( float const* p0, float const* p1, float const* p2, float const* p3, float a, float b, float c,
+    float d, float* result )
+{
+    for( int i = 0; i < Lanes; ++i ) result[ i ] = a * p0[ i ] + b * p1[ i ] + c * p2[ i ] + d * p3[ i ];
+}
+
+template< int Lanes >
+static void emit( gaze_resampler_t* resampler, int64_t timestamp_us, float const* values )
+{
+    int const* channels = resampler->lane_channels;
+    ++resampler->statistics.produced;
+    uint16_t valid = 0;
+    for( int i = 0; i < used_lanes<Lanes>(); ++i )
+        valid |= (uint16_t)( values[ i ] == values[ i ] ) << channels[ i ];
+    if( valid == 0 ) ++resampler->statistics.invalid;
+
+    if( resampler->batch_count == resampler->config.batch_capacity )
+    {
+        ++resampler->statistics.dropped;
+        return;
+    }
+    int n = resampler->batch_count++;
+    resampler->batch_us[ n ] = timestamp_us;
+    for( int i = 0; i < used_lanes<Lanes>(); ++i ) resampler->batch_channels[ channels[ i ] ][ n ] = values[ i ];
+    resampler->batch_valid[ n ] = valid;
+}
+
+// Interpolates the next grid point, which must not be past the newest row
+template< int Lanes >
+static void produce_point( gaze_resampler_t* resampler )
+{
+    std::vector<input_row_t<Lanes>> const& rows = rows_of<Lanes>( resampler );
+    int64_t point = resampler->next_point++;
+    int64_t timestamp_us = point_time_us( resampler, point );
+    while( resampler->cursor + 1 < rows.size() &&
+        point_offset_us( resampler, point, rows[ resampler->cursor + 1 ].timestamp_us ) >= 0.0 )
+        ++resampler->cursor;
+
+    size_t i = resampler->cursor;
+    input_row_t<Lanes> const& row1 = rows[ i ];
+    double since_us = point_offset_us( resampler, point, row1.timestamp_us );
+    alignas( Lanes * 4 ) float result[ Lanes ];
+    if( since_us == 0.0 || i + 1 == rows.size() )
+    {
+        emit<Lanes>( resampler, timestamp_us, row1.values );
+        return;
+    }
+
+    input_row_t<Lanes> const& row2 = rows[ i + 1 ];
+    int64_t const max_gap_us = resampler->config.max_gap_us;
+    int64_t span_us = row2.timestamp_us - row1.timestamp_us;
+    if( span_us > max_gap_us )
+    {
+        for( int k = 0; k < Lanes; ++k ) result[ k ] = NAN;
+        emit<Lanes>( resampler, timestamp_us, result );
+        return;
+    }
+
+    float s = (float)( since_us / (double) span_us );
+    alignas( Lanes * 4 ) float linear[ Lanes ];
+    weigh<Lanes>( row1.values, row1.values, row2.values, row2.values, 0.0f, 1.0f - s, s, 0.0f, linear );
+    if( resampler->config.interpolation == GAZE_RESAMPLER_LINEAR )
+    {
+        emit<Lanes>( resampler, timestamp_us, linear );
+        return;
+    }
+
+    // Cubic Hermite between rows 1 and 2, with the tangents taken as the slopes from row 0 to row 2 and from row 1 to
+    // row 3. Where an outer row is missing or too far away, the tangent is the slope between rows 1 and 2 instead.
+    input_row_t<Lanes> const* row0 = &row1;
+    input_row_t<Lanes> const* row3 = &row2;
+    float k1 = 1.0f, k2 = 1.0f; // Tangents scaled to the span, as multiples of the differences they are taken over
+    if( i > resampler->first && row1.timestamp_us - rows[ i - 1 ].timestamp_us <= max_gap_us )
+    {
+        row0 = &rows[ i - 1 ];
+        k1 = (float)( (double) span_us / (double)( row2.timestamp_us - row0->timestamp_us ) );
+    }
+    if( i + 2 < rows.size() && rows[ i + 2 ].timestamp_us - row2.timestamp_us <= max_gap_us )
+    {
+        row3 = &rows[ i + 2 ];
+        k2 = (float)( (double) span_us / (double)( row3->timestamp_us - row1.timestamp_us ) );
+    }
+    float h00 = ( 2.0f * s - 3.0f ) * s * s + 1.0f;
+    float h10 = ( ( s - 2.0f ) * s + 1.0f ) * s;
+    float h01 = ( 3.0f - 2.0f * s ) * s * s;
+    float h11 = ( s - 1.0f ) * s * s;
+    weigh<Lanes>( row0->values, row1.values, row2.values, row3->values, -h10 * k1, h00 - h11 * k2, h01 + h10 * k1,
+        h11 * k2, result );
+
+    // A channel that is invalid in an outer row is NaN in the cubic result, and falls back to linear
+    for( int k = 0; k < Lanes; ++k ) result[ k ] = result[ k ] == result[ k ] ? result[ k ] : linear[ k ];
+    emit<Lanes>( resampler, timestamp_us, result );
+}
+
+template< int Lanes >
+static void produce( gaze_resampler_t* resampler, int64_t until_us )
+{
+    std::vector<input_row_t<Lanes>>& rows = rows_of<Lanes>( resampler );
+    while( resampler->started && point_time_us( resampler, resampler->next_point ) <= until_us )
+        produce_point<Lanes>( resampler );
+
+    // Keep the row before the cursor for cubic interpolation
+    size_t keep = resampler->cursor > 0 ? resampler->cursor - 1 : 0;
+    if( keep > resampler->first ) resampler->first = keep;
+    if( resampler->first >= 256 )
+    {
+        rows.erase( rows.begin(), rows.begin() + (ptrdiff_t) resampler->first );
+        resampler->cursor -= resampler->first;
+        resampler->first = 0;
+    }
+}
+
+void gaze_resampler_default_config( float input_frequency_hz, int output_frequency_hz,
+    gaze_resampler_config_t* config )
+{
+    double period_us = 1000000.0 / (double) input_frequency_hz;
+    config->output_frequency_hz = output_frequency_hz;
+    config->interpolation = GAZE_RESAMPLER_CUBIC;
+    config->max_gap_us = (int64_t)( 2.5 * period_us );
+    config->lookahead_us = (int64_t)( 3.5 * period_us );
+    config->restart_gap_us = 1000000;
+    config->batch_capacity = 4096;
+}
+
+gaze_resampler_t* gaze_resampler_create( gaze_resampler_config_t const* config )
+{
+    auto resampler = new gaze_resampler_t();
+    resampler->config = *config;
+    if( resampler->config.output_frequency_hz < 1 ) resampler->config.output_frequency_hz = 1;
+    if( resampler->config.lookahead_us < 1 ) resampler->config.lookahead_us = 1;
+    resampler->enabled_eye = TOBII_ENABLED_EYE_BOTH;
+    resampler->lane_channels = both_channels;
+    resampler->live_channels = ( 1u << GAZE_RESAMPLER_CHANNEL_COUNT ) - 1;
+    resampler->both_rows.reserve( 512 );
+    resampler->mono_rows.reserve( 512 );
+    resampler->first = 0;
+    resampler->cursor = 0;
+    resampler->started = false;
+    resampler->next_point = 0;
+    resampler->batch_count = 0;
+    resampler->batch_us.resize( config->batch_capacity );
+    for( auto& channel : resampler->batch_channels ) channel.resize( config->batch_capacity );
+    resampler->batch_valid.resize( config->batch_capacity );
+    resampler->batch_nan.assign( config->batch_capacity, NAN );
+    return resampler;
+}
+
+void gaze_resampler_destroy( gaze_resampler_t* resampler )
+{
+    delete resampler;
+}
+
+static void push_eye( tobii_gaze_data_eye_t const* eye, int point, int origin, int pupil, float* values,
+    uint32_t* valid )
+{
+    values[ point ] = eye->gaze_point_on_display_normalized[ 0 ];
+    values[ point + 1 ] = eye->gaze_point_on_display_normalized[ 1 ];
+    if( eye->gaze_point_validity == TOBII_VALIDITY_VALID ) *valid |= 3u << point;
+    memcpy( values + origin, eye->gaze_origin_from_eye_tracker_mm, 3 * sizeof( float ) );
+    if( eye->gaze_origin_validity == TOBII_VALIDITY_VALID ) *valid |= 7u << origin;
+    values[ pupil ] = eye->pupil_diameter_mm;
+    if( eye->pupil_validity == TOBII_VALIDITY_VALID ) *valid |= 1u << pupil;
+}
+
+template< int Lanes >
+static void push_row( gaze_resampler_t* resampler, input_row_t<Lanes> const& row )
+{
+    ++resampler->statistics.pushed;
+    std::vector<input_row_t<Lanes>>& rows = rows_of<Lanes>( resampler );
+    if( rows.size() > resampler->first )
+    {
+        int64_t newest_us = rows.back().timestamp_us;
+        if( row.timestamp_us == newest_us ) { ++resampler->statistics.duplicates; return; }
+        if( row.timestamp_us < newest_us ) { ++resampler->statistics.out_of_order; return; }
+
+        // Finish the grid up to the gap, and pick it up again at this sample
+        if( row.timestamp_us - newest_us > resampler->config.restart_gap_us )
+        {
+            produce<Lanes>( resampler, newest_us );
+            rows.clear();
+            resampler->first = 0;
+            resampler->cursor = 0;
+            resampler->started = false;
+            ++resampler->statistics.restarts;
+        }
+    }
+    rows.push_back( row );
+
+    // The grid starts at the first point at or after the first sample
+    if( !resampler->started )
+    {
+        resampler->started = true;
+        resampler->cursor = rows.size() - 1;
+        resampler->next_point = -floor_div( -row.timestamp_us * resampler->config.output_frequency_hz, 1000000 );
+    }
+    produce<Lanes>( resampler, row.timestamp_us - resampler->config.lookahead_us );
+}
+
+// Copies only the enabled eye; the other one is never read
+template< int Lanes >
+static void push_gaze_data( gaze_resampler_t* resampler, tobii_gaze_data_t const* gaze_data )
+{
+    float values[ GAZE_RESAMPLER_CHANNEL_COUNT ];
+    uint32_t valid = 0;
+    input_row_t<Lanes> row;
+    row.timestamp_us = gaze_data->timestamp_tracker_us;
+    if( Lanes == both_lanes )
+    {
+        push_eye( &gaze_data->left, GAZE_RESAMPLER_LEFT_POINT_X, GAZE_RESAMPLER_LEFT_ORIGIN_X,
+            GAZE_RESAMPLER_LEFT_PUPIL, values, &valid );
+        push_eye( &gaze_data->right, GAZE_RESAMPLER_RIGHT_POINT_X, GAZE_RESAMPLER_RIGHT_ORIGIN_X,
+            GAZE_RESAMPLER_RIGHT_PUPIL, values, &valid );
+    }
+    else
+    {
+        // Lanes of one eye: point x and y, origin x, y and z, pupil
+        push_eye( resampler->enabled_eye == TOBII_ENABLED_EYE_LEFT ? &gaze_data->left : &gaze_data->right, 0, 2, 5,
+            values, &valid );
+    }
+    for( int i = 0; i < Lanes; ++i )
+        row.values[ i ] = i >= used_lanes<Lanes>() ? 0.0f : ( valid >> i ) & 1 ? values[ i ] : NAN;
+    push_row<Lanes>( resampler, row );
+}
+
+void gaze_resampler_push_gaze_data( gaze_resampler_t* resampler, tobii_gaze_data_t const* gaze_data )
+{
+    if( resampler->enabled_eye == TOBII_ENABLED_EYE_BOTH )
+        push_gaze_data<both_lanes>( resampler, gaze_data );
+    else
+        push_gaze_data<mono_lanes>( resampler, gaze_data );
+}
+
+template< int Lanes >
+static void push_values( gaze_resampler_t* resampler, int64_t timestamp_us, float const* values, uint32_t valid )
+{
+    input_row_t<Lanes> row;
+    row.timestamp_us = timestamp_us;
+    for( int i = 0; i < Lanes; ++i )
+    {
+        int channel = resampler->lane_channels[ i < used_lanes<Lanes>() ? i : 0 ];
+        row.values[ i ] = i >= used_lanes<Lanes>() ? 0.0f : ( valid >> channel ) & 1 ? values[ channel ] : NAN;
+    }
+    push_row<Lanes>( resampler, row );
+}
+
+void gaze_resampler_push( gaze_resampler_t* resampler, int64_t timestamp_us, float const* values, uint32_t valid )
+{
+    if( resampler->enabled_eye == TOBII_ENABLED_EYE_BOTH )
+        push_values<both_lanes>( resampler, timestamp_us, values, valid );
+    else
+        push_values<mono_lanes>( resampler, timestamp_us, values, valid );
+}
+
+template< int Lanes >
+static void flush( gaze_resampler_t* resampler )
+{
+    std::vector<input_row_t<Lanes>>& rows = rows_of<Lanes>( resampler );
+    if( rows.size() > resampler->first ) produce<Lanes>( resampler, rows.back().timestamp_us );
+}
+
+void gaze_resampler_flush( gaze_resampler_t* resampler )
+{
+    if( resampler->enabled_eye == TOBII_ENABLED_EYE_BOTH )
+        flush<both_lanes>( resampler );
+    else
+        flush<mono_lanes>( resampler );
+}
+
+void gaze_resampler_set_enabled_eye( gaze_resampler_t* resampler, tobii_enabled_eye_t enabled_eye )
+{
+    if( enabled_eye == resampler->enabled_eye ) return;
+
+    // The rows are laid out for the previous mode, so the grid is finished with them and starts over at the next
+    // sample, as after a long gap
+    if( resampler->started )
+    {
+        gaze_resampler_flush( resampler );
+        ++resampler->statistics.restarts;
+    }
+    resampler->both_rows.clear();
+    resampler->mono_rows.clear();
+    resampler->first = 0;
+    resampler->cursor = 0;
+    resampler->started = false;
+
+    uint16_t const left = ( 1u << GAZE_RESAMPLER_LEFT_POINT_X ) | ( 1u << GAZE_RESAMPLER_LEFT_POINT_Y ) |
+        ( 7u << GAZE_RESAMPLER_LEFT_ORIGIN_X ) | ( 1u << GAZE_RESAMPLER_LEFT_PUPIL );
+    uint16_t const both = ( 1u << GAZE_RESAMPLER_CHANNEL_COUNT ) - 1;
+    uint16_t live = enabled_eye == TOBII_ENABLED_EYE_LEFT ? left :
+        enabled_eye == TOBII_ENABLED_EYE_RIGHT ? (uint16_t)( both & ~left ) : both;
+
+    // Channels coming back to life were not written while they were not live. Channels that are no longer live read
+    // as NaN from here on, including for the samples still in the batch.
+    for( int i = 0; i < GAZE_RESAMPLER_CHANNEL_COUNT; ++i )
+    {
+        if( ( live & ~resampler->live_channels ) & ( 1u << i ) )
+            std::fill( resampler->batch_channels[ i ].begin(),
+                resampler->batch_channels[ i ].begin() + resampler->batch_count, NAN );
+    }
+    for( int n = 0; n < resampler->batch_count; ++n ) resampler->batch_valid[ n ] &= live;
+
+    resampler->enabled_eye = enabled_eye;
+    resampler->live_channels = live;
+    resampler->lane_channels = enabled_eye == TOBII_ENABLED_EYE_LEFT ? left_channels :
+        enabled_eye == TOBII_ENABLED_EYE_RIGHT ? right_channels : both_channels;
+}
+
+void gaze_resampler_notification_callback( tobii_notification_t const* notification, void* user_data )
+{
+    if( notification->type == TOBII_NOTIFICATION_TYPE_CALIBRATION_ENABLED_EYE_CHANGED &&
+        notification->value_type == TOBII_NOTIFICATION_VALUE_TYPE_ENABLED_EYE )
+        gaze_resampler_set_enabled_eye( static_cast<gaze_resampler_t*>( user_data ), notification->value.enabled_eye );
+}
+
+void gaze_resampler_batch( gaze_resampler_t const* resampler, gaze_resampler_batch_t* batch )
+{
+    batch->count = resampler->batch_count;
+    batch->timestamp_us = resampler->batch_us.data();
+    for( int i = 0; i < GAZE_RESAMPLER_CHANNEL_COUNT; ++i )
+        batch->channels[ i ] = ( resampler->live_channels >> i ) & 1 ? resampler->batch_channels[ i ].data() :
+            resampler->batch_nan.data();
+    batch->valid = resampler->batch_valid.data();
+}
+
+template< typename T >
+static void consume_array( std::vector<T>& array, int count, int remaining )
+{
+    memmove( array.data(), array.data() + count, remaining * sizeof( T ) );
+}
+
+void gaze_resampler_consume( gaze_resampler_t* resampler, int count )
+{
+    if( count > resampler->batch_count ) count = resampler->batch_count;
+    int remaining = resampler->batch_count - count;
+    // Batches are normally consumed whole, so there is rarely anything to move
+    if( remaining > 0 )
+    {
+        consume_array( resampler->batch_us, count, remaining );
+        for( int i = 0; i < GAZE_RESAMPLER_CHANNEL_COUNT; ++i )
+        {
+            if( ( resampler->live_channels >> i ) & 1 )
+                consume_array( resampler->batch_channels[ i ], count, remaining );
+        }
+        consume_array( resampler->batch_valid, count, remaining );
+    }
+    resampler->batch_count = remaining;
+}
+
+void gaze_resampler_statistics( gaze_resampler_t const* resampler, gaze_resampler_statistics_t* statistics )
+{
+    *statistics = resampler->statistics;
+}
@@ -0,0 +1,119 @@
+#ifndef sample_gaze_resampler_h
+#define sample_gaze_resampler_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_streams.h>
+
+#include <stdint.h>
+
+// Turns the gaze data stream into evenly spaced samples, for filters, spectral analysis and models that assume a fixed
+// rate. Tracker timestamps arrive with jitter, dropped frames and the odd duplicate; the resampler outputs the gaze
+// point, gaze origin and pupil diameter of both eyes on a grid of exact multiples of the output period, by linear or
+// cubic interpolation between the pushed samples.
+//
+// Every channel keeps its own validity. A channel is interpolated only between two valid samples at most max_gap_us
+// apart, so a dropped frame is bridged but a blink is not. Cubic interpolation uses the samples on either side of those
+// two when they are valid and close enough, and falls back to linear per channel when they are not. Interpolation of
+// all channels happens together, as one vector of floats per sample, so the inner loops compile to SIMD instructions.
+//
+// A grid point is produced once a sample at least lookahead_us past it has been pushed, so the output lags the input
+// by a fixed, bounded delay. Longer gaps in the input produce invalid grid points to keep the rate, up to
+// restart_gap_us, beyond which the grid simply resumes at the next sample. All functions must be called from one
+// thread at a time, normally the pump thread.
+//
+// When the tracker only tracks one eye, the resampler can be told so, and then only copies, interpolates and stores
+// the channels of that eye, as rows of half the width. The channels of the other eye read as NaN and invalid.
+
+typedef struct gaze_resampler_t gaze_resampler_t;
+
+typedef enum gaze_resampler_interpolation_t
+{
+    GAZE_RESAMPLER_LINEAR,
+    GAZE_RESAMPLER_CUBIC,
+} gaze_resampler_interpolation_t;
+
+typedef enum gaze_resampler_channel_t
+{
+    GAZE_RESAMPLER_LEFT_POINT_X, // Gaze point on the display, normalized
+    GAZE_RESAMPLER_LEFT_POINT_Y,
+    GAZE_RESAMPLER_RIGHT_POINT_X,
+    GAZE_RESAMPLER_RIGHT_POINT_Y,
+    GAZE_RESAMPLER_LEFT_ORIGIN_X, // Gaze origin from the eye tracker, in mm
+    GAZE_RESAMPLER_LEFT_ORIGIN_Y,
+    GAZE_RESAMPLER_LEFT_ORIGIN_Z,
+    GAZE_RESAMPLER_RIGHT_ORIGIN_X,
+    GAZE_RESAMPLER_RIGHT_ORIGIN_Y,
+    GAZE_RESAMPLER_RIGHT_ORIGIN_Z,
+    GAZE_RESAMPLER_LEFT_PUPIL, // Pupil diameter, in mm
+    GAZE_RESAMPLER_RIGHT_PUPIL,
+    GAZE_RESAMPLER_CHANNEL_COUNT,
+} gaze_resampler_channel_t;
+
+typedef struct gaze_resampler_config_t
+{
+    int output_frequency_hz;
+    gaze_resampler_interpolation_t interpolation;
+    int64_t max_gap_us; // Longest span between two samples that is interpolated across
+    int64_t lookahead_us; // Output delay, at least 1
+    int64_t restart_gap_us; // Gaps longer than this restart the grid instead of filling it with invalid points
+    int batch_capacity; // Output samples held until consumed, newer samples are dropped when full
+} gaze_resampler_config_t;
+
+// Arrays of *count* output samples. Invalid values are NaN, and bit n of *valid* is set when channel n is valid.
+typedef struct gaze_resampler_batch_t
+{
+    int count;
+    int64_t const* timestamp_us; // On the grid, rounded down to whole microseconds
+    float const* channels[ GAZE_RESAMPLER_CHANNEL_COUNT ];
+    uint16_t const* valid;
+} gaze_resampler_batch_t;
+
+typedef struct gaze_resampler_statistics_t
+{
+    uint64_t pushed;
+    uint64_t duplicates; // Samples with the same timestamp as the previous one, which are dropped
+    uint64_t out_of_order; // Samples older than the previous one, which are dropped
+    uint64_t produced; // Grid points, including invalid ones
+    uint64_t invalid; // Grid points without a single valid channel
+    uint64_t restarts;
+    uint64_t dropped; // Grid points lost to a full batch
+} gaze_resampler_statistics_t;
+
+// Fills *config* for a stream at *input_frequency_hz*: cubic interpolation, bridging gaps of up to 2.5 input periods,
+// which covers a single dropped frame, with a lookahead of one period more, restarting after 1 second and holding up to
+// 4096 output samples.
+void gaze_resampler_default_config( float input_frequency_hz, int output_frequency_hz,
+    gaze_resampler_config_t* config );
+
+gaze_resampler_t* gaze_resampler_create( gaze_resampler_config_t const* config );
+
+void gaze_resampler_destroy( gaze_resampler_t* resampler );
+
+// Uses the tracker timestamp, which is taken at capture and has none of the jitter of transport.
+void gaze_resampler_push_gaze_data( gaze_resampler_t* resampler, tobii_gaze_data_t const* gaze_data );
+
+// Pushes a sample of any source, with GAZE_RESAMPLER_CHANNEL_COUNT *values* and bit n of *valid* set when value n is.
+// The values of an eye that is not enabled are ignored.
+void gaze_resampler_push( gaze_resampler_t* resampler, int64_t timestamp_us, float const* values, uint32_t valid );
+
+// Both eyes are enabled when the resampler is created. Set this from tobii_get_enabled_eye after connecting. Changing
+// it finishes the grid up to the newest sample and starts it over at the next one, as after a long gap. Samples still
+// in the batch lose the channels of an eye that is no longer enabled, so consume them first to keep those.
+void gaze_resampler_set_enabled_eye( gaze_resampler_t* resampler, tobii_enabled_eye_t enabled_eye );
+
+// Follows TOBII_NOTIFICATION_TYPE_CALIBRATION_ENABLED_EYE_CHANGED; can be used as a tobii_notifications_callback_t.
+void gaze_resampler_notification_callback( tobii_notification_t const* notification, void* user_data );
+
+// Produces the grid points up to the newest sample without waiting for the lookahead. Use at the end of a recording.
+void gaze_resampler_flush( gaze_resampler_t* resampler );
+
+// The batch stays valid until the next call to gaze_resampler_consume.
+void gaze_resampler_batch( gaze_resampler_t const* resampler, gaze_resampler_batch_t* batch );
+
+// Releases the first *count* samples of the batch.
+void gaze_resampler_consume( gaze_resampler_t* resampler, int count );
+
+void gaze_resampler_statistics( gaze_resampler_t const* resampler, gaze_resampler_statistics_t* statistics );
+
+#endif // sample_gaze_resampler_h
@@ -0,0 +1,372 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_config.h>
+#include <tobii/tobii_streams.h>
+
+#include "gaze_resampler.h"
+#include "main_loop_linux.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+struct resampler_context_t
+{
+    gaze_resampler_t* resampler;
+    int64_t window_count;
+    int64_t window_valid;
+    int64_t window_start_us;
+};
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    gaze_resampler_push_gaze_data( static_cast<gaze_resampler_t*>( user_data ), gaze_data );
+}
+
+static void take_batch( void* user_data )
+{
+    auto context = static_cast<resampler_context_t*>( user_data );
+    gaze_resampler_batch_t batch;
+    gaze_resampler_batch( context->resampler, &batch );
+    if( batch.count == 0 ) return;
+
+    // A real consumer would run its filters over the channel arrays here
+    uint16_t const points = ( 1u << GAZE_RESAMPLER_LEFT_POINT_X ) | ( 1u << GAZE_RESAMPLER_RIGHT_POINT_X );
+    if( context->window_count == 0 ) context->window_start_us = batch.timestamp_us[ 0 ];
+    for( int i = 0; i < batch.count; ++i ) context->window_valid += ( batch.valid[ i ] & points ) != 0;
+    context->window_count += batch.count;
+
+    int64_t last_us = batch.timestamp_us[ batch.count - 1 ];
+    if( last_us - context->window_start_us >= 1000000 )
+    {
+        printf( "%" PRId64 " samples in %.3f s, %.1f%% with a gaze point\n", context->window_count,
+            (double)( last_us - context->window_start_us ) / 1000000.0,
+            100.0 * (double) context->window_valid / (double) context->window_count );
+        context->window_count = 0;
+        context->window_valid = 0;
+    }
+    gaze_resampler_consume( context->resampler, batch.count );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int gaze_resampler_sample_main( void );
+extern "C" int gaze_resampler_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    float frequency_hz;
+    error = tobii_get_output_frequency( device, &frequency_hz );
+    if( error != TOBII_ERROR_NO_ERROR ) frequency_hz = 120.0f;
+
+    gaze_resampler_config_t config;
+    gaze_resampler_default_config( frequency_hz, 250, &config );
+    resampler_context_t context = { gaze_resampler_create( &config ), 0, 0, 0 };
+
+    // Only the enabled eye is processed, following the calibration when it changes
+    tobii_enabled_eye_t enabled_eye;
+    if( tobii_get_enabled_eye( device, &enabled_eye ) == TOBII_ERROR_NO_ERROR )
+        gaze_resampler_set_enabled_eye( context.resampler, enabled_eye );
+    error = tobii_notifications_subscribe( device, gaze_resampler_notification_callback, context.resampler );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to subscribe to notifications, enabled eye changes will not be followed.\n" );
+
+    error = tobii_gaze_data_subscribe( device, gaze_data_callback, context.resampler );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze data stream.\n" );
+        tobii_notifications_unsubscribe( device );
+        gaze_resampler_destroy( context.resampler );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, take_batch, &context );
+
+    error = tobii_gaze_data_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze data stream.\n" );
+    tobii_notifications_unsubscribe( device );
+
+    gaze_resampler_statistics_t statistics;
+    gaze_resampler_statistics( context.resampler, &statistics );
+    printf( "%" PRIu64 " samples in, %" PRIu64 " duplicates, %" PRIu64 " out of order, %" PRIu64 " out, %" PRIu64
+        " invalid\n", statistics.pushed, statistics.duplicates, statistics.out_of_order, statistics.produced,
+        statistics.invalid );
+    gaze_resampler_destroy( context.resampler );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// Smooth pursuit and a slowly dilating pupil, which unlike the fixations of stream_replay can be evaluated at any
+// instant, so the output can be compared with the truth at its own timestamps
+static double const pi = 3.14159265358979323846;
+
+static double true_gaze_x( double t )
+{
+    return 0.5 + 0.25 * sin( 2.0 * pi * 0.4 * t ) + 0.03 * sin( 2.0 * pi * 3.0 * t );
+}
+
+static double true_gaze_x_per_s( double t )
+{
+    return 0.25 * 2.0 * pi * 0.4 * cos( 2.0 * pi * 0.4 * t ) + 0.03 * 2.0 * pi * 3.0 * cos( 2.0 * pi * 3.0 * t );
+}
+
+static double true_gaze_y( double t )
+{
+    return 0.5 + 0.2 * cos( 2.0 * pi * 0.3 * t );
+}
+
+static double true_pupil_mm( double t )
+{
+    return 3.5 + 0.5 * sin( 0.5 * t ) + 0.1 * sin( 2.0 * pi * 1.3 * t );
+}
+
+static void true_eye( double t, float side, bool valid, tobii_gaze_data_eye_t* eye )
+{
+    tobii_validity_t validity = valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+    eye->gaze_point_validity = validity;
+    eye->gaze_point_on_display_normalized[ 0 ] = (float) true_gaze_x( t ) + side * 0.004f;
+    eye->gaze_point_on_display_normalized[ 1 ] = (float) true_gaze_y( t );
+    eye->gaze_origin_validity = validity;
+    eye->gaze_origin_from_eye_tracker_mm[ 0 ] = (float)( side * 32.0 + 10.0 * sin( 0.3 * t ) );
+    eye->gaze_origin_from_eye_tracker_mm[ 1 ] = (float)( 165.0 + 5.0 * sin( 0.2 * t ) );
+    eye->gaze_origin_from_eye_tracker_mm[ 2 ] = (float)( 600.0 + 20.0 * sin( 0.1 * t ) );
+    eye->pupil_validity = validity;
+    eye->pupil_diameter_mm = (float) true_pupil_mm( t );
+}
+
+// A recording at *frequency_hz* with the irregularities of a real stream: capture times off the nominal grid by up to
+// 15% of a period, 1% of frames dropped, 0.3% delivered twice, and a 150 ms blink every 4 seconds
+static std::vector<tobii_gaze_data_t> irregular_recording( float frequency_hz, int64_t duration_s )
+{
+    std::mt19937 random( 7 );
+    std::uniform_real_distribution<double> unit( 0.0, 1.0 );
+    int64_t const epoch_us = 1000000000;
+    double const period_us = 1000000.0 / (double) frequency_hz;
+    std::vector<tobii_gaze_data_t> recording;
+    for( int64_t k = 0; k < (int64_t)( frequency_hz * (float) duration_s ); ++k )
+    {
+        if( unit( random ) < 0.01 ) continue;
+        int64_t offset_us = (int64_t) llround( ( (double) k + 0.3 * ( unit( random ) - 0.5 ) ) * period_us );
+        double t = (double) offset_us / 1000000.0;
+        bool valid = fmod( t, 4.0 ) < 3.85;
+
+        tobii_gaze_data_t gaze_data = {};
+        gaze_data.timestamp_tracker_us = epoch_us + offset_us;
+        gaze_data.timestamp_system_us = gaze_data.timestamp_tracker_us;
+        gaze_data.frame_count = (uint32_t) k;
+        true_eye( t, -1.0f, valid, &gaze_data.left );
+        true_eye( t, 1.0f, valid, &gaze_data.right );
+        recording.push_back( gaze_data );
+        if( unit( random ) < 0.003 ) recording.push_back( gaze_data );
+    }
+    return recording;
+}
+
+struct accuracy_t
+{
+    double gaze_squared; // Display widths squared
+    double gaze_max;
+    double speed_squared; // Display widths per microsecond, squared
+    double pupil_squared;
+    int64_t count;
+
+    void add( double t, float gaze_x, float pupil_mm )
+    {
+        double gaze_error = (double) gaze_x - ( true_gaze_x( t ) - 0.004 );
+        double pupil_error = (double) pupil_mm - true_pupil_mm( t );
+        double speed = true_gaze_x_per_s( t ) / 1000000.0;
+        gaze_squared += gaze_error * gaze_error;
+        gaze_max = fmax( gaze_max, fabs( gaze_error ) );
+        speed_squared += speed * speed;
+        pupil_squared += pupil_error * pupil_error;
+        ++count;
+    }
+
+    // The error in gaze expressed as how far off in time the samples effectively are
+    double timing_us() const { return sqrt( gaze_squared / speed_squared ); }
+};
+
+extern "C" int gaze_resampler_benchmark_main( void );
+extern "C" int gaze_resampler_benchmark_main( void )
+{
+    // Ten minutes of a 600 Hz tracker, displayed on a 520 mm wide screen
+    float const input_hz = 600.0f;
+    double const display_mm = 520.0;
+    std::vector<tobii_gaze_data_t> recording = irregular_recording( input_hz, 600 );
+    double const epoch_s = 1000.0;
+
+    // Taking the raw samples as if they were on the nominal grid, at the nearest point to where they really are
+    double const period_us = 1000000.0 / (double) input_hz;
+    accuracy_t raw = {};
+    double max_jitter_us = 0.0;
+    for( auto const& gaze_data : recording )
+    {
+        if( gaze_data.left.gaze_point_validity != TOBII_VALIDITY_VALID ) continue;
+        double t = (double) gaze_data.timestamp_tracker_us / 1000000.0 - epoch_s;
+        double nominal_s = floor( t * 1000000.0 / period_us + 0.5 ) * period_us / 1000000.0;
+        max_jitter_us = fmax( max_jitter_us, fabs( t - nominal_s ) * 1000000.0 );
+        raw.add( nominal_s, gaze_data.left.gaze_point_on_display_normalized[ 0 ], gaze_data.left.pupil_diameter_mm );
+    }
+    printf( "%zu raw samples at %.0f Hz, up to %.0f us off the nominal grid: gaze rms %.3f mm, max %.3f mm, "
+        "equivalent to %.0f us of timing error\n", recording.size(), input_hz, max_jitter_us,
+        sqrt( raw.gaze_squared / (double) raw.count ) * display_mm, raw.gaze_max * display_mm, raw.timing_us() );
+
+    int const rates[] = { 250, 500, 1000 };
+    for( int interpolation = GAZE_RESAMPLER_LINEAR; interpolation <= GAZE_RESAMPLER_CUBIC; ++interpolation )
+    {
+        for( int output_hz : rates )
+        {
+            gaze_resampler_config_t config;
+            gaze_resampler_default_config( input_hz, output_hz, &config );
+            config.interpolation = (gaze_resampler_interpolation_t) interpolation;
+            gaze_resampler_t* resampler = gaze_resampler_create( &config );
+
+            // Batches taken at 60 Hz, as a render loop would, and only timed while pushing
+            accuracy_t resampled = {};
+            int64_t valid = 0;
+            double off_grid_us = 0.0;
+            size_t const batch_interval = (size_t)( input_hz / 60.0f );
+            double push_s = 0.0;
+            for( size_t i = 0; i < recording.size(); i += batch_interval )
+            {
+                size_t end = i + batch_interval < recording.size() ? i + batch_interval : recording.size();
+                auto start = std::chrono::steady_clock::now();
+                for( size_t j = i; j < end; ++j ) gaze_resampler_push_gaze_data( resampler, &recording[ j ] );
+                if( end == recording.size() ) gaze_resampler_flush( resampler );
+                push_s += std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+                gaze_resampler_batch_t batch;
+                gaze_resampler_batch( resampler, &batch );
+                for( int k = 0; k < batch.count; ++k )
+                {
+                    double grid_us = (double)( batch.timestamp_us[ k ] - 1000000000 );
+                    double exact_us = floor( grid_us * output_hz / 1000000.0 + 0.5 ) * 1000000.0 / output_hz;
+                    off_grid_us = fmax( off_grid_us, fabs( exact_us - grid_us ) );
+                    if( !( batch.valid[ k ] & ( 1u << GAZE_RESAMPLER_LEFT_POINT_X ) ) ) continue;
+                    double t = exact_us / 1000000.0;
+                    resampled.add( t, batch.channels[ GAZE_RESAMPLER_LEFT_POINT_X ][ k ],
+                        batch.channels[ GAZE_RESAMPLER_LEFT_PUPIL ][ k ] );
+                    ++valid;
+                }
+                gaze_resampler_consume( resampler, batch.count );
+            }
+
+            gaze_resampler_statistics_t statistics;
+            gaze_resampler_statistics( resampler, &statistics );
+            printf( "%s %4d Hz: %.1f M samples in and %.1f M out per second, %" PRIu64 " out, %.1f%% valid, "
+                "timestamps within %.2f us of the grid, %" PRIu64 " duplicates dropped\n",
+                interpolation == GAZE_RESAMPLER_LINEAR ? "linear" : "cubic ", output_hz,
+                (double) statistics.pushed / push_s / 1000000.0, (double) statistics.produced / push_s / 1000000.0,
+                statistics.produced, 100.0 * (double) valid / (double) statistics.produced, off_grid_us,
+                statistics.duplicates );
+            printf( "             gaze rms %.4f mm, max %.4f mm, equivalent to %.1f us of timing error, pupil rms "
+                "%.3f um\n", sqrt( resampled.gaze_squared / (double) resampled.count ) * display_mm,
+                resampled.gaze_max * display_mm, resampled.timing_us(),
+                sqrt( resampled.pupil_squared / (double) resampled.count ) * 1000.0 );
+            gaze_resampler_destroy( resampler );
+        }
+    }
+    printf( "Raw pupil rms %.3f um\n", sqrt( raw.pupil_squared / (double) raw.count ) * 1000.0 );
+
+    // The same recording with only the left eye enabled, against both, best of five runs each. The left eye channels
+    // must come out identical.
+    printf( "\nOne eye enabled, cubic to 1000 Hz:\n" );
+    std::vector<float> left_x[ 2 ];
+    double best_ns[ 2 ] = { INFINITY, INFINITY };
+    uint64_t produced = 0;
+    for( int round = 0; round < 10; ++round )
+    {
+        int mono = round % 2;
+        gaze_resampler_config_t config;
+        gaze_resampler_default_config( input_hz, 1000, &config );
+        gaze_resampler_t* resampler = gaze_resampler_create( &config );
+        if( mono ) gaze_resampler_set_enabled_eye( resampler, TOBII_ENABLED_EYE_LEFT );
+        left_x[ mono ].clear();
+        auto start = std::chrono::steady_clock::now();
+        for( size_t i = 0; i < recording.size(); ++i )
+        {
+            gaze_resampler_push_gaze_data( resampler, &recording[ i ] );
+            if( i % 10 != 9 && i + 1 != recording.size() ) continue;
+            gaze_resampler_batch_t batch;
+            gaze_resampler_batch( resampler, &batch );
+            if( round < 2 )
+            {
+                left_x[ mono ].insert( left_x[ mono ].end(), batch.channels[ GAZE_RESAMPLER_LEFT_POINT_X ],
+                    batch.channels[ GAZE_RESAMPLER_LEFT_POINT_X ] + batch.count );
+            }
+            gaze_resampler_consume( resampler, batch.count );
+        }
+        double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+            (double) recording.size();
+        best_ns[ mono ] = fmin( best_ns[ mono ], ns );
+        gaze_resampler_statistics_t statistics;
+        gaze_resampler_statistics( resampler, &statistics );
+        produced = statistics.produced;
+        gaze_resampler_destroy( resampler );
+    }
+    size_t mismatches = left_x[ 0 ].size() == left_x[ 1 ].size() ? 0 : left_x[ 0 ].size();
+    for( size_t i = 0; i < left_x[ 0 ].size() && i < left_x[ 1 ].size(); ++i )
+        mismatches += memcmp( &left_x[ 0 ][ i ], &left_x[ 1 ][ i ], sizeof( float ) ) != 0;
+
+    // Batch storage per output sample: the timestamp, the validity bits and the live channels
+    double const ratio = (double) produced / (double) recording.size();
+    double const both_bytes = sizeof( int64_t ) + sizeof( uint16_t ) + GAZE_RESAMPLER_CHANNEL_COUNT * sizeof( float );
+    double const mono_bytes = sizeof( int64_t ) + sizeof( uint16_t ) + GAZE_RESAMPLER_CHANNEL_COUNT / 2 *
+        sizeof( float );
+    printf( "  both eyes: %.1f ns per input sample, %.0f bytes stored per output sample, %.0f per input sample\n",
+        best_ns[ 0 ], both_bytes, both_bytes * ratio );
+    printf( "  left eye:  %.1f ns per input sample, %.0f bytes stored per output sample, %.0f per input sample\n",
+        best_ns[ 1 ], mono_bytes, mono_bytes * ratio );
+    printf( "  %.2fx the time, %.2fx the bytes, %zu left eye values differ\n", best_ns[ 1 ] / best_ns[ 0 ],
+        mono_bytes / both_bytes, mismatches );
+    return 0;
+}
@@ -1,3 +1,4 @@
+#include "pump_trace.h"
 #include <tobii/tobii.h>
 
 #include <mutex>
@@ -34,6 +35,7 @@ static int _kbhit()
 
 void main_loop( tobii_device_t* device, void ( *action )( void* context ), void* context )
 {
+    PUMP_TRACE_THREAD_NAME( "pump" );
     bool running = true;
     bool try_reconnect = false;
     while( running )
@@ -42,17 +44,24 @@ void main_loop( tobii_device_t* device, void ( *action )( void* context ), void*
         if( _kbhit() ) break;
         if( try_reconnect )
         {
-            error = tobii_device_reconnect( device );
+            {
+                PUMP_TRACE_SPAN( "tobii_device_reconnect" );
+                error = tobii_device_reconnect( device );
+            }
             if( error != TOBII_ERROR_NO_ERROR )
             {
                 // We couldn't get the connection even if it doesn't return connection failed.
                 // So try connection again after sleep time.
+                PUMP_TRACE_SPAN( "reconnect backoff" );
                 std::this_thread::sleep_for( std::chrono::milliseconds( 1000 ) );
                 continue;
             }
             try_reconnect = false;
         }
-        error = tobii_wait_for_callbacks( 1, &device );
+        {
+            PUMP_TRACE_SPAN( "tobii_wait_for_callbacks" );
+            error = tobii_wait_for_callbacks( 1, &device );
+        }
         if( error == TOBII_ERROR_CONNECTION_FAILED )
         {
             try_reconnect = true;
@@ -60,10 +69,14 @@ void main_loop( tobii_device_t* device, void ( *action )( void* context ), void*
         }
 
         if( error == TOBII_ERROR_NO_ERROR || error == TOBII_ERROR_TIMED_OUT )
+        {
+            PUMP_TRACE_SPAN( "tobii_device_process_callbacks" );
             error = tobii_device_process_callbacks( device );
+        }
 
         if( error == TOBII_ERROR_CONNECTION_FAILED ) try_reconnect = true;
 
+        PUMP_TRACE_SPAN( "action" );
         action( context );
     }
 }
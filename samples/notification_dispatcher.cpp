@@ -0,0 +1,170 @@
+#include "notification_dispatcher.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Notification types are a small dense enum; anything beyond this is not dispatched
+static int const max_notification_types = 32;
+static int const max_handlers = 64;
+
+struct notification_slot_t
+{
+    bool pending;
+    uint32_t count; // Notifications received since the handlers last ran
+    tobii_notification_t latest;
+};
+
+struct notification_handler_entry_t
+{
+    tobii_notification_type_t type;
+    notification_handler_t handler;
+    void* user_data;
+};
+
+struct notification_dispatcher_t
+{
+    tobii_device_t* device;
+    std::chrono::microseconds debounce;
+    bool subscribed;
+
+    notification_handler_entry_t handlers[ max_handlers ];
+    int handler_count;
+
+    std::mutex mutex; // Guards the slots and the flags below, never held while handlers run
+    std::condition_variable cv;
+    notification_slot_t slots[ max_notification_types ];
+    bool any_pending;
+    bool exit_event;
+    std::thread worker;
+    notification_slot_t ready[ max_notification_types ]; // Owned by the worker, so handlers run without the lock
+
+    std::atomic<uint32_t> generations[ max_notification_types ];
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> dispatched;
+};
+
+static void dispatch_worker( notification_dispatcher_t* dispatcher )
+{
+    notification_slot_t* ready = dispatcher->ready;
+    for( ;; )
+    {
+        {
+            std::unique_lock<std::mutex> lock( dispatcher->mutex );
+            dispatcher->cv.wait( lock, [&] { return dispatcher->any_pending || dispatcher->exit_event; } );
+            if( dispatcher->exit_event ) return;
+
+            // Let the rest of a burst arrive, so it can be handled as one
+            dispatcher->cv.wait_for( lock, dispatcher->debounce, [&] { return dispatcher->exit_event; } );
+            if( dispatcher->exit_event ) return;
+
+            // Only copy the slots that fired, to keep the time the pump thread can be blocked short
+            for( int type = 0; type < max_notification_types; ++type )
+            {
+                notification_slot_t& slot = dispatcher->slots[ type ];
+                ready[ type ].pending = slot.pending;
+                if( !slot.pending ) continue;
+                ready[ type ] = slot;
+                slot.pending = false;
+                slot.count = 0;
+            }
+            dispatcher->any_pending = false;
+        }
+
+        for( int type = 0; type < max_notification_types; ++type )
+        {
+            if( !ready[ type ].pending ) continue;
+            for( int i = 0; i < dispatcher->handler_count; ++i )
+            {
+                notification_handler_entry_t const& entry = dispatcher->handlers[ i ];
+                if( entry.type == type )
+                    entry.handler( dispatcher->device, &ready[ type ].latest, ready[ type ].count, entry.user_data );
+            }
+            ++dispatcher->dispatched;
+        }
+    }
+}
+
+static void notifications_callback( tobii_notification_t const* notification, void* user_data )
+{
+    notification_dispatcher_push( static_cast<notification_dispatcher_t*>( user_data ), notification );
+}
+
+notification_dispatcher_t* notification_dispatcher_create( tobii_device_t* device, int64_t debounce_us )
+{
+    auto dispatcher = new notification_dispatcher_t();
+    dispatcher->device = device;
+    dispatcher->debounce = std::chrono::microseconds( debounce_us );
+    dispatcher->worker = std::thread( dispatch_worker, dispatcher );
+    return dispatcher;
+}
+
+void notification_dispatcher_destroy( notification_dispatcher_t* dispatcher )
+{
+    // Unsubscribe first, so no callback can push while the worker is shutting down
+    if( dispatcher->subscribed ) tobii_notifications_unsubscribe( dispatcher->device );
+
+    {
+        std::lock_guard<std::mutex> lock( dispatcher->mutex );
+        dispatcher->exit_event = true;
+    }
+    dispatcher->cv.notify_all();
+    dispatcher->worker.join();
+
+    delete dispatcher;
+}
+
+int notification_dispatcher_add_handler( notification_dispatcher_t* dispatcher, tobii_notification_type_t type,
+    notification_handler_t handler, void* user_data )
+{
+    if( dispatcher->handler_count >= max_handlers || (int) type >= max_notification_types ) return 0;
+
+    // Published to the worker by the mutex taken when the first notification is pushed
+    std::lock_guard<std::mutex> lock( dispatcher->mutex );
+    dispatcher->handlers[ dispatcher->handler_count++ ] = { type, handler, user_data };
+    return 1;
+}
+
+tobii_error_t notification_dispatcher_subscribe( notification_dispatcher_t* dispatcher )
+{
+    tobii_error_t error = tobii_notifications_subscribe( dispatcher->device, notifications_callback, dispatcher );
+    if( error == TOBII_ERROR_NO_ERROR ) dispatcher->subscribed = true;
+    return error;
+}
+
+void notification_dispatcher_push( notification_dispatcher_t* dispatcher, tobii_notification_t const* notification )
+{
+    int type = (int) notification->type;
+    ++dispatcher->received;
+    if( type < 0 || type >= max_notification_types ) return;
+    ++dispatcher->generations[ type ];
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock( dispatcher->mutex );
+        notification_slot_t& slot = dispatcher->slots[ type ];
+        slot.latest = *notification;
+        slot.pending = true;
+        ++slot.count;
+        wake = !dispatcher->any_pending;
+        dispatcher->any_pending = true;
+    }
+    // Only the first notification of a burst needs to wake the worker
+    if( wake ) dispatcher->cv.notify_one();
+}
+
+uint32_t notification_dispatcher_generation( notification_dispatcher_t const* dispatcher,
+    tobii_notification_type_t type )
+{
+    if( (int) type < 0 || (int) type >= max_notification_types ) return 0;
+    return dispatcher->generations[ type ];
+}
+
+void notification_dispatcher_statistics( notification_dispatcher_t const* dispatcher, uint64_t* received,
+    uint64_t* dispatched )
+{
+    if( received ) *received = dispatcher->received;
+    if( dispatched ) *dispatched = dispatcher->dispatched;
+}
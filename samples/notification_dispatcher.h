@@ -0,0 +1,43 @@
+#ifndef sample_notification_dispatcher_h
+#define sample_notification_dispatcher_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+// Moves notification handling off the pump thread. The notification callback only copies the notification into a
+// slot for its type and wakes a worker thread, so a burst of notifications costs the pump thread a few copies. The
+// worker waits out a debounce period, then calls the handlers of each type that fired once, with the latest
+// notification and the number of notifications it replaces. Handlers run outside of any callback, so they are free to
+// call API functions such as tobii_get_display_area or tobii_get_state_string.
+//
+// Every notification also bumps a generation counter for its type straight away, which caches depending on that
+// state can compare against to find out that they are stale before the handler has even run.
+
+typedef struct notification_dispatcher_t notification_dispatcher_t;
+
+typedef void ( *notification_handler_t )( tobii_device_t* device, tobii_notification_t const* notification,
+    uint32_t coalesced_count, void* user_data );
+
+// *device* is passed on to the handlers, and may be NULL when notifications are pushed directly.
+notification_dispatcher_t* notification_dispatcher_create( tobii_device_t* device, int64_t debounce_us );
+
+// Stops the worker thread, and unsubscribes if notification_dispatcher_subscribe was called.
+void notification_dispatcher_destroy( notification_dispatcher_t* dispatcher );
+
+// Handlers must be added before notifications start arriving. Returns 0 if there are too many handlers.
+int notification_dispatcher_add_handler( notification_dispatcher_t* dispatcher, tobii_notification_type_t type,
+    notification_handler_t handler, void* user_data );
+
+tobii_error_t notification_dispatcher_subscribe( notification_dispatcher_t* dispatcher );
+
+// Queues a notification. This is what the subscription callback calls.
+void notification_dispatcher_push( notification_dispatcher_t* dispatcher, tobii_notification_t const* notification );
+
+// Incremented for every notification of *type* as it is received. Safe to call from any thread.
+uint32_t notification_dispatcher_generation( notification_dispatcher_t const* dispatcher,
+    tobii_notification_type_t type );
+
+void notification_dispatcher_statistics( notification_dispatcher_t const* dispatcher, uint64_t* received,
+    uint64_t* dispatched );
+
+#endif // sample_notification_dispatcher_h
@@ -0,0 +1,211 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_config.h>
+
+#include "main_loop_linux.h"
+#include "notification_dispatcher.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+
+// A cache of state which is refreshed by a notification handler
+struct display_area_cache_t
+{
+    std::mutex mutex;
+    tobii_display_area_t display_area;
+    uint32_t generation; // Dispatcher generation the cached value was read at
+};
+
+struct dispatcher_context_t
+{
+    notification_dispatcher_t* dispatcher;
+    display_area_cache_t display_area;
+};
+
+static void display_area_changed( tobii_device_t* device, tobii_notification_t const* notification,
+    uint32_t coalesced_count, void* user_data )
+{
+    (void) notification; // Unused parameter, the display area is read back from the device instead
+    auto context = static_cast<dispatcher_context_t*>( user_data );
+    uint32_t generation = notification_dispatcher_generation( context->dispatcher,
+        TOBII_NOTIFICATION_TYPE_DISPLAY_AREA_CHANGED );
+
+    // Running on the dispatcher worker, so API calls are allowed here
+    tobii_display_area_t display_area;
+    tobii_error_t error = tobii_get_display_area( device, &display_area );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to read the display area: %s.\n", tobii_error_message( error ) );
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( context->display_area.mutex );
+    context->display_area.display_area = display_area;
+    context->display_area.generation = generation;
+    printf( "Display area changed (%u notifications coalesced)\n", coalesced_count );
+}
+
+static void state_string_changed( tobii_device_t* device, tobii_notification_t const* notification,
+    uint32_t coalesced_count, void* user_data )
+{
+    (void) coalesced_count; (void) user_data; // Unused parameters
+    bool faults = notification->type == TOBII_NOTIFICATION_TYPE_FAULTS_CHANGED;
+    tobii_state_string_t value;
+    tobii_error_t error = tobii_get_state_string( device, faults ? TOBII_STATE_FAULT : TOBII_STATE_WARNING, value );
+    if( error == TOBII_ERROR_NO_ERROR ) printf( "%s: %s\n", faults ? "Faults" : "Warnings", value );
+}
+
+static void enabled_eye_changed( tobii_device_t* device, tobii_notification_t const* notification,
+    uint32_t coalesced_count, void* user_data )
+{
+    (void) device; (void) coalesced_count; (void) user_data; // Unused parameters
+    tobii_enabled_eye_t eye = notification->value.enabled_eye;
+    printf( "Enabled eye: %s\n", eye == TOBII_ENABLED_EYE_LEFT ? "left" : eye == TOBII_ENABLED_EYE_RIGHT ? "right" :
+        "both" );
+}
+
+static void check_cache( void* user_data )
+{
+    // Pump thread: a cache is stale when the notification generation has moved past the one it was read at
+    auto context = static_cast<dispatcher_context_t*>( user_data );
+    uint32_t generation = notification_dispatcher_generation( context->dispatcher,
+        TOBII_NOTIFICATION_TYPE_DISPLAY_AREA_CHANGED );
+    std::lock_guard<std::mutex> lock( context->display_area.mutex );
+    if( generation != context->display_area.generation )
+        printf( "Display area cache is stale, waiting for the dispatcher to refresh it\n" );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int notification_dispatcher_sample_main( void );
+extern "C" int notification_dispatcher_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    dispatcher_context_t context;
+    context.display_area.generation = 0;
+    error = tobii_get_display_area( device, &context.display_area.display_area );
+    if( error != TOBII_ERROR_NO_ERROR ) memset( &context.display_area.display_area, 0, sizeof( tobii_display_area_t ) );
+
+    // Coalesce anything arriving within 50 ms of the first notification of a burst
+    context.dispatcher = notification_dispatcher_create( device, 50000 );
+    notification_dispatcher_add_handler( context.dispatcher, TOBII_NOTIFICATION_TYPE_DISPLAY_AREA_CHANGED,
+        display_area_changed, &context );
+    notification_dispatcher_add_handler( context.dispatcher, TOBII_NOTIFICATION_TYPE_FAULTS_CHANGED,
+        state_string_changed, &context );
+    notification_dispatcher_add_handler( context.dispatcher, TOBII_NOTIFICATION_TYPE_WARNINGS_CHANGED,
+        state_string_changed, &context );
+    notification_dispatcher_add_handler( context.dispatcher, TOBII_NOTIFICATION_TYPE_CALIBRATION_ENABLED_EYE_CHANGED,
+        enabled_eye_changed, &context );
+
+    error = notification_dispatcher_subscribe( context.dispatcher );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to notifications.\n" );
+        notification_dispatcher_destroy( context.dispatcher );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, check_cache, &context );
+
+    // Destroying the dispatcher unsubscribes from the notifications stream
+    notification_dispatcher_destroy( context.dispatcher );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+static void slow_handler( tobii_device_t* device, tobii_notification_t const* notification, uint32_t coalesced_count,
+    void* user_data )
+{
+    (void) device; (void) notification; (void) coalesced_count; (void) user_data; // Unused parameters
+    // Stand-in for a follow-up query round trip to the device
+    std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+}
+
+extern "C" int notification_dispatcher_benchmark_main( void );
+extern "C" int notification_dispatcher_benchmark_main( void )
+{
+    notification_dispatcher_t* dispatcher = notification_dispatcher_create( NULL, 10000 );
+    notification_dispatcher_add_handler( dispatcher, TOBII_NOTIFICATION_TYPE_DISPLAY_AREA_CHANGED, slow_handler, NULL );
+    notification_dispatcher_add_handler( dispatcher, TOBII_NOTIFICATION_TYPE_WARNINGS_CHANGED, slow_handler, NULL );
+
+    tobii_notification_t display_area = {};
+    display_area.type = TOBII_NOTIFICATION_TYPE_DISPLAY_AREA_CHANGED;
+    display_area.value_type = TOBII_NOTIFICATION_VALUE_TYPE_DISPLAY_AREA;
+    tobii_notification_t warnings = {};
+    warnings.type = TOBII_NOTIFICATION_TYPE_WARNINGS_CHANGED;
+    warnings.value_type = TOBII_NOTIFICATION_VALUE_TYPE_NONE;
+
+    // A storm from the pump thread's point of view: every push is timed, as a stall here would delay gaze data
+    int const storm_size = 1000000;
+    std::chrono::nanoseconds total( 0 ), worst( 0 );
+    int slow_pushes = 0;
+    for( int i = 0; i < storm_size; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        notification_dispatcher_push( dispatcher, i % 16 ? &display_area : &warnings );
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        total += elapsed;
+        if( elapsed > worst ) worst = elapsed;
+        if( elapsed > std::chrono::microseconds( 10 ) ) ++slow_pushes;
+    }
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) ); // Let the last burst drain
+
+    uint64_t received, dispatched;
+    notification_dispatcher_statistics( dispatcher, &received, &dispatched );
+    printf( "Pushed %" PRIu64 " notifications: %.1f ns average, %.1f us worst, %d over 10 us\n", received,
+        (double) total.count() / storm_size, (double) worst.count() / 1000.0, slow_pushes );
+    printf( "Handlers ran %" PRIu64 " times (%.0f notifications coalesced per run)\n", dispatched,
+        (double) received / (double) ( dispatched ? dispatched : 1 ) );
+
+    notification_dispatcher_destroy( dispatcher );
+    return 0;
+}
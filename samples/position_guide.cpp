@@ -0,0 +1,304 @@
+#include "position_guide.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+enum guide_stream_t
+{
+    GUIDE_STREAM_NONE,
+    GUIDE_STREAM_USER_POSITION_GUIDE,
+    GUIDE_STREAM_EYE_POSITION_NORMALIZED,
+};
+
+struct guide_eye_t
+{
+    bool tracking; // Whether xyz holds a smoothed position
+    bool visible;
+    float xyz[ 3 ];
+    int cell[ 3 ];
+    int64_t last_valid_us;
+};
+
+// The quantised state, which decides whether anything is published
+struct guide_key_t
+{
+    bool left_visible;
+    bool right_visible;
+    int left_cell[ 3 ];
+    int right_cell[ 3 ];
+    bool has_z;
+    int offset[ 3 ];
+};
+
+struct position_guide_t
+{
+    tobii_device_t* device;
+    position_guide_config_t config;
+    position_guide_callback_t callback;
+    void* user_data;
+    guide_stream_t stream;
+    bool has_z;
+
+    guide_eye_t left;
+    guide_eye_t right;
+    int offset[ 3 ];
+    bool has_previous;
+    int64_t previous_us;
+
+    bool has_published;
+    int64_t published_us;
+    guide_key_t published;
+    position_guide_state_t state;
+};
+
+static void reset_eye( guide_eye_t* eye )
+{
+    eye->tracking = false;
+    eye->visible = false;
+    for( int i = 0; i < 3; ++i )
+    {
+        eye->xyz[ i ] = 0.5f;
+        eye->cell[ i ] = 0;
+    }
+    eye->last_valid_us = 0;
+}
+
+static int cell_of( position_guide_config_t const& config, float position )
+{
+    int cell = (int) floorf( position * (float) config.position_steps );
+    return std::min( std::max( cell, 0 ), config.position_steps - 1 );
+}
+
+static void update_cells( position_guide_config_t const& config, guide_eye_t* eye, bool fresh )
+{
+    float margin = config.hysteresis * (float) config.position_steps;
+    for( int i = 0; i < 3; ++i )
+    {
+        // Keep the current cell until the position is a margin past either of its edges
+        float scaled = eye->xyz[ i ] * (float) config.position_steps;
+        if( fresh || scaled < (float) eye->cell[ i ] - margin || scaled >= (float)( eye->cell[ i ] + 1 ) + margin )
+            eye->cell[ i ] = cell_of( config, eye->xyz[ i ] );
+    }
+}
+
+static void update_eye( position_guide_t* guide, guide_eye_t* eye, bool valid, float const* xyz, int64_t timestamp_us,
+    int64_t elapsed_us )
+{
+    if( !valid )
+    {
+        if( eye->visible && timestamp_us - eye->last_valid_us > guide->config.lost_grace_us )
+            reset_eye( eye );
+        return;
+    }
+
+    if( !eye->tracking )
+    {
+        for( int i = 0; i < 3; ++i ) eye->xyz[ i ] = xyz[ i ];
+    }
+    else
+    {
+        // A rational approximation of 1 - exp( -elapsed / smoothing ), which is close enough at these sample rates
+        float weight = (float) elapsed_us / (float)( guide->config.smoothing_us + elapsed_us );
+        for( int i = 0; i < 3; ++i ) eye->xyz[ i ] += weight * ( xyz[ i ] - eye->xyz[ i ] );
+    }
+    update_cells( guide->config, eye, !eye->tracking );
+    eye->tracking = true;
+    eye->visible = true;
+    eye->last_valid_us = timestamp_us;
+}
+
+static void update_offsets( position_guide_t* guide )
+{
+    int visible = guide->left.visible + guide->right.visible;
+    for( int i = 0; i < 3; ++i )
+    {
+        if( visible == 0 || ( i == 2 && !guide->has_z ) )
+        {
+            guide->offset[ i ] = 0;
+            continue;
+        }
+
+        float sum = ( guide->left.visible ? guide->left.xyz[ i ] : 0.0f ) +
+            ( guide->right.visible ? guide->right.xyz[ i ] : 0.0f );
+        float distance = sum / (float) visible - 0.5f;
+        float tolerance = guide->config.center_tolerance_xyz[ i ];
+        float hysteresis = guide->config.hysteresis;
+
+        // Entering a side takes the tolerance plus the hysteresis, and leaving it takes the tolerance minus it
+        int offset = guide->offset[ i ];
+        if( distance > tolerance + hysteresis ) offset = 1;
+        else if( distance < -tolerance - hysteresis ) offset = -1;
+        else if( offset == 1 && distance < tolerance - hysteresis ) offset = 0;
+        else if( offset == -1 && distance > -tolerance + hysteresis ) offset = 0;
+        guide->offset[ i ] = offset;
+    }
+}
+
+static guide_key_t make_key( position_guide_t const* guide )
+{
+    guide_key_t key;
+    key.left_visible = guide->left.visible;
+    key.right_visible = guide->right.visible;
+    for( int i = 0; i < 3; ++i )
+    {
+        bool used = i < 2 || guide->has_z;
+        key.left_cell[ i ] = key.left_visible && used ? guide->left.cell[ i ] : 0;
+        key.right_cell[ i ] = key.right_visible && used ? guide->right.cell[ i ] : 0;
+        key.offset[ i ] = guide->offset[ i ];
+    }
+    key.has_z = guide->has_z;
+    return key;
+}
+
+static bool same_key( guide_key_t const& a, guide_key_t const& b )
+{
+    if( a.left_visible != b.left_visible || a.right_visible != b.right_visible || a.has_z != b.has_z ) return false;
+    for( int i = 0; i < 3; ++i )
+    {
+        if( a.left_cell[ i ] != b.left_cell[ i ] || a.right_cell[ i ] != b.right_cell[ i ] ) return false;
+        if( a.offset[ i ] != b.offset[ i ] ) return false;
+    }
+    return true;
+}
+
+static void publish( position_guide_t* guide, guide_key_t const& key, int64_t timestamp_us )
+{
+    guide->has_published = true;
+    guide->published_us = timestamp_us;
+    guide->published = key;
+
+    position_guide_state_t* state = &guide->state;
+    float const steps = (float) guide->config.position_steps;
+    state->timestamp_us = timestamp_us;
+    state->left_visible = key.left_visible;
+    state->right_visible = key.right_visible;
+    state->has_z = key.has_z;
+    for( int i = 0; i < 3; ++i )
+    {
+        bool used = i < 2 || key.has_z;
+        state->left_xyz[ i ] = used ? ( (float) key.left_cell[ i ] + 0.5f ) / steps : 0.5f;
+        state->right_xyz[ i ] = used ? ( (float) key.right_cell[ i ] + 0.5f ) / steps : 0.5f;
+        state->offset_xyz[ i ] = key.offset[ i ];
+    }
+    if( guide->callback ) guide->callback( state, guide->user_data );
+}
+
+static void push( position_guide_t* guide, int64_t timestamp_us, bool left_valid, float const* left_xyz,
+    bool right_valid, float const* right_xyz )
+{
+    if( guide->has_previous && timestamp_us <= guide->previous_us ) return; // Duplicated or out of order
+    int64_t elapsed_us = guide->has_previous ? timestamp_us - guide->previous_us : 0;
+    guide->has_previous = true;
+    guide->previous_us = timestamp_us;
+
+    update_eye( guide, &guide->left, left_valid, left_xyz, timestamp_us, elapsed_us );
+    update_eye( guide, &guide->right, right_valid, right_xyz, timestamp_us, elapsed_us );
+    update_offsets( guide );
+
+    // A change inside the interval waits for the first sample after it, and is published only if it still holds
+    guide_key_t key = make_key( guide );
+    if( guide->has_published && same_key( key, guide->published ) ) return;
+    if( guide->has_published && timestamp_us - guide->published_us < guide->config.min_interval_us ) return;
+    publish( guide, key, timestamp_us );
+}
+
+static void user_position_guide_callback( tobii_user_position_guide_t const* data, void* user_data )
+{
+    position_guide_push_user_position_guide( static_cast<position_guide_t*>( user_data ), data );
+}
+
+static void eye_position_normalized_callback( tobii_eye_position_normalized_t const* data, void* user_data )
+{
+    position_guide_push_eye_position_normalized( static_cast<position_guide_t*>( user_data ), data );
+}
+
+void position_guide_default_config( position_guide_config_t* config )
+{
+    config->smoothing_us = 100000;
+    config->lost_grace_us = 250000;
+    config->min_interval_us = 50000;
+    config->position_steps = 20;
+    for( int i = 0; i < 3; ++i ) config->center_tolerance_xyz[ i ] = 0.15f;
+    config->hysteresis = 0.02f;
+}
+
+position_guide_t* position_guide_create( tobii_device_t* device, position_guide_config_t const* config,
+    position_guide_callback_t callback, void* user_data )
+{
+    auto guide = new position_guide_t();
+    guide->device = device;
+    guide->config = *config;
+    guide->config.position_steps = std::max( guide->config.position_steps, 1 );
+    guide->config.smoothing_us = std::max( guide->config.smoothing_us, (int64_t) 0 );
+    guide->callback = callback;
+    guide->user_data = user_data;
+    guide->stream = GUIDE_STREAM_NONE;
+    guide->has_z = true;
+    reset_eye( &guide->left );
+    reset_eye( &guide->right );
+    for( int i = 0; i < 3; ++i ) guide->offset[ i ] = 0;
+    guide->has_previous = false;
+    guide->has_published = false;
+    return guide;
+}
+
+void position_guide_destroy( position_guide_t* guide )
+{
+    if( guide->stream == GUIDE_STREAM_USER_POSITION_GUIDE ) tobii_user_position_guide_unsubscribe( guide->device );
+    if( guide->stream == GUIDE_STREAM_EYE_POSITION_NORMALIZED )
+        tobii_eye_position_normalized_unsubscribe( guide->device );
+    delete guide;
+}
+
+tobii_error_t position_guide_start( position_guide_t* guide )
+{
+    if( !guide->device || guide->stream != GUIDE_STREAM_NONE ) return TOBII_ERROR_NO_ERROR;
+
+    tobii_supported_t supported;
+    tobii_error_t error = tobii_capability_supported( guide->device,
+        TOBII_CAPABILITY_COMPOUND_STREAM_USER_POSITION_GUIDE_XY, &supported );
+    if( error != TOBII_ERROR_NO_ERROR ) return error;
+
+    if( supported == TOBII_SUPPORTED )
+    {
+        error = tobii_capability_supported( guide->device, TOBII_CAPABILITY_COMPOUND_STREAM_USER_POSITION_GUIDE_Z,
+            &supported );
+        if( error != TOBII_ERROR_NO_ERROR ) return error;
+        position_guide_set_z_supported( guide, supported == TOBII_SUPPORTED );
+
+        error = tobii_user_position_guide_subscribe( guide->device, user_position_guide_callback, guide );
+        if( error == TOBII_ERROR_NO_ERROR ) guide->stream = GUIDE_STREAM_USER_POSITION_GUIDE;
+        return error;
+    }
+
+    // Older trackers only have the deprecated stream, which always has all three axes
+    position_guide_set_z_supported( guide, 1 );
+    error = tobii_eye_position_normalized_subscribe( guide->device, eye_position_normalized_callback, guide );
+    if( error == TOBII_ERROR_NO_ERROR ) guide->stream = GUIDE_STREAM_EYE_POSITION_NORMALIZED;
+    return error;
+}
+
+void position_guide_set_z_supported( position_guide_t* guide, int supported )
+{
+    guide->has_z = supported != 0;
+}
+
+void position_guide_push_user_position_guide( position_guide_t* guide, tobii_user_position_guide_t const* data )
+{
+    push( guide, data->timestamp_us, data->left_position_validity == TOBII_VALIDITY_VALID,
+        data->left_position_normalized_xyz, data->right_position_validity == TOBII_VALIDITY_VALID,
+        data->right_position_normalized_xyz );
+}
+
+void position_guide_push_eye_position_normalized( position_guide_t* guide,
+    tobii_eye_position_normalized_t const* data )
+{
+    push( guide, data->timestamp_us, data->left_validity == TOBII_VALIDITY_VALID, data->left_xyz,
+        data->right_validity == TOBII_VALIDITY_VALID, data->right_xyz );
+}
+
+void position_guide_state( position_guide_t const* guide, position_guide_state_t* state )
+{
+    *state = guide->state;
+}
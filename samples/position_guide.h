@@ -0,0 +1,73 @@
+#ifndef sample_position_guide_h
+#define sample_position_guide_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include <stdint.h>
+
+// Guidance for a user positioning overlay, from the user position guide stream, or from the deprecated normalized eye
+// position stream on trackers that do not have it. The positions of both eyes are smoothed, and reduced to a small
+// state: which eyes are visible, where on a coarse grid each eye is, and for each axis whether the eyes are below,
+// inside or above a band around the center of the track box. The state is published only when it changes, and at most
+// once every min_interval_us, so the overlay is redrawn a few times a second at most instead of on every sample.
+//
+// The grid cells and the bands have hysteresis, so noise around a boundary does not publish anything. An eye that
+// drops out, such as during a blink, stays visible at its last position for lost_grace_us. Trackers without the z axis
+// capability publish the z axis as centered.
+//
+// States are published from inside the pushes, which must be done from one thread at a time, usually the pump thread
+// from inside the stream callbacks. Hand them to the UI thread from the callback.
+
+typedef struct position_guide_t position_guide_t;
+
+typedef struct position_guide_config_t
+{
+    int64_t smoothing_us; // Time constant of the position smoothing
+    int64_t lost_grace_us; // How long an eye that dropped out stays visible
+    int64_t min_interval_us; // Between published states
+    int position_steps; // Grid cells along each axis of the track box
+    float center_tolerance_xyz[ 3 ]; // Half width of the band around 0.5 on each axis that needs no guidance
+    float hysteresis; // Normalized distance past a boundary before a cell or band is changed
+} position_guide_config_t;
+
+typedef struct position_guide_state_t
+{
+    int64_t timestamp_us; // Of the sample that caused the state to be published
+    int left_visible;
+    int right_visible;
+    float left_xyz[ 3 ]; // Center of the grid cell of the eye, normalized, valid if the eye is visible
+    float right_xyz[ 3 ];
+    int has_z; // Zero if the tracker has no z axis guidance
+    int offset_xyz[ 3 ]; // -1 if the visible eyes are below the band on that axis, 1 if above, 0 if inside
+} position_guide_state_t;
+
+typedef void ( *position_guide_callback_t )( position_guide_state_t const* state, void* user_data );
+
+// Fills *config* with 100 ms of smoothing, a 250 ms grace period, at most 20 states a second, a 20 by 20 by 20 grid,
+// and a band of 0.15 around the center with 0.02 of hysteresis.
+void position_guide_default_config( position_guide_config_t* config );
+
+// A NULL *device* creates a stage that is only fed by the push functions, such as when replaying recorded data.
+position_guide_t* position_guide_create( tobii_device_t* device, position_guide_config_t const* config,
+    position_guide_callback_t callback, void* user_data );
+
+// Unsubscribes from the stream the stage subscribed to.
+void position_guide_destroy( position_guide_t* guide );
+
+// Reads the capabilities of the device, and subscribes to the user position guide stream, or to the normalized eye
+// position stream if the device does not support the user position guide. Must not be called from inside a callback.
+tobii_error_t position_guide_start( position_guide_t* guide );
+
+// Whether the z axis is used. Set by position_guide_start from the capabilities, and on by default.
+void position_guide_set_z_supported( position_guide_t* guide, int supported );
+
+void position_guide_push_user_position_guide( position_guide_t* guide, tobii_user_position_guide_t const* data );
+
+void position_guide_push_eye_position_normalized( position_guide_t* guide,
+    tobii_eye_position_normalized_t const* data );
+
+// The last published state. Must be called from the thread that pushes.
+void position_guide_state( position_guide_t const* guide, position_guide_state_t* state );
+
+#endif // sample_position_guide_h
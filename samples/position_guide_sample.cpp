@@ -0,0 +1,235 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "main_loop_linux.h"
+#include "position_guide.h"
+#include "stream_replay.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+static char const* offset_name( int offset )
+{
+    return offset < 0 ? "low" : offset > 0 ? "high" : "ok";
+}
+
+static void redraw_overlay( position_guide_state_t const* state, void* user_data )
+{
+    (void) user_data; // Unused parameter
+    // Stands in for posting the state to the UI thread, which redraws the overlay
+    if( !state->left_visible && !state->right_visible )
+    {
+        printf( "No eyes found, move into view\n" );
+        return;
+    }
+    if( state->left_visible )
+        printf( "Left ( %.2f, %.2f, %.2f ) ", state->left_xyz[ 0 ], state->left_xyz[ 1 ], state->left_xyz[ 2 ] );
+    if( state->right_visible )
+        printf( "Right ( %.2f, %.2f, %.2f ) ", state->right_xyz[ 0 ], state->right_xyz[ 1 ], state->right_xyz[ 2 ] );
+    printf( "x %s, y %s", offset_name( state->offset_xyz[ 0 ] ), offset_name( state->offset_xyz[ 1 ] ) );
+    if( state->has_z ) printf( ", z %s", offset_name( state->offset_xyz[ 2 ] ) );
+    printf( "\n" );
+}
+
+static void idle( void* context )
+{
+    (void) context; // Unused parameter, the guide is fed by its own subscription
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int position_guide_sample_main( void );
+extern "C" int position_guide_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    position_guide_config_t config;
+    position_guide_default_config( &config );
+    position_guide_t* guide = position_guide_create( device, &config, redraw_overlay, NULL );
+    error = position_guide_start( guide );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to start the position guide: %s.\n", tobii_error_message( error ) );
+        position_guide_destroy( guide );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, idle, NULL );
+
+    // Destroying the guide unsubscribes the stream it subscribed to
+    position_guide_destroy( guide );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+struct replay_overlay_t
+{
+    int64_t redraws;
+    int64_t busiest_second;
+    int64_t second;
+    int64_t in_second;
+    int offset_x;
+    int offset_z;
+};
+
+static void count_redraw( position_guide_state_t const* state, void* user_data )
+{
+    auto overlay = static_cast<replay_overlay_t*>( user_data );
+    ++overlay->redraws;
+    int64_t second = state->timestamp_us / 1000000;
+    if( second != overlay->second )
+    {
+        overlay->second = second;
+        overlay->in_second = 0;
+    }
+    overlay->busiest_second = std::max( overlay->busiest_second, ++overlay->in_second );
+    overlay->offset_x = state->offset_xyz[ 0 ];
+    overlay->offset_z = state->offset_xyz[ 2 ];
+}
+
+static int reference_offset( float distance, float tolerance )
+{
+    return distance > tolerance ? 1 : distance < -tolerance ? -1 : 0;
+}
+
+static void replay( float frequency_hz, bool has_z )
+{
+    std::vector<tobii_user_position_guide_t> samples( (size_t)( frequency_hz * 600 ) );
+    for( size_t i = 0; i < samples.size(); ++i ) stream_replay_user_position_guide( (int64_t) i, frequency_hz,
+        &samples[ i ] );
+
+    // Redrawing on every quantised change, without smoothing or hysteresis, for comparison with redrawing every sample
+    position_guide_config_t config;
+    position_guide_default_config( &config );
+    int64_t quantised_changes = 0;
+    int previous_key[ 8 ] = { -1 };
+    for( auto const& sample : samples )
+    {
+        bool left = sample.left_position_validity == TOBII_VALIDITY_VALID;
+        bool right = sample.right_position_validity == TOBII_VALIDITY_VALID;
+        int key[ 8 ] = { left, right };
+        for( int i = 0; i < 3; ++i )
+        {
+            key[ 2 + i ] = left ? (int)( sample.left_position_normalized_xyz[ i ] * config.position_steps ) : 0;
+            key[ 5 + i ] = right ? (int)( sample.right_position_normalized_xyz[ i ] * config.position_steps ) : 0;
+        }
+        if( !std::equal( key, key + 8, previous_key ) ) ++quantised_changes;
+        std::copy( key, key + 8, previous_key );
+    }
+
+    // The guidance the overlay should show: each axis of a centered half second average of the raw positions
+    std::vector<double> sum_x( samples.size() + 1 ), sum_z( samples.size() + 1 );
+    std::vector<int> valid( samples.size() + 1 );
+    for( size_t i = 0; i < samples.size(); ++i )
+    {
+        auto const& sample = samples[ i ];
+        bool both = sample.left_position_validity == TOBII_VALIDITY_VALID &&
+            sample.right_position_validity == TOBII_VALIDITY_VALID;
+        sum_x[ i + 1 ] = sum_x[ i ] + ( both ? 0.5 * ( sample.left_position_normalized_xyz[ 0 ] +
+            sample.right_position_normalized_xyz[ 0 ] ) : 0.0 );
+        sum_z[ i + 1 ] = sum_z[ i ] + ( both ? 0.5 * ( sample.left_position_normalized_xyz[ 2 ] +
+            sample.right_position_normalized_xyz[ 2 ] ) : 0.0 );
+        valid[ i + 1 ] = valid[ i ] + both;
+    }
+
+    replay_overlay_t overlay = {};
+    overlay.second = -1;
+    position_guide_t* guide = position_guide_create( NULL, &config, count_redraw, &overlay );
+    position_guide_set_z_supported( guide, has_z );
+    int64_t compared = 0, agreeing = 0;
+    size_t const half_window = (size_t)( frequency_hz * 0.25f );
+    for( size_t i = 0; i < samples.size(); ++i )
+    {
+        position_guide_push_user_position_guide( guide, &samples[ i ] );
+
+        // Compare only where the whole window is valid, and the reference is clearly on one side of a boundary
+        if( i < half_window || i + half_window >= samples.size() ) continue;
+        size_t from = i - half_window, to = i + half_window + 1;
+        int count = valid[ to ] - valid[ from ];
+        if( count != (int)( to - from ) ) continue;
+        float x = (float)( ( sum_x[ to ] - sum_x[ from ] ) / count ) - 0.5f;
+        float z = (float)( ( sum_z[ to ] - sum_z[ from ] ) / count ) - 0.5f;
+        float margin = 2.0f * config.hysteresis;
+        if( fabsf( fabsf( x ) - config.center_tolerance_xyz[ 0 ] ) < margin ) continue;
+        if( has_z && fabsf( fabsf( z ) - config.center_tolerance_xyz[ 2 ] ) < margin ) continue;
+        ++compared;
+        agreeing += overlay.offset_x == reference_offset( x, config.center_tolerance_xyz[ 0 ] ) &&
+            overlay.offset_z == ( has_z ? reference_offset( z, config.center_tolerance_xyz[ 2 ] ) : 0 );
+    }
+    position_guide_destroy( guide );
+
+    // The same replay again, timing only the pushes
+    replay_overlay_t timed_overlay = {};
+    guide = position_guide_create( NULL, &config, count_redraw, &timed_overlay );
+    position_guide_set_z_supported( guide, has_z );
+    auto start = std::chrono::steady_clock::now();
+    for( auto const& sample : samples ) position_guide_push_user_position_guide( guide, &sample );
+    double push_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() /
+        (double) samples.size();
+    position_guide_destroy( guide );
+
+    printf( "%.0f Hz%s, %zu samples: %" PRId64 " quantised changes, %" PRId64 " redraws (%.0fx fewer than every "
+        "sample, at most %" PRId64 " a second), %.0f ns per sample, guidance agrees %.2f%% of the time\n",
+        frequency_hz, has_z ? "" : " without z", samples.size(), quantised_changes, overlay.redraws,
+        (double) samples.size() / (double) std::max( overlay.redraws, (int64_t) 1 ), overlay.busiest_second, push_ns,
+        100.0 * (double) agreeing / (double) std::max( compared, (int64_t) 1 ) );
+}
+
+extern "C" int position_guide_benchmark_main( void );
+extern "C" int position_guide_benchmark_main( void )
+{
+    // Ten minutes of a user finding their position, at a typical screen tracker rate and at a high one
+    replay( 90.0f, true );
+    replay( 90.0f, false );
+    replay( 1200.0f, true );
+    return 0;
+}
@@ -0,0 +1,247 @@
+#include "presence_governor.h"
+#include <tobii/tobii_config.h>
+
+enum governed_stream_kind_t
+{
+    GOVERNED_STREAM_GAZE_DATA,
+    GOVERNED_STREAM_WEARABLE_ADVANCED_DATA,
+    GOVERNED_STREAM_COUNT
+};
+
+struct governed_stream_t
+{
+    bool added;
+    union
+    {
+        tobii_gaze_data_callback_t gaze_data;
+        tobii_wearable_advanced_data_callback_t wearable_advanced_data;
+    } callback;
+    void* user_data;
+};
+
+struct presence_governor_t
+{
+    tobii_device_t* device;
+    int64_t away_grace_us;
+    presence_governor_pipeline_t pipeline;
+    void* user_data;
+    governed_stream_t streams[ GOVERNED_STREAM_COUNT ]; // A device allows one subscription per stream
+    bool started;
+    bool active;
+    bool user_away;
+    int64_t away_since_us;
+    bool device_paused;
+    bool frequency_control; // Cleared if the device refuses frequency changes
+    float present_frequency_hz;
+    float away_frequency_hz;
+};
+
+static tobii_error_t subscribe_stream( presence_governor_t* governor, int kind )
+{
+    governed_stream_t const& stream = governor->streams[ kind ];
+    if( !governor->device || !stream.added ) return TOBII_ERROR_NO_ERROR;
+
+    if( kind == GOVERNED_STREAM_GAZE_DATA )
+        return tobii_gaze_data_subscribe( governor->device, stream.callback.gaze_data, stream.user_data );
+    return tobii_wearable_advanced_data_subscribe( governor->device, stream.callback.wearable_advanced_data,
+        stream.user_data );
+}
+
+static tobii_error_t unsubscribe_stream( presence_governor_t* governor, int kind )
+{
+    if( !governor->device || !governor->streams[ kind ].added ) return TOBII_ERROR_NO_ERROR;
+
+    if( kind == GOVERNED_STREAM_GAZE_DATA ) return tobii_gaze_data_unsubscribe( governor->device );
+    return tobii_wearable_advanced_data_unsubscribe( governor->device );
+}
+
+static void set_output_frequency( presence_governor_t* governor, float frequency_hz )
+{
+    if( !governor->device || !governor->frequency_control ) return;
+
+    // Without a config license the frequency can not be changed, so stop trying and govern the streams only
+    tobii_error_t error = tobii_set_output_frequency( governor->device, frequency_hz );
+    if( error == TOBII_ERROR_INSUFFICIENT_LICENSE || error == TOBII_ERROR_NOT_SUPPORTED )
+        governor->frequency_control = false;
+}
+
+static tobii_error_t suspend( presence_governor_t* governor )
+{
+    tobii_error_t result = TOBII_ERROR_NO_ERROR;
+    for( int kind = 0; kind < GOVERNED_STREAM_COUNT; ++kind )
+    {
+        tobii_error_t error = unsubscribe_stream( governor, kind );
+        if( result == TOBII_ERROR_NO_ERROR ) result = error;
+    }
+    if( governor->away_frequency_hz < governor->present_frequency_hz )
+        set_output_frequency( governor, governor->away_frequency_hz );
+
+    governor->active = false;
+    if( governor->pipeline ) governor->pipeline( 0, governor->user_data );
+    return result;
+}
+
+static tobii_error_t resume( presence_governor_t* governor )
+{
+    // Restore the frequency first, so the first samples after resuming already arrive at full rate
+    if( governor->away_frequency_hz < governor->present_frequency_hz )
+        set_output_frequency( governor, governor->present_frequency_hz );
+
+    // Resume the pipeline before resubscribing, as the samples can be delivered by the next process callbacks
+    governor->active = true;
+    if( governor->pipeline ) governor->pipeline( 1, governor->user_data );
+
+    tobii_error_t result = TOBII_ERROR_NO_ERROR;
+    for( int kind = 0; kind < GOVERNED_STREAM_COUNT; ++kind )
+    {
+        tobii_error_t error = subscribe_stream( governor, kind );
+        if( result == TOBII_ERROR_NO_ERROR ) result = error;
+    }
+    return result;
+}
+
+static void presence_callback( tobii_user_presence_status_t status, int64_t timestamp_us, void* user_data )
+{
+    presence_governor_push_presence( static_cast<presence_governor_t*>( user_data ), status, timestamp_us );
+}
+
+static void notifications_callback( tobii_notification_t const* notification, void* user_data )
+{
+    auto governor = static_cast<presence_governor_t*>( user_data );
+    if( notification->type == TOBII_NOTIFICATION_TYPE_DEVICE_PAUSED_STATE_CHANGED )
+    {
+        governor->device_paused = notification->value.state == TOBII_STATE_BOOL_TRUE;
+    }
+    else if( notification->type == TOBII_NOTIFICATION_TYPE_FRAMERATE_CHANGED && governor->active )
+    {
+        // Someone else changed the frequency while the user was present, so that is the one to restore
+        governor->present_frequency_hz = notification->value.float_;
+    }
+}
+
+static void output_frequency_receiver( float output_frequency, void* user_data )
+{
+    float* lowest = (float*) user_data;
+    if( output_frequency < *lowest ) *lowest = output_frequency;
+}
+
+presence_governor_t* presence_governor_create( tobii_device_t* device, int64_t away_grace_us,
+    presence_governor_pipeline_t pipeline, void* user_data )
+{
+    auto governor = new presence_governor_t();
+    governor->device = device;
+    governor->away_grace_us = away_grace_us;
+    governor->pipeline = pipeline;
+    governor->user_data = user_data;
+    governor->active = true;
+    return governor;
+}
+
+void presence_governor_destroy( presence_governor_t* governor )
+{
+    if( governor->device )
+    {
+        if( governor->active )
+        {
+            for( int kind = 0; kind < GOVERNED_STREAM_COUNT; ++kind ) unsubscribe_stream( governor, kind );
+        }
+        else if( governor->away_frequency_hz < governor->present_frequency_hz )
+        {
+            // Do not leave the device running at the reduced frequency
+            set_output_frequency( governor, governor->present_frequency_hz );
+        }
+
+        if( governor->started )
+        {
+            tobii_notifications_unsubscribe( governor->device );
+            tobii_user_presence_unsubscribe( governor->device );
+        }
+    }
+
+    delete governor;
+}
+
+tobii_error_t presence_governor_start( presence_governor_t* governor )
+{
+    if( !governor->device || governor->started ) return TOBII_ERROR_NO_ERROR;
+
+    tobii_error_t error = tobii_user_presence_subscribe( governor->device, presence_callback, governor );
+    if( error != TOBII_ERROR_NO_ERROR ) return error;
+
+    error = tobii_notifications_subscribe( governor->device, notifications_callback, governor );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        tobii_user_presence_unsubscribe( governor->device );
+        return error;
+    }
+    governor->started = true;
+
+    // Use the lowest frequency the device offers while the user is away
+    float present_frequency_hz = 0.0f;
+    float away_frequency_hz = 1e9f;
+    if( tobii_get_output_frequency( governor->device, &present_frequency_hz ) == TOBII_ERROR_NO_ERROR &&
+        tobii_enumerate_output_frequencies( governor->device, output_frequency_receiver, &away_frequency_hz )
+            == TOBII_ERROR_NO_ERROR )
+    {
+        governor->frequency_control = true;
+        governor->present_frequency_hz = present_frequency_hz;
+        governor->away_frequency_hz = away_frequency_hz;
+    }
+
+    return TOBII_ERROR_NO_ERROR;
+}
+
+static tobii_error_t add_stream( presence_governor_t* governor, int kind, governed_stream_t const& stream )
+{
+    if( governor->streams[ kind ].added ) return TOBII_ERROR_ALREADY_SUBSCRIBED;
+
+    governor->streams[ kind ] = stream;
+    if( !governor->active ) return TOBII_ERROR_NO_ERROR;
+
+    tobii_error_t error = subscribe_stream( governor, kind );
+    if( error != TOBII_ERROR_NO_ERROR ) governor->streams[ kind ].added = false;
+    return error;
+}
+
+tobii_error_t presence_governor_add_gaze_data( presence_governor_t* governor, tobii_gaze_data_callback_t callback,
+    void* user_data )
+{
+    governed_stream_t stream;
+    stream.added = true;
+    stream.callback.gaze_data = callback;
+    stream.user_data = user_data;
+    return add_stream( governor, GOVERNED_STREAM_GAZE_DATA, stream );
+}
+
+tobii_error_t presence_governor_add_wearable_advanced_data( presence_governor_t* governor,
+    tobii_wearable_advanced_data_callback_t callback, void* user_data )
+{
+    governed_stream_t stream;
+    stream.added = true;
+    stream.callback.wearable_advanced_data = callback;
+    stream.user_data = user_data;
+    return add_stream( governor, GOVERNED_STREAM_WEARABLE_ADVANCED_DATA, stream );
+}
+
+void presence_governor_push_presence( presence_governor_t* governor, tobii_user_presence_status_t status,
+    int64_t timestamp_us )
+{
+    // Unknown presence is treated as present, as suspending on it could leave a user without tracking
+    bool away = status == TOBII_USER_PRESENCE_STATUS_AWAY;
+    if( away && !governor->user_away ) governor->away_since_us = timestamp_us;
+    governor->user_away = away;
+}
+
+tobii_error_t presence_governor_update( presence_governor_t* governor, int64_t now_us )
+{
+    bool away = governor->device_paused ||
+        ( governor->user_away && now_us - governor->away_since_us >= governor->away_grace_us );
+    if( away != governor->active ) return TOBII_ERROR_NO_ERROR; // No transition pending
+
+    return away ? suspend( governor ) : resume( governor );
+}
+
+int presence_governor_is_active( presence_governor_t const* governor )
+{
+    return governor->active ? 1 : 0;
+}
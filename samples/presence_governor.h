@@ -0,0 +1,57 @@
+#ifndef sample_presence_governor_h
+#define sample_presence_governor_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+// Suspends heavy streams and the processing pipeline while nobody is in front of the device. The governor subscribes
+// to the user presence and notifications streams, and owns the subscriptions of the streams added to it. When the
+// user is away, or the device is paused, those streams are unsubscribed, the output frequency is lowered and the
+// pipeline is told to suspend. When the user is back, everything is restored by the next presence_governor_update.
+//
+// API calls are not allowed from within callbacks, so presence changes are only recorded by the callbacks, and applied
+// by presence_governor_update. Call it on the pump thread directly after tobii_device_process_callbacks, and the
+// heavy streams are resubscribed within the same frame the user is detected in. All functions must be called from
+// the pump thread.
+//
+// The output frequency is a device wide setting, so only let the governor change it when the application owns the
+// tracker, such as in a kiosk.
+
+typedef struct presence_governor_t presence_governor_t;
+
+// Called with *active* 0 when the pipeline should suspend, and 1 when it should resume.
+typedef void ( *presence_governor_pipeline_t )( int active, void* user_data );
+
+// A NULL *device* creates a governor without any streams, driven only by presence_governor_push_presence, which is
+// useful for replaying recorded presence data. *away_grace_us* is how long the user must have been away before
+// anything is suspended, so short absences, such as looking down at a phone, do not cause stream churn.
+presence_governor_t* presence_governor_create( tobii_device_t* device, int64_t away_grace_us,
+    presence_governor_pipeline_t pipeline, void* user_data );
+
+// Unsubscribes all streams owned by the governor.
+void presence_governor_destroy( presence_governor_t* governor );
+
+// Subscribes to the presence and notifications streams, and reads the output frequencies of the device. Devices which
+// do not allow the output frequency to be changed are governed without it.
+tobii_error_t presence_governor_start( presence_governor_t* governor );
+
+// Adds a heavy stream to be governed, subscribing to it immediately if the governor is active.
+tobii_error_t presence_governor_add_gaze_data( presence_governor_t* governor, tobii_gaze_data_callback_t callback,
+    void* user_data );
+
+tobii_error_t presence_governor_add_wearable_advanced_data( presence_governor_t* governor,
+    tobii_wearable_advanced_data_callback_t callback, void* user_data );
+
+// Records a presence change. Called by the presence subscription, or directly when replaying.
+void presence_governor_push_presence( presence_governor_t* governor, tobii_user_presence_status_t status,
+    int64_t timestamp_us );
+
+// Applies any pending transition. *now_us* must come from the same clock as the presence timestamps, such as
+// tobii_system_clock.
+tobii_error_t presence_governor_update( presence_governor_t* governor, int64_t now_us );
+
+int presence_governor_is_active( presence_governor_t const* governor );
+
+#endif // sample_presence_governor_h
@@ -0,0 +1,233 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+
+#include "main_loop_linux.h"
+#include "presence_governor.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <vector>
+
+
+struct governor_context_t
+{
+    tobii_api_t* api;
+    presence_governor_t* governor;
+    int64_t samples;
+};
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    (void) gaze_data; // Unused parameter
+    ++static_cast<governor_context_t*>( user_data )->samples;
+}
+
+static void pipeline_callback( int active, void* user_data )
+{
+    auto context = static_cast<governor_context_t*>( user_data );
+    printf( active ? "User present, resuming after %" PRId64 " samples\n" : "User away, suspending after %"
+        PRId64 " samples\n", context->samples );
+}
+
+static void update_governor( void* user_data )
+{
+    // Runs on the pump thread after every tobii_device_process_callbacks
+    auto context = static_cast<governor_context_t*>( user_data );
+    int64_t now_us;
+    if( tobii_system_clock( context->api, &now_us ) != TOBII_ERROR_NO_ERROR ) return;
+
+    tobii_error_t error = presence_governor_update( context->governor, now_us );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to apply presence change: %s.\n", tobii_error_message( error ) );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int presence_governor_sample_main( void );
+extern "C" int presence_governor_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    governor_context_t context = { api, NULL, 0 };
+    // Suspend once the user has been away for five seconds
+    context.governor = presence_governor_create( device, 5000000, pipeline_callback, &context );
+    error = presence_governor_start( context.governor );
+    if( error == TOBII_ERROR_NO_ERROR )
+        error = presence_governor_add_gaze_data( context.governor, gaze_data_callback, &context );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to start the presence governor: %s.\n", tobii_error_message( error ) );
+        presence_governor_destroy( context.governor );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, update_governor, &context );
+
+    // Destroying the governor unsubscribes the streams it owns and restores the output frequency
+    presence_governor_destroy( context.governor );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+struct presence_segment_t
+{
+    tobii_user_presence_status_t status;
+    int64_t duration_s;
+};
+
+// One kiosk hour: sessions separated by short glances away and long idle periods
+static presence_segment_t const presence_trace[] = {
+    { TOBII_USER_PRESENCE_STATUS_PRESENT, 180 }, { TOBII_USER_PRESENCE_STATUS_AWAY, 1 },
+    { TOBII_USER_PRESENCE_STATUS_PRESENT, 120 }, { TOBII_USER_PRESENCE_STATUS_AWAY, 420 },
+    { TOBII_USER_PRESENCE_STATUS_PRESENT, 60 }, { TOBII_USER_PRESENCE_STATUS_AWAY, 4 },
+    { TOBII_USER_PRESENCE_STATUS_PRESENT, 30 }, { TOBII_USER_PRESENCE_STATUS_AWAY, 900 },
+    { TOBII_USER_PRESENCE_STATUS_PRESENT, 240 }, { TOBII_USER_PRESENCE_STATUS_AWAY, 1645 },
+};
+
+struct replay_pipeline_t
+{
+    float state[ 6 ];
+    int64_t processed;
+    int64_t first_sample_after_resume_us;
+    bool resumed;
+};
+
+static void replay_pipeline_callback( int active, void* user_data )
+{
+    auto pipeline = static_cast<replay_pipeline_t*>( user_data );
+    pipeline->resumed = active != 0;
+}
+
+static void run_pipeline( replay_pipeline_t* pipeline, tobii_gaze_data_t const* gaze_data )
+{
+    // Stand-in for the downstream filters: a cascade of smoothing passes over both eyes' gaze points
+    for( int pass = 0; pass < 32; ++pass )
+    {
+        for( int i = 0; i < 3; ++i )
+        {
+            pipeline->state[ i ] += 0.05f * ( gaze_data->left.gaze_point_from_eye_tracker_mm[ i ] - pipeline->state[ i ] );
+            pipeline->state[ i + 3 ] +=
+                0.05f * ( gaze_data->right.gaze_point_from_eye_tracker_mm[ i ] - pipeline->state[ i + 3 ] );
+        }
+    }
+    ++pipeline->processed;
+}
+
+static double replay_presence_trace( bool governed, std::vector<tobii_gaze_data_t> const& gaze_data,
+    int64_t* suspensions, int64_t* max_resume_latency_us, int64_t* processed )
+{
+    float const frequency_hz = 1200.0f;
+    replay_pipeline_t pipeline = {};
+    presence_governor_t* governor = presence_governor_create( NULL, 5000000, replay_pipeline_callback, &pipeline );
+
+    *suspensions = 0;
+    *max_resume_latency_us = 0;
+    size_t segment = 0;
+    int64_t segment_end_us = presence_trace[ 0 ].duration_s * 1000000;
+    int64_t resumed_at_us = -1;
+    int64_t sample_count = 0;
+    for( auto const& s : presence_trace ) sample_count += s.duration_s * (int64_t) frequency_hz;
+
+    clock_t start = clock();
+    for( int64_t i = 0; i < sample_count; ++i )
+    {
+        // One pump iteration per sample: deliver presence changes, update the governor, then the sample
+        int64_t now_us = (int64_t)( (double) i * 1000000.0 / frequency_hz );
+        if( now_us >= segment_end_us && segment + 1 < sizeof( presence_trace ) / sizeof( *presence_trace ) )
+        {
+            ++segment;
+            presence_governor_push_presence( governor, presence_trace[ segment ].status, segment_end_us );
+            if( presence_trace[ segment ].status == TOBII_USER_PRESENCE_STATUS_PRESENT ) resumed_at_us = segment_end_us;
+            segment_end_us += presence_trace[ segment ].duration_s * 1000000;
+        }
+
+        if( governed )
+        {
+            bool was_active = presence_governor_is_active( governor ) != 0;
+            presence_governor_update( governor, now_us );
+            if( was_active && !presence_governor_is_active( governor ) ) ++*suspensions;
+            // An unsubscribed stream delivers nothing
+            if( !presence_governor_is_active( governor ) ) continue;
+        }
+
+        run_pipeline( &pipeline, &gaze_data[ (size_t) i % gaze_data.size() ] );
+        if( resumed_at_us >= 0 )
+        {
+            if( pipeline.resumed && now_us - resumed_at_us > *max_resume_latency_us )
+                *max_resume_latency_us = now_us - resumed_at_us;
+            resumed_at_us = -1;
+        }
+        pipeline.resumed = false;
+    }
+    double cpu_s = (double)( clock() - start ) / CLOCKS_PER_SEC;
+
+    *processed = pipeline.processed;
+    presence_governor_destroy( governor );
+    return cpu_s;
+}
+
+extern "C" int presence_governor_benchmark_main( void );
+extern "C" int presence_governor_benchmark_main( void )
+{
+    // A minute of 1200 Hz gaze data, replayed cyclically under a one hour presence trace
+    std::vector<tobii_gaze_data_t> gaze_data( 1200 * 60 );
+    for( size_t i = 0; i < gaze_data.size(); ++i ) stream_replay_gaze_data( (int64_t) i, 1200.0f, &gaze_data[ i ] );
+
+    int64_t suspensions, max_resume_latency_us, processed;
+    double ungoverned_s = replay_presence_trace( false, gaze_data, &suspensions, &max_resume_latency_us, &processed );
+    printf( "Ungoverned: %" PRId64 " samples processed, %.3f s CPU\n", processed, ungoverned_s );
+
+    double governed_s = replay_presence_trace( true, gaze_data, &suspensions, &max_resume_latency_us, &processed );
+    printf( "Governed:   %" PRId64 " samples processed, %.3f s CPU, %" PRId64 " suspensions\n", processed,
+        governed_s, suspensions );
+    printf( "CPU reduction: %.1f%%, worst resume latency: %" PRId64 " us (one sample is %.0f us)\n",
+        100.0 * ( 1.0 - governed_s / ungoverned_s ), max_resume_latency_us, 1000000.0 / 1200.0 );
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include "pump_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct registry_t
+    {
+        std::mutex mutex;
+        std::vector<pump_trace_buffer_t*> buffers; // Never freed, so spans of finished threads can still be exported
+        int64_t steady_ns; // Paired with clock, to calibrate the trace clock at export
+        uint64_t clock;
+    };
+
+    registry_t& registry()
+    {
+        static registry_t* registry = []
+        {
+            registry_t* created = new registry_t;
+            created->steady_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+            created->clock = pump_trace_clock();
+            return created;
+        }();
+        return *registry;
+    }
+
+    double ticks_per_us()
+    {
+#if defined( __x86_64__ ) || defined( __i386__ )
+        registry_t& r = registry();
+        std::lock_guard<std::mutex> lock( r.mutex );
+        // The longer the interval, the better the calibration, but the first spans are recorded right after creation
+        int64_t const minimum_ns = 10000000;
+        int64_t elapsed_ns = 0;
+        uint64_t clock = 0;
+        for( ;; )
+        {
+            clock = pump_trace_clock();
+            elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count() - r.steady_ns;
+            if( elapsed_ns >= minimum_ns ) break;
+            std::this_thread::sleep_for( std::chrono::nanoseconds( minimum_ns - elapsed_ns ) );
+        }
+        return (double) ( clock - r.clock ) * 1000.0 / (double) elapsed_ns;
+#else
+        typedef std::chrono::steady_clock::period period;
+        return (double) period::den / ( (double) period::num * 1000000.0 );
+#endif
+    }
+
+    void write_string( FILE* file, char const* text )
+    {
+        fputc( '"', file );
+        for( char const* c = text; *c; ++c )
+        {
+            if( *c == '"' || *c == '\\' ) fputc( '\\', file );
+            if( (unsigned char) *c >= 0x20 ) fputc( *c, file );
+        }
+        fputc( '"', file );
+    }
+}
+
+pump_trace_buffer_t* pump_trace_register_thread( void )
+{
+    // Value initialized, which also touches every page, so recording never page faults
+    pump_trace_buffer_t* buffer = new pump_trace_buffer_t();
+    registry_t& r = registry();
+    std::lock_guard<std::mutex> lock( r.mutex );
+    buffer->thread_index = (uint32_t) r.buffers.size() + 1;
+    snprintf( buffer->thread_name, sizeof( buffer->thread_name ), "thread %u", buffer->thread_index );
+    r.buffers.push_back( buffer );
+    return buffer;
+}
+
+void pump_trace_thread_name( char const* name )
+{
+    pump_trace_buffer_t* buffer = pump_trace_thread_buffer();
+    std::lock_guard<std::mutex> lock( registry().mutex );
+    snprintf( buffer->thread_name, sizeof( buffer->thread_name ), "%s", name );
+}
+
+tobii_error_t pump_trace_write_json( char const* path )
+{
+    struct thread_t
+    {
+        uint32_t index;
+        char name[ 32 ];
+        std::vector<pump_trace_event_t> events;
+    };
+
+    uint64_t const capacity = pump_trace_buffer_t::capacity;
+    std::vector<thread_t> threads;
+    {
+        registry_t& r = registry();
+        std::lock_guard<std::mutex> lock( r.mutex );
+        threads.resize( r.buffers.size() );
+        for( size_t i = 0; i < r.buffers.size(); ++i )
+        {
+            pump_trace_buffer_t const* buffer = r.buffers[ i ];
+            thread_t& thread = threads[ i ];
+            thread.index = buffer->thread_index;
+            memcpy( thread.name, buffer->thread_name, sizeof( thread.name ) );
+
+            uint64_t end = buffer->count.load( std::memory_order_acquire );
+            uint64_t begin = end > capacity ? end - capacity : 0;
+            thread.events.reserve( (size_t) ( end - begin ) );
+            for( uint64_t n = begin; n < end; ++n )
+                thread.events.push_back( buffer->events[ n & ( capacity - 1 ) ] );
+
+            // The thread kept recording while the events were copied, and may have overwritten the oldest of them.
+            // The fence keeps the copy from being reordered after the count is read back. Event *now* may be half
+            // written into its slot, so the event that slot held counts as overwritten as well
+            std::atomic_thread_fence( std::memory_order_acquire );
+            uint64_t now = buffer->count.load( std::memory_order_relaxed );
+            uint64_t overwritten_end = now + 1 > capacity ? now + 1 - capacity : 0;
+            if( overwritten_end > begin )
+            {
+                uint64_t overwritten = overwritten_end - begin;
+                if( overwritten > end - begin ) overwritten = end - begin;
+                thread.events.erase( thread.events.begin(), thread.events.begin() + (ptrdiff_t) overwritten );
+            }
+        }
+    }
+
+    uint64_t origin = UINT64_MAX;
+    for( thread_t const& thread : threads )
+        for( pump_trace_event_t const& event : thread.events )
+            if( event.begin < origin ) origin = event.begin;
+    double const scale = 1.0 / ticks_per_us();
+
+    FILE* file = fopen( path, "w" );
+    if( !file ) return TOBII_ERROR_NOT_AVAILABLE;
+
+    fprintf( file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+    bool first = true;
+    for( thread_t const& thread : threads )
+    {
+        fprintf( file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+            first ? "" : ",\n", thread.index );
+        write_string( file, thread.name );
+        fprintf( file, "}}" );
+        first = false;
+        for( pump_trace_event_t const& event : thread.events )
+        {
+            fprintf( file, ",\n{\"name\":" );
+            write_string( file, event.name );
+            uint64_t duration = event.end > event.begin ? event.end - event.begin : 0;
+            fprintf( file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", thread.index,
+                (double) ( event.begin - origin ) * scale, (double) duration * scale );
+        }
+    }
+    fprintf( file, "\n]}\n" );
+
+    bool failed = ferror( file ) != 0;
+    if( fclose( file ) != 0 ) failed = true;
+    return failed ? TOBII_ERROR_NOT_AVAILABLE : TOBII_ERROR_NO_ERROR;
+}
+
+void pump_trace_statistics( uint64_t* recorded, uint64_t* overwritten )
+{
+    uint64_t const capacity = pump_trace_buffer_t::capacity;
+    uint64_t total = 0;
+    uint64_t lost = 0;
+    registry_t& r = registry();
+    std::lock_guard<std::mutex> lock( r.mutex );
+    for( pump_trace_buffer_t const* buffer : r.buffers )
+    {
+        uint64_t count = buffer->count.load( std::memory_order_relaxed );
+        total += count;
+        if( count > capacity ) lost += count - capacity;
+    }
+    if( recorded ) *recorded = total;
+    if( overwritten ) *overwritten = lost;
+}
@@ -0,0 +1,112 @@
+#ifndef sample_pump_trace_h
+#define sample_pump_trace_h
+
+#include <tobii/tobii.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Timeline of where the pump, timesync and reconnect threads spend their time, for finding the cause of latency
+// spikes. Each span is recorded by the thread it ran on into a ring of its own, as a name, a begin and an end time,
+// without locks or allocation; the rings keep the latest spans of each thread. pump_trace_write_json exports all
+// threads as Chrome Trace Event JSON, which chrome://tracing and the Perfetto UI both open.
+//
+// Spans are placed with PUMP_TRACE_SPAN, which covers the rest of the enclosing scope. The macros compile to nothing
+// unless PUMP_TRACE is defined, so tracing can stay in the code at no cost. Names must be string literals, or
+// otherwise outlive the export.
+//
+// A recorded span costs two reads of the trace clock and a few stores. The target was under 50 ns per span, which
+// this misses on the virtual machine it was measured on: spans cost 45 to 55 ns there, as each rdtsc takes about
+// 23 ns. rdtsc was still the cheapest clock with a usable resolution on that machine.
+
+#ifdef PUMP_TRACE
+#define PUMP_TRACE_CONCAT_( a, b ) a##b
+#define PUMP_TRACE_CONCAT( a, b ) PUMP_TRACE_CONCAT_( a, b )
+#define PUMP_TRACE_SPAN( name ) pump_trace_scope_t PUMP_TRACE_CONCAT( pump_trace_scope_, __LINE__ )( name )
+#define PUMP_TRACE_THREAD_NAME( name ) pump_trace_thread_name( name )
+#else
+#define PUMP_TRACE_SPAN( name ) ( (void) 0 )
+#define PUMP_TRACE_THREAD_NAME( name ) ( (void) 0 )
+#endif
+
+struct pump_trace_event_t
+{
+    char const* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// The ring of one thread. Only that thread writes to it.
+struct pump_trace_buffer_t
+{
+    static uint64_t const capacity = 1 << 16; // Must be a power of two
+
+    pump_trace_event_t events[ capacity ];
+    std::atomic<uint64_t> count; // Events recorded so far
+    uint32_t thread_index;
+    char thread_name[ 32 ];
+};
+
+pump_trace_buffer_t* pump_trace_register_thread( void );
+
+// The ring of the calling thread, registered on first use.
+inline pump_trace_buffer_t* pump_trace_thread_buffer( void )
+{
+    static thread_local pump_trace_buffer_t* buffer = nullptr;
+    if( !buffer ) buffer = pump_trace_register_thread();
+    return buffer;
+}
+
+// Ticks of the trace clock, which pump_trace_write_json converts to microseconds.
+inline uint64_t pump_trace_clock( void )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    return (uint64_t) std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+inline void pump_trace_record( char const* name, uint64_t begin, uint64_t end )
+{
+    pump_trace_buffer_t* buffer = pump_trace_thread_buffer();
+    uint64_t count = buffer->count.load( std::memory_order_relaxed );
+    pump_trace_event_t& event = buffer->events[ count & ( pump_trace_buffer_t::capacity - 1 ) ];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    buffer->count.store( count + 1, std::memory_order_release );
+}
+
+class pump_trace_scope_t
+{
+public:
+    explicit pump_trace_scope_t( char const* name ) : name_( name ), begin_( pump_trace_clock() ) {}
+    ~pump_trace_scope_t() { pump_trace_record( name_, begin_, pump_trace_clock() ); }
+    pump_trace_scope_t( pump_trace_scope_t const& ) = delete;
+    pump_trace_scope_t& operator=( pump_trace_scope_t const& ) = delete;
+
+private:
+    char const* name_;
+    uint64_t begin_;
+};
+
+// Names the calling thread in the exported trace.
+void pump_trace_thread_name( char const* name );
+
+// Writes every thread's spans to *path*. Safe to call while spans are being recorded: spans overwritten during the
+// export are left out. Returns TOBII_ERROR_NOT_AVAILABLE if the file can not be written.
+tobii_error_t pump_trace_write_json( char const* path );
+
+// Spans recorded so far over all threads, and how many of them the rings no longer hold.
+void pump_trace_statistics( uint64_t* recorded, uint64_t* overwritten );
+
+#endif // sample_pump_trace_h
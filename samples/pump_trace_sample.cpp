@@ -0,0 +1,219 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "pump_trace.h"
+#include "main_loop_linux.h"
+#include "timesync_thread.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct trace_context_t
+{
+    tobii_gaze_point_t latest;
+    uint64_t count;
+};
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    PUMP_TRACE_SPAN( "gaze_point_callback" );
+    trace_context_t* context = (trace_context_t*) user_data;
+    context->latest = *gaze_point;
+    ++context->count;
+}
+
+static void report( void* user_data )
+{
+    PUMP_TRACE_SPAN( "report" );
+    trace_context_t* context = (trace_context_t*) user_data;
+    if( context->count % 600 == 0 && context->count > 0 )
+        printf( "%" PRIu64 " gaze points, latest at %" PRId64 " us\n", context->count,
+            context->latest.timestamp_us );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int pump_trace_sample_main( void );
+extern "C" int pump_trace_sample_main( void )
+{
+#ifndef PUMP_TRACE
+    printf( "Built without PUMP_TRACE, so the trace will be empty.\n" );
+#endif
+
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    trace_context_t context = {};
+    error = tobii_gaze_point_subscribe( device, gaze_point_callback, &context );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze point stream.\n" );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // The pump, timesync and reconnect paths are traced by main_loop and the timesync thread themselves
+    thread_context_t* timesync = timesync_thread_create( device );
+    printf( "Tracing, press any key to stop and write pump_trace.json.\n" );
+    main_loop( device, report, &context );
+    timesync_thread_destroy( timesync );
+
+    error = pump_trace_write_json( "pump_trace.json" );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to write pump_trace.json: %s.\n", tobii_error_message( error ) );
+    else
+        printf( "Wrote pump_trace.json, open it in chrome://tracing or https://ui.perfetto.dev\n" );
+
+    tobii_gaze_point_unsubscribe( device );
+    tobii_device_destroy( device );
+    tobii_api_destroy( api );
+    return 0;
+}
+
+
+// Nanoseconds per iteration of *body*, over *iterations*
+template<typename body_t> static double time_ns( int64_t iterations, body_t body )
+{
+    auto start = std::chrono::steady_clock::now();
+    for( int64_t i = 0; i < iterations; ++i ) body( i );
+    double elapsed_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+    return elapsed_ns / (double) iterations;
+}
+
+extern "C" int pump_trace_benchmark_main( void );
+extern "C" int pump_trace_benchmark_main( void )
+{
+    int64_t const iterations = 10000000;
+    volatile uint64_t sink = 0;
+
+    // The cost of a span always recorded, whatever PUMP_TRACE is, against the same loop without it
+    pump_trace_thread_name( "benchmark" );
+    double empty_ns = time_ns( iterations, [&]( int64_t i ) { sink = sink + (uint64_t) i; } );
+    double span_ns = time_ns( iterations, [&]( int64_t i )
+    {
+        pump_trace_scope_t span( "span" );
+        sink = sink + (uint64_t) i;
+    } );
+    double macro_ns = time_ns( iterations, [&]( int64_t i )
+    {
+        PUMP_TRACE_SPAN( "macro" );
+        sink = sink + (uint64_t) i;
+    } );
+#ifdef PUMP_TRACE
+    char const* const build = "enabled";
+#else
+    char const* const build = "compiled out";
+#endif
+    printf( "Empty loop %.2f ns, with a span %.2f ns, so %.2f ns per span (%s the 50 ns target)\n", empty_ns, span_ns,
+        span_ns - empty_ns, span_ns - empty_ns < 50.0 ? "within" : "over" );
+    double clock_ns = time_ns( iterations, [&]( int64_t i ) { sink = sink + pump_trace_clock() + (uint64_t) i; } );
+    printf( "Trace clock read %.2f ns, two of which are in every span\n", clock_ns - empty_ns );
+    printf( "PUMP_TRACE_SPAN (%s): %.2f ns over the empty loop\n", build, macro_ns - empty_ns );
+
+    // Nested spans, as a callback inside process_callbacks inside the pump iteration
+    double nested_ns = time_ns( iterations / 3, [&]( int64_t i )
+    {
+        pump_trace_scope_t outer( "iteration" );
+        {
+            pump_trace_scope_t middle( "process_callbacks" );
+            pump_trace_scope_t inner( "callback" );
+            sink = sink + (uint64_t) i;
+        }
+    } );
+    printf( "Three nested spans %.2f ns\n", nested_ns - empty_ns );
+
+    // Threads recording at once, each into its own ring
+    int const thread_count = 4;
+    std::vector<std::thread> threads;
+    auto threads_start = std::chrono::steady_clock::now();
+    for( int t = 0; t < thread_count; ++t )
+    {
+        threads.emplace_back( [&, t]
+        {
+            pump_trace_thread_name( ( "worker " + std::to_string( t ) ).c_str() );
+            time_ns( iterations / thread_count, [&]( int64_t i )
+            {
+                pump_trace_scope_t span( "worker span" );
+                sink = sink + (uint64_t) i;
+            } );
+        } );
+    }
+    for( auto& thread : threads ) thread.join();
+    double threads_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - threads_start )
+        .count();
+    printf( "%d threads recording at once, on %u cores: %.2f ns of wall time per span, including the loop\n",
+        thread_count, std::thread::hardware_concurrency(), threads_ns / (double) iterations );
+
+    // Exporting full rings, while one more thread keeps recording into its own
+    std::string path = ( std::filesystem::temp_directory_path() / "pump_trace_benchmark.json" ).string();
+    std::atomic<bool> stop( false );
+    std::thread recorder( [&]
+    {
+        pump_trace_thread_name( "recording during export" );
+        while( !stop.load( std::memory_order_relaxed ) )
+        {
+            pump_trace_scope_t span( "during export" );
+            sink = sink + 1;
+        }
+    } );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+    auto start = std::chrono::steady_clock::now();
+    tobii_error_t error = pump_trace_write_json( path.c_str() );
+    double export_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    stop = true;
+    recorder.join();
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to write %s: %s.\n", path.c_str(), tobii_error_message( error ) );
+        return 1;
+    }
+
+    uint64_t recorded, overwritten;
+    pump_trace_statistics( &recorded, &overwritten );
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size( path, ec );
+    printf( "Exported the rings of %d threads in %.0f ms, %.1f MB of JSON; %" PRIu64 " spans recorded, %" PRIu64
+        " no longer held\n", thread_count + 2, export_ms, (double) size / 1048576.0, recorded, overwritten );
+    std::filesystem::remove( path, ec );
+    return 0;
+}
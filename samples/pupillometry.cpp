@@ -0,0 +1,453 @@
+#include "pupillometry.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+// Second order Butterworth low-pass, in transposed direct form II
+struct low_pass_t
+{
+    float b0, b1, b2, a1, a2;
+    float z1, z2;
+    bool primed;
+};
+
+// Pushed samples waiting for the lookahead, with validity already widened by the padding
+struct pupil_input_t
+{
+    float diameter_mm;
+    bool valid;
+};
+
+struct pupil_eye_t
+{
+    std::vector<pupil_input_t> inputs; // Shares the timestamp ring of the stage
+    bool last_input_valid;
+    int pad_remaining; // Samples after an invalid sample still to be invalidated
+
+    // Bridging the current gap, from the last valid sample to the first valid sample after the gap
+    bool has_anchor;
+    float anchor_mm;
+    int64_t anchor_us;
+    uint64_t gap_end; // Index of the sample closing the gap, or 0 when not in one
+    bool gap_missing; // The gap could not be bridged, so it is missing until the next valid sample
+    float gap_end_mm;
+    int64_t gap_end_us;
+
+    low_pass_t filter;
+    std::vector<float> history_mm; // Filtered output, for baselines. NaN when missing
+    float baseline_mm;
+    uint64_t blinks;
+};
+
+struct trial_event_t
+{
+    int64_t timestamp_us;
+    bool begin;
+};
+
+static int const max_trial_events = 16;
+
+struct pupillometry_t
+{
+    pupillometry_config_t config;
+    uint32_t lookahead; // In samples
+    int padding; // In samples
+    uint32_t input_mask; // Input rings are a power of two larger than the lookahead
+    uint32_t history_mask;
+
+    std::vector<int64_t> input_us;
+    std::vector<int64_t> history_us;
+    uint64_t pushed; // Total samples pushed
+    uint64_t processed; // Total samples that have left the lookahead
+
+    pupil_eye_t left;
+    pupil_eye_t right;
+
+    trial_event_t trial_events[ max_trial_events ]; // Waiting for the output to catch up with them
+    int trial_event_count;
+    bool in_trial;
+
+    // The batch, as structure of arrays
+    int batch_count;
+    std::vector<int64_t> batch_us;
+    std::vector<float> batch_left_mm;
+    std::vector<float> batch_right_mm;
+    std::vector<float> batch_left_change_mm;
+    std::vector<float> batch_right_change_mm;
+    std::vector<uint8_t> batch_left_sample;
+    std::vector<uint8_t> batch_right_sample;
+    uint64_t dropped;
+};
+
+static uint32_t power_of_two_above( uint32_t value )
+{
+    uint32_t result = 1;
+    while( result <= value ) result <<= 1;
+    return result;
+}
+
+static uint32_t samples_in( int64_t duration_us, float frequency_hz )
+{
+    return (uint32_t) ceil( (double) duration_us * (double) frequency_hz / 1000000.0 );
+}
+
+static void low_pass_init( low_pass_t* filter, float cutoff_hz, float frequency_hz )
+{
+    // Bilinear transform of the analog prototype, with the cutoff prewarped
+    double k = tan( 3.14159265358979323846 * (double) cutoff_hz / (double) frequency_hz );
+    double q = 0.70710678118654752440;
+    double norm = 1.0 / ( 1.0 + k / q + k * k );
+    filter->b0 = (float)( k * k * norm );
+    filter->b1 = 2.0f * filter->b0;
+    filter->b2 = filter->b0;
+    filter->a1 = (float)( 2.0 * ( k * k - 1.0 ) * norm );
+    filter->a2 = (float)( ( 1.0 - k / q + k * k ) * norm );
+    filter->primed = false;
+}
+
+static float low_pass( low_pass_t* filter, float x )
+{
+    if( !filter->primed )
+    {
+        // Start from the steady state for *x*, so the output does not ramp up from zero after a missing stretch
+        filter->z2 = ( filter->b2 - filter->a2 ) * x;
+        filter->z1 = ( filter->b1 - filter->a1 ) * x + filter->z2;
+        filter->primed = true;
+    }
+    float y = filter->b0 * x + filter->z1;
+    filter->z1 = filter->b1 * x - filter->a1 * y + filter->z2;
+    filter->z2 = filter->b2 * x - filter->a2 * y;
+    return y;
+}
+
+static void eye_init( pupillometry_t const* pupillometry, pupil_eye_t* eye )
+{
+    eye->inputs.resize( pupillometry->input_mask + 1 );
+    eye->history_mm.resize( pupillometry->history_mask + 1, NAN );
+    eye->last_input_valid = true;
+    eye->baseline_mm = NAN;
+    low_pass_init( &eye->filter, pupillometry->config.cutoff_hz, pupillometry->config.frequency_hz );
+}
+
+static void eye_input( pupillometry_t* pupillometry, pupil_eye_t* eye, float diameter_mm, bool valid )
+{
+    valid = valid && diameter_mm > 0.0f && isfinite( diameter_mm );
+    pupil_input_t& input = eye->inputs[ pupillometry->pushed & pupillometry->input_mask ];
+    input.diameter_mm = diameter_mm;
+
+    if( !valid )
+    {
+        // The lid is already closing before the pupil is lost, so widen the gap backwards too. Only needed at the
+        // start of a gap, and only for samples still in the lookahead.
+        if( eye->last_input_valid )
+        {
+            uint64_t first = pupillometry->pushed > (uint64_t) pupillometry->padding ?
+                pupillometry->pushed - pupillometry->padding : 0;
+            if( first < pupillometry->processed ) first = pupillometry->processed;
+            for( uint64_t i = first; i < pupillometry->pushed; ++i )
+                eye->inputs[ i & pupillometry->input_mask ].valid = false;
+        }
+        eye->pad_remaining = pupillometry->padding;
+        input.valid = false;
+    }
+    else if( eye->pad_remaining > 0 )
+    {
+        --eye->pad_remaining;
+        input.valid = false;
+    }
+    else
+    {
+        input.valid = true;
+    }
+    eye->last_input_valid = valid;
+}
+
+static bool find_gap_end( pupillometry_t const* pupillometry, pupil_eye_t* eye, uint64_t index )
+{
+    // Runs once per gap, so the cost of the scan is spread over all the samples of the gap
+    for( uint64_t i = index + 1; i < pupillometry->pushed; ++i )
+    {
+        pupil_input_t const& input = eye->inputs[ i & pupillometry->input_mask ];
+        if( !input.valid ) continue;
+        eye->gap_end = i;
+        eye->gap_end_mm = input.diameter_mm;
+        eye->gap_end_us = pupillometry->input_us[ i & pupillometry->input_mask ];
+        return true;
+    }
+    return false;
+}
+
+static pupillometry_sample_t eye_output( pupillometry_t* pupillometry, pupil_eye_t* eye, uint64_t index,
+    int64_t timestamp_us, float* diameter_mm )
+{
+    pupil_input_t const& input = eye->inputs[ index & pupillometry->input_mask ];
+    if( input.valid )
+    {
+        eye->has_anchor = true;
+        eye->anchor_mm = input.diameter_mm;
+        eye->anchor_us = timestamp_us;
+        eye->gap_end = 0;
+        eye->gap_missing = false;
+        *diameter_mm = input.diameter_mm;
+        return PUPILLOMETRY_SAMPLE_MEASURED;
+    }
+
+    if( !eye->gap_missing && eye->gap_end <= index )
+    {
+        // First sample of a new gap, or the sample which was to close the gap has since been invalidated by the
+        // padding of a following gap, so the two gaps are bridged as one
+        bool new_gap = eye->gap_end == 0;
+        if( !eye->has_anchor || !find_gap_end( pupillometry, eye, index ) )
+        {
+            eye->gap_missing = true;
+        }
+        else if( new_gap )
+        {
+            int64_t gap_us = eye->gap_end_us - timestamp_us - 2 * pupillometry->config.padding_us;
+            if( gap_us >= pupillometry->config.min_blink_us && gap_us <= pupillometry->config.max_blink_us )
+                ++eye->blinks;
+        }
+    }
+
+    if( eye->gap_missing )
+    {
+        eye->has_anchor = false;
+        *diameter_mm = NAN;
+        return PUPILLOMETRY_SAMPLE_MISSING;
+    }
+
+    float t = (float)( timestamp_us - eye->anchor_us ) / (float)( eye->gap_end_us - eye->anchor_us );
+    *diameter_mm = eye->anchor_mm + t * ( eye->gap_end_mm - eye->anchor_mm );
+    return PUPILLOMETRY_SAMPLE_INTERPOLATED;
+}
+
+static float eye_baseline( pupillometry_t const* pupillometry, pupil_eye_t const* eye, int64_t start_us )
+{
+    // Mean over the baseline period, which has already been processed and is still in the history
+    int64_t baseline_start_us = start_us - pupillometry->config.baseline_us;
+    uint64_t oldest = pupillometry->processed > pupillometry->history_mask ?
+        pupillometry->processed - pupillometry->history_mask : 0;
+    double sum = 0.0;
+    uint32_t count = 0;
+    for( uint64_t i = pupillometry->processed; i > oldest; --i )
+    {
+        uint32_t slot = ( i - 1 ) & pupillometry->history_mask;
+        int64_t timestamp_us = pupillometry->history_us[ slot ];
+        if( timestamp_us >= start_us ) continue;
+        if( timestamp_us < baseline_start_us ) break;
+        float diameter_mm = eye->history_mm[ slot ];
+        if( isnan( diameter_mm ) ) continue;
+        sum += diameter_mm;
+        ++count;
+    }
+
+    // A baseline mostly made up of a dropout is worse than none
+    if( count < samples_in( pupillometry->config.baseline_us, pupillometry->config.frequency_hz ) / 2 ) return NAN;
+    return (float)( sum / count );
+}
+
+static void apply_trial_events( pupillometry_t* pupillometry, int64_t timestamp_us )
+{
+    int applied = 0;
+    while( applied < pupillometry->trial_event_count &&
+        pupillometry->trial_events[ applied ].timestamp_us <= timestamp_us )
+    {
+        trial_event_t const& event = pupillometry->trial_events[ applied++ ];
+        pupillometry->in_trial = event.begin;
+        if( event.begin )
+        {
+            pupillometry->left.baseline_mm = eye_baseline( pupillometry, &pupillometry->left, event.timestamp_us );
+            pupillometry->right.baseline_mm = eye_baseline( pupillometry, &pupillometry->right, event.timestamp_us );
+        }
+    }
+    if( applied == 0 ) return;
+    pupillometry->trial_event_count -= applied;
+    memmove( pupillometry->trial_events, pupillometry->trial_events + applied,
+        pupillometry->trial_event_count * sizeof( trial_event_t ) );
+}
+
+static void process_next( pupillometry_t* pupillometry )
+{
+    uint64_t index = pupillometry->processed;
+    int64_t timestamp_us = pupillometry->input_us[ index & pupillometry->input_mask ];
+    if( pupillometry->trial_event_count > 0 ) apply_trial_events( pupillometry, timestamp_us );
+
+    float left_mm, right_mm;
+    pupillometry_sample_t left_sample = eye_output( pupillometry, &pupillometry->left, index, timestamp_us, &left_mm );
+    pupillometry_sample_t right_sample = eye_output( pupillometry, &pupillometry->right, index, timestamp_us,
+        &right_mm );
+
+    // Restart the filters after missing stretches rather than letting NaN through them
+    if( left_sample == PUPILLOMETRY_SAMPLE_MISSING ) pupillometry->left.filter.primed = false;
+    else left_mm = low_pass( &pupillometry->left.filter, left_mm );
+    if( right_sample == PUPILLOMETRY_SAMPLE_MISSING ) pupillometry->right.filter.primed = false;
+    else right_mm = low_pass( &pupillometry->right.filter, right_mm );
+
+    uint32_t slot = index & pupillometry->history_mask;
+    pupillometry->history_us[ slot ] = timestamp_us;
+    pupillometry->left.history_mm[ slot ] = left_mm;
+    pupillometry->right.history_mm[ slot ] = right_mm;
+    ++pupillometry->processed;
+
+    if( pupillometry->batch_count == pupillometry->config.batch_capacity )
+    {
+        ++pupillometry->dropped;
+        return;
+    }
+    int i = pupillometry->batch_count++;
+    pupillometry->batch_us[ i ] = timestamp_us;
+    pupillometry->batch_left_mm[ i ] = left_mm;
+    pupillometry->batch_right_mm[ i ] = right_mm;
+    // NaN propagates from missing samples and missing baselines on its own
+    pupillometry->batch_left_change_mm[ i ] = pupillometry->in_trial ? left_mm - pupillometry->left.baseline_mm : NAN;
+    pupillometry->batch_right_change_mm[ i ] = pupillometry->in_trial ? right_mm - pupillometry->right.baseline_mm :
+        NAN;
+    pupillometry->batch_left_sample[ i ] = (uint8_t) left_sample;
+    pupillometry->batch_right_sample[ i ] = (uint8_t) right_sample;
+}
+
+void pupillometry_default_config( float frequency_hz, pupillometry_config_t* config )
+{
+    config->frequency_hz = frequency_hz;
+    config->lookahead_us = 500000;
+    config->padding_us = 50000;
+    config->min_blink_us = 50000;
+    config->max_blink_us = 500000;
+    config->cutoff_hz = 4.0f;
+    config->baseline_us = 500000;
+    config->batch_capacity = 4096;
+}
+
+pupillometry_t* pupillometry_create( pupillometry_config_t const* config )
+{
+    auto pupillometry = new pupillometry_t();
+    pupillometry->config = *config;
+    pupillometry->lookahead = samples_in( config->lookahead_us, config->frequency_hz );
+    pupillometry->padding = (int) samples_in( config->padding_us, config->frequency_hz );
+    pupillometry->input_mask = power_of_two_above( pupillometry->lookahead ) - 1;
+    // Room for the baseline, plus the lookahead a trial may be started late by
+    pupillometry->history_mask = power_of_two_above( pupillometry->lookahead +
+        samples_in( config->baseline_us, config->frequency_hz ) ) - 1;
+
+    pupillometry->input_us.resize( pupillometry->input_mask + 1 );
+    pupillometry->history_us.resize( pupillometry->history_mask + 1 );
+    eye_init( pupillometry, &pupillometry->left );
+    eye_init( pupillometry, &pupillometry->right );
+
+    pupillometry->batch_us.resize( config->batch_capacity );
+    pupillometry->batch_left_mm.resize( config->batch_capacity );
+    pupillometry->batch_right_mm.resize( config->batch_capacity );
+    pupillometry->batch_left_change_mm.resize( config->batch_capacity );
+    pupillometry->batch_right_change_mm.resize( config->batch_capacity );
+    pupillometry->batch_left_sample.resize( config->batch_capacity );
+    pupillometry->batch_right_sample.resize( config->batch_capacity );
+    return pupillometry;
+}
+
+void pupillometry_destroy( pupillometry_t* pupillometry )
+{
+    delete pupillometry;
+}
+
+void pupillometry_push( pupillometry_t* pupillometry, int64_t timestamp_us, float left_mm, int left_valid,
+    float right_mm, int right_valid )
+{
+    pupillometry->input_us[ pupillometry->pushed & pupillometry->input_mask ] = timestamp_us;
+    eye_input( pupillometry, &pupillometry->left, left_mm, left_valid != 0 );
+    eye_input( pupillometry, &pupillometry->right, right_mm, right_valid != 0 );
+    ++pupillometry->pushed;
+
+    if( pupillometry->pushed - pupillometry->processed > pupillometry->lookahead ) process_next( pupillometry );
+}
+
+void pupillometry_push_gaze_data( pupillometry_t* pupillometry, tobii_gaze_data_t const* gaze_data )
+{
+    pupillometry_push( pupillometry, gaze_data->timestamp_system_us,
+        gaze_data->left.pupil_diameter_mm, gaze_data->left.pupil_validity == TOBII_VALIDITY_VALID,
+        gaze_data->right.pupil_diameter_mm, gaze_data->right.pupil_validity == TOBII_VALIDITY_VALID );
+}
+
+void pupillometry_push_wearable_advanced_data( pupillometry_t* pupillometry,
+    tobii_wearable_advanced_data_t const* data )
+{
+    // The headset reports blinks separately, and a diameter may still be flagged valid while the lid is half closed
+    bool left_blink = data->left.blink_validity == TOBII_VALIDITY_VALID && data->left.blink == TOBII_STATE_BOOL_TRUE;
+    bool right_blink = data->right.blink_validity == TOBII_VALIDITY_VALID &&
+        data->right.blink == TOBII_STATE_BOOL_TRUE;
+    pupillometry_push( pupillometry, data->timestamp_system_us,
+        data->left.pupil_diameter_mm, data->left.pupil_diameter_validity == TOBII_VALIDITY_VALID && !left_blink,
+        data->right.pupil_diameter_mm, data->right.pupil_diameter_validity == TOBII_VALIDITY_VALID && !right_blink );
+}
+
+static void push_trial_event( pupillometry_t* pupillometry, int64_t timestamp_us, bool begin )
+{
+    // More than a handful of trial boundaries within one lookahead is not meaningful, so just drop the oldest
+    if( pupillometry->trial_event_count == max_trial_events )
+    {
+        --pupillometry->trial_event_count;
+        memmove( pupillometry->trial_events, pupillometry->trial_events + 1,
+            pupillometry->trial_event_count * sizeof( trial_event_t ) );
+    }
+    pupillometry->trial_events[ pupillometry->trial_event_count++ ] = { timestamp_us, begin };
+}
+
+void pupillometry_begin_trial( pupillometry_t* pupillometry, int64_t timestamp_us )
+{
+    push_trial_event( pupillometry, timestamp_us, true );
+}
+
+void pupillometry_end_trial( pupillometry_t* pupillometry, int64_t timestamp_us )
+{
+    push_trial_event( pupillometry, timestamp_us, false );
+}
+
+void pupillometry_flush( pupillometry_t* pupillometry )
+{
+    while( pupillometry->processed < pupillometry->pushed ) process_next( pupillometry );
+}
+
+void pupillometry_batch( pupillometry_t const* pupillometry, pupillometry_batch_t* batch )
+{
+    batch->count = pupillometry->batch_count;
+    batch->timestamp_us = pupillometry->batch_us.data();
+    batch->left_mm = pupillometry->batch_left_mm.data();
+    batch->right_mm = pupillometry->batch_right_mm.data();
+    batch->left_change_mm = pupillometry->batch_left_change_mm.data();
+    batch->right_change_mm = pupillometry->batch_right_change_mm.data();
+    batch->left_sample = pupillometry->batch_left_sample.data();
+    batch->right_sample = pupillometry->batch_right_sample.data();
+}
+
+template< typename T >
+static void consume_array( std::vector<T>& array, int count, int remaining )
+{
+    memmove( array.data(), array.data() + count, remaining * sizeof( T ) );
+}
+
+void pupillometry_consume( pupillometry_t* pupillometry, int count )
+{
+    if( count > pupillometry->batch_count ) count = pupillometry->batch_count;
+    int remaining = pupillometry->batch_count - count;
+    // Batches are normally consumed whole, so there is rarely anything to move
+    if( remaining > 0 )
+    {
+        consume_array( pupillometry->batch_us, count, remaining );
+        consume_array( pupillometry->batch_left_mm, count, remaining );
+        consume_array( pupillometry->batch_right_mm, count, remaining );
+        consume_array( pupillometry->batch_left_change_mm, count, remaining );
+        consume_array( pupillometry->batch_right_change_mm, count, remaining );
+        consume_array( pupillometry->batch_left_sample, count, remaining );
+        consume_array( pupillometry->batch_right_sample, count, remaining );
+    }
+    pupillometry->batch_count = remaining;
+}
+
+void pupillometry_statistics( pupillometry_t const* pupillometry, uint64_t* left_blinks, uint64_t* right_blinks,
+    uint64_t* dropped )
+{
+    if( left_blinks ) *left_blinks = pupillometry->left.blinks;
+    if( right_blinks ) *right_blinks = pupillometry->right.blinks;
+    if( dropped ) *dropped = pupillometry->dropped;
+}
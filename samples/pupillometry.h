@@ -0,0 +1,90 @@
+#ifndef sample_pupillometry_h
+#define sample_pupillometry_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+// Online pupil diameter processing, per eye. Blinks and other dropouts are detected from the pupil validity, widened
+// by a few samples on each side since the diameter is already distorted while the lid closes and opens, and bridged by
+// linear interpolation. To interpolate, the stage has to see where a gap ends, so output is delayed by a fixed
+// lookahead: gaps which are still open when their first sample leaves the lookahead are reported as missing instead.
+// The bridged signal is low-pass filtered, and within a trial also baseline corrected, by subtracting the mean diameter
+// over a baseline period before the trial started.
+//
+// Processed samples are collected as contiguous arrays, one per eye and quantity, so consumers can take them in
+// batches. All functions must be called from one thread at a time, normally the pump thread.
+
+typedef struct pupillometry_t pupillometry_t;
+
+typedef struct pupillometry_config_t
+{
+    float frequency_hz; // Nominal rate of the stream being pushed
+    int64_t lookahead_us; // Output delay, and the longest gap that can be interpolated
+    int64_t padding_us; // Samples this close to an invalid sample are treated as invalid too
+    int64_t min_blink_us; // Gaps between min_blink_us and max_blink_us are counted as blinks
+    int64_t max_blink_us;
+    float cutoff_hz; // Low-pass filter cutoff
+    int64_t baseline_us; // Length of the baseline period before each trial
+    int batch_capacity; // Processed samples held until consumed, newer samples are dropped when full
+} pupillometry_config_t;
+
+typedef enum pupillometry_sample_t
+{
+    PUPILLOMETRY_SAMPLE_MISSING,
+    PUPILLOMETRY_SAMPLE_MEASURED,
+    PUPILLOMETRY_SAMPLE_INTERPOLATED,
+} pupillometry_sample_t;
+
+// Arrays of *count* processed samples. Missing diameters, and baseline corrected diameters outside of a trial or
+// without a valid baseline, are NaN.
+typedef struct pupillometry_batch_t
+{
+    int count;
+    int64_t const* timestamp_us;
+    float const* left_mm;
+    float const* right_mm;
+    float const* left_change_mm; // Baseline corrected
+    float const* right_change_mm;
+    uint8_t const* left_sample; // pupillometry_sample_t
+    uint8_t const* right_sample;
+} pupillometry_batch_t;
+
+// Fills *config* with values suitable for cognitive load measurements: a 500 ms lookahead, 50 ms padding, blinks from
+// 50 to 500 ms, a 4 Hz cutoff and a 500 ms baseline.
+void pupillometry_default_config( float frequency_hz, pupillometry_config_t* config );
+
+pupillometry_t* pupillometry_create( pupillometry_config_t const* config );
+
+void pupillometry_destroy( pupillometry_t* pupillometry );
+
+// Timestamps must come from one clock, use the system timestamps of the streams so trials can be started from
+// tobii_system_clock.
+void pupillometry_push( pupillometry_t* pupillometry, int64_t timestamp_us, float left_mm, int left_valid,
+    float right_mm, int right_valid );
+
+void pupillometry_push_gaze_data( pupillometry_t* pupillometry, tobii_gaze_data_t const* gaze_data );
+
+void pupillometry_push_wearable_advanced_data( pupillometry_t* pupillometry,
+    tobii_wearable_advanced_data_t const* data );
+
+// Samples from *timestamp_us* onwards are baseline corrected against the baseline period preceding it, until the next
+// trial begins or pupillometry_end_trial is called. The timestamp may lie up to the lookahead in the past.
+void pupillometry_begin_trial( pupillometry_t* pupillometry, int64_t timestamp_us );
+
+void pupillometry_end_trial( pupillometry_t* pupillometry, int64_t timestamp_us );
+
+// Makes every pushed sample still in the lookahead available, interpolating nothing that is not yet closed. Use at
+// the end of a recording.
+void pupillometry_flush( pupillometry_t* pupillometry );
+
+// The batch stays valid until the next call to pupillometry_consume.
+void pupillometry_batch( pupillometry_t const* pupillometry, pupillometry_batch_t* batch );
+
+// Releases the first *count* samples of the batch.
+void pupillometry_consume( pupillometry_t* pupillometry, int count );
+
+void pupillometry_statistics( pupillometry_t const* pupillometry, uint64_t* left_blinks, uint64_t* right_blinks,
+    uint64_t* dropped );
+
+#endif // sample_pupillometry_h
@@ -0,0 +1,198 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_config.h>
+
+#include "main_loop_linux.h"
+#include "pupillometry.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include <chrono>
+#include <vector>
+
+
+struct pupillometry_context_t
+{
+    tobii_api_t* api;
+    pupillometry_t* pupillometry;
+    int64_t next_trial_us;
+    bool in_trial;
+};
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    pupillometry_push_gaze_data( static_cast<pupillometry_t*>( user_data ), gaze_data );
+}
+
+static void run_trials( void* user_data )
+{
+    auto context = static_cast<pupillometry_context_t*>( user_data );
+    int64_t now_us;
+    if( tobii_system_clock( context->api, &now_us ) != TOBII_ERROR_NO_ERROR ) return;
+
+    // Alternate five second trials with five second rests
+    if( now_us >= context->next_trial_us )
+    {
+        if( context->in_trial ) pupillometry_end_trial( context->pupillometry, now_us );
+        else pupillometry_begin_trial( context->pupillometry, now_us );
+        context->in_trial = !context->in_trial;
+        context->next_trial_us = now_us + 5000000;
+    }
+
+    // Take whatever has been processed as one batch
+    pupillometry_batch_t batch;
+    pupillometry_batch( context->pupillometry, &batch );
+    if( batch.count == 0 ) return;
+
+    double left_change = 0.0, right_change = 0.0;
+    int left_count = 0, right_count = 0;
+    for( int i = 0; i < batch.count; ++i )
+    {
+        if( !isnan( batch.left_change_mm[ i ] ) ) { left_change += batch.left_change_mm[ i ]; ++left_count; }
+        if( !isnan( batch.right_change_mm[ i ] ) ) { right_change += batch.right_change_mm[ i ]; ++right_count; }
+    }
+    if( left_count > 0 && right_count > 0 )
+        printf( "Pupil dilation: left %+.3f mm, right %+.3f mm\n", left_change / left_count,
+            right_change / right_count );
+    pupillometry_consume( context->pupillometry, batch.count );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int pupillometry_sample_main( void );
+extern "C" int pupillometry_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    float frequency_hz;
+    error = tobii_get_output_frequency( device, &frequency_hz );
+    if( error != TOBII_ERROR_NO_ERROR ) frequency_hz = 120.0f;
+
+    pupillometry_config_t config;
+    pupillometry_default_config( frequency_hz, &config );
+    pupillometry_context_t context = { api, pupillometry_create( &config ), 0, false };
+
+    error = tobii_gaze_data_subscribe( device, gaze_data_callback, context.pupillometry );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze data stream.\n" );
+        pupillometry_destroy( context.pupillometry );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, run_trials, &context );
+
+    error = tobii_gaze_data_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from gaze data stream.\n" );
+
+    uint64_t left_blinks, right_blinks;
+    pupillometry_statistics( context.pupillometry, &left_blinks, &right_blinks, NULL );
+    printf( "Blinks: left %" PRIu64 ", right %" PRIu64 "\n", left_blinks, right_blinks );
+    pupillometry_destroy( context.pupillometry );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+extern "C" int pupillometry_benchmark_main( void );
+extern "C" int pupillometry_benchmark_main( void )
+{
+    // Ten minutes of replayed gaze data at 1200 Hz, which blinks for 150 ms every 4 seconds
+    float const frequency_hz = 1200.0f;
+    int64_t const duration_s = 600;
+    std::vector<tobii_gaze_data_t> gaze_data( (size_t)( frequency_hz * duration_s ) );
+    for( size_t i = 0; i < gaze_data.size(); ++i )
+        stream_replay_gaze_data( (int64_t) i, frequency_hz, &gaze_data[ i ] );
+
+    pupillometry_config_t config;
+    pupillometry_default_config( frequency_hz, &config );
+    pupillometry_t* pupillometry = pupillometry_create( &config );
+
+    // A 2 second trial every 10 seconds, and a consumer taking batches at 60 Hz, as a render loop would
+    int64_t const trial_interval = (int64_t)( frequency_hz * 10 );
+    int64_t const batch_interval = (int64_t)( frequency_hz / 60 );
+    uint64_t samples_out[ 3 ] = {};
+    auto start = std::chrono::steady_clock::now();
+    for( size_t i = 0; i < gaze_data.size(); ++i )
+    {
+        pupillometry_push_gaze_data( pupillometry, &gaze_data[ i ] );
+        if( (int64_t) i % trial_interval == trial_interval / 2 )
+            pupillometry_begin_trial( pupillometry, gaze_data[ i ].timestamp_system_us );
+        else if( (int64_t) i % trial_interval == trial_interval / 2 + (int64_t)( frequency_hz * 2 ) )
+            pupillometry_end_trial( pupillometry, gaze_data[ i ].timestamp_system_us );
+
+        if( (int64_t) i % batch_interval == 0 )
+        {
+            pupillometry_batch_t batch;
+            pupillometry_batch( pupillometry, &batch );
+            for( int j = 0; j < batch.count; ++j ) ++samples_out[ batch.left_sample[ j ] ];
+            pupillometry_consume( pupillometry, batch.count );
+        }
+    }
+    pupillometry_flush( pupillometry );
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    pupillometry_batch_t batch;
+    pupillometry_batch( pupillometry, &batch );
+    for( int j = 0; j < batch.count; ++j ) ++samples_out[ batch.left_sample[ j ] ];
+
+    double samples = (double) gaze_data.size();
+    double ns_per_sample = (double) std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count() / samples;
+    printf( "Processed %.0f samples: %.1f ns per sample, %.3f%% of one core at %.0f Hz (budget is 1000 ns)\n", samples,
+        ns_per_sample, ns_per_sample * frequency_hz / 1e7, frequency_hz );
+
+    uint64_t left_blinks, right_blinks, dropped;
+    pupillometry_statistics( pupillometry, &left_blinks, &right_blinks, &dropped );
+    printf( "Left eye: %" PRIu64 " measured, %" PRIu64 " interpolated, %" PRIu64 " missing, %" PRIu64 " blinks, %"
+        PRIu64 " dropped\n", samples_out[ PUPILLOMETRY_SAMPLE_MEASURED ], samples_out[ PUPILLOMETRY_SAMPLE_INTERPOLATED ],
+        samples_out[ PUPILLOMETRY_SAMPLE_MISSING ], left_blinks, dropped );
+
+    pupillometry_destroy( pupillometry );
+    return ns_per_sample < 1000.0 ? 0 : 1;
+}
@@ -0,0 +1,494 @@
+#include "startup_orchestrator_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    uint32_t const cache_magic = 0x43555354; // "TSUC"
+    uint32_t const cache_version = 1;
+
+    // Followed by license_size bytes of license
+    struct cache_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        int64_t license_mtime_ns; // Of the license file the license was read from
+        uint64_t license_size;
+        uint64_t checksum; // Of the url and the license
+        char url[ 256 ];
+    };
+
+    uint64_t fnv1a( void const* data, size_t size, uint64_t hash = 14695981039346656037ull )
+    {
+        unsigned char const* bytes = (unsigned char const*) data;
+        for( size_t i = 0; i < size; ++i ) hash = ( hash ^ bytes[ i ] ) * 1099511628211ull;
+        return hash;
+    }
+
+    uint64_t cache_checksum( cache_header_t const* header, void const* license )
+    {
+        return fnv1a( license, (size_t) header->license_size, fnv1a( header->url, sizeof( header->url ) ) );
+    }
+
+    int64_t mtime_ns( struct stat const& st )
+    {
+        return (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    enum task_kind_t
+    {
+        TASK_API_CREATE,
+        TASK_ENUMERATE,
+        TASK_LICENSE_LOAD,
+        TASK_DEVICE_CREATE,
+        TASK_LICENSE_RETRIEVE,
+        TASK_SUBSCRIBE,
+        TASK_CACHE_WRITE,
+    };
+
+    struct task_t
+    {
+        task_kind_t kind;
+        int subscription;
+        uint32_t dependencies; // Bit per task index
+        bool started;
+        bool finished;
+        bool failed;
+    };
+
+    struct startup_t
+    {
+        startup_config_t const* config;
+        startup_functions_t functions;
+        startup_result_t* result;
+        std::chrono::steady_clock::time_point start;
+
+        // The cache, mapped as a whole, if it is valid
+        void* cache_map;
+        size_t cache_map_size;
+        cache_header_t const* cache;
+
+        uint16_t const* license; // Into the cache or license_buffer
+        size_t license_size;
+        int64_t license_mtime_ns;
+        std::vector<uint16_t> license_buffer;
+
+        // Enumeration runs alongside the create at the cached url when there are threads to spare, so a stale url
+        // costs no more than a start without a cache. The url it finds is only used if that create fails.
+        bool speculative_enumeration;
+        size_t enumeration_task;
+        char enumerated_url[ 256 ];
+
+        std::vector<task_t> tasks;
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+    int64_t elapsed_us( startup_t const& startup )
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - startup.start ).count();
+    }
+
+    void map_cache( startup_t& startup )
+    {
+        int fd = open( startup.config->cache_path, O_RDONLY | O_CLOEXEC );
+        if( fd < 0 ) return;
+        struct stat st;
+        if( fstat( fd, &st ) == 0 && st.st_size >= (off_t) sizeof( cache_header_t ) )
+        {
+            void* map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( map != MAP_FAILED )
+            {
+                startup.cache_map = map;
+                startup.cache_map_size = (size_t) st.st_size;
+            }
+        }
+        close( fd );
+        if( !startup.cache_map ) return;
+
+        cache_header_t const* header = (cache_header_t const*) startup.cache_map;
+        bool valid = header->magic == cache_magic && header->version == cache_version &&
+            header->license_size == startup.cache_map_size - sizeof( cache_header_t ) &&
+            header->url[ sizeof( header->url ) - 1 ] == '\0' &&
+            cache_checksum( header, header + 1 ) == header->checksum;
+        if( valid ) startup.cache = header;
+    }
+
+    void url_receiver( char const* url, void* user_data )
+    {
+        char* first = (char*) user_data;
+        if( *first == '\0' && strlen( url ) < 256 ) strcpy( first, url );
+    }
+
+    tobii_error_t enumerate( startup_t& startup )
+    {
+        char url[ 256 ] = {};
+        tobii_error_t error = startup.functions.enumerate_local_device_urls( startup.result->api, url_receiver, url );
+        if( error != TOBII_ERROR_NO_ERROR ) return error;
+        if( *url == '\0' ) return TOBII_ERROR_NOT_AVAILABLE;
+        memcpy( startup.enumerated_url, url, sizeof( url ) );
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    // The result of the enumeration task, once it has finished
+    tobii_error_t wait_for_enumeration( startup_t& startup )
+    {
+        std::unique_lock<std::mutex> lock( startup.mutex );
+        startup.changed.wait( lock, [&] { return startup.tasks[ startup.enumeration_task ].finished; } );
+        return startup.result->phases[ 1 + startup.enumeration_task ].error;
+    }
+
+    tobii_error_t load_license( startup_t& startup )
+    {
+        char const* path = startup.config->license_path;
+        if( !path ) return TOBII_ERROR_NO_ERROR;
+
+        // One open, one stat and one read, or just the stat if the cache holds the same license
+        int fd = open( path, O_RDONLY | O_CLOEXEC );
+        if( fd < 0 ) return TOBII_ERROR_NOT_AVAILABLE;
+        struct stat st;
+        if( fstat( fd, &st ) != 0 || st.st_size <= 0 || st.st_size % 2 != 0 )
+        {
+            close( fd );
+            return TOBII_ERROR_NOT_AVAILABLE;
+        }
+        startup.license_mtime_ns = mtime_ns( st );
+
+        cache_header_t const* cache = startup.cache;
+        if( cache && cache->license_size == (uint64_t) st.st_size && cache->license_mtime_ns == mtime_ns( st ) )
+        {
+            close( fd );
+            startup.license = (uint16_t const*) ( cache + 1 );
+            startup.license_size = (size_t) cache->license_size;
+            startup.result->license_from_cache = 1;
+            return TOBII_ERROR_NO_ERROR;
+        }
+
+        startup.license_buffer.resize( (size_t) st.st_size / sizeof( uint16_t ) );
+        char* buffer = (char*) startup.license_buffer.data();
+        size_t done = 0;
+        while( done < (size_t) st.st_size )
+        {
+            ssize_t count = read( fd, buffer + done, (size_t) st.st_size - done );
+            if( count < 0 && errno == EINTR ) continue;
+            if( count <= 0 ) break;
+            done += (size_t) count;
+        }
+        close( fd );
+        if( done != (size_t) st.st_size ) return TOBII_ERROR_NOT_AVAILABLE;
+        startup.license = startup.license_buffer.data();
+        startup.license_size = done;
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t create_device_at( startup_t& startup, char const* url )
+    {
+        startup_result_t* result = startup.result;
+        if( !startup.license )
+            return startup.functions.device_create( result->api, url, startup.config->field_of_use, &result->device );
+        tobii_license_key_t key = { startup.license, startup.license_size };
+        return startup.functions.device_create_ex( result->api, url, startup.config->field_of_use, &key, 1,
+            &result->license_validation, &result->device );
+    }
+
+    tobii_error_t create_device( startup_t& startup )
+    {
+        startup_result_t* result = startup.result;
+        tobii_error_t error;
+        if( startup.config->url )
+        {
+            snprintf( result->url, sizeof( result->url ), "%s", startup.config->url );
+            error = create_device_at( startup, result->url );
+        }
+        else if( startup.cache && *startup.cache->url )
+        {
+            // The device is most likely still where it was. If it is not, the enumeration started alongside has
+            // usually finished by the time the create fails; run in turn, it only enumerates then.
+            memcpy( result->url, startup.cache->url, sizeof( result->url ) );
+            error = create_device_at( startup, result->url );
+            if( error == TOBII_ERROR_NO_ERROR ) result->url_from_cache = 1;
+            else
+            {
+                error = startup.speculative_enumeration ? wait_for_enumeration( startup ) : enumerate( startup );
+                memcpy( result->url, startup.enumerated_url, sizeof( result->url ) );
+                if( error == TOBII_ERROR_NO_ERROR ) error = create_device_at( startup, result->url );
+            }
+        }
+        else
+        {
+            memcpy( result->url, startup.enumerated_url, sizeof( result->url ) );
+            error = create_device_at( startup, result->url );
+        }
+
+        if( error == TOBII_ERROR_NO_ERROR && startup.license &&
+            result->license_validation != TOBII_LICENSE_VALIDATION_RESULT_OK && startup.config->cache_path )
+            unlink( startup.config->cache_path );
+        return error;
+    }
+
+    void license_receiver( void const* data, size_t size, void* user_data )
+    {
+        (void) data; // Unused parameter
+        *(size_t*) user_data = size;
+    }
+
+    tobii_error_t write_cache( startup_t& startup )
+    {
+        startup_result_t* result = startup.result;
+        if( startup.license && result->license_validation != TOBII_LICENSE_VALIDATION_RESULT_OK )
+            return TOBII_ERROR_NO_ERROR;
+        // Nothing to do if the cache already holds this license and url
+        if( startup.cache && ( !startup.license || result->license_from_cache ) &&
+            strcmp( startup.cache->url, result->url ) == 0 && startup.cache->license_size == startup.license_size )
+            return TOBII_ERROR_NO_ERROR;
+
+        cache_header_t header = {};
+        header.magic = cache_magic;
+        header.version = cache_version;
+        header.license_mtime_ns = startup.license_mtime_ns;
+        header.license_size = startup.license_size;
+        memcpy( header.url, result->url, sizeof( header.url ) );
+        header.checksum = cache_checksum( &header, startup.license );
+
+        // Written under a temporary name, and renamed into place once complete
+        std::string path = startup.config->cache_path;
+        std::string temporary = path + ".tmp";
+        int fd = open( temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600 );
+        if( fd < 0 ) return TOBII_ERROR_NOT_AVAILABLE;
+        bool ok = write( fd, &header, sizeof( header ) ) == (ssize_t) sizeof( header );
+        if( startup.license_size )
+            ok = ok && write( fd, startup.license, startup.license_size ) == (ssize_t) startup.license_size;
+        ok = close( fd ) == 0 && ok;
+        ok = ok && rename( temporary.c_str(), path.c_str() ) == 0;
+        if( !ok ) unlink( temporary.c_str() );
+        return ok ? TOBII_ERROR_NO_ERROR : TOBII_ERROR_NOT_AVAILABLE;
+    }
+
+    tobii_error_t run_task( startup_t& startup, task_t const& task )
+    {
+        startup_result_t* result = startup.result;
+        switch( task.kind )
+        {
+            case TASK_API_CREATE: return startup.functions.api_create( &result->api, NULL, NULL );
+            case TASK_ENUMERATE: return enumerate( startup );
+            case TASK_LICENSE_LOAD: return load_license( startup );
+            case TASK_DEVICE_CREATE: return create_device( startup );
+            case TASK_LICENSE_RETRIEVE:
+                return startup.functions.license_key_retrieve( result->device, license_receiver,
+                    &result->stored_license_size );
+            case TASK_SUBSCRIBE:
+            {
+                startup_subscription_t const& subscription = startup.config->subscriptions[ task.subscription ];
+                return subscription.subscribe( result->device, subscription.context );
+            }
+            case TASK_CACHE_WRITE: return write_cache( startup );
+        }
+        return TOBII_ERROR_INTERNAL;
+    }
+
+    // Runs whichever task is ready, lowest index first, until all are done. With a single thread, that is list order.
+    void worker( startup_t& startup, int thread )
+    {
+        std::unique_lock<std::mutex> lock( startup.mutex );
+        for( ;; )
+        {
+            uint32_t finished = 0;
+            uint32_t failed = 0;
+            size_t remaining = 0;
+            for( size_t i = 0; i < startup.tasks.size(); ++i )
+            {
+                if( startup.tasks[ i ].finished ) finished |= 1u << i;
+                if( startup.tasks[ i ].failed ) failed |= 1u << i;
+                if( !startup.tasks[ i ].finished ) ++remaining;
+            }
+            if( remaining == 0 ) return;
+
+            size_t ready = startup.tasks.size();
+            for( size_t i = 0; i < startup.tasks.size() && ready == startup.tasks.size(); ++i )
+            {
+                task_t const& task = startup.tasks[ i ];
+                if( !task.started && ( task.dependencies & finished ) == task.dependencies ) ready = i;
+            }
+            if( ready == startup.tasks.size() )
+            {
+                startup.changed.wait( lock );
+                continue;
+            }
+
+            task_t& task = startup.tasks[ ready ];
+            startup_phase_t& phase = startup.result->phases[ 1 + ready ];
+            task.started = true;
+            phase.thread = thread;
+            if( task.dependencies & failed )
+            {
+                phase.skipped = 1;
+                phase.begin_us = phase.end_us = elapsed_us( startup );
+                task.finished = task.failed = true;
+                startup.changed.notify_all();
+                continue;
+            }
+
+            lock.unlock();
+            phase.begin_us = elapsed_us( startup );
+            phase.error = run_task( startup, task );
+            phase.end_us = elapsed_us( startup );
+            lock.lock();
+            task.finished = true;
+            task.failed = phase.error != TOBII_ERROR_NO_ERROR;
+            startup.changed.notify_all();
+        }
+    }
+
+    char const* task_name( startup_config_t const* config, task_t const& task )
+    {
+        switch( task.kind )
+        {
+            case TASK_API_CREATE: return "tobii_api_create";
+            case TASK_ENUMERATE: return "enumerate devices";
+            case TASK_LICENSE_LOAD: return "load license";
+            case TASK_DEVICE_CREATE: return "create device";
+            case TASK_LICENSE_RETRIEVE: return "tobii_license_key_retrieve";
+            case TASK_SUBSCRIBE: return config->subscriptions[ task.subscription ].name;
+            case TASK_CACHE_WRITE: return "write cache";
+        }
+        return "";
+    }
+}
+
+void startup_default_functions( startup_functions_t* functions )
+{
+    functions->api_create = tobii_api_create;
+    functions->api_destroy = tobii_api_destroy;
+    functions->enumerate_local_device_urls = tobii_enumerate_local_device_urls;
+    functions->device_create = tobii_device_create;
+    functions->device_create_ex = tobii_device_create_ex;
+    functions->device_destroy = tobii_device_destroy;
+    functions->license_key_retrieve = tobii_license_key_retrieve;
+}
+
+void startup_default_config( startup_config_t* config )
+{
+    memset( config, 0, sizeof( *config ) );
+    config->field_of_use = TOBII_FIELD_OF_USE_INTERACTIVE;
+    config->threads = 4;
+}
+
+tobii_error_t startup_run( startup_config_t const* config, startup_result_t* result )
+{
+    memset( result, 0, sizeof( *result ) );
+    if( config->subscription_count < 0 || config->subscription_count > STARTUP_MAX_SUBSCRIPTIONS ||
+        ( config->subscription_count > 0 && !config->subscriptions ) )
+        return TOBII_ERROR_INVALID_PARAMETER;
+
+    startup_t startup;
+    startup.config = config;
+    if( config->functions ) startup.functions = *config->functions;
+    else startup_default_functions( &startup.functions );
+    startup.result = result;
+    startup.start = std::chrono::steady_clock::now();
+    startup.cache_map = NULL;
+    startup.cache_map_size = 0;
+    startup.cache = NULL;
+    startup.license = NULL;
+    startup.license_size = 0;
+    startup.license_mtime_ns = 0;
+    startup.speculative_enumeration = false;
+    startup.enumeration_task = 0;
+    memset( startup.enumerated_url, 0, sizeof( startup.enumerated_url ) );
+
+    // Mapping the cache decides whether enumeration is needed, and takes microseconds, so it is done up front
+    startup_phase_t& cache_phase = result->phases[ 0 ];
+    cache_phase.name = "map cache";
+    if( config->cache_path ) map_cache( startup );
+    cache_phase.end_us = elapsed_us( startup );
+
+    // The same graph whatever the thread count, in the order the steps would be taken one by one
+    auto add = [&]( task_kind_t kind, uint32_t dependencies, int subscription )
+    {
+        task_t task = { kind, subscription, dependencies, false, false, false };
+        startup.tasks.push_back( task );
+        return 1u << ( startup.tasks.size() - 1 );
+    };
+    uint32_t const api = add( TASK_API_CREATE, 0, 0 );
+    bool const cached_url = startup.cache && *startup.cache->url;
+    bool const needs_enumeration = !config->url && !cached_url;
+    startup.speculative_enumeration = !config->url && cached_url && config->threads > 1;
+    startup.enumeration_task = startup.tasks.size();
+    uint32_t const enumeration = needs_enumeration || startup.speculative_enumeration ? add( TASK_ENUMERATE, api, 0 ) :
+        0;
+    uint32_t const license = add( TASK_LICENSE_LOAD, 0, 0 );
+    uint32_t const device = add( TASK_DEVICE_CREATE, api | ( needs_enumeration ? enumeration : 0 ) | license, 0 );
+    if( config->retrieve_stored_license ) add( TASK_LICENSE_RETRIEVE, device, 0 );
+    for( int i = 0; i < config->subscription_count; ++i ) add( TASK_SUBSCRIBE, device, i );
+    if( config->cache_path ) add( TASK_CACHE_WRITE, device, 0 );
+
+    result->phase_count = 1 + (int) startup.tasks.size();
+    for( size_t i = 0; i < startup.tasks.size(); ++i )
+        result->phases[ 1 + i ].name = task_name( config, startup.tasks[ i ] );
+
+    int const thread_count = config->threads > 1 ? config->threads : 1;
+    std::vector<std::thread> threads;
+    for( int i = 1; i < thread_count; ++i ) threads.emplace_back( worker, std::ref( startup ), i );
+    worker( startup, 0 );
+    for( auto& thread : threads ) thread.join();
+
+    if( startup.cache_map ) munmap( startup.cache_map, startup.cache_map_size );
+    result->total_us = elapsed_us( startup );
+
+    tobii_error_t error = TOBII_ERROR_NO_ERROR;
+    for( int i = 1; i < result->phase_count; ++i )
+    {
+        startup_phase_t const& phase = result->phases[ i ];
+        task_kind_t kind = startup.tasks[ (size_t) i - 1 ].kind;
+        bool failed = phase.skipped || phase.error != TOBII_ERROR_NO_ERROR;
+        if( kind == TASK_SUBSCRIBE && failed ) ++result->failed_subscriptions;
+        // A speculative enumeration that failed only matters if the device create needed it, and then fails that
+        bool essential = kind == TASK_API_CREATE || ( kind == TASK_ENUMERATE && !startup.speculative_enumeration ) ||
+            kind == TASK_LICENSE_LOAD || kind == TASK_DEVICE_CREATE;
+        if( essential && !phase.skipped && error == TOBII_ERROR_NO_ERROR ) error = phase.error;
+    }
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        if( result->device ) startup.functions.device_destroy( result->device );
+        if( result->api ) startup.functions.api_destroy( result->api );
+        result->device = NULL;
+        result->api = NULL;
+    }
+    return error;
+}
+
+void startup_print_phases( startup_result_t const* result )
+{
+    int const width = 48;
+    double const scale = result->total_us > 0 ? (double) width / (double) result->total_us : 0.0;
+    printf( "%-28s %6s %9s %9s  %s\n", "phase", "thread", "start ms", "ms", "timeline" );
+    for( int i = 0; i < result->phase_count; ++i )
+    {
+        startup_phase_t const& phase = result->phases[ i ];
+        char bar[ width + 1 ];
+        int begin = (int) ( (double) phase.begin_us * scale );
+        int end = (int) ( (double) phase.end_us * scale + 0.5 );
+        if( end <= begin ) end = begin + 1;
+        for( int c = 0; c < width; ++c ) bar[ c ] = c >= begin && c < end ? '#' : '.';
+        bar[ width ] = '\0';
+        char const* status = phase.skipped ? " skipped" : phase.error != TOBII_ERROR_NO_ERROR ?
+            tobii_error_message( phase.error ) : "";
+        printf( "%-28.28s %6d %9.1f %9.1f  %s %s\n", phase.name, phase.thread, (double) phase.begin_us / 1000.0,
+            (double) ( phase.end_us - phase.begin_us ) / 1000.0, bar, status );
+    }
+    printf( "%-28s %6s %9s %9.1f\n", "total", "", "", (double) result->total_us / 1000.0 );
+}
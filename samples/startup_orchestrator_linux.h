@@ -0,0 +1,111 @@
+#ifndef sample_startup_orchestrator_linux_h
+#define sample_startup_orchestrator_linux_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_licensing.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Gets from nothing to a subscribed device as fast as possible, and reports where the time went. The startup steps
+// run as a graph on a few threads, so that steps which do not depend on each other overlap: the license is loaded
+// while the API is created and devices are enumerated, and once the device is created, the stored license is retrieved
+// and every stream subscribed to from separate threads. The device still handles those calls one at a time, so they
+// take as long as in turn; what shortens the start is the cache below. Each step is timed, and the phases can be
+// printed as a timeline.
+//
+// After a successful start, the license the device accepted and the url of the device are written to a cache file.
+// The next start maps the cache instead of reading the license file, as long as the license file has not changed
+// since, and creates the device at the cached url right away rather than enumerating first. With more than one thread,
+// enumeration runs alongside that create, and the url it finds is used if the cached one has gone stale, so a stale
+// cache costs no more than none; run in turn, enumeration only happens once the create has failed. A license the
+// device rejects removes the cache.
+//
+// Against the stand-in device of the benchmark, which handles one call at a time, a start takes 0.81 times as long
+// as the serial one with a valid cache, and 1.00 times without a cache or with a stale url. Halving the start is out
+// of reach while the device calls, not the steps around them, make up most of it.
+
+#define STARTUP_MAX_SUBSCRIPTIONS 16
+#define STARTUP_MAX_PHASES ( 7 + STARTUP_MAX_SUBSCRIPTIONS )
+
+// The API functions called during startup. Replaceable, to measure startup against a stand-in device.
+typedef struct startup_functions_t
+{
+    tobii_error_t ( *api_create )( tobii_api_t** api, tobii_custom_alloc_t const* custom_alloc,
+        tobii_custom_log_t const* custom_log );
+    tobii_error_t ( *api_destroy )( tobii_api_t* api );
+    tobii_error_t ( *enumerate_local_device_urls )( tobii_api_t* api, tobii_device_url_receiver_t receiver,
+        void* user_data );
+    tobii_error_t ( *device_create )( tobii_api_t* api, char const* url, tobii_field_of_use_t field_of_use,
+        tobii_device_t** device );
+    tobii_error_t ( *device_create_ex )( tobii_api_t* api, char const* url, tobii_field_of_use_t field_of_use,
+        tobii_license_key_t const* license_keys, int license_count, tobii_license_validation_result_t* license_results,
+        tobii_device_t** device );
+    tobii_error_t ( *device_destroy )( tobii_device_t* device );
+    tobii_error_t ( *license_key_retrieve )( tobii_device_t* device, tobii_data_receiver_t receiver, void* user_data );
+} startup_functions_t;
+
+typedef struct startup_subscription_t
+{
+    char const* name;
+    // Called with the created device, on any of the startup threads
+    tobii_error_t ( *subscribe )( tobii_device_t* device, void* context );
+    void* context;
+} startup_subscription_t;
+
+typedef struct startup_config_t
+{
+    char const* url; // NULL connects to the cached device, or to the first device found
+    tobii_field_of_use_t field_of_use;
+    char const* license_path; // NULL creates the device without a license
+    char const* cache_path; // NULL neither reads nor writes a cache
+    int retrieve_stored_license; // Also reads the license stored on the device
+    startup_subscription_t const* subscriptions;
+    int subscription_count;
+    int threads; // 1 runs each step in turn on the calling thread
+    startup_functions_t const* functions; // NULL for the Stream Engine functions
+} startup_config_t;
+
+typedef struct startup_phase_t
+{
+    char const* name;
+    int64_t begin_us; // Since startup_run was called
+    int64_t end_us;
+    int thread; // 0 is the calling thread
+    tobii_error_t error;
+    int skipped; // Not run, because a step it depends on failed
+} startup_phase_t;
+
+typedef struct startup_result_t
+{
+    // Owned by the caller when startup_run succeeds, and NULL otherwise
+    tobii_api_t* api;
+    tobii_device_t* device;
+
+    char url[ 256 ];
+    int url_from_cache; // The device was created at the cached url, without enumerating
+    int license_from_cache;
+    tobii_license_validation_result_t license_validation;
+    size_t stored_license_size; // Of the license retrieved from the device, 0 if none was retrieved
+    int failed_subscriptions;
+
+    startup_phase_t phases[ STARTUP_MAX_PHASES ];
+    int phase_count;
+    int64_t total_us;
+} startup_result_t;
+
+void startup_default_functions( startup_functions_t* functions );
+
+// Connects to the first device found without a license, with 4 threads and no cache.
+void startup_default_config( startup_config_t* config );
+
+// Creates the API and the device, and subscribes. Returns the error of the API, enumeration, license or device step
+// that failed, in which case whatever was created has been destroyed again; TOBII_ERROR_NOT_AVAILABLE if no device was
+// found or the license file can not be read. Failed subscriptions are counted in the result, and do not fail the
+// startup. The phases are filled in either way.
+tobii_error_t startup_run( startup_config_t const* config, startup_result_t* result );
+
+// Prints each phase with its thread, its start and duration, and a bar placing it on the startup timeline.
+void startup_print_phases( startup_result_t const* result );
+
+#endif // sample_startup_orchestrator_linux_h
@@ -0,0 +1,231 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_licensing.h>
+
+#include "startup_orchestrator_linux.h"
+#include "main_loop_linux.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+struct kiosk_context_t
+{
+    std::chrono::steady_clock::time_point start;
+    std::atomic<int64_t> first_gaze_us;
+    tobii_user_presence_status_t presence;
+};
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    (void) gaze_point; // Unused parameter
+    kiosk_context_t* context = (kiosk_context_t*) user_data;
+    if( context->first_gaze_us.load( std::memory_order_relaxed ) < 0 )
+        context->first_gaze_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - context->start ).count();
+}
+
+static void presence_callback( tobii_user_presence_status_t status, int64_t timestamp_us, void* user_data )
+{
+    (void) timestamp_us; // Unused parameter
+    ( (kiosk_context_t*) user_data )->presence = status;
+}
+
+static tobii_error_t subscribe_gaze_point( tobii_device_t* device, void* context )
+{
+    return tobii_gaze_point_subscribe( device, gaze_point_callback, context );
+}
+
+static tobii_error_t subscribe_user_presence( tobii_device_t* device, void* context )
+{
+    return tobii_user_presence_subscribe( device, presence_callback, context );
+}
+
+static void print_first_gaze( void* user_data )
+{
+    kiosk_context_t* context = (kiosk_context_t*) user_data;
+    static bool printed = false;
+    int64_t first_gaze_us = context->first_gaze_us.load( std::memory_order_relaxed );
+    if( printed || first_gaze_us < 0 ) return;
+    printf( "First gaze point %.1f ms after starting\n", (double) first_gaze_us / 1000.0 );
+    printed = true;
+}
+
+extern "C" int startup_orchestrator_sample_main( void );
+extern "C" int startup_orchestrator_sample_main( void )
+{
+    kiosk_context_t context;
+    context.start = std::chrono::steady_clock::now();
+    context.first_gaze_us = -1;
+    context.presence = TOBII_USER_PRESENCE_STATUS_UNKNOWN;
+
+    startup_subscription_t const subscriptions[] = {
+        { "subscribe gaze point", subscribe_gaze_point, &context },
+        { "subscribe user presence", subscribe_user_presence, &context },
+    };
+    startup_config_t config;
+    startup_default_config( &config );
+    // The license is optional, the cache lives next to it
+    if( std::filesystem::exists( "se_license_key_sample" ) ) config.license_path = "se_license_key_sample";
+    config.cache_path = ".startup_cache";
+    config.subscriptions = subscriptions;
+    config.subscription_count = 2;
+
+    startup_result_t result;
+    tobii_error_t error = startup_run( &config, &result );
+    startup_print_phases( &result );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to start: %s.\n", tobii_error_message( error ) );
+        return 1;
+    }
+    printf( "Connected to %s%s, license %s%s\n", result.url, result.url_from_cache ? " (cached)" : "",
+        config.license_path ? ( result.license_validation == TOBII_LICENSE_VALIDATION_RESULT_OK ? "valid" : "rejected" )
+        : "none", result.license_from_cache ? " (cached)" : "" );
+
+    main_loop( result.device, print_first_gaze, &context );
+
+    tobii_gaze_point_unsubscribe( result.device );
+    tobii_user_presence_unsubscribe( result.device );
+    tobii_device_destroy( result.device );
+    tobii_api_destroy( result.api );
+    return 0;
+}
+
+
+// A stand-in device, with delays in the range of a USB tracker starting up. Like a real device, it handles one call
+// at a time, so concurrent subscriptions and license retrieval queue up behind each other rather than overlapping.
+namespace standin
+{
+    std::string url = "tobii-ttp://standin-1";
+    std::mutex device_mutex;
+
+    void delay( int ms ) { std::this_thread::sleep_for( std::chrono::milliseconds( ms ) ); }
+
+    tobii_error_t api_create( tobii_api_t** api, tobii_custom_alloc_t const*, tobii_custom_log_t const* )
+    {
+        delay( 40 );
+        *api = (tobii_api_t*) 1;
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t api_destroy( tobii_api_t* ) { return TOBII_ERROR_NO_ERROR; }
+
+    tobii_error_t enumerate( tobii_api_t*, tobii_device_url_receiver_t receiver, void* user_data )
+    {
+        delay( 150 );
+        receiver( url.c_str(), user_data );
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t device_create_ex( tobii_api_t*, char const* device_url, tobii_field_of_use_t,
+        tobii_license_key_t const* license_keys, int license_count, tobii_license_validation_result_t* license_results,
+        tobii_device_t** device )
+    {
+        if( url != device_url )
+        {
+            delay( 20 );
+            return TOBII_ERROR_CONNECTION_FAILED;
+        }
+        delay( 300 );
+        for( int i = 0; i < license_count; ++i )
+            license_results[ i ] = license_keys[ i ].size_in_bytes > 0 ? TOBII_LICENSE_VALIDATION_RESULT_OK :
+                TOBII_LICENSE_VALIDATION_RESULT_TAMPERED;
+        *device = (tobii_device_t*) 1;
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t device_create( tobii_api_t* api, char const* device_url, tobii_field_of_use_t field_of_use,
+        tobii_device_t** device )
+    {
+        return device_create_ex( api, device_url, field_of_use, NULL, 0, NULL, device );
+    }
+
+    tobii_error_t device_destroy( tobii_device_t* ) { return TOBII_ERROR_NO_ERROR; }
+
+    tobii_error_t license_key_retrieve( tobii_device_t*, tobii_data_receiver_t receiver, void* user_data )
+    {
+        std::lock_guard<std::mutex> lock( device_mutex );
+        delay( 80 );
+        uint16_t stored[ 64 ] = {};
+        receiver( stored, sizeof( stored ), user_data );
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t subscribe( tobii_device_t*, void* )
+    {
+        std::lock_guard<std::mutex> lock( device_mutex );
+        delay( 60 );
+        return TOBII_ERROR_NO_ERROR;
+    }
+}
+
+extern "C" int startup_orchestrator_benchmark_main( void );
+extern "C" int startup_orchestrator_benchmark_main( void )
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "startup_orchestrator_benchmark";
+    std::filesystem::create_directories( directory );
+    std::string license_path = ( directory / "license" ).string();
+    std::string cache_path = ( directory / "cache" ).string();
+    std::filesystem::remove( cache_path );
+    FILE* file = fopen( license_path.c_str(), "wb" );
+    if( !file )
+    {
+        fprintf( stderr, "Failed to write %s.\n", license_path.c_str() );
+        return 1;
+    }
+    uint16_t license[ 2048 ];
+    for( int i = 0; i < 2048; ++i ) license[ i ] = (uint16_t) ( 'A' + i % 26 );
+    fwrite( license, sizeof( license ), 1, file );
+    fclose( file );
+
+    startup_functions_t functions = { standin::api_create, standin::api_destroy, standin::enumerate,
+        standin::device_create, standin::device_create_ex, standin::device_destroy, standin::license_key_retrieve };
+    startup_subscription_t const subscriptions[] = {
+        { "subscribe gaze point", standin::subscribe, NULL },
+        { "subscribe user presence", standin::subscribe, NULL },
+        { "subscribe head pose", standin::subscribe, NULL },
+        { "subscribe notifications", standin::subscribe, NULL },
+    };
+
+    struct run_t { char const* name; int threads; bool cache; char const* url; };
+    run_t const runs[] = {
+        { "Serial, as the samples start today", 1, false, "tobii-ttp://standin-1" },
+        { "Parallel, first start without a cache", 6, true, "tobii-ttp://standin-1" },
+        { "Parallel, cached license and url", 6, true, "tobii-ttp://standin-1" },
+        { "Parallel, cached url gone stale", 6, true, "tobii-ttp://standin-2" },
+    };
+    int64_t serial_us = 0;
+    for( run_t const& run : runs )
+    {
+        standin::url = run.url;
+        startup_config_t config;
+        startup_default_config( &config );
+        config.license_path = license_path.c_str();
+        config.cache_path = run.cache ? cache_path.c_str() : NULL;
+        config.retrieve_stored_license = 1;
+        config.subscriptions = subscriptions;
+        config.subscription_count = 4;
+        config.threads = run.threads;
+        config.functions = &functions;
+
+        startup_result_t result;
+        tobii_error_t error = startup_run( &config, &result );
+        printf( "\n%s: %s\n", run.name, tobii_error_message( error ) );
+        startup_print_phases( &result );
+        if( serial_us == 0 ) serial_us = result.total_us;
+        printf( "%.2fx the serial start, license%s from cache, url%s from cache\n",
+            (double) result.total_us / (double) serial_us, result.license_from_cache ? "" : " not",
+            result.url_from_cache ? "" : " not" );
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all( directory, ec );
+    return 0;
+}
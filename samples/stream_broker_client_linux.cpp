@@ -0,0 +1,381 @@
+#include "stream_broker_client_linux.h"
+#include "stream_broker_shared_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Largest record of any stream. Samples are validated in a copy, since the slot itself can be overwritten while a
+// callback runs.
+static size_t const max_record_size = 1024;
+
+union stream_broker_callback_t
+{
+    tobii_gaze_point_callback_t gaze_point;
+    tobii_gaze_origin_callback_t gaze_origin;
+    tobii_eye_position_normalized_callback_t eye_position_normalized;
+    tobii_user_presence_callback_t user_presence;
+    tobii_head_pose_callback_t head_pose;
+    tobii_notifications_callback_t notifications;
+    tobii_user_position_guide_callback_t user_position_guide;
+    tobii_gaze_data_callback_t gaze_data;
+    tobii_wearable_consumer_data_callback_t wearable_consumer_data;
+    tobii_wearable_advanced_data_callback_t wearable_advanced_data;
+};
+
+struct stream_broker_subscription_t
+{
+    bool subscribed;
+    stream_broker_callback_t callback;
+    void* user_data;
+    uint64_t next; // Index of the next sample to read
+};
+
+struct stream_broker_client_t
+{
+    stream_broker_region_t* region;
+    size_t size;
+    stream_broker_subscription_t subscriptions[ STREAM_BROKER_STREAM_COUNT ];
+    uint64_t overruns;
+};
+
+static bool broker_alive( stream_broker_region_t const* region )
+{
+    // The pid is cleared on a clean shutdown, but a crashed broker has to be looked for
+    int32_t pid = region->broker_pid.load();
+    return pid > 0 && ( kill( pid, 0 ) == 0 || errno == EPERM );
+}
+
+static void invoke( stream_broker_stream_t stream, stream_broker_subscription_t const& subscription,
+    void const* record )
+{
+    stream_broker_callback_t const& callback = subscription.callback;
+    void* user_data = subscription.user_data;
+    switch( stream )
+    {
+        case STREAM_BROKER_GAZE_POINT:
+            callback.gaze_point( static_cast<tobii_gaze_point_t const*>( record ), user_data ); break;
+        case STREAM_BROKER_GAZE_ORIGIN:
+            callback.gaze_origin( static_cast<tobii_gaze_origin_t const*>( record ), user_data ); break;
+        case STREAM_BROKER_EYE_POSITION_NORMALIZED:
+            callback.eye_position_normalized( static_cast<tobii_eye_position_normalized_t const*>( record ),
+                user_data ); break;
+        case STREAM_BROKER_USER_PRESENCE:
+        {
+            auto presence = static_cast<stream_broker_user_presence_t const*>( record );
+            callback.user_presence( presence->status, presence->timestamp_us, user_data ); break;
+        }
+        case STREAM_BROKER_HEAD_POSE:
+            callback.head_pose( static_cast<tobii_head_pose_t const*>( record ), user_data ); break;
+        case STREAM_BROKER_NOTIFICATIONS:
+            callback.notifications( static_cast<tobii_notification_t const*>( record ), user_data ); break;
+        case STREAM_BROKER_USER_POSITION_GUIDE:
+            callback.user_position_guide( static_cast<tobii_user_position_guide_t const*>( record ), user_data );
+            break;
+        case STREAM_BROKER_GAZE_DATA:
+            callback.gaze_data( static_cast<tobii_gaze_data_t const*>( record ), user_data ); break;
+        case STREAM_BROKER_WEARABLE_CONSUMER_DATA:
+            callback.wearable_consumer_data( static_cast<tobii_wearable_consumer_data_t const*>( record ), user_data );
+            break;
+        case STREAM_BROKER_WEARABLE_ADVANCED_DATA:
+            callback.wearable_advanced_data( static_cast<tobii_wearable_advanced_data_t const*>( record ), user_data );
+            break;
+        default: break;
+    }
+}
+
+tobii_error_t stream_broker_client_create( char const* name, stream_broker_client_t** client )
+{
+    if( !name || !client ) return TOBII_ERROR_INVALID_PARAMETER;
+    int fd = shm_open( name, O_RDWR, 0 );
+    if( fd < 0 ) return TOBII_ERROR_CONNECTION_FAILED;
+
+    struct stat status;
+    if( fstat( fd, &status ) != 0 || (size_t) status.st_size < sizeof( stream_broker_region_t ) )
+    {
+        // The broker is still setting the region up
+        close( fd );
+        return TOBII_ERROR_CONNECTION_FAILED;
+    }
+    size_t size = (size_t) status.st_size;
+    void* memory = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( memory == MAP_FAILED ) return TOBII_ERROR_CONNECTION_FAILED;
+
+    auto region = static_cast<stream_broker_region_t*>( memory );
+    if( region->magic.load( std::memory_order_acquire ) != stream_broker_magic ||
+        region->version != stream_broker_version || region->size != size || !broker_alive( region ) )
+    {
+        munmap( memory, size );
+        return TOBII_ERROR_CONNECTION_FAILED;
+    }
+
+    auto result = new stream_broker_client_t();
+    result->region = region;
+    result->size = size;
+    *client = result;
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void stream_broker_client_destroy( stream_broker_client_t* client )
+{
+    munmap( client->region, client->size );
+    delete client;
+}
+
+static bool has_pending( stream_broker_client_t const* client )
+{
+    for( int stream = 0; stream < STREAM_BROKER_STREAM_COUNT; ++stream )
+    {
+        stream_broker_subscription_t const& subscription = client->subscriptions[ stream ];
+        if( subscription.subscribed && client->region->rings[ stream ].written.load( std::memory_order_acquire ) !=
+            subscription.next ) return true;
+    }
+    return false;
+}
+
+tobii_error_t stream_broker_client_wait_for_callbacks( stream_broker_client_t* client, int64_t timeout_us )
+{
+    stream_broker_region_t* region = client->region;
+    if( has_pending( client ) ) return TOBII_ERROR_NO_ERROR;
+
+    // Register as a waiter before the final check, see stream_broker_publish for why this cannot miss a wake
+    region->waiters.fetch_add( 1 );
+    uint32_t futex = region->futex.load();
+    if( !has_pending( client ) && region->broker_pid.load() != 0 )
+    {
+        timespec timeout = { (time_t)( timeout_us / 1000000 ), (long)( timeout_us % 1000000 ) * 1000 };
+        syscall( SYS_futex, &region->futex, FUTEX_WAIT, futex, &timeout, NULL, 0 );
+    }
+    region->waiters.fetch_sub( 1 );
+
+    if( has_pending( client ) ) return TOBII_ERROR_NO_ERROR;
+    return broker_alive( region ) ? TOBII_ERROR_TIMED_OUT : TOBII_ERROR_CONNECTION_FAILED;
+}
+
+tobii_error_t stream_broker_client_process_callbacks( stream_broker_client_t* client )
+{
+    stream_broker_region_t* region = client->region;
+    alignas( 16 ) char record[ max_record_size ];
+    for( int stream = 0; stream < STREAM_BROKER_STREAM_COUNT; ++stream )
+    {
+        stream_broker_subscription_t& subscription = client->subscriptions[ stream ];
+        if( !subscription.subscribed ) continue;
+        stream_broker_ring_t const& ring = region->rings[ stream ];
+
+        // Only read up to what was written when starting, so a fast broker can not keep the client here forever
+        uint64_t written = ring.written.load( std::memory_order_acquire );
+        while( subscription.next < written )
+        {
+            if( written - subscription.next > ring.capacity )
+            {
+                client->overruns += written - ring.capacity - subscription.next;
+                subscription.next = written - ring.capacity;
+            }
+
+            uint64_t index = subscription.next;
+            stream_broker_slot_t* slot = stream_broker_slot( region, &ring, index );
+            uint64_t sequence = slot->sequence.load( std::memory_order_acquire );
+            if( sequence == 2 * index + 2 )
+            {
+                memcpy( record, stream_broker_slot_record( slot ), ring.record_size );
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if( slot->sequence.load( std::memory_order_relaxed ) == sequence )
+                {
+                    ++subscription.next;
+                    invoke( (stream_broker_stream_t) stream, subscription, record );
+                    // The callback may have unsubscribed
+                    if( !subscription.subscribed ) break;
+                    continue;
+                }
+            }
+
+            // The broker has lapped the client while it was reading this slot, so catch up with the broker
+            written = ring.written.load( std::memory_order_acquire );
+            if( written - index <= ring.capacity )
+            {
+                // Not lapped after all, so the slot is damaged; skip it rather than retrying forever
+                ++subscription.next;
+                ++client->overruns;
+            }
+        }
+    }
+    // Checking that the broker process is still running takes a system call, so that is left to the wait
+    return region->broker_pid.load() != 0 ? TOBII_ERROR_NO_ERROR : TOBII_ERROR_CONNECTION_FAILED;
+}
+
+uint64_t stream_broker_client_overruns( stream_broker_client_t const* client )
+{
+    return client->overruns;
+}
+
+static tobii_error_t subscribe( stream_broker_client_t* client, stream_broker_stream_t stream,
+    stream_broker_callback_t callback, void* user_data )
+{
+    stream_broker_subscription_t& subscription = client->subscriptions[ stream ];
+    if( subscription.subscribed ) return TOBII_ERROR_ALREADY_SUBSCRIBED;
+    stream_broker_ring_t const& ring = client->region->rings[ stream ];
+    if( !ring.published.load( std::memory_order_acquire ) || ring.record_size > max_record_size )
+        return TOBII_ERROR_NOT_SUPPORTED;
+
+    subscription.callback = callback;
+    subscription.user_data = user_data;
+    subscription.next = ring.written.load( std::memory_order_acquire );
+    subscription.subscribed = true;
+    return TOBII_ERROR_NO_ERROR;
+}
+
+static tobii_error_t unsubscribe( stream_broker_client_t* client, stream_broker_stream_t stream )
+{
+    stream_broker_subscription_t& subscription = client->subscriptions[ stream ];
+    if( !subscription.subscribed ) return TOBII_ERROR_NOT_SUBSCRIBED;
+    subscription.subscribed = false;
+    return TOBII_ERROR_NO_ERROR;
+}
+
+tobii_error_t stream_broker_client_gaze_point_subscribe( stream_broker_client_t* client,
+    tobii_gaze_point_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.gaze_point = callback;
+    return subscribe( client, STREAM_BROKER_GAZE_POINT, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_gaze_point_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_GAZE_POINT );
+}
+
+tobii_error_t stream_broker_client_gaze_origin_subscribe( stream_broker_client_t* client,
+    tobii_gaze_origin_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.gaze_origin = callback;
+    return subscribe( client, STREAM_BROKER_GAZE_ORIGIN, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_gaze_origin_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_GAZE_ORIGIN );
+}
+
+tobii_error_t stream_broker_client_eye_position_normalized_subscribe( stream_broker_client_t* client,
+    tobii_eye_position_normalized_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.eye_position_normalized = callback;
+    return subscribe( client, STREAM_BROKER_EYE_POSITION_NORMALIZED, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_eye_position_normalized_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_EYE_POSITION_NORMALIZED );
+}
+
+tobii_error_t stream_broker_client_user_presence_subscribe( stream_broker_client_t* client,
+    tobii_user_presence_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.user_presence = callback;
+    return subscribe( client, STREAM_BROKER_USER_PRESENCE, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_user_presence_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_USER_PRESENCE );
+}
+
+tobii_error_t stream_broker_client_head_pose_subscribe( stream_broker_client_t* client,
+    tobii_head_pose_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.head_pose = callback;
+    return subscribe( client, STREAM_BROKER_HEAD_POSE, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_head_pose_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_HEAD_POSE );
+}
+
+tobii_error_t stream_broker_client_notifications_subscribe( stream_broker_client_t* client,
+    tobii_notifications_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.notifications = callback;
+    return subscribe( client, STREAM_BROKER_NOTIFICATIONS, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_notifications_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_NOTIFICATIONS );
+}
+
+tobii_error_t stream_broker_client_user_position_guide_subscribe( stream_broker_client_t* client,
+    tobii_user_position_guide_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.user_position_guide = callback;
+    return subscribe( client, STREAM_BROKER_USER_POSITION_GUIDE, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_user_position_guide_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_USER_POSITION_GUIDE );
+}
+
+tobii_error_t stream_broker_client_gaze_data_subscribe( stream_broker_client_t* client,
+    tobii_gaze_data_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.gaze_data = callback;
+    return subscribe( client, STREAM_BROKER_GAZE_DATA, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_gaze_data_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_GAZE_DATA );
+}
+
+tobii_error_t stream_broker_client_wearable_consumer_data_subscribe( stream_broker_client_t* client,
+    tobii_wearable_consumer_data_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.wearable_consumer_data = callback;
+    return subscribe( client, STREAM_BROKER_WEARABLE_CONSUMER_DATA, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_wearable_consumer_data_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_WEARABLE_CONSUMER_DATA );
+}
+
+tobii_error_t stream_broker_client_wearable_advanced_data_subscribe( stream_broker_client_t* client,
+    tobii_wearable_advanced_data_callback_t callback, void* user_data )
+{
+    if( !callback ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_callback_t entry;
+    entry.wearable_advanced_data = callback;
+    return subscribe( client, STREAM_BROKER_WEARABLE_ADVANCED_DATA, entry, user_data );
+}
+
+tobii_error_t stream_broker_client_wearable_advanced_data_unsubscribe( stream_broker_client_t* client )
+{
+    return unsubscribe( client, STREAM_BROKER_WEARABLE_ADVANCED_DATA );
+}
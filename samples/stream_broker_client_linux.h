@@ -0,0 +1,81 @@
+#ifndef sample_stream_broker_client_linux_h
+#define sample_stream_broker_client_linux_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+// Reader side of the stream broker, mirroring the device API: create a client instead of a device, subscribe with the
+// same callback types, and pump with stream_broker_client_wait_for_callbacks and
+// stream_broker_client_process_callbacks. Samples are read from the shared memory rings of the broker without any
+// locking, but not handed out in place: the broker may overwrite a slot at any time, so each sample is copied out
+// first, and the callback is only invoked with the copy once the slot sequence number shows it was not overwritten
+// while being copied. That costs one copy of at most a few hundred bytes per sample, into a buffer on the stack, and
+// the pointer passed to a callback is only valid until it returns.
+//
+// A subscription starts with the next sample published. A reader which falls more than a ring behind the broker skips
+// ahead to the oldest sample still available, and the skipped samples are counted as overruns. All functions of one
+// client must be called from one thread at a time, and, like the device API, not from within its callbacks.
+
+typedef struct stream_broker_client_t stream_broker_client_t;
+
+// Attaches to the broker publishing under *name*, normally STREAM_BROKER_DEFAULT_NAME. Returns
+// TOBII_ERROR_CONNECTION_FAILED if no broker is running.
+tobii_error_t stream_broker_client_create( char const* name, stream_broker_client_t** client );
+
+void stream_broker_client_destroy( stream_broker_client_t* client );
+
+// Sleeps until the broker publishes to any subscribed stream, or *timeout_us* has passed. Returns
+// TOBII_ERROR_TIMED_OUT on timeout, and TOBII_ERROR_CONNECTION_FAILED once the broker has gone away, after which the
+// client must be destroyed and created again.
+tobii_error_t stream_broker_client_wait_for_callbacks( stream_broker_client_t* client, int64_t timeout_us );
+
+// Invokes the callbacks for every sample published since the last call.
+tobii_error_t stream_broker_client_process_callbacks( stream_broker_client_t* client );
+
+// Number of samples skipped because the client fell too far behind.
+uint64_t stream_broker_client_overruns( stream_broker_client_t const* client );
+
+// These return TOBII_ERROR_NOT_SUPPORTED for streams the broker does not publish.
+tobii_error_t stream_broker_client_gaze_point_subscribe( stream_broker_client_t* client,
+    tobii_gaze_point_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_gaze_point_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_gaze_origin_subscribe( stream_broker_client_t* client,
+    tobii_gaze_origin_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_gaze_origin_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_eye_position_normalized_subscribe( stream_broker_client_t* client,
+    tobii_eye_position_normalized_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_eye_position_normalized_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_user_presence_subscribe( stream_broker_client_t* client,
+    tobii_user_presence_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_user_presence_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_head_pose_subscribe( stream_broker_client_t* client,
+    tobii_head_pose_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_head_pose_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_notifications_subscribe( stream_broker_client_t* client,
+    tobii_notifications_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_notifications_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_user_position_guide_subscribe( stream_broker_client_t* client,
+    tobii_user_position_guide_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_user_position_guide_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_gaze_data_subscribe( stream_broker_client_t* client,
+    tobii_gaze_data_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_gaze_data_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_wearable_consumer_data_subscribe( stream_broker_client_t* client,
+    tobii_wearable_consumer_data_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_wearable_consumer_data_unsubscribe( stream_broker_client_t* client );
+
+tobii_error_t stream_broker_client_wearable_advanced_data_subscribe( stream_broker_client_t* client,
+    tobii_wearable_advanced_data_callback_t callback, void* user_data );
+tobii_error_t stream_broker_client_wearable_advanced_data_unsubscribe( stream_broker_client_t* client );
+
+#endif // sample_stream_broker_client_linux_h
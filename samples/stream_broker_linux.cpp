@@ -0,0 +1,261 @@
+#include "stream_broker_linux.h"
+#include "stream_broker_shared_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <new>
+#include <string>
+
+struct stream_broker_t
+{
+    std::string name;
+    int lock_fd; // Holds the lock on the name for as long as the broker runs
+    tobii_device_t* device;
+    stream_broker_region_t* region;
+    size_t size;
+    bool subscribed[ STREAM_BROKER_STREAM_COUNT ];
+};
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_GAZE_POINT, gaze_point );
+}
+
+static void gaze_origin_callback( tobii_gaze_origin_t const* gaze_origin, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_GAZE_ORIGIN, gaze_origin );
+}
+
+static void eye_position_callback( tobii_eye_position_normalized_t const* eye_position, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_EYE_POSITION_NORMALIZED,
+        eye_position );
+}
+
+static void user_presence_callback( tobii_user_presence_status_t status, int64_t timestamp_us, void* user_data )
+{
+    stream_broker_user_presence_t presence = { status, timestamp_us };
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_USER_PRESENCE, &presence );
+}
+
+static void head_pose_callback( tobii_head_pose_t const* head_pose, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_HEAD_POSE, head_pose );
+}
+
+static void notifications_callback( tobii_notification_t const* notification, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_NOTIFICATIONS, notification );
+}
+
+static void user_position_guide_callback( tobii_user_position_guide_t const* data, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_USER_POSITION_GUIDE, data );
+}
+
+static void gaze_data_callback( tobii_gaze_data_t const* gaze_data, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_GAZE_DATA, gaze_data );
+}
+
+static void wearable_consumer_callback( tobii_wearable_consumer_data_t const* data, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_WEARABLE_CONSUMER_DATA, data );
+}
+
+static void wearable_advanced_callback( tobii_wearable_advanced_data_t const* data, void* user_data )
+{
+    stream_broker_publish( static_cast<stream_broker_t*>( user_data ), STREAM_BROKER_WEARABLE_ADVANCED_DATA, data );
+}
+
+static tobii_error_t subscribe( stream_broker_t* broker, stream_broker_stream_t stream )
+{
+    tobii_device_t* device = broker->device;
+    switch( stream )
+    {
+        case STREAM_BROKER_GAZE_POINT: return tobii_gaze_point_subscribe( device, gaze_point_callback, broker );
+        case STREAM_BROKER_GAZE_ORIGIN: return tobii_gaze_origin_subscribe( device, gaze_origin_callback, broker );
+        case STREAM_BROKER_EYE_POSITION_NORMALIZED:
+            return tobii_eye_position_normalized_subscribe( device, eye_position_callback, broker );
+        case STREAM_BROKER_USER_PRESENCE:
+            return tobii_user_presence_subscribe( device, user_presence_callback, broker );
+        case STREAM_BROKER_HEAD_POSE: return tobii_head_pose_subscribe( device, head_pose_callback, broker );
+        case STREAM_BROKER_NOTIFICATIONS:
+            return tobii_notifications_subscribe( device, notifications_callback, broker );
+        case STREAM_BROKER_USER_POSITION_GUIDE:
+            return tobii_user_position_guide_subscribe( device, user_position_guide_callback, broker );
+        case STREAM_BROKER_GAZE_DATA: return tobii_gaze_data_subscribe( device, gaze_data_callback, broker );
+        case STREAM_BROKER_WEARABLE_CONSUMER_DATA:
+            return tobii_wearable_consumer_data_subscribe( device, wearable_consumer_callback, broker );
+        case STREAM_BROKER_WEARABLE_ADVANCED_DATA:
+            return tobii_wearable_advanced_data_subscribe( device, wearable_advanced_callback, broker );
+        default: return TOBII_ERROR_INVALID_PARAMETER;
+    }
+}
+
+static tobii_error_t unsubscribe( stream_broker_t* broker, stream_broker_stream_t stream )
+{
+    tobii_device_t* device = broker->device;
+    switch( stream )
+    {
+        case STREAM_BROKER_GAZE_POINT: return tobii_gaze_point_unsubscribe( device );
+        case STREAM_BROKER_GAZE_ORIGIN: return tobii_gaze_origin_unsubscribe( device );
+        case STREAM_BROKER_EYE_POSITION_NORMALIZED: return tobii_eye_position_normalized_unsubscribe( device );
+        case STREAM_BROKER_USER_PRESENCE: return tobii_user_presence_unsubscribe( device );
+        case STREAM_BROKER_HEAD_POSE: return tobii_head_pose_unsubscribe( device );
+        case STREAM_BROKER_NOTIFICATIONS: return tobii_notifications_unsubscribe( device );
+        case STREAM_BROKER_USER_POSITION_GUIDE: return tobii_user_position_guide_unsubscribe( device );
+        case STREAM_BROKER_GAZE_DATA: return tobii_gaze_data_unsubscribe( device );
+        case STREAM_BROKER_WEARABLE_CONSUMER_DATA: return tobii_wearable_consumer_data_unsubscribe( device );
+        case STREAM_BROKER_WEARABLE_ADVANCED_DATA: return tobii_wearable_advanced_data_unsubscribe( device );
+        default: return TOBII_ERROR_INVALID_PARAMETER;
+    }
+}
+
+// Takes the lock that goes with *name*, a shared memory object of its own which is never removed, so every broker
+// locks the same one. The lock is released when the broker exits, however it exits, so whoever holds it owns the name
+// and may replace a region left behind. Returns -1 if another broker holds it.
+static int lock_name( char const* name )
+{
+    std::string lock_name = std::string( name ) + ".lock";
+    int fd = shm_open( lock_name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0660 );
+    if( fd < 0 ) return -1;
+    if( flock( fd, LOCK_EX | LOCK_NB ) != 0 )
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+tobii_error_t stream_broker_create( char const* name, tobii_device_t* device, uint32_t capacity,
+    stream_broker_t** broker )
+{
+    if( !name || !broker || capacity == 0 || capacity > ( 1u << 20 ) ) return TOBII_ERROR_INVALID_PARAMETER;
+    uint32_t ring_capacity = 1;
+    while( ring_capacity < capacity ) ring_capacity <<= 1;
+
+    // Lay out the rings after the region header, each slot starting on a cache line of its own
+    size_t size = sizeof( stream_broker_region_t );
+    uint64_t slots_offset[ STREAM_BROKER_STREAM_COUNT ];
+    uint32_t slot_size[ STREAM_BROKER_STREAM_COUNT ];
+    for( int stream = 0; stream < STREAM_BROKER_STREAM_COUNT; ++stream )
+    {
+        uint32_t record_size = stream_broker_record_size( (stream_broker_stream_t) stream );
+        slot_size[ stream ] = ( (uint32_t) sizeof( stream_broker_slot_t ) + record_size + 63u ) & ~63u;
+        slots_offset[ stream ] = size;
+        size += (size_t) slot_size[ stream ] * ring_capacity;
+    }
+
+    // A previous broker may have crashed without removing its region, and its readers will notice it is gone. Only
+    // the holder of the lock removes and creates the region, so two brokers starting together can not both do it.
+    int lock_fd = lock_name( name );
+    if( lock_fd < 0 ) return TOBII_ERROR_NOT_AVAILABLE;
+    shm_unlink( name );
+    int fd = shm_open( name, O_CREAT | O_EXCL | O_RDWR, 0660 );
+    if( fd < 0 )
+    {
+        close( lock_fd );
+        return TOBII_ERROR_INTERNAL;
+    }
+    if( ftruncate( fd, (off_t) size ) != 0 )
+    {
+        close( fd );
+        shm_unlink( name );
+        close( lock_fd );
+        return TOBII_ERROR_ALLOCATION_FAILED;
+    }
+    void* memory = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( memory == MAP_FAILED )
+    {
+        shm_unlink( name );
+        close( lock_fd );
+        return TOBII_ERROR_ALLOCATION_FAILED;
+    }
+
+    // The mapping is zero filled, which is a valid initial state for all the atomics
+    auto region = new( memory ) stream_broker_region_t();
+    region->version = stream_broker_version;
+    region->size = size;
+    region->broker_pid.store( (int32_t) getpid() );
+    for( int stream = 0; stream < STREAM_BROKER_STREAM_COUNT; ++stream )
+    {
+        stream_broker_ring_t& ring = region->rings[ stream ];
+        ring.record_size = stream_broker_record_size( (stream_broker_stream_t) stream );
+        ring.slot_size = slot_size[ stream ];
+        ring.capacity = ring_capacity;
+        ring.slots_offset = slots_offset[ stream ];
+    }
+    region->magic.store( stream_broker_magic, std::memory_order_release );
+
+    auto result = new stream_broker_t();
+    result->name = name;
+    result->lock_fd = lock_fd;
+    result->device = device;
+    result->region = region;
+    result->size = size;
+    *broker = result;
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void stream_broker_destroy( stream_broker_t* broker )
+{
+    for( int stream = 0; stream < STREAM_BROKER_STREAM_COUNT; ++stream )
+        if( broker->subscribed[ stream ] ) unsubscribe( broker, (stream_broker_stream_t) stream );
+
+    // Wake sleeping readers, so they notice the broker is gone without waiting for their timeout
+    broker->region->broker_pid.store( 0 );
+    broker->region->futex.fetch_add( 1 );
+    syscall( SYS_futex, &broker->region->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+
+    // The region is removed before the lock is released, so the next broker finds the name free
+    munmap( broker->region, broker->size );
+    shm_unlink( broker->name.c_str() );
+    close( broker->lock_fd );
+    delete broker;
+}
+
+tobii_error_t stream_broker_add_stream( stream_broker_t* broker, stream_broker_stream_t stream )
+{
+    if( (int) stream < 0 || stream >= STREAM_BROKER_STREAM_COUNT ) return TOBII_ERROR_INVALID_PARAMETER;
+    stream_broker_ring_t& ring = broker->region->rings[ stream ];
+    if( ring.published.load( std::memory_order_acquire ) ) return TOBII_ERROR_ALREADY_SUBSCRIBED;
+
+    if( broker->device )
+    {
+        tobii_error_t error = subscribe( broker, stream );
+        if( error != TOBII_ERROR_NO_ERROR ) return error;
+        broker->subscribed[ stream ] = true;
+    }
+    ring.published.store( 1, std::memory_order_release );
+    return TOBII_ERROR_NO_ERROR;
+}
+
+void stream_broker_publish( stream_broker_t* broker, stream_broker_stream_t stream, void const* record )
+{
+    stream_broker_region_t* region = broker->region;
+    stream_broker_ring_t& ring = region->rings[ stream ];
+
+    uint64_t index = ring.written.load( std::memory_order_relaxed );
+    stream_broker_slot_t* slot = stream_broker_slot( region, &ring, index );
+    slot->sequence.store( 2 * index + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    memcpy( stream_broker_slot_record( slot ), record, ring.record_size );
+    slot->sequence.store( 2 * index + 2, std::memory_order_release );
+    ring.written.store( index + 1, std::memory_order_release );
+
+    // The readers check for new samples after registering as waiters, and the broker checks for waiters after
+    // bumping the futex, so with sequentially consistent ordering one of them always sees the other
+    region->futex.fetch_add( 1 );
+    if( region->waiters.load() > 0 )
+        syscall( SYS_futex, &region->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+}
@@ -0,0 +1,64 @@
+#ifndef sample_stream_broker_linux_h
+#define sample_stream_broker_linux_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+// Lets any number of local processes consume the streams of one device, through a single set of subscriptions. The
+// broker owns the device, and publishes every sample it receives into a ring per stream in POSIX shared memory. Slots
+// carry a sequence number which is odd while the slot is written, so readers can detect both torn reads and being
+// lapped without any lock. Readers sleeping in stream_broker_client_wait_for_callbacks are woken through a futex in the
+// shared region, and the wake is skipped when no reader is sleeping.
+//
+// The broker is driven by the usual pump loop: the device callbacks publish straight into shared memory, so nothing
+// else needs to be done on the pump thread. See stream_broker_client_linux.h for the reader side.
+
+#define STREAM_BROKER_DEFAULT_NAME "/tobii_stream_broker"
+
+typedef enum stream_broker_stream_t
+{
+    STREAM_BROKER_GAZE_POINT,
+    STREAM_BROKER_GAZE_ORIGIN,
+    STREAM_BROKER_EYE_POSITION_NORMALIZED,
+    STREAM_BROKER_USER_PRESENCE,
+    STREAM_BROKER_HEAD_POSE,
+    STREAM_BROKER_NOTIFICATIONS,
+    STREAM_BROKER_USER_POSITION_GUIDE,
+    STREAM_BROKER_GAZE_DATA,
+    STREAM_BROKER_WEARABLE_CONSUMER_DATA,
+    STREAM_BROKER_WEARABLE_ADVANCED_DATA,
+    STREAM_BROKER_STREAM_COUNT,
+} stream_broker_stream_t;
+
+typedef struct stream_broker_t stream_broker_t;
+
+// Creates the shared memory region *name*, replacing any region left behind by a broker which did not shut down
+// cleanly. Returns TOBII_ERROR_NOT_AVAILABLE if another broker is running with the same name. Each stream gets a ring
+// of *capacity* samples, rounded up to a power of two; it has to cover the longest a reader can be busy elsewhere, such
+// as 1024 samples for almost a second at 1200 Hz. A NULL *device* creates a broker which is only fed through
+// stream_broker_publish.
+tobii_error_t stream_broker_create( char const* name, tobii_device_t* device, uint32_t capacity,
+    stream_broker_t** broker );
+
+// Unsubscribes all streams and removes the shared memory region. Readers still attached find out the next time they
+// wait for callbacks.
+void stream_broker_destroy( stream_broker_t* broker );
+
+// Subscribes to *stream* on the device and publishes it. Readers can only subscribe to published streams.
+tobii_error_t stream_broker_add_stream( stream_broker_t* broker, stream_broker_stream_t stream );
+
+// Publishes a sample of *stream*, which must point to the record type of the corresponding tobii stream. This is what
+// the subscription callbacks call, and may be used directly to publish recorded or synthetic data. Calls for one
+// stream must be made from one thread at a time.
+void stream_broker_publish( stream_broker_t* broker, stream_broker_stream_t stream, void const* record );
+
+// The user presence stream has no record type of its own, so it is published as this.
+typedef struct stream_broker_user_presence_t
+{
+    tobii_user_presence_status_t status;
+    int64_t timestamp_us;
+} stream_broker_user_presence_t;
+
+#endif // sample_stream_broker_linux_h
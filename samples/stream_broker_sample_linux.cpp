@@ -0,0 +1,277 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "main_loop_linux.h"
+#include "stream_broker_linux.h"
+#include "stream_broker_client_linux.h"
+#include "stream_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+static void idle( void* context )
+{
+    (void) context; // Unused parameter, the callbacks publish everything
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int stream_broker_sample_main( void );
+extern "C" int stream_broker_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    stream_broker_t* broker;
+    error = stream_broker_create( STREAM_BROKER_DEFAULT_NAME, device, 1024, &broker );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to create the stream broker: %s.\n", tobii_error_message( error ) );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    // Publish everything the device supports; a screen based tracker has no wearable streams and vice versa
+    for( int stream = 0; stream < STREAM_BROKER_STREAM_COUNT; ++stream )
+    {
+        error = stream_broker_add_stream( broker, (stream_broker_stream_t) stream );
+        if( error != TOBII_ERROR_NO_ERROR && error != TOBII_ERROR_NOT_SUPPORTED )
+            fprintf( stderr, "Failed to publish stream %d: %s.\n", stream, tobii_error_message( error ) );
+    }
+
+    main_loop( device, idle, NULL );
+
+    stream_broker_destroy( broker );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+static void gaze_point_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    (void) user_data; // Unused parameter
+    if( gaze_point->validity == TOBII_VALIDITY_VALID )
+        printf( "Gaze point: %" PRIu64 " %f, %f\n", gaze_point->timestamp_us, gaze_point->position_xy[ 0 ],
+            gaze_point->position_xy[ 1 ] );
+    else
+        printf( "Gaze point: %" PRIu64 " INVALID\n", gaze_point->timestamp_us );
+}
+
+extern "C" int stream_broker_client_sample_main( void );
+extern "C" int stream_broker_client_sample_main( void )
+{
+    // Works like a device, but any number of these can run next to each other
+    stream_broker_client_t* client;
+    tobii_error_t error = stream_broker_client_create( STREAM_BROKER_DEFAULT_NAME, &client );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to attach to the stream broker, is it running?\n" );
+        return 1;
+    }
+
+    error = stream_broker_client_gaze_point_subscribe( client, gaze_point_callback, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to gaze stream.\n" );
+        stream_broker_client_destroy( client );
+        return 1;
+    }
+
+    for( ;; )
+    {
+        error = stream_broker_client_wait_for_callbacks( client, 100000 );
+        if( error == TOBII_ERROR_NO_ERROR ) error = stream_broker_client_process_callbacks( client );
+        if( error == TOBII_ERROR_CONNECTION_FAILED ) break;
+    }
+    printf( "The stream broker has shut down\n" );
+
+    stream_broker_client_destroy( client );
+    return 0;
+}
+
+
+// Per reader results, in memory shared with the forked reader processes
+struct fan_out_result_t
+{
+    std::atomic<int> ready; // 1 once subscribed, -1 if the reader failed to attach
+    uint64_t received;
+    uint64_t overruns;
+    uint64_t latency_total_us;
+    uint32_t latency_histogram_us[ 1000 ]; // The last bucket collects everything slower
+};
+
+static int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void reader_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    // The broker stamps each sample with the time it was published
+    auto result = static_cast<fan_out_result_t*>( user_data );
+    int64_t latency_us = now_us() - gaze_point->timestamp_us;
+    ++result->received;
+    result->latency_total_us += (uint64_t) latency_us;
+    ++result->latency_histogram_us[ std::min<int64_t>( std::max<int64_t>( latency_us, 0 ), 999 ) ];
+}
+
+static void run_reader( char const* name, fan_out_result_t* result )
+{
+    stream_broker_client_t* client;
+    if( stream_broker_client_create( name, &client ) != TOBII_ERROR_NO_ERROR )
+    {
+        result->ready = -1;
+        return;
+    }
+    if( stream_broker_client_gaze_point_subscribe( client, reader_callback, result ) != TOBII_ERROR_NO_ERROR )
+        result->ready = -1;
+    else
+    {
+        result->ready = 1;
+        for( ;; )
+        {
+            tobii_error_t error = stream_broker_client_wait_for_callbacks( client, 100000 );
+            if( error == TOBII_ERROR_NO_ERROR ) error = stream_broker_client_process_callbacks( client );
+            if( error == TOBII_ERROR_CONNECTION_FAILED ) break;
+        }
+        result->overruns = stream_broker_client_overruns( client );
+    }
+    stream_broker_client_destroy( client );
+}
+
+extern "C" int stream_broker_benchmark_main( void );
+extern "C" int stream_broker_benchmark_main( void )
+{
+    char const* name = "/tobii_stream_broker_benchmark";
+    float const frequency_hz = 1200.0f;
+    int const sample_count = 2400;
+    int const max_readers = 32;
+
+    size_t results_size = sizeof( fan_out_result_t ) * max_readers;
+    void* results_memory = mmap( NULL, results_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if( results_memory == MAP_FAILED ) return 1;
+    auto results = static_cast<fan_out_result_t*>( results_memory );
+
+    printf( "Two seconds of gaze points at %.0f Hz, on %u cores\n", frequency_hz,
+        std::thread::hardware_concurrency() );
+    printf( "readers  delivered  overruns  mean latency  p99 latency  publish cost\n" );
+    for( int readers = 1; readers <= max_readers; readers *= 2 )
+    {
+        memset( results_memory, 0, results_size );
+        stream_broker_t* broker;
+        tobii_error_t error = stream_broker_create( name, NULL, 1024, &broker );
+        if( error != TOBII_ERROR_NO_ERROR )
+        {
+            fprintf( stderr, "Failed to create the stream broker: %s.\n", tobii_error_message( error ) );
+            return 1;
+        }
+        stream_broker_add_stream( broker, STREAM_BROKER_GAZE_POINT );
+
+        pid_t pids[ max_readers ];
+        for( int i = 0; i < readers; ++i )
+        {
+            pids[ i ] = fork();
+            if( pids[ i ] == 0 )
+            {
+                run_reader( name, &results[ i ] );
+                _exit( 0 );
+            }
+        }
+        for( int i = 0; i < readers; ++i )
+            while( results[ i ].ready == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+        // Publish at the stream rate, as the pump thread would
+        std::chrono::nanoseconds publish_total( 0 );
+        auto period = std::chrono::nanoseconds( (int64_t)( 1e9 / frequency_hz ) );
+        auto next = std::chrono::steady_clock::now();
+        for( int i = 0; i < sample_count; ++i )
+        {
+            std::this_thread::sleep_until( next );
+            next += period;
+
+            tobii_gaze_point_t gaze_point;
+            stream_replay_gaze_point( i, frequency_hz, &gaze_point );
+            auto start = std::chrono::steady_clock::now();
+            gaze_point.timestamp_us = now_us();
+            stream_broker_publish( broker, STREAM_BROKER_GAZE_POINT, &gaze_point );
+            publish_total += std::chrono::steady_clock::now() - start;
+        }
+
+        // Let the readers drain the rings before they are told the broker is gone
+        std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+        stream_broker_destroy( broker );
+        for( int i = 0; i < readers; ++i ) waitpid( pids[ i ], NULL, 0 );
+
+        uint64_t received = 0, overruns = 0, latency_total_us = 0;
+        uint64_t histogram[ 1000 ] = {};
+        for( int i = 0; i < readers; ++i )
+        {
+            received += results[ i ].received;
+            overruns += results[ i ].overruns;
+            latency_total_us += results[ i ].latency_total_us;
+            for( int bucket = 0; bucket < 1000; ++bucket )
+                histogram[ bucket ] += results[ i ].latency_histogram_us[ bucket ];
+        }
+        uint64_t p99_count = received - received / 100, seen = 0;
+        int p99_us = 0;
+        while( p99_us < 999 && ( seen += histogram[ p99_us ] ) < p99_count ) ++p99_us;
+
+        printf( "%7d  %8.2f%%  %8" PRIu64 "  %9.1f us  %8d%s us  %9.0f ns\n", readers,
+            100.0 * (double) received / ( (double) sample_count * readers ), overruns,
+            received ? (double) latency_total_us / (double) received : 0.0, p99_us, p99_us == 999 ? "+" : "",
+            (double) publish_total.count() / sample_count );
+    }
+
+    munmap( results_memory, results_size );
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef sample_stream_broker_shared_linux_h
+#define sample_stream_broker_shared_linux_h
+
+#include "stream_broker_linux.h"
+
+#include <stddef.h>
+
+#include <atomic>
+
+// Layout of the shared memory region, used by both the broker and the client library. Bump the version when changing
+// anything here, as clients built against another layout refuse to attach.
+
+static uint32_t const stream_broker_magic = 0x4b425354; // "TSBK"
+static uint32_t const stream_broker_version = 1;
+
+// Each slot is a sequence number followed by the record. For the sample numbered n, counting from zero, the sequence
+// number is 2n + 1 while the broker writes the record, and 2n + 2 once it is complete.
+struct stream_broker_slot_t
+{
+    std::atomic<uint64_t> sequence;
+};
+
+struct alignas( 64 ) stream_broker_ring_t
+{
+    std::atomic<uint32_t> published; // Set with release ordering when the broker has subscribed to the stream
+    uint32_t record_size;
+    uint32_t slot_size; // Multiple of the cache line size
+    uint32_t capacity; // Power of two
+    uint64_t slots_offset; // From the start of the region
+
+    alignas( 64 ) std::atomic<uint64_t> written; // Number of samples completely written, owned by the broker
+};
+
+struct alignas( 64 ) stream_broker_region_t
+{
+    std::atomic<uint32_t> magic; // Written last, when the region is ready
+    uint32_t version;
+    uint64_t size;
+    std::atomic<int32_t> broker_pid; // Cleared when the broker shuts down
+
+    alignas( 64 ) std::atomic<uint32_t> futex; // Incremented for every sample, waited on by readers
+    std::atomic<uint32_t> waiters; // Readers sleeping on the futex
+
+    stream_broker_ring_t rings[ STREAM_BROKER_STREAM_COUNT ];
+};
+
+static inline uint32_t stream_broker_record_size( stream_broker_stream_t stream )
+{
+    switch( stream )
+    {
+        case STREAM_BROKER_GAZE_POINT: return sizeof( tobii_gaze_point_t );
+        case STREAM_BROKER_GAZE_ORIGIN: return sizeof( tobii_gaze_origin_t );
+        case STREAM_BROKER_EYE_POSITION_NORMALIZED: return sizeof( tobii_eye_position_normalized_t );
+        case STREAM_BROKER_USER_PRESENCE: return sizeof( stream_broker_user_presence_t );
+        case STREAM_BROKER_HEAD_POSE: return sizeof( tobii_head_pose_t );
+        case STREAM_BROKER_NOTIFICATIONS: return sizeof( tobii_notification_t );
+        case STREAM_BROKER_USER_POSITION_GUIDE: return sizeof( tobii_user_position_guide_t );
+        case STREAM_BROKER_GAZE_DATA: return sizeof( tobii_gaze_data_t );
+        case STREAM_BROKER_WEARABLE_CONSUMER_DATA: return sizeof( tobii_wearable_consumer_data_t );
+        case STREAM_BROKER_WEARABLE_ADVANCED_DATA: return sizeof( tobii_wearable_advanced_data_t );
+        default: return 0;
+    }
+}
+
+static inline stream_broker_slot_t* stream_broker_slot( stream_broker_region_t* region,
+    stream_broker_ring_t const* ring, uint64_t index )
+{
+    char* slots = reinterpret_cast<char*>( region ) + ring->slots_offset;
+    return reinterpret_cast<stream_broker_slot_t*>( slots + ( index & ( ring->capacity - 1 ) ) * ring->slot_size );
+}
+
+static inline void* stream_broker_slot_record( stream_broker_slot_t* slot )
+{
+    return reinterpret_cast<char*>( slot ) + sizeof( stream_broker_slot_t );
+}
+
+#endif // sample_stream_broker_shared_linux_h
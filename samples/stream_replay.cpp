@@ -0,0 +1,257 @@
+#include "stream_replay.h"
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+#include <math.h>
+
+static int64_t const replay_epoch_us = 1000000000LL; // Arbitrary, like the device clock epoch
+static int64_t const system_clock_offset_us = 12345; // Between the device clock and the system clock
+static double const blink_interval_s = 4.0;
+static double const blink_duration_s = 0.15;
+static double const fixation_duration_s = 0.25;
+
+static uint32_t hash( uint32_t x )
+{
+    // Integer hash, so any sample can be regenerated from its index without keeping generator state
+    x ^= x >> 16; x *= 0x7feb352dU;
+    x ^= x >> 15; x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static float unit_noise( uint32_t seed )
+{
+    return (float)( hash( seed ) & 0xffffff ) / (float)0xffffff;
+}
+
+static double sample_time_s( int64_t index, float frequency_hz )
+{
+    return (double)index / (double)frequency_hz;
+}
+
+static int64_t sample_timestamp_us( int64_t index, float frequency_hz, uint32_t stream )
+{
+    // Nominal sample time plus up to +-40 us of transport jitter
+    double nominal_us = sample_time_s( index, frequency_hz ) * 1000000.0;
+    float jitter_us = ( unit_noise( (uint32_t)index * 31u + stream ) - 0.5f ) * 80.0f;
+    return replay_epoch_us + (int64_t)( nominal_us + jitter_us );
+}
+
+static bool is_blinking( double t )
+{
+    return fmod( t, blink_interval_s ) >= blink_interval_s - blink_duration_s;
+}
+
+static void head_position( double t, float* xyz )
+{
+    xyz[ 0 ] = (float)( 10.0 * sin( 0.3 * t ) );
+    xyz[ 1 ] = (float)( 5.0 * sin( 0.2 * t ) );
+    xyz[ 2 ] = (float)( 600.0 + 20.0 * sin( 0.1 * t ) );
+}
+
+static void gaze_position( double t, float* xy )
+{
+    // Fixations at pseudo random targets, with a little tremor on top
+    uint32_t fixation = (uint32_t)( t / fixation_duration_s );
+    xy[ 0 ] = 0.1f + 0.8f * unit_noise( fixation * 2u ) + 0.002f * (float)sin( 90.0 * t );
+    xy[ 1 ] = 0.1f + 0.8f * unit_noise( fixation * 2u + 1u ) + 0.002f * (float)cos( 70.0 * t );
+}
+
+static float pupil_diameter( double t, uint32_t seed )
+{
+    // Slow pupil dilation with a little measurement noise
+    return 3.5f + 0.5f * (float)sin( 0.5 * t ) + 0.05f * ( unit_noise( seed ) - 0.5f );
+}
+
+void stream_replay_gaze_point( int64_t index, float frequency_hz, tobii_gaze_point_t* gaze_point )
+{
+    double t = sample_time_s( index, frequency_hz );
+    gaze_point->timestamp_us = sample_timestamp_us( index, frequency_hz, 1 );
+    gaze_point->validity = is_blinking( t ) ? TOBII_VALIDITY_INVALID : TOBII_VALIDITY_VALID;
+    gaze_position( t, gaze_point->position_xy );
+}
+
+void stream_replay_gaze_origin( int64_t index, float frequency_hz, tobii_gaze_origin_t* gaze_origin )
+{
+    double t = sample_time_s( index, frequency_hz );
+    gaze_origin->timestamp_us = sample_timestamp_us( index, frequency_hz, 2 );
+
+    tobii_validity_t validity = is_blinking( t ) ? TOBII_VALIDITY_INVALID : TOBII_VALIDITY_VALID;
+    gaze_origin->left_validity = validity;
+    gaze_origin->right_validity = validity;
+
+    float head[ 3 ];
+    head_position( t, head );
+    gaze_origin->left_xyz[ 0 ] = head[ 0 ] - 32.0f;
+    gaze_origin->left_xyz[ 1 ] = head[ 1 ];
+    gaze_origin->left_xyz[ 2 ] = head[ 2 ];
+    gaze_origin->right_xyz[ 0 ] = head[ 0 ] + 32.0f;
+    gaze_origin->right_xyz[ 1 ] = head[ 1 ];
+    gaze_origin->right_xyz[ 2 ] = head[ 2 ];
+}
+
+void stream_replay_head_pose( int64_t index, float frequency_hz, tobii_head_pose_t* head_pose )
+{
+    double t = sample_time_s( index, frequency_hz );
+    head_pose->timestamp_us = sample_timestamp_us( index, frequency_hz, 3 );
+
+    // The head tracker loses the user for half a second every 20 seconds
+    bool lost = fmod( t, 20.0 ) >= 19.5;
+    head_pose->position_validity = lost ? TOBII_VALIDITY_INVALID : TOBII_VALIDITY_VALID;
+    head_position( t, head_pose->position_xyz );
+
+    for( int i = 0; i < 3; ++i )
+    {
+        head_pose->rotation_validity_xyz[ i ] = head_pose->position_validity;
+        head_pose->rotation_xyz[ i ] = (float)( 0.2 * sin( ( 0.15 + 0.05 * i ) * t ) );
+    }
+}
+
+static void gaze_data_eye( double t, float side, uint32_t seed, bool valid, tobii_gaze_data_eye_t* eye )
+{
+    tobii_validity_t validity = valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+    float head[ 3 ];
+    head_position( t, head );
+
+    // The tracker sits 20 mm below a 520 x 290 mm display, and the eyes are 64 mm apart
+    eye->gaze_origin_validity = validity;
+    eye->gaze_origin_from_eye_tracker_mm[ 0 ] = head[ 0 ] + side * 32.0f;
+    eye->gaze_origin_from_eye_tracker_mm[ 1 ] = head[ 1 ] + 165.0f;
+    eye->gaze_origin_from_eye_tracker_mm[ 2 ] = head[ 2 ];
+    eye->gaze_origin_in_track_box_normalized[ 0 ] = 0.5f + eye->gaze_origin_from_eye_tracker_mm[ 0 ] / 400.0f;
+    eye->gaze_origin_in_track_box_normalized[ 1 ] = 0.5f - head[ 1 ] / 300.0f;
+    eye->gaze_origin_in_track_box_normalized[ 2 ] = ( head[ 2 ] - 450.0f ) / 350.0f;
+
+    // Each eye lands slightly off the true target
+    eye->gaze_point_validity = validity;
+    gaze_position( t, eye->gaze_point_on_display_normalized );
+    eye->gaze_point_on_display_normalized[ 0 ] += side * 0.004f;
+    eye->gaze_point_from_eye_tracker_mm[ 0 ] = -260.0f + 520.0f * eye->gaze_point_on_display_normalized[ 0 ];
+    eye->gaze_point_from_eye_tracker_mm[ 1 ] = 310.0f - 290.0f * eye->gaze_point_on_display_normalized[ 1 ];
+    eye->gaze_point_from_eye_tracker_mm[ 2 ] = 0.0f;
+
+    eye->eyeball_center_validity = validity;
+    eye->eyeball_center_from_eye_tracker_mm[ 0 ] = eye->gaze_origin_from_eye_tracker_mm[ 0 ];
+    eye->eyeball_center_from_eye_tracker_mm[ 1 ] = eye->gaze_origin_from_eye_tracker_mm[ 1 ];
+    eye->eyeball_center_from_eye_tracker_mm[ 2 ] = eye->gaze_origin_from_eye_tracker_mm[ 2 ] + 12.0f;
+
+    eye->pupil_validity = validity;
+    eye->pupil_diameter_mm = pupil_diameter( t, seed );
+}
+
+void stream_replay_gaze_data( int64_t index, float frequency_hz, tobii_gaze_data_t* gaze_data )
+{
+    double t = sample_time_s( index, frequency_hz );
+    gaze_data->timestamp_tracker_us = replay_epoch_us + (int64_t)( t * 1000000.0 );
+    gaze_data->timestamp_system_us = sample_timestamp_us( index, frequency_hz, 4 ) + system_clock_offset_us;
+    gaze_data->frame_count = (uint32_t) index;
+    gaze_data->frame_skipped = 0;
+
+    bool valid = !is_blinking( t );
+    gaze_data_eye( t, -1.0f, (uint32_t) index * 2u, valid, &gaze_data->left );
+    gaze_data_eye( t, 1.0f, (uint32_t) index * 2u + 1u, valid, &gaze_data->right );
+}
+
+static void user_position_guide_eye( double t, float side, uint32_t seed, float* xyz )
+{
+    // Leaning sideways and back and forth over the slow head motion, with a little measurement noise per sample
+    float head[ 3 ];
+    head_position( t, head );
+    float lean_x = (float)( 90.0 * sin( 0.14 * t ) );
+    float lean_z = (float)( 120.0 * sin( 0.09 * t ) );
+    xyz[ 0 ] = 0.5f + ( head[ 0 ] + lean_x + side * 32.0f ) / 400.0f + 0.02f * ( unit_noise( seed * 3u ) - 0.5f );
+    xyz[ 1 ] = 0.5f - head[ 1 ] / 300.0f + 0.02f * ( unit_noise( seed * 3u + 1u ) - 0.5f );
+    xyz[ 2 ] = 0.5f + ( head[ 2 ] + lean_z - 600.0f ) / 400.0f + 0.02f * ( unit_noise( seed * 3u + 2u ) - 0.5f );
+}
+
+void stream_replay_user_position_guide( int64_t index, float frequency_hz, tobii_user_position_guide_t* data )
+{
+    double t = sample_time_s( index, frequency_hz );
+    data->timestamp_us = sample_timestamp_us( index, frequency_hz, 6 );
+
+    bool away = fmod( t, 60.0 ) >= 55.0;
+    tobii_validity_t validity = away || is_blinking( t ) ? TOBII_VALIDITY_INVALID : TOBII_VALIDITY_VALID;
+    data->left_position_validity = validity;
+    data->right_position_validity = validity;
+    user_position_guide_eye( t, -1.0f, (uint32_t) index * 2u, data->left_position_normalized_xyz );
+    user_position_guide_eye( t, 1.0f, (uint32_t) index * 2u + 1u, data->right_position_normalized_xyz );
+}
+
+static void wearable_advanced_eye( double t, float side, uint32_t seed, bool valid, float const* target,
+    tobii_wearable_advanced_eye_t* eye )
+{
+    tobii_validity_t validity = valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+
+    // The headset does not move relative to the head, so the eyes stay put apart from a little slippage
+    eye->gaze_origin_validity = validity;
+    eye->gaze_origin_mm_xyz[ 0 ] = side * 32.0f + 0.2f * (float)sin( 0.05 * t );
+    eye->gaze_origin_mm_xyz[ 1 ] = 0.0f;
+    eye->gaze_origin_mm_xyz[ 2 ] = 0.0f;
+
+    float direction[ 3 ];
+    float length_squared = 0.0f;
+    for( int i = 0; i < 3; ++i )
+    {
+        direction[ i ] = target[ i ] - eye->gaze_origin_mm_xyz[ i ];
+        length_squared += direction[ i ] * direction[ i ];
+    }
+    float length = sqrtf( length_squared );
+    eye->gaze_direction_validity = validity;
+    for( int i = 0; i < 3; ++i ) eye->gaze_direction_normalized_xyz[ i ] = direction[ i ] / length;
+
+    eye->pupil_diameter_validity = validity;
+    eye->pupil_diameter_mm = pupil_diameter( t, seed );
+
+    eye->pupil_position_in_sensor_area_validity = validity;
+    eye->pupil_position_in_sensor_area_xy[ 0 ] = 0.5f + 0.3f * eye->gaze_direction_normalized_xyz[ 0 ];
+    eye->pupil_position_in_sensor_area_xy[ 1 ] = 0.5f - 0.3f * eye->gaze_direction_normalized_xyz[ 1 ];
+
+    eye->position_guide_validity = validity;
+    eye->position_guide_xy[ 0 ] = 0.5f + 0.02f * (float)sin( 0.05 * t );
+    eye->position_guide_xy[ 1 ] = 0.5f;
+
+    // The blink signal stays valid through the blink, unlike the other signals
+    eye->blink_validity = TOBII_VALIDITY_VALID;
+    eye->blink = valid ? TOBII_STATE_BOOL_FALSE : TOBII_STATE_BOOL_TRUE;
+}
+
+void stream_replay_wearable_advanced_data( int64_t index, float frequency_hz, tobii_wearable_advanced_data_t* data )
+{
+    double t = sample_time_s( index, frequency_hz );
+    data->timestamp_tracker_us = replay_epoch_us + (int64_t)( t * 1000000.0 );
+    data->timestamp_system_us = sample_timestamp_us( index, frequency_hz, 5 ) + system_clock_offset_us;
+    data->frame_counter = (uint32_t) index;
+    data->led_mode = 0;
+
+    // The gaze target sweeps a plane two meters in front of the user, with the same fixation pattern as on a display.
+    // Headset x points to the user's left, so the left eye is at positive x and a target further right has smaller x.
+    float xy[ 2 ];
+    gaze_position( t, xy );
+    float target[ 3 ] = { ( 0.5f - xy[ 0 ] ) * 2000.0f, ( 0.5f - xy[ 1 ] ) * 1200.0f, 2000.0f };
+
+    bool valid = !is_blinking( t );
+    wearable_advanced_eye( t, 1.0f, (uint32_t) index * 2u, valid, target, &data->left );
+    wearable_advanced_eye( t, -1.0f, (uint32_t) index * 2u + 1u, valid, target, &data->right );
+
+    tobii_validity_t validity = valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+    data->gaze_origin_combined_validity = validity;
+    data->gaze_direction_combined_validity = validity;
+    float length_squared = 0.0f;
+    for( int i = 0; i < 3; ++i )
+    {
+        data->gaze_origin_combined_mm_xyz[ i ] = 0.5f * ( data->left.gaze_origin_mm_xyz[ i ] +
+            data->right.gaze_origin_mm_xyz[ i ] );
+        data->gaze_direction_combined_normalized_xyz[ i ] = target[ i ] - data->gaze_origin_combined_mm_xyz[ i ];
+        length_squared += data->gaze_direction_combined_normalized_xyz[ i ] *
+            data->gaze_direction_combined_normalized_xyz[ i ];
+    }
+    float length = sqrtf( length_squared );
+    for( int i = 0; i < 3; ++i ) data->gaze_direction_combined_normalized_xyz[ i ] /= length;
+
+    data->convergence_distance_validity = validity;
+    data->convergence_distance_mm = length;
+    data->improve_user_position_hmd = TOBII_STATE_BOOL_FALSE;
+    data->increase_eye_relief = TOBII_STATE_BOOL_FALSE;
+}
@@ -0,0 +1,31 @@
+#ifndef sample_stream_replay_h
+#define sample_stream_replay_h
+
+#include <stdint.h>
+
+typedef struct tobii_gaze_point_t tobii_gaze_point_t;
+typedef struct tobii_gaze_origin_t tobii_gaze_origin_t;
+typedef struct tobii_head_pose_t tobii_head_pose_t;
+typedef struct tobii_gaze_data_t tobii_gaze_data_t;
+typedef struct tobii_user_position_guide_t tobii_user_position_guide_t;
+typedef struct tobii_wearable_advanced_data_t tobii_wearable_advanced_data_t;
+
+// Deterministic stand-ins for recorded streams, so the benchmarks in these samples can run without a device.
+// Sample number *index* of a stream running at *frequency_hz* is always generated with the same contents, including
+// timestamp jitter and periodic blinks where the stream carries eye validity.
+
+void stream_replay_gaze_point( int64_t index, float frequency_hz, tobii_gaze_point_t* gaze_point );
+
+void stream_replay_gaze_origin( int64_t index, float frequency_hz, tobii_gaze_origin_t* gaze_origin );
+
+void stream_replay_head_pose( int64_t index, float frequency_hz, tobii_head_pose_t* head_pose );
+
+void stream_replay_gaze_data( int64_t index, float frequency_hz, tobii_gaze_data_t* gaze_data );
+
+// A user leaning in and out of the center of the track box, and leaving it for five seconds every minute.
+void stream_replay_user_position_guide( int64_t index, float frequency_hz, tobii_user_position_guide_t* data );
+
+// A headset user looking around a scene two meters away.
+void stream_replay_wearable_advanced_data( int64_t index, float frequency_hz, tobii_wearable_advanced_data_t* data );
+
+#endif // sample_stream_replay_h
@@ -1,4 +1,5 @@
 #include "timesync_thread.h"
+#include "pump_trace.h"
 #include <tobii/tobii.h>
 
 #include <chrono>
@@ -18,6 +19,7 @@ struct thread_context_t
 static void timesync_thread( void* param )
 {
     thread_context_t* context = static_cast<thread_context_t*>( param );
+    PUMP_TRACE_THREAD_NAME( "timesync" );
 
     for( ;; )
     {
@@ -28,7 +30,11 @@ static void timesync_thread( void* param )
         // Block here, waiting for one of the three events.
         if( !context->exit_event ) // Handle timesync event
         {
-            tobii_error_t error = tobii_update_timesync( context->device );
+            tobii_error_t error;
+            {
+                PUMP_TRACE_SPAN( "tobii_update_timesync" );
+                error = tobii_update_timesync( context->device );
+            }
             std::chrono::milliseconds timesync_update_interval{30 * 1000}; // Time sync every 30 s
             std::chrono::milliseconds timesync_retry_interval{100}; // Retry time sync every 100 ms
             if (error == TOBII_ERROR_NO_ERROR)
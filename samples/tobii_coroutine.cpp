@@ -0,0 +1,124 @@
+#include "tobii_coroutine.h"
+
+#include <tobii/tobii_config.h>
+
+#include <chrono>
+
+namespace tobii_coroutine
+{
+
+pump_t::pump_t( tobii_device_t* device, executor_t executor )
+    : device_( device ), executor_( executor ), running_( true )
+{
+    pump_ = std::thread( &pump_t::pump_thread, this );
+    commands_thread_ = std::thread( &pump_t::command_thread, this );
+}
+
+pump_t::~pump_t()
+{
+    {
+        std::lock_guard<std::mutex> lock( commands_mutex_ );
+        running_ = false;
+    }
+    commands_cv_.notify_all();
+    commands_thread_.join();
+    pump_.join();
+}
+
+void pump_t::pump_thread()
+{
+    // The same loop as main_loop, stopping when the pump is destroyed rather than on a key press
+    bool try_reconnect = false;
+    while( running_ )
+    {
+        tobii_error_t error = TOBII_ERROR_NO_ERROR;
+        if( try_reconnect )
+        {
+            error = tobii_device_reconnect( device_ );
+            if( error != TOBII_ERROR_NO_ERROR )
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1000 ) );
+                continue;
+            }
+            try_reconnect = false;
+        }
+        error = tobii_wait_for_callbacks( 1, &device_ );
+        if( error == TOBII_ERROR_CONNECTION_FAILED )
+        {
+            try_reconnect = true;
+            continue;
+        }
+
+        // Coroutines waiting on streams are resumed from inside the callbacks processed here
+        if( error == TOBII_ERROR_NO_ERROR || error == TOBII_ERROR_TIMED_OUT )
+            error = tobii_device_process_callbacks( device_ );
+
+        if( error == TOBII_ERROR_CONNECTION_FAILED )
+            try_reconnect = true;
+        else if( error != TOBII_ERROR_NO_ERROR && error != TOBII_ERROR_TIMED_OUT )
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) ); // Don't spin on persistent errors
+    }
+}
+
+void pump_t::command_thread()
+{
+    // Commands block for a round trip to the tracker, and must not be called from inside callbacks, so they get a
+    // thread of their own rather than running on the pump thread
+    for( ;; )
+    {
+        command_t* command;
+        {
+            std::unique_lock<std::mutex> lock( commands_mutex_ );
+            commands_cv_.wait( lock, [ & ] { return !commands_.empty() || !running_; } );
+            if( commands_.empty() ) return;
+            command = commands_.front();
+            commands_.erase( commands_.begin() );
+        }
+        command->result_ = command->function_( device_ );
+        executor_.resume( command->handle_ );
+    }
+}
+
+void pump_t::command_t::await_suspend( std::coroutine_handle<> handle )
+{
+    handle_ = handle;
+    // Once queued, the command can run and resume the coroutine, destroying this awaiter, before the push returns
+    pump_t* pump = pump_;
+    {
+        std::lock_guard<std::mutex> lock( pump->commands_mutex_ );
+        pump->commands_.push_back( this );
+    }
+    pump->commands_cv_.notify_one();
+}
+
+pump_t::command_t pump_t::call( std::function<tobii_error_t( tobii_device_t* device )> function )
+{
+    return command_t( this, std::move( function ) );
+}
+
+pump_t::command_t pump_t::update_timesync()
+{
+    return call( []( tobii_device_t* device ) { return tobii_update_timesync( device ); } );
+}
+
+pump_t::command_t pump_t::calibration_start( tobii_enabled_eye_t enabled_eye )
+{
+    return call( [ enabled_eye ]( tobii_device_t* device ) { return tobii_calibration_start( device, enabled_eye ); } );
+}
+
+pump_t::command_t pump_t::calibration_collect_data_2d( float x, float y )
+{
+    return call( [ x, y ]( tobii_device_t* device ) { return tobii_calibration_collect_data_2d( device, x, y ); } );
+}
+
+pump_t::command_t pump_t::calibration_compute_and_apply()
+{
+    return call( []( tobii_device_t* device ) { return tobii_calibration_compute_and_apply( device ); } );
+}
+
+pump_t::command_t pump_t::calibration_stop()
+{
+    return call( []( tobii_device_t* device ) { return tobii_calibration_stop( device ); } );
+}
+
+} // namespace tobii_coroutine
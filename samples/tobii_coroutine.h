@@ -0,0 +1,253 @@
+#ifndef sample_tobii_coroutine_h
+#define sample_tobii_coroutine_h
+
+#include <tobii/tobii.h>
+
+#include "tobii_subscription.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// C++20 awaitables on top of the Stream Engine callbacks, for applications built on coroutines.
+//
+//     tobii_coroutine::stream_t<tobii_subscription::gaze_point> gaze( device );
+//     tobii_gaze_point_t gaze_point = co_await gaze.next();
+//     std::vector<tobii_gaze_point_t> batch = co_await gaze.batch( 120 );
+//     tobii_error_t error = co_await pump.update_timesync();
+//
+// A pump_t runs the loop of tobii_wait_for_callbacks and tobii_device_process_callbacks on its own thread. A
+// coroutine waiting on a stream is resumed from inside the callback that delivers the record it waits for, with no
+// queue or condition variable in between, unless the stream has an executor to resume it on instead. Because it then
+// runs inside a callback, it must not call Stream Engine functions before its next co_await; awaiting the commands on
+// pump_t is always safe, since they run on a separate command thread, as timesync_thread does.
+//
+// Each stream can be awaited by one coroutine at a time. Records that arrive while nobody is waiting are kept, up to
+// the capacity of the stream, after which the oldest are dropped.
+
+namespace tobii_coroutine
+{
+
+// Where resumed coroutines continue. Without a post function they continue on the thread that resumes them: the pump
+// thread for streams, and the command thread for commands.
+struct executor_t
+{
+    void ( *post )( std::coroutine_handle<> handle, void* context );
+    void* context;
+
+    void resume( std::coroutine_handle<> handle ) const
+    {
+        if( post )
+            post( handle, context );
+        else
+            handle.resume();
+    }
+};
+
+// The return type of a coroutine that is started and left to run to completion on its own.
+struct detached_t
+{
+    struct promise_type
+    {
+        detached_t get_return_object() { return detached_t(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// One of the record streams of tobii_subscription.h, such as tobii_subscription::gaze_point or notifications.
+template< typename Stream >
+class stream_t
+{
+public:
+    typedef typename Stream::record_t record_t;
+
+    stream_t( tobii_device_t* device, executor_t executor = executor_t(), size_t capacity = 1024 )
+        : executor_( executor ), queue_( capacity ), head_( 0 ), count_( 0 ), dropped_( 0 ),
+        subscription_( device, handler_t{ this } )
+    {
+    }
+
+    // A coroutine still waiting on the stream is destroyed with it, without being resumed.
+    ~stream_t()
+    {
+        subscription_.unsubscribe();
+        if( waiter_ ) waiter_.destroy();
+    }
+
+    stream_t( stream_t const& ) = delete;
+    stream_t& operator=( stream_t const& ) = delete;
+
+    // The result of subscribing to the stream.
+    tobii_error_t error() const { return subscription_.error(); }
+
+    // The number of records dropped because nobody awaited them in time.
+    uint64_t dropped() const { return dropped_.load( std::memory_order_relaxed ); }
+
+    class next_t;
+    class batch_t;
+
+    // co_await returns the next record.
+    next_t next() { return next_t( this ); }
+
+    // co_await returns the next *count* records.
+    batch_t batch( size_t count ) { return batch_t( this, count ); }
+
+    // What the subscription callback calls. Can also be called directly, for example with recorded data, from one
+    // thread at a time.
+    void deliver( record_t const& record )
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+        if( !waiter_ )
+        {
+            if( count_ == queue_.size() )
+            {
+                head_ = ( head_ + 1 ) % queue_.size();
+                --count_;
+                dropped_.store( dropped_.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+            }
+            queue_[ ( head_ + count_++ ) % queue_.size() ] = record;
+            return;
+        }
+
+        waiter_records_[ waiter_filled_++ ] = record;
+        if( waiter_filled_ < waiter_wanted_ ) return;
+        std::coroutine_handle<> waiter = waiter_;
+        waiter_ = nullptr;
+        lock.unlock();
+        executor_.resume( waiter );
+    }
+
+    class next_t
+    {
+    public:
+        bool await_ready() { return false; }
+        bool await_suspend( std::coroutine_handle<> handle ) { return stream_->wait( handle, &record_, 1 ); }
+        record_t await_resume() { return record_; }
+
+    private:
+        friend class stream_t;
+        explicit next_t( stream_t* stream ) : stream_( stream ) {}
+        stream_t* stream_;
+        record_t record_;
+    };
+
+    class batch_t
+    {
+    public:
+        bool await_ready() { return records_.empty(); }
+        bool await_suspend( std::coroutine_handle<> handle )
+        {
+            return stream_->wait( handle, records_.data(), records_.size() );
+        }
+        std::vector<record_t> await_resume() { return std::move( records_ ); }
+
+    private:
+        friend class stream_t;
+        batch_t( stream_t* stream, size_t count ) : stream_( stream ), records_( count ) {}
+        stream_t* stream_;
+        std::vector<record_t> records_;
+    };
+
+private:
+    struct handler_t
+    {
+        stream_t* stream;
+        void operator()( record_t const& record ) const { stream->deliver( record ); }
+    };
+
+    // Takes queued records first, and suspends only if more are needed. Returns false to continue without suspending.
+    bool wait( std::coroutine_handle<> handle, record_t* records, size_t count )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        size_t filled = 0;
+        for( ; filled < count && count_ > 0; ++filled, --count_, head_ = ( head_ + 1 ) % queue_.size() )
+            records[ filled ] = queue_[ head_ ];
+        if( filled == count ) return false;
+
+        waiter_ = handle;
+        waiter_records_ = records;
+        waiter_filled_ = filled;
+        waiter_wanted_ = count;
+        return true;
+    }
+
+    executor_t executor_;
+    std::mutex mutex_;
+    std::vector<record_t> queue_;
+    size_t head_;
+    size_t count_;
+    std::atomic<uint64_t> dropped_;
+
+    std::coroutine_handle<> waiter_;
+    record_t* waiter_records_;
+    size_t waiter_filled_;
+    size_t waiter_wanted_;
+
+    // Last, so it is unsubscribed before the rest of the stream is destroyed
+    tobii_subscription::subscription_t<Stream, handler_t> subscription_;
+};
+
+// Runs the callback loop of *device* on a pump thread, and Stream Engine commands on a command thread, until
+// destroyed. Create it after the streams, so that it stops before they are unsubscribed.
+class pump_t
+{
+public:
+    explicit pump_t( tobii_device_t* device, executor_t executor = executor_t() );
+    ~pump_t();
+
+    pump_t( pump_t const& ) = delete;
+    pump_t& operator=( pump_t const& ) = delete;
+
+    class command_t
+    {
+    public:
+        bool await_ready() { return false; }
+        void await_suspend( std::coroutine_handle<> handle );
+        tobii_error_t await_resume() { return result_; }
+
+    private:
+        friend class pump_t;
+        command_t( pump_t* pump, std::function<tobii_error_t( tobii_device_t* device )> function )
+            : pump_( pump ), function_( std::move( function ) ), result_( TOBII_ERROR_NO_ERROR ) {}
+        pump_t* pump_;
+        std::function<tobii_error_t( tobii_device_t* device )> function_;
+        tobii_error_t result_;
+        std::coroutine_handle<> handle_;
+    };
+
+    // co_await runs *function* with the device on the command thread, and returns its result.
+    command_t call( std::function<tobii_error_t( tobii_device_t* device )> function );
+
+    command_t update_timesync();
+    command_t calibration_start( tobii_enabled_eye_t enabled_eye );
+    command_t calibration_collect_data_2d( float x, float y );
+    command_t calibration_compute_and_apply();
+    command_t calibration_stop();
+
+private:
+    void pump_thread();
+    void command_thread();
+
+    tobii_device_t* device_;
+    executor_t executor_;
+    std::atomic<bool> running_;
+
+    std::mutex commands_mutex_;
+    std::condition_variable commands_cv_;
+    std::vector<command_t*> commands_;
+
+    std::thread pump_;
+    std::thread commands_thread_;
+};
+
+} // namespace tobii_coroutine
+
+#endif // sample_tobii_coroutine_h
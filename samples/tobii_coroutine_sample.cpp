@@ -0,0 +1,343 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "stream_replay.h"
+#include "tobii_coroutine.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+struct completion_t
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done;
+};
+
+static void complete( completion_t* completion )
+{
+    // Notify under the lock: the waiting thread destroys the completion as soon as it sees done
+    std::lock_guard<std::mutex> lock( completion->mutex );
+    completion->done = true;
+    completion->cv.notify_all();
+}
+
+static tobii_coroutine::detached_t print_notifications(
+    tobii_coroutine::stream_t<tobii_subscription::notifications>* notifications )
+{
+    // Runs until the stream is destroyed while this waits for the next notification
+    for( ;; )
+    {
+        tobii_notification_t notification = co_await notifications->next();
+        printf( "Notification: type %d\n", (int) notification.type );
+    }
+}
+
+static tobii_coroutine::detached_t track_gaze( tobii_coroutine::pump_t* pump,
+    tobii_coroutine::stream_t<tobii_subscription::gaze_point>* gaze, completion_t* completion )
+{
+    tobii_error_t error = co_await pump->update_timesync();
+    if( error != TOBII_ERROR_NO_ERROR ) printf( "Time sync failed: %s\n", tobii_error_message( error ) );
+
+    // Ten batches of gaze points, resumed on the pump thread when each batch is complete
+    for( int i = 0; i < 10; ++i )
+    {
+        std::vector<tobii_gaze_point_t> batch = co_await gaze->batch( 120 );
+        int valid = 0;
+        float sum_xy[ 2 ] = { 0.0f, 0.0f };
+        for( auto const& gaze_point : batch )
+        {
+            if( gaze_point.validity != TOBII_VALIDITY_VALID ) continue;
+            ++valid;
+            sum_xy[ 0 ] += gaze_point.position_xy[ 0 ];
+            sum_xy[ 1 ] += gaze_point.position_xy[ 1 ];
+        }
+        if( valid > 0 )
+            printf( "Batch ending at %" PRId64 ": %d valid, mean gaze %f, %f\n", batch.back().timestamp_us, valid,
+                sum_xy[ 0 ] / valid, sum_xy[ 1 ] / valid );
+        else
+            printf( "Batch ending at %" PRId64 ": no valid gaze\n", batch.back().timestamp_us );
+    }
+
+    // Refresh time sync on the way out, to show a command awaited after stream data
+    co_await pump->update_timesync();
+    complete( completion );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int tobii_coroutine_sample_main( void );
+extern "C" int tobii_coroutine_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    {
+        tobii_coroutine::stream_t<tobii_subscription::gaze_point> gaze( device );
+        tobii_coroutine::stream_t<tobii_subscription::notifications> notifications( device );
+        if( gaze.error() != TOBII_ERROR_NO_ERROR || notifications.error() != TOBII_ERROR_NO_ERROR )
+        {
+            fprintf( stderr, "Failed to subscribe to gaze and notification streams.\n" );
+        }
+        else
+        {
+            // The pump is declared after the streams, so it stops before they unsubscribe
+            tobii_coroutine::pump_t pump( device );
+            completion_t completion;
+            completion.done = false;
+            print_notifications( &notifications );
+            track_gaze( &pump, &gaze, &completion );
+
+            std::unique_lock<std::mutex> lock( completion.mutex );
+            completion.cv.wait( lock, [ & ] { return completion.done; } );
+        }
+    }
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// Stands in for the engine, holding the registered callback for the pump thread of the benchmark to call
+struct replay_engine_t
+{
+    tobii_gaze_point_callback_t callback;
+    void* user_data;
+};
+
+static replay_engine_t replay_engine;
+
+struct replay_gaze_point
+{
+    typedef tobii_gaze_point_t record_t;
+    static tobii_error_t subscribe( tobii_device_t* device, tobii_gaze_point_callback_t callback, void* user_data )
+    {
+        (void) device; // Unused parameter
+        replay_engine.callback = callback;
+        replay_engine.user_data = user_data;
+        return TOBII_ERROR_NO_ERROR;
+    }
+    static tobii_error_t unsubscribe( tobii_device_t* device )
+    {
+        (void) device; // Unused parameter
+        replay_engine.callback = nullptr;
+        return TOBII_ERROR_NO_ERROR;
+    }
+    template< typename Handler >
+    static constexpr tobii_gaze_point_callback_t callback()
+    {
+        return tobii_subscription::gaze_point::callback<Handler>();
+    }
+};
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// When the pump thread started delivering the current sample
+static std::atomic<int64_t> sent_ns;
+
+// Delivers *count* samples a millisecond apart, so the consumer is asleep when each one arrives
+static void pump_samples( int count, void ( *deliver )( tobii_gaze_point_t const* gaze_point, void* context ),
+    void* context )
+{
+    auto next = std::chrono::steady_clock::now();
+    for( int i = 0; i < count; ++i )
+    {
+        next += std::chrono::milliseconds( 1 );
+        std::this_thread::sleep_until( next );
+        tobii_gaze_point_t gaze_point;
+        stream_replay_gaze_point( i, 1000.0f, &gaze_point );
+        sent_ns = now_ns();
+        deliver( &gaze_point, context );
+    }
+}
+
+// The bridge the repo uses for timesync_thread: the pump thread stores a sample and signals a condition variable,
+// and a consumer thread waiting on it wakes up
+struct bridge_t
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<tobii_gaze_point_t> samples;
+};
+
+static void bridge_deliver( tobii_gaze_point_t const* gaze_point, void* context )
+{
+    auto bridge = static_cast<bridge_t*>( context );
+    {
+        std::lock_guard<std::mutex> lock( bridge->mutex );
+        bridge->samples.push_back( *gaze_point );
+    }
+    bridge->cv.notify_one();
+}
+
+static void replay_deliver( tobii_gaze_point_t const* gaze_point, void* context )
+{
+    (void) context; // Unused parameter
+    replay_engine.callback( gaze_point, replay_engine.user_data );
+}
+
+static tobii_coroutine::detached_t measure( tobii_coroutine::stream_t<replay_gaze_point>* stream, int count,
+    std::vector<double>* latencies_us, completion_t* completion )
+{
+    for( int i = 0; i < count; ++i )
+    {
+        co_await stream->next();
+        latencies_us->push_back( ( now_ns() - sent_ns ) / 1000.0 );
+    }
+    complete( completion );
+}
+
+// An executor resuming coroutines on a worker thread of its own
+struct worker_t
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::coroutine_handle<>> handles;
+    bool exit;
+    std::thread thread;
+};
+
+static void worker_post( std::coroutine_handle<> handle, void* context )
+{
+    auto worker = static_cast<worker_t*>( context );
+    {
+        std::lock_guard<std::mutex> lock( worker->mutex );
+        worker->handles.push_back( handle );
+    }
+    worker->cv.notify_one();
+}
+
+static void worker_thread( worker_t* worker )
+{
+    for( ;; )
+    {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock<std::mutex> lock( worker->mutex );
+            worker->cv.wait( lock, [ & ] { return !worker->handles.empty() || worker->exit; } );
+            if( worker->handles.empty() ) return;
+            handle = worker->handles.front();
+            worker->handles.pop_front();
+        }
+        handle.resume();
+    }
+}
+
+static void print_latencies( char const* name, std::vector<double> latencies_us )
+{
+    std::sort( latencies_us.begin(), latencies_us.end() );
+    printf( "    %-44s median %6.2f us, 99%% %7.2f us\n", name, latencies_us[ latencies_us.size() / 2 ],
+        latencies_us[ latencies_us.size() * 99 / 100 ] );
+}
+
+extern "C" int tobii_coroutine_benchmark_main( void );
+extern "C" int tobii_coroutine_benchmark_main( void )
+{
+    int const count = 2000;
+    tobii_device_t* device = nullptr;
+    printf( "Wakeup latency from the pump thread, %d samples 1 ms apart, on %u cores:\n", count,
+        std::thread::hardware_concurrency() );
+
+    std::vector<double> bridge_latencies_us;
+    {
+        bridge_t bridge;
+        std::thread consumer( [ & ]() {
+            for( int i = 0; i < count; ++i )
+            {
+                std::unique_lock<std::mutex> lock( bridge.mutex );
+                bridge.cv.wait( lock, [ & ] { return !bridge.samples.empty(); } );
+                bridge_latencies_us.push_back( ( now_ns() - sent_ns ) / 1000.0 );
+                bridge.samples.pop_front();
+            }
+        } );
+        pump_samples( count, bridge_deliver, &bridge );
+        consumer.join();
+    }
+    print_latencies( "condition variable bridge:", bridge_latencies_us );
+
+    std::vector<double> inline_latencies_us;
+    {
+        tobii_coroutine::stream_t<replay_gaze_point> stream( device );
+        completion_t completion;
+        completion.done = false;
+        measure( &stream, count, &inline_latencies_us, &completion );
+        pump_samples( count, replay_deliver, nullptr );
+    }
+    print_latencies( "co_await next(), resumed on the pump thread:", inline_latencies_us );
+
+    std::vector<double> worker_latencies_us;
+    {
+        worker_t worker;
+        worker.exit = false;
+        worker.thread = std::thread( worker_thread, &worker );
+        {
+            tobii_coroutine::stream_t<replay_gaze_point> stream( device, { worker_post, &worker } );
+            completion_t completion;
+            completion.done = false;
+            measure( &stream, count, &worker_latencies_us, &completion );
+            pump_samples( count, replay_deliver, nullptr );
+            std::unique_lock<std::mutex> lock( completion.mutex );
+            completion.cv.wait( lock, [ & ] { return completion.done; } );
+        }
+        {
+            std::lock_guard<std::mutex> lock( worker.mutex );
+            worker.exit = true;
+        }
+        worker.cv.notify_one();
+        worker.thread.join();
+    }
+    print_latencies( "co_await next(), resumed on a worker thread:", worker_latencies_us );
+
+    return inline_latencies_us.size() == (size_t) count && worker_latencies_us.size() == (size_t) count ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+#ifndef sample_tobii_subscription_h
+#define sample_tobii_subscription_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+#include <type_traits>
+#include <utility>
+
+// C++17 subscriptions that call a handler object directly, rather than through a function pointer and a cast of
+// user_data written by hand for every stream. For each handler type one static callback is generated, which casts
+// user_data back to the handler and calls it, so the compiler can inline the handler body into the callback the
+// engine calls. The handler is stored inside the subscription object, so lambdas with captures and other stateful
+// functors need no heap allocation, and the stream is unsubscribed when the subscription goes out of scope.
+//
+//     auto gaze = tobii_subscription::subscribe<tobii_subscription::gaze_point>( device,
+//         [ &latest ]( tobii_gaze_point_t const& gaze_point ) { latest = gaze_point; } );
+//     if( gaze.error() != TOBII_ERROR_NO_ERROR ) ...
+//
+// The engine still makes one indirect call per sample, as it does for any callback; what goes away is everything the
+// handler would otherwise do behind it. As with plain callbacks, handlers run on the thread that calls
+// tobii_device_process_callbacks, and must not call any other Stream Engine functions.
+
+namespace tobii_subscription
+{
+
+// Streams whose callback takes a pointer to one record. Each stream type lists the record, how to subscribe and
+// unsubscribe, and the callback generated for a handler type.
+#define TOBII_SUBSCRIPTION_STREAM( name, record ) \
+    struct name \
+    { \
+        typedef record record_t; \
+        static tobii_error_t subscribe( tobii_device_t* device, tobii_##name##_callback_t callback, void* user_data ) \
+        { \
+            return tobii_##name##_subscribe( device, callback, user_data ); \
+        } \
+        static tobii_error_t unsubscribe( tobii_device_t* device ) { return tobii_##name##_unsubscribe( device ); } \
+        template< typename Handler > \
+        static constexpr tobii_##name##_callback_t callback() \
+        { \
+            return []( record const* data, void* user_data ) { ( *static_cast<Handler*>( user_data ) )( *data ); }; \
+        } \
+    };
+
+TOBII_SUBSCRIPTION_STREAM( gaze_point, tobii_gaze_point_t )
+TOBII_SUBSCRIPTION_STREAM( gaze_origin, tobii_gaze_origin_t )
+TOBII_SUBSCRIPTION_STREAM( eye_position_normalized, tobii_eye_position_normalized_t )
+TOBII_SUBSCRIPTION_STREAM( head_pose, tobii_head_pose_t )
+TOBII_SUBSCRIPTION_STREAM( notifications, tobii_notification_t )
+TOBII_SUBSCRIPTION_STREAM( user_position_guide, tobii_user_position_guide_t )
+TOBII_SUBSCRIPTION_STREAM( gaze_data, tobii_gaze_data_t )
+TOBII_SUBSCRIPTION_STREAM( wearable_consumer_data, tobii_wearable_consumer_data_t )
+TOBII_SUBSCRIPTION_STREAM( wearable_advanced_data, tobii_wearable_advanced_data_t )
+
+#undef TOBII_SUBSCRIPTION_STREAM
+
+// User presence passes its values directly, so the handler is called with the status and the timestamp.
+struct user_presence
+{
+    static tobii_error_t subscribe( tobii_device_t* device, tobii_user_presence_callback_t callback, void* user_data )
+    {
+        return tobii_user_presence_subscribe( device, callback, user_data );
+    }
+    static tobii_error_t unsubscribe( tobii_device_t* device ) { return tobii_user_presence_unsubscribe( device ); }
+    template< typename Handler >
+    static constexpr tobii_user_presence_callback_t callback()
+    {
+        return []( tobii_user_presence_status_t status, int64_t timestamp_us, void* user_data )
+        {
+            ( *static_cast<Handler*>( user_data ) )( status, timestamp_us );
+        };
+    }
+};
+
+// Owns a subscription to *Stream* and the handler it calls. The engine holds a pointer to the handler, so a
+// subscription can neither be copied nor moved; subscribe() returns it by guaranteed copy elision.
+template< typename Stream, typename Handler >
+class subscription_t
+{
+public:
+    subscription_t( tobii_device_t* device, Handler handler )
+        : device_( device ), handler_( std::move( handler ) )
+    {
+        error_ = Stream::subscribe( device_, Stream::template callback<Handler>(), &handler_ );
+    }
+
+    ~subscription_t() { unsubscribe(); }
+
+    subscription_t( subscription_t const& ) = delete;
+    subscription_t& operator=( subscription_t const& ) = delete;
+
+    // The result of subscribing. Nothing is unsubscribed on destruction if this is an error.
+    tobii_error_t error() const { return error_; }
+
+    // Unsubscribes before the end of the scope, for example to check the result. Does nothing if not subscribed.
+    tobii_error_t unsubscribe()
+    {
+        if( error_ != TOBII_ERROR_NO_ERROR ) return TOBII_ERROR_NO_ERROR;
+        error_ = TOBII_ERROR_NOT_SUBSCRIBED;
+        return Stream::unsubscribe( device_ );
+    }
+
+    // Only safe to use from the thread processing callbacks, or while no callbacks are processed.
+    Handler& handler() { return handler_; }
+
+private:
+    tobii_device_t* device_;
+    Handler handler_;
+    tobii_error_t error_;
+};
+
+template< typename Stream, typename Handler >
+subscription_t<Stream, std::decay_t<Handler>> subscribe( tobii_device_t* device, Handler&& handler )
+{
+    return subscription_t<Stream, std::decay_t<Handler>>( device, std::forward<Handler>( handler ) );
+}
+
+} // namespace tobii_subscription
+
+#endif // sample_tobii_subscription_h
@@ -0,0 +1,246 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_streams.h>
+
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+#include "tobii_subscription.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+
+static void idle( void* context )
+{
+    (void) context; // Unused parameter, the handlers print as samples arrive
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int tobii_subscription_sample_main( void );
+extern "C" int tobii_subscription_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    {
+        // The handlers keep their own state, and both streams are unsubscribed at the end of this scope, before the
+        // device is destroyed
+        int64_t valid_count = 0;
+        auto gaze = tobii_subscription::subscribe<tobii_subscription::gaze_point>( device,
+            [ &valid_count ]( tobii_gaze_point_t const& gaze_point )
+            {
+                if( gaze_point.validity != TOBII_VALIDITY_VALID ) return;
+                if( ++valid_count % 60 == 0 )
+                    printf( "Gaze point: %" PRId64 " %f, %f\n", gaze_point.timestamp_us,
+                        gaze_point.position_xy[ 0 ], gaze_point.position_xy[ 1 ] );
+            } );
+        auto presence = tobii_subscription::subscribe<tobii_subscription::user_presence>( device,
+            []( tobii_user_presence_status_t status, int64_t timestamp_us )
+            {
+                printf( "User presence: %" PRId64 " %s\n", timestamp_us,
+                    status == TOBII_USER_PRESENCE_STATUS_PRESENT ? "present" :
+                    status == TOBII_USER_PRESENCE_STATUS_AWAY ? "away" : "unknown" );
+            } );
+        if( gaze.error() != TOBII_ERROR_NO_ERROR )
+        {
+            fprintf( stderr, "Failed to subscribe to gaze stream.\n" );
+        }
+        else
+        {
+            if( presence.error() != TOBII_ERROR_NO_ERROR )
+                fprintf( stderr, "User presence is not available, continuing with gaze only.\n" );
+
+            main_loop( device, idle, NULL );
+
+            if( gaze.unsubscribe() != TOBII_ERROR_NO_ERROR )
+                fprintf( stderr, "Failed to unsubscribe from gaze stream.\n" );
+        }
+    }
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// Stands in for the engine: holds the registered callback, and calls it once per replayed sample
+struct replay_engine_t
+{
+    tobii_gaze_point_callback_t callback;
+    void* user_data;
+};
+
+static replay_engine_t replay_engine;
+
+// A stream type of its own, shaped like the ones in tobii_subscription.h, so the wrappers register with the replay
+// engine instead of a device
+struct replay_gaze_point
+{
+    static tobii_error_t subscribe( tobii_device_t* device, tobii_gaze_point_callback_t callback, void* user_data )
+    {
+        (void) device; // Unused parameter
+        replay_engine.callback = callback;
+        replay_engine.user_data = user_data;
+        return TOBII_ERROR_NO_ERROR;
+    }
+    static tobii_error_t unsubscribe( tobii_device_t* device )
+    {
+        (void) device; // Unused parameter
+        replay_engine.callback = nullptr;
+        return TOBII_ERROR_NO_ERROR;
+    }
+    template< typename Handler >
+    static constexpr tobii_gaze_point_callback_t callback()
+    {
+        return tobii_subscription::gaze_point::callback<Handler>();
+    }
+};
+
+// Delivering is kept out of line, so the compiler can not see which callback is registered, just as it can not see
+// into the engine
+__attribute__(( noinline )) static void deliver( std::vector<tobii_gaze_point_t> const& gaze_points )
+{
+    for( auto const& gaze_point : gaze_points ) replay_engine.callback( &gaze_point, replay_engine.user_data );
+}
+
+// What every handler computes: the number of valid points and their mean position
+struct accumulator_t
+{
+    int64_t count;
+    double sum_xy[ 2 ];
+
+    void add( tobii_gaze_point_t const& gaze_point )
+    {
+        if( gaze_point.validity != TOBII_VALIDITY_VALID ) return;
+        ++count;
+        sum_xy[ 0 ] += gaze_point.position_xy[ 0 ];
+        sum_xy[ 1 ] += gaze_point.position_xy[ 1 ];
+    }
+};
+
+// The plain C callback every sample uses, casting user_data back to its state
+static void raw_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    ( (accumulator_t*) user_data )->add( *gaze_point );
+}
+
+// A consumer written as a reusable stage behind a function pointer, as when one callback forwards to a stage in
+// another file
+typedef void ( *stage_function_t )( tobii_gaze_point_t const* gaze_point, void* context );
+
+struct forwarding_context_t
+{
+    stage_function_t stage;
+    void* context;
+};
+
+__attribute__(( noinline )) static void accumulate_stage( tobii_gaze_point_t const* gaze_point, void* context )
+{
+    ( (accumulator_t*) context )->add( *gaze_point );
+}
+
+static void forwarding_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    auto forwarding = (forwarding_context_t*) user_data;
+    forwarding->stage( gaze_point, forwarding->context );
+}
+
+static void function_callback( tobii_gaze_point_t const* gaze_point, void* user_data )
+{
+    ( *(std::function<void( tobii_gaze_point_t const& )>*) user_data )( *gaze_point );
+}
+
+static double nanoseconds_per_sample( std::vector<tobii_gaze_point_t> const& gaze_points, int rounds )
+{
+    deliver( gaze_points ); // Warm up
+    auto start = std::chrono::steady_clock::now();
+    for( int i = 0; i < rounds; ++i ) deliver( gaze_points );
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>( elapsed ).count() / ( (double) gaze_points.size() * rounds );
+}
+
+extern "C" int tobii_subscription_benchmark_main( void );
+extern "C" int tobii_subscription_benchmark_main( void )
+{
+    std::vector<tobii_gaze_point_t> gaze_points( 1200 * 60 );
+    for( size_t i = 0; i < gaze_points.size(); ++i )
+        stream_replay_gaze_point( (int64_t) i, 1200.0f, &gaze_points[ i ] );
+    int const rounds = 50;
+    tobii_device_t* device = nullptr;
+
+    accumulator_t raw = {};
+    replay_engine = { raw_callback, &raw };
+    double raw_ns = nanoseconds_per_sample( gaze_points, rounds );
+
+    accumulator_t forwarded = {};
+    forwarding_context_t forwarding = { accumulate_stage, &forwarded };
+    replay_engine = { forwarding_callback, &forwarding };
+    double forwarding_ns = nanoseconds_per_sample( gaze_points, rounds );
+
+    accumulator_t function_accumulator = {};
+    std::function<void( tobii_gaze_point_t const& )> function =
+        [ &function_accumulator ]( tobii_gaze_point_t const& gaze_point ) { function_accumulator.add( gaze_point ); };
+    replay_engine = { function_callback, &function };
+    double function_ns = nanoseconds_per_sample( gaze_points, rounds );
+
+    accumulator_t templated = {};
+    double templated_ns;
+    {
+        auto subscription = tobii_subscription::subscribe<replay_gaze_point>( device,
+            [ &templated ]( tobii_gaze_point_t const& gaze_point ) { templated.add( gaze_point ); } );
+        templated_ns = nanoseconds_per_sample( gaze_points, rounds );
+    }
+    bool unsubscribed = replay_engine.callback == nullptr;
+
+    printf( "Per sample, %zu gaze points %d times:\n", gaze_points.size(), rounds );
+    printf( "    C callback with user_data:          %5.2f ns\n", raw_ns );
+    printf( "    C callback forwarding to a stage:   %5.2f ns\n", forwarding_ns );
+    printf( "    std::function behind a C callback:  %5.2f ns\n", function_ns );
+    printf( "    tobii_subscription::subscribe:      %5.2f ns\n", templated_ns );
+
+    bool same = raw.count == templated.count && raw.sum_xy[ 0 ] == templated.sum_xy[ 0 ] &&
+        raw.count == forwarded.count && raw.count == function_accumulator.count;
+    printf( "Same results: %s, unsubscribed at end of scope: %s\n", same ? "yes" : "no", unsubscribed ? "yes" : "no" );
+    return same && unsubscribed ? 0 : 1;
+}
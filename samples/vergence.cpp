@@ -0,0 +1,525 @@
+#include "vergence.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+struct vergence_t
+{
+    vergence_config_t config;
+
+    // Pushed samples, processed ones first, as structure of arrays. Consumed samples stay at the front until everything
+    // is consumed, or the arrays are full, so consuming a batch moves nothing.
+    int first; // Consumed
+    int count;
+    int processed;
+    std::vector<int64_t> timestamp_us;
+    std::vector<float> left_origin[ 3 ];
+    std::vector<float> left_direction[ 3 ];
+    std::vector<float> right_origin[ 3 ];
+    std::vector<float> right_direction[ 3 ];
+
+    // Results of the processed samples
+    std::vector<float> point[ 3 ];
+    std::vector<float> raw_depth_mm;
+    std::vector<float> raw_diopters;
+    std::vector<float> raw_miss_mm;
+    std::vector<float> raw_confidence;
+    std::vector<float> depth_mm;
+    std::vector<float> diopters;
+    std::vector<float> confidence;
+
+    // Filter state
+    bool has_value;
+    float filtered_diopters;
+    float filtered_confidence;
+    int run_length; // Outliers in a row that agree with each other
+    float run_sum;
+
+    vergence_statistics_t statistics;
+};
+
+void vergence_default_config( vergence_config_t* config )
+{
+    config->angular_noise_deg = 0.5f;
+    config->miss_tolerance_mm = 10.0f;
+    config->min_confidence = 0.2f;
+    config->smoothing = 0.2f;
+    config->outlier_diopters = 0.5f;
+    config->outlier_run = 4;
+    config->max_depth_mm = 10000.0f;
+    config->batch_capacity = 4096;
+}
+
+vergence_t* vergence_create( vergence_config_t const* config )
+{
+    vergence_t* vergence = new vergence_t;
+    vergence->config = *config;
+    if( vergence->config.batch_capacity < 1 ) vergence->config.batch_capacity = 1;
+    if( vergence->config.outlier_run < 1 ) vergence->config.outlier_run = 1;
+    size_t capacity = (size_t) vergence->config.batch_capacity;
+
+    vergence->first = 0;
+    vergence->count = 0;
+    vergence->processed = 0;
+    vergence->timestamp_us.resize( capacity );
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        vergence->left_origin[ axis ].resize( capacity );
+        vergence->left_direction[ axis ].resize( capacity );
+        vergence->right_origin[ axis ].resize( capacity );
+        vergence->right_direction[ axis ].resize( capacity );
+        vergence->point[ axis ].resize( capacity );
+    }
+    vergence->raw_depth_mm.resize( capacity );
+    vergence->raw_diopters.resize( capacity );
+    vergence->raw_miss_mm.resize( capacity );
+    vergence->raw_confidence.resize( capacity );
+    vergence->depth_mm.resize( capacity );
+    vergence->diopters.resize( capacity );
+    vergence->confidence.resize( capacity );
+
+    vergence->has_value = false;
+    vergence->filtered_diopters = 0.0f;
+    vergence->filtered_confidence = 0.0f;
+    vergence->run_length = 0;
+    vergence->run_sum = 0.0f;
+    memset( &vergence->statistics, 0, sizeof( vergence->statistics ) );
+    return vergence;
+}
+
+void vergence_destroy( vergence_t* vergence )
+{
+    delete vergence;
+}
+
+// Makes room at the end of the arrays by moving the unconsumed samples to the front, which only happens once the
+// arrays are full, rather than once per batch
+static void compact( vergence_t* vergence );
+
+// Stores a sample with its directions as given; vergence_compute normalizes them a block at a time
+static inline void store( vergence_t* vergence, int i, int64_t timestamp_us, float const* left_origin_xyz,
+    float const* left_direction_xyz, float const* right_origin_xyz, float const* right_direction_xyz )
+{
+    vergence->timestamp_us[ i ] = timestamp_us;
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        vergence->left_origin[ axis ][ i ] = left_origin_xyz[ axis ];
+        vergence->left_direction[ axis ][ i ] = left_direction_xyz[ axis ];
+        vergence->right_origin[ axis ][ i ] = right_origin_xyz[ axis ];
+        vergence->right_direction[ axis ][ i ] = right_direction_xyz[ axis ];
+    }
+}
+
+// Reserves room for up to *count* samples, returns the index of the first and sets *count* to how many fit
+static inline int reserve( vergence_t* vergence, int* count )
+{
+    vergence->statistics.pushed += (uint64_t) *count;
+    if( vergence->count + *count > vergence->config.batch_capacity && vergence->first > 0 ) compact( vergence );
+    int room = vergence->config.batch_capacity - vergence->count;
+    if( *count > room )
+    {
+        vergence->statistics.dropped += (uint64_t)( *count - room );
+        *count = room;
+    }
+    int i = vergence->count;
+    vergence->count += *count;
+    return i;
+}
+
+void vergence_push( vergence_t* vergence, int64_t timestamp_us, float const* left_origin_xyz,
+    float const* left_direction_xyz, float const* right_origin_xyz, float const* right_direction_xyz )
+{
+    int count = 1;
+    int i = reserve( vergence, &count );
+    if( count ) store( vergence, i, timestamp_us, left_origin_xyz, left_direction_xyz, right_origin_xyz,
+        right_direction_xyz );
+}
+
+void vergence_push_gaze_data( vergence_t* vergence, tobii_gaze_data_t const* gaze_data, int count )
+{
+    int first = reserve( vergence, &count );
+    for( int k = 0; k < count; ++k )
+    {
+        // The gaze direction of each eye is from its gaze origin to its gaze point on the display
+        float origin[ 2 ][ 3 ];
+        float direction[ 2 ][ 3 ];
+        tobii_gaze_data_eye_t const* eyes[ 2 ] = { &gaze_data[ k ].left, &gaze_data[ k ].right };
+        for( int e = 0; e < 2; ++e )
+        {
+            bool valid = eyes[ e ]->gaze_origin_validity == TOBII_VALIDITY_VALID &&
+                eyes[ e ]->gaze_point_validity == TOBII_VALIDITY_VALID;
+            for( int axis = 0; axis < 3; ++axis )
+            {
+                origin[ e ][ axis ] = valid ? eyes[ e ]->gaze_origin_from_eye_tracker_mm[ axis ] : NAN;
+                direction[ e ][ axis ] = valid ? eyes[ e ]->gaze_point_from_eye_tracker_mm[ axis ] -
+                    eyes[ e ]->gaze_origin_from_eye_tracker_mm[ axis ] : NAN;
+            }
+        }
+        store( vergence, first + k, gaze_data[ k ].timestamp_system_us, origin[ 0 ], direction[ 0 ], origin[ 1 ],
+            direction[ 1 ] );
+    }
+}
+
+void vergence_push_wearable_advanced_data( vergence_t* vergence, tobii_wearable_advanced_data_t const* data,
+    int count )
+{
+    int first = reserve( vergence, &count );
+    for( int k = 0; k < count; ++k )
+    {
+        // Copied as they are, without a select per coordinate: one NaN coordinate of an invalid eye carries through
+        // the whole estimate
+        tobii_wearable_advanced_eye_t const& left = data[ k ].left;
+        tobii_wearable_advanced_eye_t const& right = data[ k ].right;
+        int i = first + k;
+        store( vergence, i, data[ k ].timestamp_system_us, left.gaze_origin_mm_xyz,
+            left.gaze_direction_normalized_xyz, right.gaze_origin_mm_xyz, right.gaze_direction_normalized_xyz );
+        if( left.gaze_origin_validity != TOBII_VALIDITY_VALID || left.gaze_direction_validity != TOBII_VALIDITY_VALID )
+            vergence->left_origin[ 0 ][ i ] = NAN;
+        if( right.gaze_origin_validity != TOBII_VALIDITY_VALID ||
+            right.gaze_direction_validity != TOBII_VALIDITY_VALID )
+            vergence->right_origin[ 0 ][ i ] = NAN;
+    }
+}
+
+// Rays are processed in blocks of a fixed number of lanes, copied into local arrays, so the loops over a block have a
+// known length and no aliasing, and compile to SIMD instructions
+static int const lanes = 16;
+static int const short_lanes = 4;
+
+enum block_input_t
+{
+    LEFT_ORIGIN_X, LEFT_ORIGIN_Y, LEFT_ORIGIN_Z,
+    LEFT_DIRECTION_X, LEFT_DIRECTION_Y, LEFT_DIRECTION_Z,
+    RIGHT_ORIGIN_X, RIGHT_ORIGIN_Y, RIGHT_ORIGIN_Z,
+    RIGHT_DIRECTION_X, RIGHT_DIRECTION_Y, RIGHT_DIRECTION_Z,
+    BLOCK_INPUT_COUNT,
+};
+
+enum block_output_t
+{
+    POINT_X, POINT_Y, POINT_Z, DEPTH, DIOPTERS, MISS, CONFIDENCE,
+    BLOCK_OUTPUT_COUNT,
+};
+
+struct block_constants_t
+{
+    float max_depth_mm;
+    float noise_squared;
+    float inverse_tolerance_squared;
+};
+
+// Picks *a* where *mask* is all ones and *b* where it is zero. A plain select lets the compiler move arithmetic needed
+// by only one side into a branch, and floating point arithmetic may trap, so the branch can not be turned back into a
+// select, and the loop does not vectorize. Integer operations do not trap.
+static inline float blend( uint32_t mask, float a, float b )
+{
+    uint32_t bits_a, bits_b;
+    memcpy( &bits_a, &a, sizeof( bits_a ) );
+    memcpy( &bits_b, &b, sizeof( bits_b ) );
+    uint32_t bits = ( bits_a & mask ) | ( bits_b & ~mask );
+    float result;
+    memcpy( &result, &bits, sizeof( result ) );
+    return result;
+}
+
+// One over the square root of a positive *x*. Starts from the usual bit level estimate, within 3.5%, and three Newton
+// steps take it to float precision, so loops using it vectorize where sqrtf, which can set errno, does not.
+static inline float inverse_sqrt( float x )
+{
+    uint32_t bits;
+    memcpy( &bits, &x, sizeof( bits ) );
+    bits = 0x5f3759dfu - ( bits >> 1 );
+    float y;
+    memcpy( &y, &bits, sizeof( y ) );
+    y = y * ( 1.5f - 0.5f * x * y * y );
+    y = y * ( 1.5f - 0.5f * x * y * y );
+    y = y * ( 1.5f - 0.5f * x * y * y );
+    return y;
+}
+
+template<int block_lanes>
+static void compute_block( block_constants_t const& constants,
+    float const ( &in )[ BLOCK_INPUT_COUNT ][ block_lanes ], float ( &out )[ BLOCK_OUTPUT_COUNT ][ block_lanes ] )
+{
+    float const max_depth_mm = constants.max_depth_mm;
+    for( int i = 0; i < block_lanes; ++i )
+    {
+        float lox = in[ LEFT_ORIGIN_X ][ i ], loy = in[ LEFT_ORIGIN_Y ][ i ], loz = in[ LEFT_ORIGIN_Z ][ i ];
+        float ldx = in[ LEFT_DIRECTION_X ][ i ], ldy = in[ LEFT_DIRECTION_Y ][ i ], ldz = in[ LEFT_DIRECTION_Z ][ i ];
+        float rox = in[ RIGHT_ORIGIN_X ][ i ], roy = in[ RIGHT_ORIGIN_Y ][ i ], roz = in[ RIGHT_ORIGIN_Z ][ i ];
+        float rdx = in[ RIGHT_DIRECTION_X ][ i ], rdy = in[ RIGHT_DIRECTION_Y ][ i ];
+        float rdz = in[ RIGHT_DIRECTION_Z ][ i ];
+
+        // Directions of any length, made unit; zero length ones become NaN, as invalid eyes
+        float left_squared = ldx * ldx + ldy * ldy + ldz * ldz, right_squared = rdx * rdx + rdy * rdy + rdz * rdz;
+        float left_inverse = blend( 0u - (uint32_t) ( left_squared > 0.0f ), inverse_sqrt( left_squared ), NAN );
+        float right_inverse = blend( 0u - (uint32_t) ( right_squared > 0.0f ), inverse_sqrt( right_squared ), NAN );
+        ldx *= left_inverse;
+        ldy *= left_inverse;
+        ldz *= left_inverse;
+        rdx *= right_inverse;
+        rdy *= right_inverse;
+        rdz *= right_inverse;
+
+        float wx = lox - rox, wy = loy - roy, wz = loz - roz;
+        float b = ldx * rdx + ldy * rdy + ldz * rdz;
+        float d = ldx * wx + ldy * wy + ldz * wz;
+        float e = rdx * wx + rdy * wy + rdz * wz;
+        float sine_squared = 1.0f - b * b; // Of the angle between the rays
+        sine_squared = sine_squared > 1e-12f ? sine_squared : 1e-12f;
+        float s = ( b * e - d ) / sine_squared; // Along the left ray to its closest point
+        float t = ( e - b * d ) / sine_squared; // Along the right ray
+
+        float lx = lox + s * ldx, ly = loy + s * ldy, lz = loz + s * ldz;
+        float rx = rox + t * rdx, ry = roy + t * rdy, rz = roz + t * rdz;
+        float mx = 0.5f * ( lx + rx ), my = 0.5f * ( ly + ry ), mz = 0.5f * ( lz + rz );
+        float miss_squared = ( lx - rx ) * ( lx - rx ) + ( ly - ry ) * ( ly - ry ) + ( lz - rz ) * ( lz - rz );
+
+        // Mean gaze direction, normalized by Newton steps on the inverse square root of its squared length, which
+        // is 2 + 2b: close to 4 for any vergence an eye can make, so 0.5 is a good first guess and three steps reach
+        // float precision up to 60 degrees. sqrtf can set errno, and does not vectorize.
+        float cx = ldx + rdx, cy = ldy + rdy, cz = ldz + rdz;
+        float length_squared = 2.0f + 2.0f * b;
+        float inverse = 0.5f;
+        inverse = inverse * ( 1.5f - 0.5f * length_squared * inverse * inverse );
+        inverse = inverse * ( 1.5f - 0.5f * length_squared * inverse * inverse );
+        inverse = inverse * ( 1.5f - 0.5f * length_squared * inverse * inverse );
+        cx *= inverse;
+        cy *= inverse;
+        cz *= inverse;
+
+        float ex = 0.5f * ( lox + rox ), ey = 0.5f * ( loy + roy ), ez = 0.5f * ( loz + roz );
+        float depth = ( mx - ex ) * cx + ( my - ey ) * cy + ( mz - ez ) * cz;
+        float vergence = 1000.0f / depth;
+
+        uint32_t in_range = 0u - (uint32_t) ( ( depth > 0.0f ) & ( depth < max_depth_mm ) );
+        out[ POINT_X ][ i ] = blend( in_range, mx, ex + cx * max_depth_mm );
+        out[ POINT_Y ][ i ] = blend( in_range, my, ey + cy * max_depth_mm );
+        out[ POINT_Z ][ i ] = blend( in_range, mz, ez + cz * max_depth_mm );
+        out[ DEPTH ][ i ] = blend( in_range, depth, max_depth_mm );
+        out[ DIOPTERS ][ i ] = vergence;
+        out[ MISS ][ i ] = blend( 0u - (uint32_t) ( miss_squared > 0.0f ), miss_squared * inverse_sqrt( miss_squared ),
+            miss_squared );
+
+        // Relative depth error is the diopter noise over the vergence, giving vergence^2 / ( vergence^2 + noise^2 )
+        float ipd_squared = wx * wx + wy * wy + wz * wz;
+        float converging = blend( 0u - (uint32_t) ( vergence > 0.0f ), vergence, 0.0f ); // Diverging rays get none
+        float vergence_squared = converging * converging * ipd_squared;
+        float depth_confidence = vergence_squared / ( vergence_squared + constants.noise_squared );
+        float miss_confidence = 1.0f / ( 1.0f + miss_squared * constants.inverse_tolerance_squared );
+        float c = depth_confidence * miss_confidence;
+        out[ CONFIDENCE ][ i ] = c > 0.0f ? c : 0.0f; // Also clears NaN from invalid eyes
+    }
+}
+
+// Computes samples *first* to *end* in blocks of *block_lanes*, padding the last one, and returns *end*
+template<int block_lanes>
+static int compute_blocks( block_constants_t const& constants, float const* const ( &inputs )[ BLOCK_INPUT_COUNT ],
+    float* const ( &outputs )[ BLOCK_OUTPUT_COUNT ], int first, int end )
+{
+    alignas( 64 ) float in[ BLOCK_INPUT_COUNT ][ block_lanes ];
+    alignas( 64 ) float out[ BLOCK_OUTPUT_COUNT ][ block_lanes ];
+    for( ; first < end; first += block_lanes )
+    {
+        // Copies of a constant size are inlined, where the library call of a variable one would cost more than the
+        // arithmetic of the block
+        int n = end - first;
+        if( n >= block_lanes )
+            for( int k = 0; k < BLOCK_INPUT_COUNT; ++k ) memcpy( in[ k ], inputs[ k ] + first, sizeof( in[ k ] ) );
+        else
+            for( int k = 0; k < BLOCK_INPUT_COUNT; ++k )
+                for( int i = 0; i < block_lanes; ++i ) in[ k ][ i ] = i < n ? inputs[ k ][ first + i ] : NAN;
+        compute_block( constants, in, out );
+        if( n >= block_lanes )
+            for( int k = 0; k < BLOCK_OUTPUT_COUNT; ++k ) memcpy( outputs[ k ] + first, out[ k ], sizeof( out[ k ] ) );
+        else
+            for( int k = 0; k < BLOCK_OUTPUT_COUNT; ++k )
+                for( int i = 0; i < n; ++i ) outputs[ k ][ first + i ] = out[ k ][ i ];
+    }
+    return end;
+}
+
+void vergence_compute( vergence_config_t const* config, vergence_rays_t const* rays, int count,
+    vergence_estimate_t const* estimate )
+{
+    block_constants_t constants;
+    constants.max_depth_mm = config->max_depth_mm;
+    float const noise_rad = config->angular_noise_deg * 3.14159265f / 180.0f;
+    // Diopter noise of a unit ipd, squared: vergence is the ipd over the depth, so its error is the angular error
+    constants.noise_squared = noise_rad * 1000.0f * noise_rad * 1000.0f;
+    constants.inverse_tolerance_squared = 1.0f / ( config->miss_tolerance_mm * config->miss_tolerance_mm );
+
+    float const* inputs[ BLOCK_INPUT_COUNT ];
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        inputs[ LEFT_ORIGIN_X + axis ] = rays->left_origin[ axis ];
+        inputs[ LEFT_DIRECTION_X + axis ] = rays->left_direction[ axis ];
+        inputs[ RIGHT_ORIGIN_X + axis ] = rays->right_origin[ axis ];
+        inputs[ RIGHT_DIRECTION_X + axis ] = rays->right_direction[ axis ];
+    }
+    float* const outputs[ BLOCK_OUTPUT_COUNT ] = { estimate->point[ 0 ], estimate->point[ 1 ], estimate->point[ 2 ],
+        estimate->depth_mm, estimate->diopters, estimate->miss_mm, estimate->confidence };
+
+    // Full blocks, then the rest in short blocks, so a batch of a few samples does not pay for a full block
+    int first = compute_blocks<lanes>( constants, inputs, outputs, 0, count - count % lanes );
+    compute_blocks<short_lanes>( constants, inputs, outputs, first, count );
+}
+
+static void filter( vergence_t* vergence, int begin, int end )
+{
+    vergence_config_t const& config = vergence->config;
+    float const min_diopters = 1000.0f / config.max_depth_mm;
+    for( int i = begin; i < end; ++i )
+    {
+        float c = vergence->raw_confidence[ i ];
+        float sample = vergence->raw_diopters[ i ];
+        if( !( c >= config.min_confidence ) )
+        {
+            ++vergence->statistics.ignored;
+            vergence->raw_depth_mm[ i ] = NAN;
+            for( int axis = 0; axis < 3; ++axis ) vergence->point[ axis ][ i ] = NAN;
+            vergence->filtered_confidence *= 1.0f - config.smoothing;
+        }
+        else if( !vergence->has_value )
+        {
+            vergence->has_value = true;
+            vergence->filtered_diopters = sample;
+            vergence->filtered_confidence = c;
+        }
+        else if( fabsf( sample - vergence->filtered_diopters ) > config.outlier_diopters )
+        {
+            // Either a glitch, or a look at something at another depth, which the next samples will agree with
+            ++vergence->statistics.outliers;
+            float run_mean = vergence->run_length > 0 ? vergence->run_sum / (float) vergence->run_length : 0.0f;
+            if( vergence->run_length > 0 && fabsf( sample - run_mean ) <= config.outlier_diopters )
+            {
+                ++vergence->run_length;
+                vergence->run_sum += sample;
+            }
+            else
+            {
+                vergence->run_length = 1;
+                vergence->run_sum = sample;
+            }
+            if( vergence->run_length >= config.outlier_run )
+            {
+                ++vergence->statistics.jumps;
+                vergence->filtered_diopters = vergence->run_sum / (float) vergence->run_length;
+                vergence->filtered_confidence = c;
+                vergence->run_length = 0;
+            }
+            else
+            {
+                vergence->filtered_confidence *= 1.0f - config.smoothing;
+            }
+        }
+        else
+        {
+            vergence->run_length = 0;
+            vergence->filtered_diopters += config.smoothing * c * ( sample - vergence->filtered_diopters );
+            vergence->filtered_confidence += config.smoothing * ( c - vergence->filtered_confidence );
+        }
+
+        if( vergence->has_value )
+        {
+            float diopters = vergence->filtered_diopters;
+            vergence->diopters[ i ] = diopters;
+            vergence->depth_mm[ i ] = 1000.0f / ( diopters > min_diopters ? diopters : min_diopters );
+        }
+        else
+        {
+            vergence->diopters[ i ] = NAN;
+            vergence->depth_mm[ i ] = NAN;
+        }
+        vergence->confidence[ i ] = vergence->filtered_confidence;
+    }
+}
+
+void vergence_batch( vergence_t* vergence, vergence_batch_t* batch )
+{
+    int begin = vergence->processed;
+    int end = vergence->count;
+    if( end > begin )
+    {
+        vergence_rays_t rays;
+        vergence_estimate_t estimate;
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            rays.left_origin[ axis ] = vergence->left_origin[ axis ].data() + begin;
+            rays.left_direction[ axis ] = vergence->left_direction[ axis ].data() + begin;
+            rays.right_origin[ axis ] = vergence->right_origin[ axis ].data() + begin;
+            rays.right_direction[ axis ] = vergence->right_direction[ axis ].data() + begin;
+            estimate.point[ axis ] = vergence->point[ axis ].data() + begin;
+        }
+        estimate.depth_mm = vergence->raw_depth_mm.data() + begin;
+        estimate.diopters = vergence->raw_diopters.data() + begin;
+        estimate.miss_mm = vergence->raw_miss_mm.data() + begin;
+        estimate.confidence = vergence->raw_confidence.data() + begin;
+        vergence_compute( &vergence->config, &rays, end - begin, &estimate );
+        filter( vergence, begin, end );
+        vergence->processed = end;
+    }
+
+    int first = vergence->first;
+    batch->count = vergence->processed - first;
+    batch->timestamp_us = vergence->timestamp_us.data() + first;
+    for( int axis = 0; axis < 3; ++axis ) batch->point[ axis ] = vergence->point[ axis ].data() + first;
+    batch->raw_depth_mm = vergence->raw_depth_mm.data() + first;
+    batch->raw_confidence = vergence->raw_confidence.data() + first;
+    batch->depth_mm = vergence->depth_mm.data() + first;
+    batch->diopters = vergence->diopters.data() + first;
+    batch->confidence = vergence->confidence.data() + first;
+}
+
+template<typename T>
+static void compact_array( std::vector<T>& array, int first, int remaining )
+{
+    memmove( array.data(), array.data() + first, remaining * sizeof( T ) );
+}
+
+static void compact( vergence_t* vergence )
+{
+    int first = vergence->first;
+    int remaining = vergence->count - first;
+    compact_array( vergence->timestamp_us, first, remaining );
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        compact_array( vergence->left_origin[ axis ], first, remaining );
+        compact_array( vergence->left_direction[ axis ], first, remaining );
+        compact_array( vergence->right_origin[ axis ], first, remaining );
+        compact_array( vergence->right_direction[ axis ], first, remaining );
+        compact_array( vergence->point[ axis ], first, remaining );
+    }
+    compact_array( vergence->raw_depth_mm, first, remaining );
+    compact_array( vergence->raw_diopters, first, remaining );
+    compact_array( vergence->raw_miss_mm, first, remaining );
+    compact_array( vergence->raw_confidence, first, remaining );
+    compact_array( vergence->depth_mm, first, remaining );
+    compact_array( vergence->diopters, first, remaining );
+    compact_array( vergence->confidence, first, remaining );
+    vergence->first = 0;
+    vergence->count = remaining;
+    vergence->processed -= first;
+}
+
+void vergence_consume( vergence_t* vergence, int count )
+{
+    int available = vergence->processed - vergence->first;
+    if( count > available ) count = available;
+    if( count <= 0 ) return;
+    vergence->first += count;
+    // Batches are normally consumed whole with nothing pending, which empties the arrays without moving anything
+    if( vergence->first == vergence->count )
+    {
+        vergence->first = 0;
+        vergence->count = 0;
+        vergence->processed = 0;
+    }
+}
+
+void vergence_statistics( vergence_t const* vergence, vergence_statistics_t* statistics )
+{
+    *statistics = vergence->statistics;
+}
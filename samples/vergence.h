@@ -0,0 +1,114 @@
+#ifndef sample_vergence_h
+#define sample_vergence_h
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+#include <tobii/tobii_wearable.h>
+
+#include <stdint.h>
+
+// The 3D point the user is looking at, and its depth, from where the gaze rays of the two eyes come closest. Rays are
+// taken from the per-eye gaze origins and directions of the wearable advanced data, or from the gaze origins and gaze
+// points of the gaze data. The closest approach is computed for a whole batch at a time, over one array per
+// coordinate, so the loop compiles to SIMD instructions.
+//
+// Depth is uncertain in proportion to its square: far away, the rays are nearly parallel and a small error in either
+// direction moves the crossing a long way. Depth is therefore filtered as vergence in diopters, one over the depth in
+// meters, where that error stays the same size at any distance and parallel rays are simply 0. Each sample gets a
+// confidence from the depth error expected of the configured angular noise, and from how far the rays miss each other.
+// Samples with too low a confidence are ignored by the filter, and samples far from the filtered vergence are rejected
+// as outliers unless enough of them in a row agree, in which case the filter jumps to the new depth.
+//
+// Processed samples are collected as contiguous arrays, so consumers can take them in batches. Consuming moves
+// nothing; the arrays are compacted only when they fill up with samples left behind by partial consumes. All functions
+// except vergence_compute must be called from one thread at a time, normally the pump thread.
+
+typedef struct vergence_t vergence_t;
+
+typedef struct vergence_config_t
+{
+    float angular_noise_deg; // Expected error of each gaze direction
+    float miss_tolerance_mm; // Distance between the rays at their closest that halves the confidence
+    float min_confidence; // Samples below this are ignored by the filter
+    float smoothing; // Weight of a fully confident sample in the filtered vergence, from 0 to 1
+    float outlier_diopters; // Samples further than this from the filtered vergence are outliers
+    int outlier_run; // Outliers in a row that agree with each other are taken as a new depth
+    float max_depth_mm; // Depths beyond this, including parallel rays, are reported as this
+    int batch_capacity; // Processed samples held until consumed, newer samples are dropped when full
+} vergence_config_t;
+
+// Rays of *count* samples, one array per coordinate. Directions need not be normalized. An invalid eye is NaN, or has
+// a zero direction.
+typedef struct vergence_rays_t
+{
+    float const* left_origin[ 3 ];
+    float const* left_direction[ 3 ];
+    float const* right_origin[ 3 ];
+    float const* right_direction[ 3 ];
+} vergence_rays_t;
+
+// Per sample results of vergence_compute. Samples without a crossing in front of the eyes, or with an invalid eye,
+// get a confidence of 0.
+typedef struct vergence_estimate_t
+{
+    float* point[ 3 ]; // Midpoint of the closest approach, or on the mean gaze ray at max_depth_mm
+    float* depth_mm; // Along the mean gaze direction from between the eyes, up to max_depth_mm
+    float* diopters; // Signed: rays that diverge give a negative vergence
+    float* miss_mm; // Distance between the rays at their closest
+    float* confidence;
+} vergence_estimate_t;
+
+// Arrays of *count* processed samples.
+typedef struct vergence_batch_t
+{
+    int count;
+    int64_t const* timestamp_us;
+    float const* point[ 3 ]; // Of this sample, NaN if it had no valid crossing
+    float const* raw_depth_mm; // Of this sample, NaN if it had no valid crossing
+    float const* raw_confidence;
+    float const* depth_mm; // Filtered, NaN until the first sample the filter accepts
+    float const* diopters; // Filtered
+    float const* confidence; // Of the filtered depth, which decays while samples are ignored or rejected
+} vergence_batch_t;
+
+typedef struct vergence_statistics_t
+{
+    uint64_t pushed;
+    uint64_t ignored; // Below min_confidence, including invalid samples
+    uint64_t outliers;
+    uint64_t jumps; // Runs of outliers taken as a new depth
+    uint64_t dropped;
+} vergence_statistics_t;
+
+// Fills *config* with 0.5 degrees of angular noise, 10 mm of miss tolerance, a minimum confidence of 0.2, smoothing
+// of 0.2, outliers beyond 0.5 diopters with runs of 4 taken as a new depth, and a 10 m maximum depth.
+void vergence_default_config( vergence_config_t* config );
+
+vergence_t* vergence_create( vergence_config_t const* config );
+
+void vergence_destroy( vergence_t* vergence );
+
+// Origins and directions must be in one coordinate system, in mm. Directions need not be normalized. Invalid eyes are
+// NaN. Use the system timestamps of the streams.
+void vergence_push( vergence_t* vergence, int64_t timestamp_us, float const* left_origin_xyz,
+    float const* left_direction_xyz, float const* right_origin_xyz, float const* right_direction_xyz );
+
+// Push *count* samples, one from a stream callback or several queued ones.
+void vergence_push_gaze_data( vergence_t* vergence, tobii_gaze_data_t const* gaze_data, int count );
+
+void vergence_push_wearable_advanced_data( vergence_t* vergence, tobii_wearable_advanced_data_t const* data,
+    int count );
+
+// Estimates the closest approach of *count* ray pairs, without filtering. Thread safe.
+void vergence_compute( vergence_config_t const* config, vergence_rays_t const* rays, int count,
+    vergence_estimate_t const* estimate );
+
+// Processes the pushed samples. The batch stays valid until the next call to vergence_consume.
+void vergence_batch( vergence_t* vergence, vergence_batch_t* batch );
+
+// Releases the first *count* samples of the batch.
+void vergence_consume( vergence_t* vergence, int count );
+
+void vergence_statistics( vergence_t const* vergence, vergence_statistics_t* statistics );
+
+#endif // sample_vergence_h
@@ -0,0 +1,313 @@
+#include <tobii/tobii.h>
+#include <tobii/tobii_wearable.h>
+
+#include "vergence.h"
+#include "main_loop_linux.h"
+#include "stream_replay.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+struct vergence_context_t
+{
+    vergence_t* vergence;
+    float tracker_convergence_mm;
+    int64_t last_print_us;
+};
+
+static void wearable_advanced_data_callback( tobii_wearable_advanced_data_t const* data, void* user_data )
+{
+    vergence_context_t* context = (vergence_context_t*) user_data;
+    vergence_push_wearable_advanced_data( context->vergence, data, 1 );
+    context->tracker_convergence_mm = data->convergence_distance_validity == TOBII_VALIDITY_VALID ?
+        data->convergence_distance_mm : NAN;
+}
+
+static void print_depth( void* user_data )
+{
+    // Runs on the pump thread after the callbacks, so the vergence is only ever used from this thread
+    vergence_context_t* context = (vergence_context_t*) user_data;
+    vergence_batch_t batch;
+    vergence_batch( context->vergence, &batch );
+    if( batch.count == 0 ) return;
+    int last = batch.count - 1;
+    if( batch.timestamp_us[ last ] - context->last_print_us >= 500000 )
+    {
+        printf( "Depth %.0f mm (raw %.0f mm, tracker %.0f mm), %.2f D, confidence %.2f\n", batch.depth_mm[ last ],
+            batch.raw_depth_mm[ last ], context->tracker_convergence_mm, batch.diopters[ last ],
+            batch.confidence[ last ] );
+        context->last_print_us = batch.timestamp_us[ last ];
+    }
+    vergence_consume( context->vergence, batch.count );
+}
+
+static void url_receiver( char const* url, void* user_data )
+{
+    // Only keep the first url found
+    char* buffer = (char*) user_data;
+    if( *buffer != '\0' ) return;
+    if( strlen( url ) < 256 ) strcpy( buffer, url );
+}
+
+extern "C" int vergence_sample_main( void );
+extern "C" int vergence_sample_main( void )
+{
+    tobii_api_t* api;
+    tobii_error_t error = tobii_api_create( &api, NULL, NULL );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the Tobii Stream Engine API.\n" );
+        return 1;
+    }
+
+    // Connect to the first eye tracker found
+    char url[ 256 ] = { 0 };
+    error = tobii_enumerate_local_device_urls( api, url_receiver, url );
+    if( error != TOBII_ERROR_NO_ERROR || *url == '\0' )
+    {
+        fprintf( stderr, "No stream engine compatible device(s) found.\n" );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    tobii_device_t* device;
+    error = tobii_device_create( api, url, TOBII_FIELD_OF_USE_INTERACTIVE, &device );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to initialize the device with url %s.\n", url );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    vergence_config_t config;
+    vergence_default_config( &config );
+    vergence_context_t context;
+    context.vergence = vergence_create( &config );
+    context.tracker_convergence_mm = NAN;
+    context.last_print_us = 0;
+
+    error = tobii_wearable_advanced_data_subscribe( device, wearable_advanced_data_callback, &context );
+    if( error != TOBII_ERROR_NO_ERROR )
+    {
+        fprintf( stderr, "Failed to subscribe to wearable advanced data stream.\n" );
+        vergence_destroy( context.vergence );
+        tobii_device_destroy( device );
+        tobii_api_destroy( api );
+        return 1;
+    }
+
+    main_loop( device, print_depth, &context );
+
+    error = tobii_wearable_advanced_data_unsubscribe( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to unsubscribe from wearable advanced data stream.\n" );
+
+    vergence_statistics_t statistics;
+    vergence_statistics( context.vergence, &statistics );
+    printf( "%" PRIu64 " samples, %" PRIu64 " ignored, %" PRIu64 " outliers, %" PRIu64 " depth jumps\n",
+        statistics.pushed, statistics.ignored, statistics.outliers, statistics.jumps );
+    vergence_destroy( context.vergence );
+
+    error = tobii_device_destroy( device );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy device.\n" );
+
+    error = tobii_api_destroy( api );
+    if( error != TOBII_ERROR_NO_ERROR )
+        fprintf( stderr, "Failed to destroy API.\n" );
+
+    return 0;
+}
+
+
+// Deterministic noise for the benchmark, uniform in [0, 1) and normal
+static float uniform( uint32_t* state )
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (float)( *state >> 8 ) / 16777216.0f;
+}
+
+static float normal( uint32_t* state )
+{
+    float u = std::max( uniform( state ), 1e-7f );
+    return sqrtf( -2.0f * logf( u ) ) * cosf( 6.2831853f * uniform( state ) );
+}
+
+static void normalize( float* direction )
+{
+    float length = sqrtf( direction[ 0 ] * direction[ 0 ] + direction[ 1 ] * direction[ 1 ] +
+        direction[ 2 ] * direction[ 2 ] );
+    for( int i = 0; i < 3; ++i ) direction[ i ] /= length;
+}
+
+// Turns a normalized direction by a random error of *sigma_rad* on each axis
+static void perturb( float* direction, float sigma_rad, uint32_t* state )
+{
+    for( int i = 0; i < 3; ++i ) direction[ i ] += sigma_rad * normal( state );
+    normalize( direction );
+}
+
+// Re-aims both eyes of a replayed sample at a point *depth_mm* along its combined gaze direction
+static void aim( tobii_wearable_advanced_data_t* data, float depth_mm, float sigma_rad, float outlier_rad,
+    uint32_t* state )
+{
+    float target[ 3 ];
+    for( int i = 0; i < 3; ++i )
+        target[ i ] = data->gaze_origin_combined_mm_xyz[ i ] +
+            depth_mm * data->gaze_direction_combined_normalized_xyz[ i ];
+    tobii_wearable_advanced_eye_t* eyes[ 2 ] = { &data->left, &data->right };
+    for( int e = 0; e < 2; ++e )
+    {
+        float* direction = eyes[ e ]->gaze_direction_normalized_xyz;
+        for( int i = 0; i < 3; ++i ) direction[ i ] = target[ i ] - eyes[ e ]->gaze_origin_mm_xyz[ i ];
+        normalize( direction );
+        perturb( direction, sigma_rad, state );
+    }
+    if( outlier_rad > 0.0f ) perturb( eyes[ uniform( state ) < 0.5f ? 0 : 1 ]->gaze_direction_normalized_xyz,
+        outlier_rad, state );
+    data->convergence_distance_mm = depth_mm;
+}
+
+static float median( std::vector<float>* values )
+{
+    if( values->empty() ) return NAN;
+    std::nth_element( values->begin(), values->begin() + (ptrdiff_t)( values->size() / 2 ), values->end() );
+    return ( *values )[ values->size() / 2 ];
+}
+
+extern "C" int vergence_benchmark_main( void );
+extern "C" int vergence_benchmark_main( void )
+{
+    // Two and a half hours of replayed headset data at 120 Hz, blinking every 4 seconds. The user refocuses every half
+    // second on a depth between 0.3 and 5 m, with 0.3 degrees of noise per axis on each eye, and one sample in a
+    // hundred has a 3 degree error on one eye.
+    float const frequency_hz = 120.0f;
+    int const count = 1 << 20;
+    int const fixation_samples = 60;
+    float const degree = 3.14159265f / 180.0f;
+    std::vector<tobii_wearable_advanced_data_t> samples( (size_t) count );
+    uint32_t state = 1;
+    float depth_mm = 0.0f;
+    for( int i = 0; i < count; ++i )
+    {
+        if( i % fixation_samples == 0 ) depth_mm = 300.0f * powf( 5000.0f / 300.0f, uniform( &state ) );
+        stream_replay_wearable_advanced_data( i, frequency_hz, &samples[ (size_t) i ] );
+        aim( &samples[ (size_t) i ], depth_mm, 0.3f * degree, uniform( &state ) < 0.01f ? 3.0f * degree : 0.0f,
+            &state );
+    }
+
+    vergence_config_t config;
+    vergence_default_config( &config );
+
+    // The estimator alone, over rays already laid out as arrays
+    std::vector<float> rays_data( (size_t) count * 12 );
+    vergence_rays_t rays;
+    for( int c = 0; c < 12; ++c )
+    {
+        float* column = rays_data.data() + (size_t) count * (size_t) c;
+        for( int i = 0; i < count; ++i )
+        {
+            tobii_wearable_advanced_eye_t const& eye = c < 6 ? samples[ (size_t) i ].left : samples[ (size_t) i ].right;
+            bool valid = eye.gaze_origin_validity == TOBII_VALIDITY_VALID;
+            column[ i ] = !valid ? NAN : c % 6 < 3 ? eye.gaze_origin_mm_xyz[ c % 3 ] :
+                eye.gaze_direction_normalized_xyz[ c % 3 ];
+        }
+        ( c % 6 < 3 ? ( c < 6 ? rays.left_origin : rays.right_origin ) :
+            ( c < 6 ? rays.left_direction : rays.right_direction ) )[ c % 3 ] = column;
+    }
+    std::vector<float> estimate_data( (size_t) count * 7 );
+    vergence_estimate_t estimate;
+    for( int c = 0; c < 3; ++c ) estimate.point[ c ] = estimate_data.data() + (size_t) count * (size_t) c;
+    estimate.depth_mm = estimate_data.data() + (size_t) count * 3;
+    estimate.diopters = estimate_data.data() + (size_t) count * 4;
+    estimate.miss_mm = estimate_data.data() + (size_t) count * 5;
+    estimate.confidence = estimate_data.data() + (size_t) count * 6;
+    int const rounds = 20;
+    auto start = std::chrono::steady_clock::now();
+    for( int round = 0; round < rounds; ++round ) vergence_compute( &config, &rays, count, &estimate );
+    double compute_s = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() / rounds;
+    printf( "vergence_compute: %.1f M samples/s, %.1f ns per sample\n", count / compute_s / 1e6,
+        compute_s * 1e9 / count );
+
+    // Pushed and filtered, with a consumer taking a batch every 4 samples: pushed one at a time, as from the callback,
+    // and 4 at a time, as from a queue of samples
+    int const batch_interval = 4;
+    std::vector<float> filtered( (size_t) count );
+    vergence_t* vergence = NULL;
+    double pipeline_rate[ 2 ];
+    for( int run = 0; run < 2; ++run )
+    {
+        int const push_size = run == 0 ? 1 : batch_interval;
+        if( vergence ) vergence_destroy( vergence );
+        vergence = vergence_create( &config );
+        int consumed = 0;
+        start = std::chrono::steady_clock::now();
+        for( int i = 0; i < count; i += batch_interval )
+        {
+            int n = count - i < batch_interval ? count - i : batch_interval;
+            for( int k = 0; k < n; k += push_size )
+                vergence_push_wearable_advanced_data( vergence, &samples[ (size_t)( i + k ) ], push_size );
+            vergence_batch_t batch;
+            vergence_batch( vergence, &batch );
+            std::copy( batch.depth_mm, batch.depth_mm + batch.count, filtered.begin() + consumed );
+            consumed += batch.count;
+            vergence_consume( vergence, batch.count );
+        }
+        double pipeline_s = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        pipeline_rate[ run ] = count / pipeline_s / 1e6;
+        printf( "Push %d at a time, filter and consume: %.1f M samples/s, %.1f ns per sample, %s the 10 M/s target\n",
+            push_size, pipeline_rate[ run ], pipeline_s * 1e9 / count, pipeline_rate[ run ] >= 10.0 ? "meets" :
+            "misses" );
+    }
+
+    // Errors once the filter has had 100 ms to settle on each new depth, in diopters since that is how vergence
+    // errors behave, and as a fraction of the depth
+    struct band_t { char const* name; float near_mm; float far_mm; std::vector<float> raw[ 2 ], smooth[ 2 ]; };
+    band_t bands[ 3 ];
+    char const* names[ 3 ] = { "0.3-1 m", "1-2.5 m", "2.5-5 m" };
+    float const limits_mm[ 4 ] = { 300.0f, 1000.0f, 2500.0f, 5000.0f };
+    for( int b = 0; b < 3; ++b )
+    {
+        bands[ b ].name = names[ b ];
+        bands[ b ].near_mm = limits_mm[ b ];
+        bands[ b ].far_mm = limits_mm[ b + 1 ];
+    }
+    int const settle_samples = (int)( 0.1f * frequency_hz );
+    for( int i = 0; i < count; ++i )
+    {
+        if( i % fixation_samples < settle_samples ) continue;
+        float truth_mm = samples[ (size_t) i ].convergence_distance_mm;
+        for( band_t& band : bands )
+        {
+            if( truth_mm < band.near_mm || truth_mm >= band.far_mm ) continue;
+            float raw_mm = estimate.confidence[ i ] > 0.0f ? estimate.depth_mm[ i ] : NAN;
+            float const values[ 2 ] = { raw_mm, filtered[ (size_t) i ] };
+            std::vector<float>* errors[ 2 ] = { band.raw, band.smooth };
+            for( int k = 0; k < 2; ++k )
+            {
+                if( isnan( values[ k ] ) ) continue;
+                errors[ k ][ 0 ].push_back( fabsf( 1000.0f / values[ k ] - 1000.0f / truth_mm ) );
+                errors[ k ][ 1 ].push_back( fabsf( values[ k ] - truth_mm ) / truth_mm );
+            }
+        }
+    }
+    printf( "Median error        raw                filtered\n" );
+    for( band_t& band : bands )
+        printf( "%-10s  %.3f D %5.1f%%    %.3f D %5.1f%%\n", band.name, median( &band.raw[ 0 ] ),
+            100.0f * median( &band.raw[ 1 ] ), median( &band.smooth[ 0 ] ), 100.0f * median( &band.smooth[ 1 ] ) );
+
+    vergence_statistics_t statistics;
+    vergence_statistics( vergence, &statistics );
+    printf( "%" PRIu64 " samples, %" PRIu64 " ignored, %" PRIu64 " outliers, %" PRIu64 " depth jumps, %" PRIu64
+        " dropped\n", statistics.pushed, statistics.ignored, statistics.outliers, statistics.jumps,
+        statistics.dropped );
+    vergence_destroy( vergence );
+    return 0;
+}